@@ -1,9 +1,29 @@
 #include "devices/block.h"
+#include <counter.h>
 #include <list.h>
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
 #include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/trace.h"
+
+/* Latency histogram size.  Bucket I counts operations that took
+   from 2**I to just under 2**(I+1) microseconds; the last bucket
+   also absorbs everything slower. */
+#define LAT_BUCKETS 16
+
+/* Latency statistics for one direction of transfer on one
+   device.  Accumulated in the dispatch thread, so no locking is
+   needed. */
+struct io_stats
+  {
+    unsigned long long ops;             /* Operations completed. */
+    int64_t total_ns;                   /* Summed latency. */
+    int64_t max_ns;                     /* Worst single operation. */
+    unsigned long long hist[LAT_BUCKETS]; /* Log-scale latency buckets. */
+  };
 
 /* A block device. */
 struct block
@@ -16,9 +36,32 @@ struct block
 
     const struct block_operations *ops;  /* Driver operations. */
     void *aux;                          /* Extra data owned by driver. */
+    block_sector_t base;                /* Sector of the underlying device
+                                           where this device begins: 0 for
+                                           a whole device, the partition
+                                           start for a region registered
+                                           with block_register_region(). */
+    int channel;                        /* Hardware channel (set by the
+                                           driver), or -1 if unknown.
+                                           Devices on distinct channels
+                                           can transfer in parallel. */
 
-    unsigned long long read_cnt;        /* Number of sectors read. */
-    unsigned long long write_cnt;       /* Number of sectors written. */
+    struct counter read_cnt;            /* Number of sectors read. */
+    struct counter write_cnt;           /* Number of sectors written. */
+
+    struct io_stats read_stats;         /* Per-read-op latencies. */
+    struct io_stats write_stats;        /* Per-write-op latencies. */
+
+    /* Request queue, serviced by a per-device dispatch thread in
+       elevator (C-SCAN) order. */
+    struct lock q_lock;                 /* Protects the members below. */
+    struct condition q_nonempty;        /* Signaled when a request arrives. */
+    struct list q_requests;             /* Pending requests, by sector. */
+    block_sector_t q_pos;               /* Sector the "head" sweeps toward. */
+    size_t q_depth;                     /* Submitted, not yet completed. */
+    size_t q_depth_max;                 /* Deepest the queue has been. */
+    unsigned long long q_depth_sum;     /* Depth summed over submissions. */
+    unsigned long long q_submit_cnt;    /* Number of submissions. */
   };
 
 /* List of all block devices. */
@@ -28,6 +71,7 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static thread_func block_daemon;
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -113,6 +157,219 @@ check_sector (struct block *block, block_sector_t sector)
     }
 }
 
+/* Folds an operation that took NS nanoseconds into S. */
+static void
+record_latency (struct io_stats *s, int64_t ns)
+{
+  int64_t us = ns / 1000;
+  int bucket = 0;
+
+  s->ops++;
+  s->total_ns += ns;
+  if (ns > s->max_ns)
+    s->max_ns = ns;
+  while (us > 1 && bucket < LAT_BUCKETS - 1)
+    {
+      us >>= 1;
+      bucket++;
+    }
+  s->hist[bucket]++;
+}
+
+/* Performs REQUEST's transfer by calling into BLOCK's driver,
+   timing it into the device's latency statistics.  Runs in the
+   dispatch thread. */
+static void
+service_request (struct block *block, struct block_request *req)
+{
+  /* Remap to the underlying device: a single add, since a region
+     registered with block_register_region() shares its parent's
+     driver with a precomputed absolute base. */
+  block_sector_t sector = block->base + req->sector;
+  int64_t start = timer_now_ns ();
+
+  if (!req->is_write)
+    {
+      if (block->ops->read_multiple != NULL)
+        block->ops->read_multiple (block->aux, sector, req->cnt,
+                                   req->buffer);
+      else
+        {
+          uint8_t *b = req->buffer;
+          size_t i;
+
+          for (i = 0; i < req->cnt; i++)
+            block->ops->read (block->aux, sector + i,
+                              b + i * BLOCK_SECTOR_SIZE);
+        }
+      counter_add (&block->read_cnt, req->cnt);
+      record_latency (&block->read_stats, timer_now_ns () - start);
+    }
+  else
+    {
+      if (block->ops->write_multiple != NULL)
+        block->ops->write_multiple (block->aux, sector, req->cnt,
+                                    req->buffer);
+      else
+        {
+          const uint8_t *b = req->buffer;
+          size_t i;
+
+          for (i = 0; i < req->cnt; i++)
+            block->ops->write (block->aux, sector + i,
+                               b + i * BLOCK_SECTOR_SIZE);
+        }
+      counter_add (&block->write_cnt, req->cnt);
+      record_latency (&block->write_stats, timer_now_ns () - start);
+    }
+}
+
+/* Orders pending requests by starting sector. */
+static bool
+request_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request, elem);
+  const struct block_request *b = list_entry (b_, struct block_request, elem);
+
+  return a->sector < b->sector;
+}
+
+/* Dispatch thread for the block device AUX.  Pulls pending
+   requests off the queue in C-SCAN order: the "head" sweeps from
+   low to high sectors, servicing the lowest-numbered pending
+   request at or beyond its position, and jumps back to the
+   lowest pending sector when it passes the last one.  This
+   trades a little latency on individual requests for much less
+   seeking when many are outstanding. */
+static void
+block_daemon (void *aux)
+{
+  struct block *block = aux;
+
+  for (;;)
+    {
+      struct block_request *req;
+      struct list_elem *e;
+
+      lock_acquire (&block->q_lock);
+      while (list_empty (&block->q_requests))
+        cond_wait (&block->q_nonempty, &block->q_lock);
+
+      /* Find the first request at or past the head position,
+         wrapping around to the start of the sweep if the head
+         has passed them all. */
+      req = NULL;
+      for (e = list_begin (&block->q_requests);
+           e != list_end (&block->q_requests); e = list_next (e))
+        {
+          struct block_request *r = list_entry (e, struct block_request, elem);
+          if (r->sector >= block->q_pos)
+            {
+              req = r;
+              break;
+            }
+        }
+      if (req == NULL)
+        req = list_entry (list_begin (&block->q_requests),
+                          struct block_request, elem);
+
+      list_remove (&req->elem);
+      block->q_pos = req->sector + req->cnt;
+      lock_release (&block->q_lock);
+
+      service_request (block, req);
+
+      lock_acquire (&block->q_lock);
+      block->q_depth--;
+      lock_release (&block->q_lock);
+
+      if (req->completion != NULL)
+        req->completion (req);
+      sema_up (&req->done);
+    }
+}
+
+/* Submits REQUEST for asynchronous servicing by BLOCK's dispatch
+   thread and returns immediately.  The caller learns of
+   completion through the request's callback or by calling
+   block_request_wait(). */
+void
+block_submit (struct block *block, struct block_request *req)
+{
+  ASSERT (req->cnt > 0);
+  check_sector (block, req->sector);
+  check_sector (block, req->sector + req->cnt - 1);
+  if (req->is_write)
+    {
+      ASSERT (block->type != BLOCK_FOREIGN);
+    }
+
+  req->block = block;
+  sema_init (&req->done, 0);
+
+  lock_acquire (&block->q_lock);
+  list_insert_ordered (&block->q_requests, &req->elem, request_less, NULL);
+  if (++block->q_depth > block->q_depth_max)
+    block->q_depth_max = block->q_depth;
+  block->q_depth_sum += block->q_depth;
+  block->q_submit_cnt++;
+  cond_signal (&block->q_nonempty, &block->q_lock);
+  lock_release (&block->q_lock);
+}
+
+/* Waits for previously submitted REQUEST to complete. */
+void
+block_request_wait (struct block_request *req)
+{
+  sema_down (&req->done);
+}
+
+/* Crash-point injection for recovery testing: when nonnegative,
+   the number of further sector writes allowed before the kernel
+   panics, simulating a crash in mid-write.  Set with the
+   -bwlimit kernel option; scripting boots over a range of limits
+   exercises recovery at every crash point of a workload. */
+static long long write_limit = -1;
+
+/* Limits the machine to CNT more sector writes; the write that
+   would exceed the budget panics instead of reaching the
+   device. */
+void
+block_set_write_limit (long long cnt)
+{
+  write_limit = cnt;
+}
+
+/* Submits a request for BLOCK and waits for it to complete.
+   Synchronous wrapper used by the block_read()/block_write()
+   family below. */
+static void
+block_do_request (struct block *block, block_sector_t sector, size_t cnt,
+                  void *buffer, bool is_write)
+{
+  struct block_request req;
+
+  if (is_write && write_limit >= 0)
+    {
+      if (write_limit < (long long) cnt)
+        PANIC ("%s: write limit exhausted at sector %"PRDSNu
+               " (simulated crash)", block->name, sector);
+      write_limit -= cnt;
+    }
+
+  TRACE (is_write ? TRACE_BLOCK_WRITE : TRACE_BLOCK_READ, sector);
+
+  req.sector = sector;
+  req.cnt = cnt;
+  req.buffer = buffer;
+  req.is_write = is_write;
+  req.completion = NULL;
+  req.aux = NULL;
+  block_submit (block, &req);
+  block_request_wait (&req);
+}
+
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
    have room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to block devices, so external
@@ -120,9 +377,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  block_do_request (block, sector, 1, buffer, false);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +388,34 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  block_do_request (block, sector, 1, (void *) buffer, true);
+}
+
+/* Reads CNT consecutive sectors starting at SECTOR from BLOCK
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  Uses the driver's multi-sector operation when it has
+   one, which issues one device command for the whole run instead
+   of one per sector. */
+void
+block_read_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                     void *buffer)
+{
+  if (cnt == 0)
+    return;
+  block_do_request (block, sector, cnt, buffer, false);
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to BLOCK
+   from BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving the
+   data. */
+void
+block_write_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                      const void *buffer)
+{
+  if (cnt == 0)
+    return;
+  block_do_request (block, sector, cnt, (void *) buffer, true);
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -160,7 +439,52 @@ block_type (struct block *block)
   return block->type;
 }
 
-/* Prints statistics for each block device used for a Pintos role. */
+/* Returns the hardware channel BLOCK is attached to, or -1 if
+   its driver never said.  Two devices on distinct channels can
+   transfer at the same time, which role assignment exploits to
+   keep swap and scratch off the file system's channel. */
+int
+block_channel (struct block *block)
+{
+  return block->channel;
+}
+
+/* Records that BLOCK is attached to hardware CHANNEL.  Called by
+   the driver after registration. */
+void
+block_set_channel (struct block *block, int channel)
+{
+  block->channel = channel;
+}
+
+/* Prints S, the statistics for one direction of transfer,
+   labeled with VERB.  Quiet if no such operations happened. */
+static void
+print_io_stats (const char *verb, const struct io_stats *s)
+{
+  int i;
+
+  if (s->ops == 0)
+    return;
+  printf ("  %s: %'llu ops, avg %'lld us, max %'lld us, hist(us)",
+          verb, s->ops, s->total_ns / (int64_t) s->ops / 1000,
+          s->max_ns / 1000);
+  for (i = 0; i < LAT_BUCKETS; i++)
+    if (s->hist[i] != 0)
+      {
+        if (i < LAT_BUCKETS - 1)
+          printf (" <%d:%llu", 2 << i, s->hist[i]);
+        else
+          printf (" >=%d:%llu", 1 << i, s->hist[i]);
+      }
+  printf ("\n");
+}
+
+/* Prints statistics for each block device used for a Pintos
+   role: sector counts, per-operation latency distributions, and
+   request queue depth.  The latency histogram tells "many fast
+   I/Os" apart from "few disastrous ones", which the totals
+   alone cannot. */
 void
 block_print_stats (void)
 {
@@ -171,9 +495,17 @@ block_print_stats (void)
       struct block *block = block_by_role[i];
       if (block != NULL)
         {
-          printf ("%s (%s): %llu reads, %llu writes\n",
+          printf ("%s (%s): %llu reads, %llu writes",
                   block->name, block_type_name (block->type),
-                  block->read_cnt, block->write_cnt);
+                  (unsigned long long) counter_read (&block->read_cnt),
+                  (unsigned long long) counter_read (&block->write_cnt));
+          if (block->q_submit_cnt > 0)
+            printf (", queue depth avg %llu max %zu",
+                    block->q_depth_sum / block->q_submit_cnt,
+                    block->q_depth_max);
+          printf ("\n");
+          print_io_stats ("read", &block->read_stats);
+          print_io_stats ("write", &block->write_stats);
         }
     }
 }
@@ -188,7 +520,8 @@ block_register (const char *name, enum block_type type,
                 const char *extra_info, block_sector_t size,
                 const struct block_operations *ops, void *aux)
 {
-  struct block *block = malloc (sizeof *block);
+  char thread_name[20];
+  struct block *block = malloc_long (sizeof *block);
   if (block == NULL)
     PANIC ("Failed to allocate memory for block device descriptor");
 
@@ -198,8 +531,26 @@ block_register (const char *name, enum block_type type,
   block->size = size;
   block->ops = ops;
   block->aux = aux;
-  block->read_cnt = 0;
-  block->write_cnt = 0;
+  block->base = 0;
+  block->channel = -1;
+  memset (&block->read_cnt, 0, sizeof block->read_cnt);
+  memset (&block->write_cnt, 0, sizeof block->write_cnt);
+  memset (&block->read_stats, 0, sizeof block->read_stats);
+  memset (&block->write_stats, 0, sizeof block->write_stats);
+
+  lock_init (&block->q_lock);
+  cond_init (&block->q_nonempty);
+  list_init (&block->q_requests);
+  block->q_pos = 0;
+  block->q_depth = 0;
+  block->q_depth_max = 0;
+  block->q_depth_sum = 0;
+  block->q_submit_cnt = 0;
+
+  snprintf (thread_name, sizeof thread_name, "%s-io", block->name);
+  if (thread_create (thread_name, PRI_DEFAULT, block_daemon, block) == TID_ERROR)
+    PANIC ("Failed to create dispatch thread for block device %s",
+           block->name);
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -211,6 +562,29 @@ block_register (const char *name, enum block_type type,
   return block;
 }
 
+/* Registers a region of PARENT -- a partition, typically -- as a
+   block device of its own with the given NAME and TYPE, START
+   sectors into PARENT and SIZE sectors long.  The region shares
+   PARENT's driver directly, so its I/O costs one precomputed
+   base add over I/O on PARENT itself rather than a second trip
+   through a request queue. */
+struct block *
+block_register_region (struct block *parent, const char *name,
+                       enum block_type type, const char *extra_info,
+                       block_sector_t start, block_sector_t size)
+{
+  struct block *block;
+
+  ASSERT (start + size >= start);
+  ASSERT (start + size <= parent->size);
+
+  block = block_register (name, type, extra_info, size,
+                          parent->ops, parent->aux);
+  block->base = parent->base + start;
+  block->channel = parent->channel;
+  return block;
+}
+
 /* Returns the block device corresponding to LIST_ELEM, or a null
    pointer if LIST_ELEM is the list end of all_blocks. */
 static struct block *
@@ -1,8 +1,11 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -49,12 +52,50 @@ struct block *block_get_by_name (const char *name);
 struct block *block_first (void);
 struct block *block_next (struct block *);
 
+/* An asynchronous block I/O request.
+
+   Fill in the first group of members, then pass the request to
+   block_submit().  Each device's dispatch thread services its
+   pending requests in elevator (C-SCAN) order by sector number,
+   so requests need not complete in submission order.  When a
+   request finishes, its COMPLETION callback (if any) runs in the
+   dispatch thread's context and the DONE semaphore is upped;
+   either may be used to learn of completion.  The request and
+   its buffer must stay valid until then. */
+struct block_request
+  {
+    /* Set by the submitter before block_submit(). */
+    block_sector_t sector;              /* First sector to transfer. */
+    size_t cnt;                         /* Number of sectors. */
+    void *buffer;                       /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    bool is_write;                      /* Read or write? */
+    void (*completion) (struct block_request *);  /* Optional callback. */
+    void *aux;                          /* For the callback's use. */
+
+    /* Managed by the block layer. */
+    struct block *block;                /* Device being accessed. */
+    struct list_elem elem;              /* Element in request queue. */
+    struct semaphore done;              /* Upped on completion. */
+  };
+
+void block_submit (struct block *, struct block_request *);
+void block_request_wait (struct block_request *);
+
 /* Block device operations. */
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, size_t cnt,
+                          void *);
+void block_write_multiple (struct block *, block_sector_t, size_t cnt,
+                           const void *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
+int block_channel (struct block *);
+void block_set_channel (struct block *, int channel);
+
+/* Crash-point injection for recovery testing. */
+void block_set_write_limit (long long cnt);
 
 /* Statistics. */
 void block_print_stats (void);
@@ -65,10 +106,23 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Multi-sector operations.  Either may be a null pointer, in
+       which case the block layer falls back to a loop of
+       single-sector operations. */
+    void (*read_multiple) (void *aux, block_sector_t, size_t cnt,
+                           void *buffer);
+    void (*write_multiple) (void *aux, block_sector_t, size_t cnt,
+                            const void *buffer);
   };
 
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
+struct block *block_register_region (struct block *parent, const char *name,
+                                     enum block_type,
+                                     const char *extra_info,
+                                     block_sector_t start,
+                                     block_sector_t size);
 
 #endif /* devices/block.h */
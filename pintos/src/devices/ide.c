@@ -1,6 +1,7 @@
 #include "devices/ide.h"
 #include <ctype.h>
 #include <debug.h>
+#include <list.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include "devices/block.h"
@@ -8,7 +9,10 @@
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -49,6 +53,44 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* PCI configuration space access, used to locate the IDE
+   controller's bus master DMA registers.  See [PCI 2.2] 3.2.2.3. */
+#define PCI_CONFIG_ADDRESS 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+/* Bus master register offsets from the BAR4 base.  The secondary
+   channel's registers follow the primary's at offset 8. */
+#define reg_bm_cmd(CHANNEL) ((CHANNEL)->bm_base + 0)    /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2) /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)   /* PRD table. */
+
+/* Bus master command register bits. */
+#define BM_CMD_START 0x01       /* Start/stop the DMA engine. */
+#define BM_CMD_READ 0x08        /* Direction: device to memory. */
+
+/* Bus master status register bits.  ERR and INTR are cleared by
+   writing 1 to them. */
+#define BM_STA_ACTIVE 0x01      /* DMA in progress. */
+#define BM_STA_ERR 0x02         /* DMA error. */
+#define BM_STA_INTR 0x04        /* Device raised an interrupt. */
+
+/* A physical region descriptor: one contiguous chunk of a DMA
+   transfer.  A chunk must not cross a 64 kB boundary; the last
+   descriptor in a table has PRD_EOT set. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address of buffer. */
+    uint16_t count;             /* Byte count; 0 means 64 kB. */
+    uint16_t flags;             /* PRD_EOT or 0. */
+  };
+#define PRD_EOT 0x8000
+
+/* One page holds far more descriptors than a maximal transfer
+   (128 sectors = 64 kB = at most 2 chunks) can need. */
+#define PRD_MAX 16
 
 /* An ATA device. */
 struct ata_disk
@@ -59,6 +101,21 @@ struct ata_disk
     bool is_ata;                /* Is device an ATA disk? */
   };
 
+/* One transfer queued on a channel.  Lives on its submitter's
+   stack; the submitter sleeps on DONE until the completion
+   handler finishes the transfer. */
+struct ide_request
+  {
+    struct list_elem elem;      /* Element in channel's request queue. */
+    struct ata_disk *d;         /* Device to transfer to or from. */
+    block_sector_t sec_no;      /* First sector. */
+    size_t cnt;                 /* Number of sectors. */
+    void *buffer;               /* Data buffer. */
+    bool is_write;              /* Transfer direction. */
+    bool error;                 /* Set by the completion handler. */
+    struct semaphore done;      /* Up'd when the transfer completes. */
+  };
+
 /* An ATA channel (aka controller).
    Each channel can control up to two disks. */
 struct channel
@@ -72,6 +129,20 @@ struct channel
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    /* Outstanding-request table for the interrupt-driven DMA
+       path.  The hardware allows one command in flight per
+       channel; CURRENT is that command and REQUESTS the ones
+       behind it, from both devices.  The interrupt handler
+       completes CURRENT and issues the next request on the spot,
+       so the channel never idles between queued commands waiting
+       for a submitter to be scheduled. */
+    struct spinlock queue_lock; /* Protects CURRENT and REQUESTS. */
+    struct ide_request *current;    /* Command in flight, or null. */
+    struct list requests;       /* Queued struct ide_requests. */
+
+    uint16_t bm_base;           /* Bus master register base, 0 if no DMA. */
+    struct prd *prdt;           /* PRD table, one page. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -85,7 +156,7 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -97,12 +168,100 @@ static void select_device_wait (const struct ata_disk *);
 
 static void interrupt_handler (struct intr_frame *);
 
+/* Reads 32-bit configuration register REG of PCI device
+   BUS:DEV.FUNC through the legacy configuration mechanism. */
+static uint32_t
+pci_config_read (int bus, int dev, int func, int reg)
+{
+  outl (PCI_CONFIG_ADDRESS,
+        0x80000000u | (bus << 16) | (dev << 11) | (func << 8) | (reg & 0xfc));
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to 32-bit configuration register REG of PCI
+   device BUS:DEV.FUNC. */
+static void
+pci_config_write (int bus, int dev, int func, int reg, uint32_t value)
+{
+  outl (PCI_CONFIG_ADDRESS,
+        0x80000000u | (bus << 16) | (dev << 11) | (func << 8) | (reg & 0xfc));
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Scans PCI bus 0 for an IDE controller with bus master support,
+   enables bus mastering on it, and returns the I/O base of its
+   bus master registers (BAR4), or 0 if there is none. */
+static uint16_t
+pci_locate_ide_bus_master (void)
+{
+  int dev;
+
+  for (dev = 0; dev < 32; dev++)
+    {
+      uint32_t id = pci_config_read (0, dev, 0, 0);
+      uint32_t class;
+      uint32_t bar4;
+
+      if ((id & 0xffff) == 0xffff)
+        continue;
+
+      /* Class 0x01 (mass storage), subclass 0x01 (IDE). */
+      class = pci_config_read (0, dev, 0, 0x08);
+      if (class >> 24 != 0x01 || ((class >> 16) & 0xff) != 0x01)
+        continue;
+
+      /* BAR4 points at the bus master registers; bit 0 set means
+         I/O space.  A zero BAR means the controller predates bus
+         master DMA. */
+      bar4 = pci_config_read (0, dev, 0, 0x20);
+      if ((bar4 & 1) == 0 || (bar4 & ~3u) == 0)
+        continue;
+
+      /* Set the Bus Master Enable bit in the command register. */
+      pci_config_write (0, dev, 0, 0x04,
+                        pci_config_read (0, dev, 0, 0x04) | 0x4);
+      return bar4 & ~3u;
+    }
+
+  return 0;
+}
+
+/* A per-channel probe and the rendezvous for joining it. */
+struct channel_probe
+  {
+    struct channel *channel;    /* Channel to reset and probe. */
+    struct semaphore done;      /* Upped when the probe finishes. */
+  };
+
+/* Thread function: resets a channel and detects the devices on
+   it.  The reset sequence spends fixed wall-clock time asleep
+   (150 ms minimum, up to 30 s for a slow device), and the two
+   channels' port ranges and IRQs are independent, so running the
+   probes concurrently overlaps the waits instead of summing
+   them. */
+static void
+probe_channel_thread (void *probe_)
+{
+  struct channel_probe *probe = probe_;
+  struct channel *c = probe->channel;
+
+  reset_channel (c);
+  if (check_device_type (&c->devices[0]))
+    check_device_type (&c->devices[1]);
+  sema_up (&probe->done);
+}
+
 /* Initialize the disk subsystem and detect disks. */
 void
-ide_init (void) 
+ide_init (void)
 {
+  struct channel_probe probes[CHANNEL_CNT];
+  uint16_t bm_base = pci_locate_ide_bus_master ();
   size_t chan_no;
 
+  if (bm_base != 0)
+    printf ("ide: bus master DMA at port 0x%x\n", bm_base);
+
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
       struct channel *c = &channels[chan_no];
@@ -110,7 +269,7 @@ ide_init (void)
 
       /* Initialize channel. */
       snprintf (c->name, sizeof c->name, "ide%zu", chan_no);
-      switch (chan_no) 
+      switch (chan_no)
         {
         case 0:
           c->reg_base = 0x1f0;
@@ -126,13 +285,27 @@ ide_init (void)
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
- 
+      spinlock_init (&c->queue_lock);
+      c->current = NULL;
+      list_init (&c->requests);
+
+      /* Set up bus master DMA state.  Each channel's registers
+         follow the previous channel's at offset 8. */
+      c->bm_base = bm_base != 0 ? bm_base + 8 * chan_no : 0;
+      c->prdt = NULL;
+      if (c->bm_base != 0)
+        {
+          c->prdt = palloc_get_page (PAL_ZERO);
+          if (c->prdt == NULL)
+            c->bm_base = 0;
+        }
+
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
         {
           struct ata_disk *d = &c->devices[dev_no];
           snprintf (d->name, sizeof d->name,
-                    "hd%c", 'a' + chan_no * 2 + dev_no); 
+                    "hd%c", 'a' + chan_no * 2 + dev_no);
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
@@ -141,14 +314,25 @@ ide_init (void)
       /* Register interrupt handler. */
       intr_register_ext (c->irq, interrupt_handler, c->name);
 
-      /* Reset hardware. */
-      reset_channel (c);
+      /* Reset hardware and detect devices concurrently. */
+      probes[chan_no].channel = c;
+      sema_init (&probes[chan_no].done, 0);
+      thread_create (c->name, PRI_DEFAULT, probe_channel_thread,
+                     &probes[chan_no]);
+    }
+
+  /* Join the probes. */
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    sema_down (&probes[chan_no].done);
 
-      /* Distinguish ATA hard disks from other devices. */
-      if (check_device_type (&c->devices[0]))
-        check_device_type (&c->devices[1]);
+  /* Read hard disk identity information and register the disks,
+     serially so that block devices appear in channel order --
+     assignment of devices to roles depends on probe order. */
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    {
+      struct channel *c = &channels[chan_no];
+      int dev_no;
 
-      /* Read hard disk identity information. */
       for (dev_no = 0; dev_no < 2; dev_no++)
         if (c->devices[dev_no].is_ata)
           identify_ata_device (&c->devices[dev_no]);
@@ -303,9 +487,12 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
-  /* Register. */
+  /* Register.  Tagging the channel lets role assignment spread
+     the file system and swap across channels, whose transfers
+     can then overlap. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
+  block_set_channel (block, d->channel - channels);
   partition_scan (block);
 }
 
@@ -337,63 +524,256 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
+/* Maximum number of sectors per PIO command.  The sector count
+   register is 8 bits wide; we stop at 128 to keep interrupt
+   latency per command reasonable. */
+#define PIO_MAX_SECTORS 128
+
+/* Fills C's PRD table to describe BYTES bytes at BUFFER,
+   splitting chunks at 64 kB physical boundaries as the bus
+   master engine requires.  BUFFER must be kernel memory, which
+   is physically contiguous.  Returns true on success, false if
+   the buffer would need too many chunks. */
+static bool
+setup_prd_table (struct channel *c, const void *buffer, size_t bytes)
+{
+  uint32_t addr = vtop (buffer);
+  size_t i = 0;
+
+  while (bytes > 0)
+    {
+      uint32_t boundary_left = ((addr | 0xffff) + 1) - addr;
+      uint32_t chunk = boundary_left < bytes ? boundary_left : bytes;
+
+      if (i >= PRD_MAX)
+        return false;
+      c->prdt[i].addr = addr;
+      c->prdt[i].count = chunk;         /* 64 kB wraps to 0, as intended. */
+      c->prdt[i].flags = 0;
+      addr += chunk;
+      bytes -= chunk;
+      i++;
+    }
+  c->prdt[i - 1].flags = PRD_EOT;
+  return true;
+}
+
+/* Issues the bus master DMA command for REQ, which must already
+   be C's current request.  Runs in thread context for the first
+   request on an idle channel and in the completion interrupt for
+   the rest; both are safe because device selection only
+   busy-waits.  The device interrupts once, when the whole
+   transfer is done -- the big win over PIO's per-sector
+   interrupts. */
+static void
+start_request (struct channel *c, struct ide_request *req)
+{
+  bool ok UNUSED;
+
+  /* A request is at most PIO_MAX_SECTORS = 64 kB of physically
+     contiguous kernel memory, which spans too few 64 kB
+     boundaries to overflow the PRD table. */
+  ok = setup_prd_table (c, req->buffer, req->cnt * BLOCK_SECTOR_SIZE);
+  ASSERT (ok);
+
+  /* Program the engine: PRD table location, transfer direction,
+     and clear any stale error/interrupt status. */
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_cmd (c), req->is_write ? 0 : BM_CMD_READ);
+  outb (reg_bm_status (c),
+        inb (reg_bm_status (c)) | BM_STA_ERR | BM_STA_INTR);
+
+  select_sector (req->d, req->sec_no, req->cnt);
+  outb (reg_command (c), req->is_write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bm_cmd (c), (req->is_write ? 0 : BM_CMD_READ) | BM_CMD_START);
+}
+
+/* Transfers CNT sectors starting at SEC_NO between disk D and
+   BUFFER through the channel's outstanding-request table, in the
+   direction given by IS_WRITE.  Sleeps until the completion
+   handler has finished the transfer.  No lock is held while the
+   device works, so requests for both devices on the channel
+   queue up behind each other instead of serializing their
+   submitters. */
+static void
+ide_queue_transfer (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+                    void *buffer, bool is_write)
+{
+  struct channel *c = d->channel;
+  struct ide_request req;
+  bool start;
+
+  req.d = d;
+  req.sec_no = sec_no;
+  req.cnt = cnt;
+  req.buffer = buffer;
+  req.is_write = is_write;
+  req.error = false;
+  sema_init (&req.done, 0);
+
+  /* Enqueue.  If the channel is idle we claim it and issue the
+     command ourselves; otherwise the completion interrupt for
+     the command in flight will reach this request in turn. */
+  spinlock_acquire (&c->queue_lock);
+  start = c->current == NULL;
+  if (start)
+    c->current = &req;
+  else
+    list_push_back (&c->requests, &req.elem);
+  spinlock_release (&c->queue_lock);
+
+  if (start)
+    start_request (c, &req);
+  sema_down (&req.done);
+
+  if (req.error)
+    PANIC ("%s: DMA %s failed, sector=%"PRDSNu, d->name,
+           is_write ? "write" : "read", sec_no);
+}
+
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER,
+   which must have room for CNT * BLOCK_SECTOR_SIZE bytes.
+   Issues one command per run of up to PIO_MAX_SECTORS sectors,
+   so command setup and device selection are amortized over the
+   whole run.  On a channel with a DMA engine the run goes
+   through the outstanding-request table; without one it falls
+   back to PIO under the channel lock, with an interrupt per
+   sector.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_read_multiple (void *d_, block_sector_t sec_no, size_t cnt, void *buffer_)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  uint8_t *buffer = buffer_;
+
+  if (c->bm_base != 0)
+    {
+      while (cnt > 0)
+        {
+          size_t chunk = cnt < PIO_MAX_SECTORS ? cnt : PIO_MAX_SECTORS;
+
+          ide_queue_transfer (d, sec_no, chunk, buffer, false);
+          buffer += chunk * BLOCK_SECTOR_SIZE;
+          sec_no += chunk;
+          cnt -= chunk;
+        }
+      return;
+    }
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
+  while (cnt > 0)
+    {
+      size_t chunk = cnt < PIO_MAX_SECTORS ? cnt : PIO_MAX_SECTORS;
+      size_t i;
+
+      select_sector (d, sec_no, chunk);
+      issue_pio_command (c, CMD_READ_SECTOR_RETRY);
+      for (i = 0; i < chunk; i++)
+        {
+          sema_down (&c->completion_wait);
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                   d->name, sec_no + (block_sector_t) i);
+          input_sector (c, buffer);
+          buffer += BLOCK_SECTOR_SIZE;
+        }
+      sec_no += chunk;
+      cnt -= chunk;
+    }
   lock_release (&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Returns
+   after the disk has acknowledged receiving all the data.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+ide_write_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                    const void *buffer_)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  const uint8_t *buffer = buffer_;
+
+  if (c->bm_base != 0)
+    {
+      while (cnt > 0)
+        {
+          size_t chunk = cnt < PIO_MAX_SECTORS ? cnt : PIO_MAX_SECTORS;
+
+          ide_queue_transfer (d, sec_no, chunk, (void *) buffer, true);
+          buffer += chunk * BLOCK_SECTOR_SIZE;
+          sec_no += chunk;
+          cnt -= chunk;
+        }
+      return;
+    }
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
+  while (cnt > 0)
+    {
+      size_t chunk = cnt < PIO_MAX_SECTORS ? cnt : PIO_MAX_SECTORS;
+      size_t i;
+
+      select_sector (d, sec_no, chunk);
+      issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
+      for (i = 0; i < chunk; i++)
+        {
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                   d->name, sec_no + (block_sector_t) i);
+          output_sector (c, buffer);
+          sema_down (&c->completion_wait);
+          buffer += BLOCK_SECTOR_SIZE;
+        }
+      sec_no += chunk;
+      cnt -= chunk;
+    }
   lock_release (&c->lock);
 }
 
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes. */
+static void
+ide_read (void *d_, block_sector_t sec_no, void *buffer)
+{
+  ide_read_multiple (d_, sec_no, 1, buffer);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data. */
+static void
+ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+{
+  ide_write_multiple (d_, sec_no, 1, buffer);
+}
+
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple
   };
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the transfer length CNT to the disk's sector
+   selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
-  
+  ASSERT (cnt > 0 && cnt <= 256);
+
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  /* A sector count of 0 means 256 sectors. */
+  outb (reg_nsect (c), cnt & 0xff);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -511,7 +891,36 @@ interrupt_handler (struct intr_frame *f)
   for (c = channels; c < channels + CHANNEL_CNT; c++)
     if (f->vec_no == c->irq)
       {
-        if (c->expecting_interrupt) 
+        if (c->current != NULL)
+          {
+            struct ide_request *req = c->current;
+            struct ide_request *next;
+            uint8_t status;
+
+            inb (reg_status (c));               /* Acknowledge interrupt. */
+
+            /* Stop the DMA engine and collect its verdict. */
+            outb (reg_bm_cmd (c), 0);
+            status = inb (reg_bm_status (c));
+            outb (reg_bm_status (c), status | BM_STA_ERR | BM_STA_INTR);
+            req->error = (status & BM_STA_ERR) != 0;
+
+            /* Issue the next queued request right here, before
+               waking the finished submitter, so the channel is
+               never idle while work is outstanding. */
+            spinlock_acquire (&c->queue_lock);
+            next = (!list_empty (&c->requests)
+                    ? list_entry (list_pop_front (&c->requests),
+                                  struct ide_request, elem)
+                    : NULL);
+            c->current = next;
+            spinlock_release (&c->queue_lock);
+            if (next != NULL)
+              start_request (c, next);
+
+            sema_up (&req->done);               /* Wake up submitter. */
+          }
+        else if (c->expecting_interrupt)
           {
             inb (reg_status (c));               /* Acknowledge interrupt. */
             sema_up (&c->completion_wait);      /* Wake up waiter. */
@@ -5,12 +5,13 @@
 
 /* Stores keys from the keyboard and serial port. */
 static struct intq buffer;
+static uint8_t buffer_buf[INTQ_BUFSIZE];
 
 /* Initializes the input buffer. */
 void
-input_init (void) 
+input_init (void)
 {
-  intq_init (&buffer);
+  intq_init (&buffer, buffer_buf, sizeof buffer_buf);
 }
 
 /* Adds a key to the input buffer.
@@ -41,6 +42,32 @@ input_getc (void)
   return key;
 }
 
+/* Reads up to N bytes into BUF and returns the number read,
+   which is at least 1.  Waits for the first key if the buffer is
+   empty, then drains whatever else has accumulated -- a pasted
+   line, piped input -- in the same interrupts-off window, paying
+   the monitor cost and the serial flow-control update once per
+   batch instead of once per key.  Interactive reads still return
+   after a single keystroke. */
+size_t
+input_read (void *buf_, size_t n)
+{
+  uint8_t *buf = buf_;
+  enum intr_level old_level;
+  size_t cnt = 0;
+
+  ASSERT (n > 0);
+
+  old_level = intr_disable ();
+  buf[cnt++] = intq_getc (&buffer);
+  while (cnt < n && !intq_empty (&buffer))
+    buf[cnt++] = intq_getc (&buffer);
+  serial_notify ();
+  intr_set_level (old_level);
+
+  return cnt;
+}
+
 /* Returns true if the input buffer is full,
    false otherwise.
    Interrupts must be off. */
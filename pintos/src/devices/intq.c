@@ -2,16 +2,21 @@
 #include <debug.h>
 #include "threads/thread.h"
 
-static int next (int pos);
+static int next (const struct intq *q, int pos);
 static void wait (struct intq *q, struct thread **waiter);
 static void signal (struct intq *q, struct thread **waiter);
 
-/* Initializes interrupt queue Q. */
+/* Initializes interrupt queue Q to use the SIZE-byte buffer BUF,
+   which must outlive Q.  SIZE must be a power of 2. */
 void
-intq_init (struct intq *q) 
+intq_init (struct intq *q, uint8_t *buf, int size)
 {
+  ASSERT (size > 0 && (size & (size - 1)) == 0);
+
   lock_init (&q->lock);
   q->not_full = q->not_empty = NULL;
+  q->buf = buf;
+  q->size = size;
   q->head = q->tail = 0;
 }
 
@@ -25,10 +30,10 @@ intq_empty (const struct intq *q)
 
 /* Returns true if Q is full, false otherwise. */
 bool
-intq_full (const struct intq *q) 
+intq_full (const struct intq *q)
 {
   ASSERT (intr_get_level () == INTR_OFF);
-  return next (q->head) == q->tail;
+  return next (q, q->head) == q->tail;
 }
 
 /* Removes a byte from Q and returns it.
@@ -49,7 +54,7 @@ intq_getc (struct intq *q)
     }
   
   byte = q->buf[q->tail];
-  q->tail = next (q->tail);
+  q->tail = next (q, q->tail);
   signal (q, &q->not_full);
   return byte;
 }
@@ -70,15 +75,47 @@ intq_putc (struct intq *q, uint8_t byte)
     }
 
   q->buf[q->head] = byte;
-  q->head = next (q->head);
+  q->head = next (q, q->head);
   signal (q, &q->not_empty);
 }
+
+/* Tries to add BYTE to the end of Q without touching the
+   interrupt state, returning true on success or false if Q is
+   full.
+
+   This is a fast path for a queue with a single producer thread
+   and a single consumer, where the consumer is an interrupt
+   handler: only the producer moves `head', so it may publish a
+   byte with interrupts enabled, writing the data before the
+   index so that a consumer interrupt arriving in between sees a
+   consistent queue.  The full check is conservative -- a
+   concurrent consumer only makes more room.  Interrupts are
+   disabled only if a sleeping consumer thread must be woken. */
+bool
+intq_putc_try (struct intq *q, uint8_t byte)
+{
+  if (next (q, q->head) == q->tail)
+    return false;
+
+  q->buf[q->head] = byte;
+  barrier ();
+  q->head = next (q, q->head);
+
+  if (q->not_empty != NULL)
+    {
+      enum intr_level old_level = intr_disable ();
+      if (q->not_empty != NULL && !intq_empty (q))
+        signal (q, &q->not_empty);
+      intr_set_level (old_level);
+    }
+  return true;
+}
 
-/* Returns the position after POS within an intq. */
+/* Returns the position after POS within Q. */
 static int
-next (int pos) 
+next (const struct intq *q, int pos)
 {
-  return (pos + 1) % INTQ_BUFSIZE;
+  return (pos + 1) & (q->size - 1);
 }
 
 /* WAITER must be the address of Q's not_empty or not_full
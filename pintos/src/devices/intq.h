@@ -8,16 +8,20 @@
    kernel threads and external interrupt handlers.
 
    Interrupt queue functions can be called from kernel threads or
-   from external interrupt handlers.  Except for intq_init(),
-   interrupts must be off in either case.
+   from external interrupt handlers.  Except for intq_init() and
+   intq_putc_try(), interrupts must be off in either case.
 
    The interrupt queue has the structure of a "monitor".  Locks
    and condition variables from threads/synch.h cannot be used in
    this case, as they normally would, because they can only
    protect kernel threads from one another, not from interrupt
-   handlers. */
+   handlers.
 
-/* Queue buffer size, in bytes. */
+   Each queue's buffer is supplied by its owner, so a device can
+   size its queue to its traffic; the size must be a power of 2
+   so that wraparound is a mask rather than a division. */
+
+/* Default queue buffer size, in bytes. */
 #define INTQ_BUFSIZE 64
 
 /* A circular queue of bytes. */
@@ -29,15 +33,17 @@ struct intq
     struct thread *not_empty;   /* Thread waiting for not-empty condition. */
 
     /* Queue. */
-    uint8_t buf[INTQ_BUFSIZE];  /* Buffer. */
+    uint8_t *buf;               /* Buffer, supplied by intq_init() caller. */
+    int size;                   /* Buffer size in bytes, a power of 2. */
     int head;                   /* New data is written here. */
     int tail;                   /* Old data is read here. */
   };
 
-void intq_init (struct intq *);
+void intq_init (struct intq *, uint8_t *buf, int size);
 bool intq_empty (const struct intq *);
 bool intq_full (const struct intq *);
 uint8_t intq_getc (struct intq *);
 void intq_putc (struct intq *, uint8_t);
+bool intq_putc_try (struct intq *, uint8_t);
 
 #endif /* devices/intq.h */
@@ -7,10 +7,23 @@
 #include "devices/shutdown.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/softirq.h"
 
 /* Keyboard data register port. */
 #define DATA_REG 0x60
 
+/* Raw scancodes captured by the interrupt handler, awaiting
+   decoding by the bottom half.  The handler is the only writer
+   of `head' and the bottom half the only writer of `tail', so no
+   further locking is needed.  A scancode arriving while the ring
+   is full is dropped, which only loses a keystroke. */
+#define SCANCODE_BUF 64
+static unsigned scancode_buf[SCANCODE_BUF];
+static size_t scancode_head, scancode_tail;
+
+/* Softirq number for the decoding bottom half. */
+static int kbd_softirq;
+
 /* Current state of shift keys.
    True if depressed, false otherwise. */
 static bool left_shift, right_shift;    /* Left and right Shift keys. */
@@ -25,11 +38,13 @@ static bool caps_lock;
 static int64_t key_cnt;
 
 static intr_handler_func keyboard_interrupt;
+static softirq_func kbd_bottom_half;
 
 /* Initializes the keyboard. */
 void
-kbd_init (void) 
+kbd_init (void)
 {
+  kbd_softirq = softirq_register (kbd_bottom_half, NULL, "kbd");
   intr_register_ext (0x21, keyboard_interrupt, "8042 Keyboard");
 }
 
@@ -92,105 +107,128 @@ static const struct keymap shifted_keymap[] =
 
 static bool map_key (const struct keymap[], unsigned scancode, uint8_t *);
 
+/* Keyboard interrupt handler: empties the 8042's output buffer
+   into the scancode ring and raises the decoding softirq.  The
+   keymap walks and shift-state bookkeeping run in the bottom
+   half with interrupts on, so this interrupts-off window is just
+   the port reads. */
 static void
-keyboard_interrupt (struct intr_frame *args UNUSED) 
+keyboard_interrupt (struct intr_frame *args UNUSED)
 {
-  /* Status of shift keys. */
-  bool shift = left_shift || right_shift;
-  bool alt = left_alt || right_alt;
-  bool ctrl = left_ctrl || right_ctrl;
-
-  /* Keyboard scancode. */
-  unsigned code;
-
-  /* False if key pressed, true if key released. */
-  bool release;
-
-  /* Character that corresponds to `code'. */
-  uint8_t c;
-
-  /* Read scancode, including second byte if prefix code. */
-  code = inb (DATA_REG);
+  /* Keyboard scancode, including second byte if prefix code. */
+  unsigned code = inb (DATA_REG);
   if (code == 0xe0)
     code = (code << 8) | inb (DATA_REG);
 
-  /* Bit 0x80 distinguishes key press from key release
-     (even if there's a prefix). */
-  release = (code & 0x80) != 0;
-  code &= ~0x80u;
+  if (scancode_head - scancode_tail < SCANCODE_BUF)
+    scancode_buf[scancode_head++ % SCANCODE_BUF] = code;
+  softirq_raise (kbd_softirq);
+}
 
-  /* Interpret key. */
-  if (code == 0x3a) 
-    {
-      /* Caps Lock. */
-      if (!release)
-        caps_lock = !caps_lock;
-    }
-  else if (map_key (invariant_keymap, code, &c)
-           || (!shift && map_key (unshifted_keymap, code, &c))
-           || (shift && map_key (shifted_keymap, code, &c)))
+/* Bottom half: decodes buffered scancodes into characters.
+   Runs in the softirq daemon. */
+static void
+kbd_bottom_half (void *aux UNUSED)
+{
+  while (scancode_tail != scancode_head)
     {
-      /* Ordinary character. */
-      if (!release) 
-        {
-          /* Reboot if Ctrl+Alt+Del pressed. */
-          if (c == 0177 && ctrl && alt)
-            shutdown_reboot ();
+      /* Status of shift keys. */
+      bool shift = left_shift || right_shift;
+      bool alt = left_alt || right_alt;
+      bool ctrl = left_ctrl || right_ctrl;
 
-          /* Handle Ctrl, Shift.
-             Note that Ctrl overrides Shift. */
-          if (ctrl && c >= 0x40 && c < 0x60) 
-            {
-              /* A is 0x41, Ctrl+A is 0x01, etc. */
-              c -= 0x40; 
-            }
-          else if (shift == caps_lock)
-            c = tolower (c);
+      /* Keyboard scancode. */
+      unsigned code = scancode_buf[scancode_tail++ % SCANCODE_BUF];
+
+      /* False if key pressed, true if key released. */
+      bool release;
 
-          /* Handle Alt by setting the high bit.
-             This 0x80 is unrelated to the one used to
-             distinguish key press from key release. */
-          if (alt)
-            c += 0x80;
+      /* Character that corresponds to `code'. */
+      uint8_t c;
 
-          /* Append to keyboard buffer. */
-          if (!input_full ())
+      /* Bit 0x80 distinguishes key press from key release
+         (even if there's a prefix). */
+      release = (code & 0x80) != 0;
+      code &= ~0x80u;
+
+      /* Interpret key. */
+      if (code == 0x3a)
+        {
+          /* Caps Lock. */
+          if (!release)
+            caps_lock = !caps_lock;
+        }
+      else if (map_key (invariant_keymap, code, &c)
+               || (!shift && map_key (unshifted_keymap, code, &c))
+               || (shift && map_key (shifted_keymap, code, &c)))
+        {
+          /* Ordinary character. */
+          if (!release)
             {
-              key_cnt++;
-              input_putc (c);
+              enum intr_level old_level;
+
+              /* Reboot if Ctrl+Alt+Del pressed. */
+              if (c == 0177 && ctrl && alt)
+                shutdown_reboot ();
+
+              /* Handle Ctrl, Shift.
+                 Note that Ctrl overrides Shift. */
+              if (ctrl && c >= 0x40 && c < 0x60)
+                {
+                  /* A is 0x41, Ctrl+A is 0x01, etc. */
+                  c -= 0x40;
+                }
+              else if (shift == caps_lock)
+                c = tolower (c);
+
+              /* Handle Alt by setting the high bit.
+                 This 0x80 is unrelated to the one used to
+                 distinguish key press from key release. */
+              if (alt)
+                c += 0x80;
+
+              /* Append to keyboard buffer, which expects
+                 interrupts off. */
+              old_level = intr_disable ();
+              if (!input_full ())
+                {
+                  key_cnt++;
+                  input_putc (c);
+                }
+              intr_set_level (old_level);
             }
         }
-    }
-  else
-    {
-      /* Maps a keycode into a shift state variable. */
-      struct shift_key 
+      else
         {
-          unsigned scancode;
-          bool *state_var;
-        };
+          /* Maps a keycode into a shift state variable. */
+          struct shift_key
+            {
+              unsigned scancode;
+              bool *state_var;
+            };
 
-      /* Table of shift keys. */
-      static const struct shift_key shift_keys[] = 
-        {
-          {  0x2a, &left_shift},
-          {  0x36, &right_shift},
-          {  0x38, &left_alt},
-          {0xe038, &right_alt},
-          {  0x1d, &left_ctrl},
-          {0xe01d, &right_ctrl},
-          {0,      NULL},
-        };
-  
-      const struct shift_key *key;
-
-      /* Scan the table. */
-      for (key = shift_keys; key->scancode != 0; key++) 
-        if (key->scancode == code)
-          {
-            *key->state_var = !release;
-            break;
-          }
+          /* Table of shift keys. */
+          static const struct shift_key shift_keys[] =
+            {
+              {  0x2a, &left_shift},
+              {  0x36, &right_shift},
+              {  0x38, &left_alt},
+              {0xe038, &right_alt},
+              {  0x1d, &left_ctrl},
+              {0xe01d, &right_ctrl},
+              {0,      NULL},
+            };
+
+          const struct shift_key *key;
+
+          /* Scan the table. */
+          for (key = shift_keys; key->scancode != 0; key++)
+            if (key->scancode == code)
+              {
+                *key->state_var = !release;
+                break;
+              }
+        }
     }
 }
 
@@ -6,16 +6,29 @@
 #include "devices/block.h"
 #include "threads/malloc.h"
 
-/* A partition of a block device. */
-struct partition
+/* Format of a partition table entry.  See [Partitions]. */
+struct partition_table_entry
   {
-    struct block *block;                /* Underlying block device. */
-    block_sector_t start;               /* First sector within device. */
-  };
+    uint8_t bootable;           /* 0x00=not bootable, 0x80=bootable. */
+    uint8_t start_chs[3];       /* Encoded starting cylinder, head, sector. */
+    uint8_t type;               /* Partition type (see partition_type_name). */
+    uint8_t end_chs[3];         /* Encoded ending cylinder, head, sector. */
+    uint32_t offset;            /* Start sector offset from partition table. */
+    uint32_t size;              /* Number of sectors. */
+  }
+PACKED;
 
-static struct block_operations partition_operations;
+/* Partition table sector. */
+struct partition_table
+  {
+    uint8_t loader[446];        /* Loader, in top-level partition table. */
+    struct partition_table_entry partitions[4];         /* Table entries. */
+    uint16_t signature;         /* Should be 0xaa55. */
+  }
+PACKED;
 
-static void read_partition_table (struct block *, block_sector_t sector,
+static void read_partition_table (struct block *, struct partition_table *,
+                                  block_sector_t sector,
                                   block_sector_t primary_extended_sector,
                                   int *part_nr);
 static void found_partition (struct block *, uint8_t type,
@@ -23,18 +36,30 @@ static void found_partition (struct block *, uint8_t type,
                              int part_nr);
 static const char *partition_type_name (uint8_t);
 
-/* Scans BLOCK for partitions of interest to Pintos. */
+/* Scans BLOCK for partitions of interest to Pintos.  One sector
+   buffer serves the whole scan: each table in the MBR chain is
+   read into it exactly once, instead of a fresh allocation per
+   probed sector. */
 void
 partition_scan (struct block *block)
 {
+  struct partition_table *pt;
   int part_nr = 0;
-  read_partition_table (block, 0, 0, &part_nr);
+
+  ASSERT (sizeof *pt == BLOCK_SECTOR_SIZE);
+  pt = malloc (sizeof *pt);
+  if (pt == NULL)
+    PANIC ("Failed to allocate memory for partition table.");
+  read_partition_table (block, pt, 0, 0, &part_nr);
+  free (pt);
+
   if (part_nr == 0)
     printf ("%s: Device contains no partitions\n", block_name (block));
 }
 
-/* Reads the partition table in the given SECTOR of BLOCK and
-   scans it for partitions of interest to Pintos.
+/* Reads the partition table in the given SECTOR of BLOCK into
+   PT, a buffer shared by the whole scan, and scans it for
+   partitions of interest to Pintos.
 
    If SECTOR is 0, so that this is the top-level partition table
    on BLOCK, then PRIMARY_EXTENDED_SECTOR is not meaningful;
@@ -47,32 +72,12 @@ partition_scan (struct block *block)
    partitions already encountered on BLOCK.  It is incremented as
    partitions are found. */
 static void
-read_partition_table (struct block *block, block_sector_t sector,
+read_partition_table (struct block *block, struct partition_table *pt,
+                      block_sector_t sector,
                       block_sector_t primary_extended_sector,
                       int *part_nr)
 {
-  /* Format of a partition table entry.  See [Partitions]. */
-  struct partition_table_entry
-    {
-      uint8_t bootable;         /* 0x00=not bootable, 0x80=bootable. */
-      uint8_t start_chs[3];     /* Encoded starting cylinder, head, sector. */
-      uint8_t type;             /* Partition type (see partition_type_name). */
-      uint8_t end_chs[3];       /* Encoded ending cylinder, head, sector. */
-      uint32_t offset;          /* Start sector offset from partition table. */
-      uint32_t size;            /* Number of sectors. */
-    }
-  PACKED;
-
-  /* Partition table sector. */
-  struct partition_table
-    {
-      uint8_t loader[446];      /* Loader, in top-level partition table. */
-      struct partition_table_entry partitions[4];       /* Table entries. */
-      uint16_t signature;       /* Should be 0xaa55. */
-    }
-  PACKED;
-
-  struct partition_table *pt;
+  struct partition_table_entry entries[4];
   size_t i;
 
   /* Check SECTOR validity. */
@@ -84,11 +89,7 @@ read_partition_table (struct block *block, block_sector_t sector,
     }
 
   /* Read sector. */
-  ASSERT (sizeof *pt == BLOCK_SECTOR_SIZE);
-  pt = malloc (sizeof *pt);
-  if (pt == NULL)
-    PANIC ("Failed to allocate memory for partition table.");
-  block_read (block, 0, pt);
+  block_read (block, sector, pt);
 
   /* Check signature. */
   if (pt->signature != 0xaa55)
@@ -98,14 +99,16 @@ read_partition_table (struct block *block, block_sector_t sector,
       else
         printf ("%s: Invalid extended partition table in sector %"PRDSNu"\n",
                 block_name (block), sector);
-      free (pt);
       return;
     }
 
-  /* Parse partitions. */
-  for (i = 0; i < sizeof pt->partitions / sizeof *pt->partitions; i++)
+  /* Parse partitions from a local copy of the entries, so that
+     the shared buffer is free for the tables that extended
+     partitions chain to. */
+  memcpy (entries, pt->partitions, sizeof entries);
+  for (i = 0; i < sizeof entries / sizeof *entries; i++)
     {
-      struct partition_table_entry *e = &pt->partitions[i];
+      struct partition_table_entry *e = &entries[i];
 
       if (e->size == 0 || e->type == 0)
         {
@@ -128,9 +131,10 @@ read_partition_table (struct block *block, block_sector_t sector,
              is nested, the offset is relative to the start of
              the extended partition that the MBR points to. */
           if (sector == 0)
-            read_partition_table (block, e->offset, e->offset, part_nr);
+            read_partition_table (block, pt, e->offset, e->offset, part_nr);
           else
-            read_partition_table (block, e->offset + primary_extended_sector,
+            read_partition_table (block, pt,
+                                  e->offset + primary_extended_sector,
                                   primary_extended_sector, part_nr);
         }
       else
@@ -141,15 +145,15 @@ read_partition_table (struct block *block, block_sector_t sector,
                            e->size, *part_nr);
         }
     }
-
-  free (pt);
 }
 
 /* We have found a primary or logical partition of the given TYPE
    on BLOCK, starting at sector START and continuing for SIZE
    sectors, which we are giving the partition number PART_NR.
    Check whether this is a partition of interest to Pintos, and
-   if so then add it to the proper element of partitions[]. */
+   if so then register it as a region of BLOCK, so that its I/O
+   goes straight to BLOCK's driver with a precomputed base rather
+   than through a second request queue. */
 static void
 found_partition (struct block *block, uint8_t part_type,
                  block_sector_t start, block_sector_t size,
@@ -168,20 +172,13 @@ found_partition (struct block *block, uint8_t part_type,
                               : part_type == 0x22 ? BLOCK_SCRATCH
                               : part_type == 0x23 ? BLOCK_SWAP
                               : BLOCK_FOREIGN);
-      struct partition *p;
       char extra_info[128];
       char name[16];
 
-      p = malloc (sizeof *p);
-      if (p == NULL)
-        PANIC ("Failed to allocate memory for partition descriptor");
-      p->block = block;
-      p->start = start;
-
       snprintf (name, sizeof name, "%s%d", block_name (block), part_nr);
       snprintf (extra_info, sizeof extra_info, "%s (%02x)",
                 partition_type_name (part_type), part_type);
-      block_register (name, type, extra_info, size, &partition_operations, p);
+      block_register_region (block, name, type, extra_info, start, size);
     }
 }
 
@@ -297,28 +294,3 @@ partition_type_name (uint8_t type)
 
   return type_names[type] != NULL ? type_names[type] : "Unknown";
 }
-
-/* Reads sector SECTOR from partition P into BUFFER, which must
-   have room for BLOCK_SECTOR_SIZE bytes. */
-static void
-partition_read (void *p_, block_sector_t sector, void *buffer)
-{
-  struct partition *p = p_;
-  block_read (p->block, p->start + sector, buffer);
-}
-
-/* Write sector SECTOR to partition P from BUFFER, which must
-   contain BLOCK_SECTOR_SIZE bytes.  Returns after the block has
-   acknowledged receiving the data. */
-static void
-partition_write (void *p_, block_sector_t sector, const void *buffer)
-{
-  struct partition *p = p_;
-  block_write (p->block, p->start + sector, buffer);
-}
-
-static struct block_operations partition_operations =
-  {
-    partition_read,
-    partition_write
-  };
@@ -0,0 +1,92 @@
+#include "devices/pci.h"
+#include <debug.h>
+#include "threads/io.h"
+
+/* Minimal PCI configuration-space access: just enough to find a
+   device by vendor and device ID and to read its BARs and
+   interrupt line.  Uses the port-mapped "mechanism #1"
+   interface, where an address written to CONFIG_ADDRESS selects
+   one dword of one function's configuration space, which
+   CONFIG_DATA then reads or writes. */
+
+#define CONFIG_ADDRESS 0xcf8
+#define CONFIG_DATA 0xcfc
+
+/* Selects the dword containing OFS in D's configuration
+   space. */
+static void
+select_cfg (const struct pci_dev *d, int ofs)
+{
+  outl (CONFIG_ADDRESS,
+        0x80000000
+        | (uint32_t) d->bus << 16
+        | (uint32_t) d->dev << 11
+        | (uint32_t) d->func << 8
+        | (ofs & 0xfc));
+}
+
+/* Reads the SIZE-byte (1, 2, or 4) value at OFS in D's
+   configuration space, which must not span a dword boundary. */
+uint32_t
+pci_read_cfg (const struct pci_dev *d, int ofs, int size)
+{
+  uint32_t w;
+
+  ASSERT (ofs % size == 0);
+
+  select_cfg (d, ofs);
+  w = inl (CONFIG_DATA) >> (ofs & 3) * 8;
+  return size == 4 ? w : w & ((1u << size * 8) - 1);
+}
+
+/* Writes the SIZE-byte (1, 2, or 4) VALUE at OFS in D's
+   configuration space, which must not span a dword boundary. */
+void
+pci_write_cfg (const struct pci_dev *d, int ofs, int size, uint32_t value)
+{
+  ASSERT (ofs % size == 0);
+
+  select_cfg (d, ofs);
+  if (size == 4)
+    outl (CONFIG_DATA, value);
+  else if (size == 2)
+    outw (CONFIG_DATA + (ofs & 2), value);
+  else
+    outb (CONFIG_DATA + (ofs & 3), value);
+}
+
+/* Finds the INDEXth function on bus 0 with the given VENDOR and
+   DEVICE IDs, in increasing device order, and stores its
+   location into *D_.  Returns true if found.  Only bus 0 is
+   scanned; the machines QEMU emulates for us put every device
+   there. */
+bool
+pci_find (uint16_t vendor, uint16_t device, int index, struct pci_dev *d_)
+{
+  struct pci_dev d;
+  int dev;
+
+  d.bus = 0;
+  for (dev = 0; dev < 32; dev++)
+    {
+      int func_cnt, func;
+
+      d.dev = dev;
+      d.func = 0;
+      if (pci_read_cfg (&d, PCI_VENDOR_ID, 2) == 0xffff)
+        continue;
+      func_cnt = pci_read_cfg (&d, PCI_HEADER_TYPE, 1) & 0x80 ? 8 : 1;
+      for (func = 0; func < func_cnt; func++)
+        {
+          d.func = func;
+          if (pci_read_cfg (&d, PCI_VENDOR_ID, 2) == vendor
+              && pci_read_cfg (&d, PCI_DEVICE_ID, 2) == device
+              && index-- == 0)
+            {
+              *d_ = d;
+              return true;
+            }
+        }
+    }
+  return false;
+}
@@ -0,0 +1,31 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* A PCI function's location on the bus. */
+struct pci_dev
+  {
+    uint8_t bus;
+    uint8_t dev;
+    uint8_t func;
+  };
+
+/* Common configuration-space offsets. */
+#define PCI_VENDOR_ID 0x00              /* 16 bits. */
+#define PCI_DEVICE_ID 0x02              /* 16 bits. */
+#define PCI_COMMAND 0x04                /* 16 bits. */
+#define PCI_HEADER_TYPE 0x0e            /* 8 bits. */
+#define PCI_BAR0 0x10                   /* 32 bits. */
+#define PCI_INTR_LINE 0x3c              /* 8 bits. */
+
+/* PCI_COMMAND bits. */
+#define PCI_CMD_IO 0x1                  /* Respond to port I/O. */
+#define PCI_CMD_MASTER 0x4              /* May initiate DMA. */
+
+uint32_t pci_read_cfg (const struct pci_dev *, int ofs, int size);
+void pci_write_cfg (const struct pci_dev *, int ofs, int size, uint32_t);
+bool pci_find (uint16_t vendor, uint16_t device, int index, struct pci_dev *);
+
+#endif /* devices/pci.h */
@@ -0,0 +1,144 @@
+#include "devices/pvclock.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* kvmclock, KVM's paravirtual clock.
+
+   A guest cannot calibrate time against the PIT the way real
+   hardware can: the host may deschedule it for milliseconds in
+   the middle of a calibration loop, so a busy-wait comparison
+   against timer ticks misjudges badly whenever the host is
+   loaded.  The hypervisor, on the other hand, knows the TSC
+   frequency exactly.  kvmclock hands it over: the guest points
+   an MSR at a structure in its own memory and the hypervisor
+   fills in the factors that convert TSC cycles to nanoseconds.
+
+   Detection is by CPUID: leaf 1 advertises a hypervisor, leaf
+   0x40000000 names it, and leaf 0x40000001 carries KVM's feature
+   bits.  Under plain TCG emulation none of that is present and
+   pvclock_tsc_hz() stays zero, which sends timer_calibrate()
+   down its hardware path. */
+
+/* CPUID.1 ECX bit advertising a hypervisor. */
+#define CPUID_HYPERVISOR (1u << 31)
+
+/* Hypervisor CPUID leaves. */
+#define KVM_CPUID_SIGNATURE 0x40000000
+#define KVM_CPUID_FEATURES 0x40000001
+
+/* KVM_CPUID_FEATURES EAX bits for the two clocksource
+   revisions. */
+#define KVM_FEATURE_CLOCKSOURCE 0x01
+#define KVM_FEATURE_CLOCKSOURCE2 0x08
+
+/* MSRs that take the physical address of the time structure,
+   low bit set to enable. */
+#define MSR_KVM_SYSTEM_TIME_OLD 0x12
+#define MSR_KVM_SYSTEM_TIME_NEW 0x4b564d01
+
+/* The structure the hypervisor keeps updated.  Layout is fixed
+   by the KVM ABI; it must be 32-byte aligned.  VERSION is odd
+   while the hypervisor rewrites the contents, even when they are
+   stable, like the time page's sequence number. */
+struct pvclock_time_info
+  {
+    uint32_t version;
+    uint32_t pad0;
+    uint64_t tsc_timestamp;     /* TSC when the fields were written. */
+    uint64_t system_time;       /* Nanoseconds at that moment. */
+    uint32_t tsc_to_system_mul; /* ns = (cycles << shift) * mul >> 32. */
+    int8_t tsc_shift;
+    uint8_t flags;
+    uint8_t pad[2];
+  };
+
+static struct pvclock_time_info time_info __attribute__ ((aligned (32)));
+
+/* TSC frequency the hypervisor reported, or 0 if there is no
+   usable kvmclock. */
+static uint64_t tsc_hz;
+
+/* Executes CPUID for LEAF. */
+static void
+cpuid (uint32_t leaf, uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d)
+{
+  asm volatile ("cpuid"
+                : "=a" (*a), "=b" (*b), "=c" (*c), "=d" (*d)
+                : "a" (leaf));
+}
+
+/* Writes VALUE to model-specific register MSR. */
+static void
+wrmsr (uint32_t msr, uint64_t value)
+{
+  asm volatile ("wrmsr" : : "c" (msr), "A" (value));
+}
+
+/* Detects a KVM hypervisor and, if its paravirtual clock is
+   offered, enables it and records the TSC frequency it
+   reports. */
+void
+pvclock_init (void)
+{
+  uint32_t a, b, c, d;
+  uint32_t features, msr;
+  uint32_t mul, v0;
+  int8_t shift;
+  uint64_t hz;
+
+  cpuid (1, &a, &b, &c, &d);
+  if (!(c & CPUID_HYPERVISOR))
+    return;
+
+  cpuid (KVM_CPUID_SIGNATURE, &a, &b, &c, &d);
+  if (b != 0x4b4d564b || c != 0x564b4d56 || d != 0x4d)  /* "KVMKVMKVM". */
+    return;
+
+  cpuid (KVM_CPUID_FEATURES, &features, &b, &c, &d);
+  if (features & KVM_FEATURE_CLOCKSOURCE2)
+    msr = MSR_KVM_SYSTEM_TIME_NEW;
+  else if (features & KVM_FEATURE_CLOCKSOURCE)
+    msr = MSR_KVM_SYSTEM_TIME_OLD;
+  else
+    return;
+
+  wrmsr (msr, vtop (&time_info) | 1);
+
+  /* Read the conversion factors under the version number, in
+     case the hypervisor rewrites them mid-read. */
+  do
+    {
+      v0 = time_info.version;
+      barrier ();
+      mul = time_info.tsc_to_system_mul;
+      shift = time_info.tsc_shift;
+      barrier ();
+    }
+  while (time_info.version != v0 || v0 % 2 != 0);
+
+  if (mul == 0)
+    return;
+
+  /* Invert ns = (cycles << shift) * mul >> 32 to get cycles per
+     second. */
+  hz = (1000000000ull << 32) / mul;
+  if (shift >= 0)
+    hz >>= shift;
+  else
+    hz <<= -shift;
+  tsc_hz = hz;
+
+  printf ("Hypervisor detected: KVM, TSC at %'"PRIu64" Hz (kvmclock).\n",
+          tsc_hz);
+}
+
+/* Returns the hypervisor-reported TSC frequency, or 0 if no
+   paravirtual clock is available. */
+uint64_t
+pvclock_tsc_hz (void)
+{
+  return tsc_hz;
+}
@@ -0,0 +1,9 @@
+#ifndef DEVICES_PVCLOCK_H
+#define DEVICES_PVCLOCK_H
+
+#include <stdint.h>
+
+void pvclock_init (void);
+uint64_t pvclock_tsc_hz (void);
+
+#endif /* devices/pvclock.h */
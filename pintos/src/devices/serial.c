@@ -37,6 +37,14 @@
 #define IER_RECV 0x01           /* Interrupt when data received. */
 #define IER_XMIT 0x02           /* Interrupt when transmit finishes. */
 
+/* FIFO Control Register bits. */
+#define FCR_ENABLE 0x01         /* Enable FIFOs. */
+#define FCR_CLR_RX 0x02         /* Clear receive FIFO. */
+#define FCR_CLR_TX 0x04         /* Clear transmit FIFO. */
+
+/* Size of the 16550A transmit FIFO. */
+#define TX_FIFO_SIZE 16
+
 /* Line Control Register bits. */
 #define LCR_N81 0x03            /* No parity, 8 data bits, 1 stop bit. */
 #define LCR_DLAB 0x80           /* Divisor Latch Access Bit (DLAB). */
@@ -51,8 +59,11 @@
 /* Transmission mode. */
 static enum { UNINIT, POLL, QUEUE } mode;
 
-/* Data to be transmitted. */
+/* Data to be transmitted.  The queue is sized well above the
+   default so that bursts of kernel logging fill it, and block
+   the writer, less often. */
 static struct intq txq;
+static uint8_t txq_buf[1024];
 
 static void set_serial (int bps);
 static void putc_poll (uint8_t);
@@ -68,10 +79,15 @@ init_poll (void)
 {
   ASSERT (mode == UNINIT);
   outb (IER_REG, 0);                    /* Turn off all interrupts. */
-  outb (FCR_REG, 0);                    /* Disable FIFO. */
+  outb (FCR_REG,                        /* Enable and clear FIFOs, with
+                                           the receive trigger level left
+                                           at one byte, so a THRE
+                                           interrupt can accept a whole
+                                           FIFO of output at once. */
+        FCR_ENABLE | FCR_CLR_RX | FCR_CLR_TX);
   set_serial (9600);                    /* 9.6 kbps, N-8-1. */
   outb (MCR_REG, MCR_OUT2);             /* Required to enable interrupts. */
-  intq_init (&txq);
+  intq_init (&txq, txq_buf, sizeof txq_buf);
   mode = POLL;
 } 
 
@@ -129,6 +145,68 @@ serial_putc (uint8_t byte)
   intr_set_level (old_level);
 }
 
+/* Sends the SIZE bytes at BUF to the serial port as a batch.
+   The transmit queue is filled in bulk inside one interrupt-off
+   window and the interrupt enable register is written once per
+   stretch, instead of once per character as serial_putc()
+   does. */
+void
+serial_write (const void *buf_, size_t size)
+{
+  const uint8_t *buf = buf_;
+  enum intr_level old_level;
+
+  /* In queued mode with interrupts on, we are the single
+     producer and the transmit interrupt the single consumer, so
+     bytes can be published with interrupts enabled until the
+     queue fills; only the leftovers below pay for an
+     interrupt-off window. */
+  if (mode == QUEUE && intr_get_level () == INTR_ON)
+    while (size > 0 && intq_putc_try (&txq, *buf))
+      {
+        buf++;
+        size--;
+      }
+
+  old_level = intr_disable ();
+
+  if (mode != QUEUE)
+    {
+      if (mode == UNINIT)
+        init_poll ();
+      while (size-- > 0)
+        putc_poll (*buf++);
+    }
+  else
+    {
+      while (size > 0)
+        {
+          if (intq_full (&txq))
+            {
+              if (old_level == INTR_OFF)
+                {
+                  /* Interrupts are off, so nobody else will
+                     drain the queue; poll a byte out ourselves,
+                     as serial_putc() does. */
+                  putc_poll (intq_getc (&txq));
+                }
+              else
+                {
+                  /* intq_putc() is about to sleep until the
+                     queue has room, so make sure the transmit
+                     interrupt that will drain it is enabled. */
+                  write_ier ();
+                }
+            }
+          intq_putc (&txq, *buf++);
+          size--;
+        }
+      write_ier ();
+    }
+
+  intr_set_level (old_level);
+}
+
 /* Flushes anything in the serial buffer out the port in polling
    mode. */
 void
@@ -218,10 +296,18 @@ serial_interrupt (struct intr_frame *f UNUSED)
   while (!input_full () && (inb (LSR_REG) & LSR_DR) != 0)
     input_putc (inb (RBR_REG));
 
-  /* As long as we have a byte to transmit, and the hardware is
-     ready to accept a byte for transmission, transmit a byte. */
-  while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0) 
-    outb (THR_REG, intq_getc (&txq));
+  /* If the hardware can accept output, hand it a whole transmit
+     FIFO's worth of bytes, not just one: THRE means the FIFO is
+     completely empty, so up to TX_FIFO_SIZE bytes fit without
+     further status checks.  This coalesces what used to be one
+     interrupt per character into one per FIFO. */
+  if (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0)
+    {
+      int i;
+
+      for (i = 0; i < TX_FIFO_SIZE && !intq_empty (&txq); i++)
+        outb (THR_REG, intq_getc (&txq));
+    }
 
   /* Update interrupt enable register based on queue status. */
   write_ier ();
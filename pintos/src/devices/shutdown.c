@@ -1,17 +1,26 @@
 #include "devices/shutdown.h"
+#include <cachestat.h>
 #include <console.h>
 #include <stdio.h>
 #include "devices/kbd.h"
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/profile.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/swap.h"
+#endif
 #ifdef FILESYS
 #include "devices/block.h"
 #include "filesys/filesys.h"
+#include "filesys/fsutil.h"
 #endif
 
 /* Keyboard control register port. */
@@ -56,6 +65,7 @@ shutdown_configure (enum shutdown_type type)
 void
 shutdown_reboot (void)
 {
+  console_flush ();
   printf ("Rebooting...\n");
 
     /* See [kbd] for details on how to program the keyboard
@@ -90,6 +100,7 @@ shutdown_power_off (void)
   const char s[] = "Shutdown";
   const char *p;
 
+  console_flush ();
 #ifdef FILESYS
   filesys_done ();
 #endif
@@ -130,12 +141,21 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  palloc_print_stats ();
+  malloc_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
+  fsutil_print_stats ();
 #endif
+  cache_stats_print ();
   console_print_stats ();
   kbd_print_stats ();
 #ifdef USERPROG
   exception_print_stats ();
 #endif
+#ifdef VM
+  frame_print_stats ();
+  swap_print_stats ();
+#endif
+  profile_print ();
 }
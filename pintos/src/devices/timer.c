@@ -1,12 +1,16 @@
 #include "devices/timer.h"
 #include <debug.h>
+#include <div64.h>
 #include <inttypes.h>
 #include <round.h>
 #include <stdio.h>
 #include "devices/pit.h"
+#include "devices/pvclock.h"
 #include "threads/interrupt.h"
+#include "threads/profile.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
   
 /* See [8254] for hardware details of the 8254 timer chip. */
 
@@ -20,11 +24,101 @@
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* If true, stretch the timer interval while only the idle thread
+   is runnable (kernel option "-tickless"), instead of waking the
+   machine TIMER_FREQ times a second to accomplish nothing. */
+bool timer_tickless;
+
+/* Number of ticks the currently programmed PIT interval stands
+   for.  1 in normal operation; larger during a tickless-idle
+   stretch, so the next interrupt credits the skipped ticks. */
+static int skip_ticks = 1;
+
+/* Longest tickless stretch, in ticks.  The bound keeps the
+   frequency passed to pit_configure_channel() above its minimum
+   of 19 Hz, which in turn keeps the interval inside the PIT's
+   16-bit counter. */
+#define TICKLESS_MAX (TIMER_FREQ / 19)
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* Number of time stamp counter (TSC) cycles per timer tick, and
+   the TSC value at the moment of calibration.  Initialized by
+   timer_calibrate(); zero until then, which timer_now_ns() and
+   timer_usleep() treat as "fall back to tick granularity". */
+static uint64_t tsc_per_tick;
+static uint64_t tsc_base;
+
+/* Number of ticks the TSC is calibrated over.  More ticks give a
+   finer estimate but lengthen boot. */
+#define TSC_CAL_TICKS 10
+
+/* The time page, mapped read-only into every user process so
+   that user code reads the clock without a trap.  The layout
+   must match struct time_page in lib/user/time.h.  The sequence
+   number is odd while the interrupt handler updates the tick
+   count, so a user reader on 32-bit loads retries instead of
+   seeing a torn 64-bit value. */
+struct time_page
+  {
+    unsigned seq;               /* Even when stable, odd mid-update. */
+    int64_t ticks;              /* Timer ticks since boot. */
+    int freq;                   /* Timer ticks per second. */
+    uint64_t tsc_per_tick;      /* TSC cycles per tick; 0 before
+                                   calibration. */
+    uint64_t tsc_base;          /* TSC value at calibration. */
+  };
+
+/* The page itself.  The union pads it to a full page of zeros,
+   so mapping it leaks no neighboring kernel data. */
+static union
+  {
+    struct time_page tp;
+    uint8_t pad[PGSIZE];
+  }
+time_page __attribute__ ((aligned (PGSIZE)));
+
+/* Reads the CPU's time stamp counter, which counts core clock
+   cycles from reset.  See [IA32-v2b] "RDTSC". */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* The timer wheel.  Pending timeouts are hashed into buckets by
+   expiry tick modulo the wheel size, so setting or canceling a
+   timeout is an O(1) list operation no matter how many are
+   pending, and each tick touches only the one bucket whose turn
+   it is.  A bucket can also hold timeouts due a whole lap (or
+   more) of the wheel later; those are skipped, not removed, when
+   the bucket comes around. */
+#define TIMER_WHEEL_SIZE 256
+static struct list wheel[TIMER_WHEEL_SIZE];
+
+/* Protects the wheel's buckets and timeout_cnt, for queueing,
+   canceling, and the interrupt handler's bucket sweep.  The
+   clock read path takes no lock at all; see timer_ticks(). */
+static struct spinlock wheel_lock;
+
+/* Bucket holding timeouts that expire at tick TICK. */
+#define WHEEL_BUCKET(TICK) (&wheel[(TICK) & (TIMER_WHEEL_SIZE - 1)])
+
+/* Next tick whose bucket timer_interrupt() has not yet
+   processed.  Trails `ticks' by at most the tickless stretch,
+   which is far less than a full lap of the wheel. */
+static int64_t wheel_tick = 1;
+
+/* Number of timeouts pending on the wheel. */
+static size_t timeout_cnt;
+
 static intr_handler_func timer_interrupt;
+static int64_t next_expiry_within (int64_t span);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
@@ -33,67 +127,268 @@ static void real_time_delay (int64_t num, int32_t denom);
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
 void
-timer_init (void) 
+timer_init (void)
 {
+  int i;
+
   pit_configure_channel (0, 2, TIMER_FREQ);
+  spinlock_init (&wheel_lock);
+  for (i = 0; i < TIMER_WHEEL_SIZE; i++)
+    list_init (&wheel[i]);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Calibrates loops_per_tick, used to implement brief delays, and
+   the TSC, used for nanosecond timekeeping.  Prefers the
+   hypervisor's paravirtual clock when one is offered; see
+   devices/pvclock.c. */
 void
 timer_calibrate (void) 
 {
   unsigned high_bit, test_bit;
 
   ASSERT (intr_get_level () == INTR_ON);
-  printf ("Calibrating timer...  ");
 
-  /* Approximate loops_per_tick as the largest power-of-two
-     still less than one timer tick. */
-  loops_per_tick = 1u << 10;
-  while (!too_many_loops (loops_per_tick << 1)) 
+  if (pvclock_tsc_hz () != 0)
     {
-      loops_per_tick <<= 1;
-      ASSERT (loops_per_tick != 0);
+      /* The hypervisor told us the TSC frequency exactly, so skip
+         both tick-counting loops below: they cost a noticeable
+         slice of boot and, worse, a loaded host can deschedule us
+         mid-loop and skew the result.  Derive loops_per_tick by
+         timing a short busy_wait() against the known TSC instead;
+         the shortest of a few runs discards any that an interrupt
+         landed in. */
+      uint64_t best = (uint64_t) -1;
+      int i;
+
+      tsc_per_tick = pvclock_tsc_hz () / TIMER_FREQ;
+      tsc_base = rdtsc ();
+
+      for (i = 0; i < 4; i++)
+        {
+          uint64_t start = rdtsc (), elapsed;
+
+          busy_wait (1 << 16);
+          elapsed = rdtsc () - start;
+          if (elapsed < best)
+            best = elapsed;
+        }
+      loops_per_tick = (uint64_t) (1 << 16) * tsc_per_tick / best;
+
+      printf ("Calibrating timer...  %'"PRIu64" loops/s (kvmclock).\n",
+              (uint64_t) loops_per_tick * TIMER_FREQ);
+      printf ("Calibrating TSC...  %'"PRIu64" cycles/s (kvmclock).\n",
+              tsc_per_tick * TIMER_FREQ);
+    }
+  else
+    {
+      printf ("Calibrating timer...  ");
+
+      /* Approximate loops_per_tick as the largest power-of-two
+         still less than one timer tick. */
+      loops_per_tick = 1u << 10;
+      while (!too_many_loops (loops_per_tick << 1))
+        {
+          loops_per_tick <<= 1;
+          ASSERT (loops_per_tick != 0);
+        }
+
+      /* Refine the next 8 bits of loops_per_tick. */
+      high_bit = loops_per_tick;
+      for (test_bit = high_bit >> 1; test_bit != high_bit >> 10;
+           test_bit >>= 1)
+        if (!too_many_loops (high_bit | test_bit))
+          loops_per_tick |= test_bit;
+
+      printf ("%'"PRIu64" loops/s.\n",
+              (uint64_t) loops_per_tick * TIMER_FREQ);
+
+      /* Calibrate the TSC against the PIT: count cycles across
+         TSC_CAL_TICKS whole ticks. */
+      {
+        int64_t start;
+        uint64_t tsc_start;
+
+        start = ticks;
+        while (ticks == start)
+          barrier ();
+        tsc_start = rdtsc ();
+        start = ticks;
+        while (ticks - start < TSC_CAL_TICKS)
+          barrier ();
+        tsc_per_tick = (rdtsc () - tsc_start) / TSC_CAL_TICKS;
+        tsc_base = tsc_start;
+        printf ("Calibrating TSC...  %'"PRIu64" cycles/s.\n",
+                tsc_per_tick * TIMER_FREQ);
+      }
     }
 
-  /* Refine the next 8 bits of loops_per_tick. */
-  high_bit = loops_per_tick;
-  for (test_bit = high_bit >> 1; test_bit != high_bit >> 10; test_bit >>= 1)
-    if (!too_many_loops (high_bit | test_bit))
-      loops_per_tick |= test_bit;
+  /* Publish the calibration to the time page, before any user
+     process exists to read it. */
+  time_page.tp.freq = TIMER_FREQ;
+  time_page.tp.tsc_per_tick = tsc_per_tick;
+  time_page.tp.tsc_base = tsc_base;
+}
 
-  printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+/* Returns the kernel address of the time page, for mapping into
+   a user process's address space. */
+void *
+timer_time_page (void)
+{
+  return &time_page;
 }
 
-/* Returns the number of timer ticks since the OS booted. */
+/* Returns the number of timer ticks since the OS booted.
+   Lock-free: the 64-bit count is read under the time page's
+   sequence number -- the same protocol user processes use -- and
+   reread in the rare case that a timer interrupt updated it
+   between the loads.  Measurement loops can therefore call this
+   as often as they like without perturbing interrupt latency. */
 int64_t
-timer_ticks (void) 
+timer_ticks (void)
 {
-  enum intr_level old_level = intr_disable ();
-  int64_t t = ticks;
-  intr_set_level (old_level);
+  unsigned seq;
+  int64_t t;
+
+  do
+    {
+      seq = time_page.tp.seq;
+      barrier ();
+      t = time_page.tp.ticks;
+      barrier ();
+    }
+  while (seq != time_page.tp.seq || seq % 2 != 0);
   return t;
 }
 
 /* Returns the number of timer ticks elapsed since THEN, which
    should be a value once returned by timer_ticks(). */
 int64_t
-timer_elapsed (int64_t then) 
+timer_elapsed (int64_t then)
 {
   return timer_ticks () - then;
 }
 
+/* Returns the number of nanoseconds elapsed since TSC
+   calibration, with sub-tick resolution.  Before calibration
+   completes this falls back to tick granularity. */
+int64_t
+timer_now_ns (void)
+{
+  uint64_t cycles, hz;
+
+  if (tsc_per_tick == 0)
+    return timer_ticks () * (1000 * 1000 * 1000 / TIMER_FREQ);
+
+  cycles = rdtsc () - tsc_base;
+  hz = tsc_per_tick * TIMER_FREQ;
+
+  /* Split the conversion so that neither product overflows
+     64 bits for any plausible clock rate. */
+  return (cycles / hz * 1000000000
+          + cycles % hz * 1000000000 / hz);
+}
+
+/* Returns the raw TSC value.  Unlike timer_now_ns(), this works
+   before timer_calibrate(); convert the difference of two
+   readings with timer_cycles_to_ns() once calibration has
+   run. */
+uint64_t
+timer_cycles (void)
+{
+  return rdtsc ();
+}
+
+/* Converts CYCLES, a difference of two timer_cycles() readings,
+   to nanoseconds.  Returns -1 if the TSC has not been calibrated
+   yet. */
+int64_t
+timer_cycles_to_ns (uint64_t cycles)
+{
+  uint64_t hz;
+
+  if (tsc_per_tick == 0)
+    return -1;
+  hz = tsc_per_tick * TIMER_FREQ;
+  return cycles / hz * 1000000000 + cycles % hz * 1000000000 / hz;
+}
+
+/* Queues T to call FUNC with argument AUX after DELAY timer
+   ticks.  A timeout that is never canceled fires exactly once,
+   from the timer interrupt handler; see struct timeout for the
+   constraints on FUNC.  Queueing is O(1) regardless of how many
+   timeouts are pending. */
+void
+timeout_set (struct timeout *t, int64_t delay,
+             timer_timeout_func *func, void *aux)
+{
+  ASSERT (delay > 0);
+
+  spinlock_acquire (&wheel_lock);
+  t->expire_tick = ticks + delay;
+  t->func = func;
+  t->aux = aux;
+  t->queued = true;
+  list_push_back (WHEEL_BUCKET (t->expire_tick), &t->elem);
+  timeout_cnt++;
+  spinlock_release (&wheel_lock);
+}
+
+/* Cancels T if it has not fired yet.  Returns true if T was
+   still pending and is now removed, false if it already fired
+   (or was never set).  Cancellation is O(1): the common case of
+   a timeout that never fires -- a per-connection watchdog, say
+   -- costs two list operations over its whole lifetime. */
+bool
+timeout_cancel (struct timeout *t)
+{
+  bool canceled;
+
+  spinlock_acquire (&wheel_lock);
+  canceled = t->queued;
+  if (canceled)
+    {
+      list_remove (&t->elem);
+      t->queued = false;
+      timeout_cnt--;
+    }
+  spinlock_release (&wheel_lock);
+  return canceled;
+}
+
+/* Timeout callback for timer_sleep(): wakes the sleeper. */
+static void
+wake_sleeper (void *thread_)
+{
+  thread_unblock (thread_);
+}
+
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+   be turned on.
+
+   The caller blocks until the timer interrupt handler finds that
+   its wakeup time has arrived, so sleeping threads consume no
+   CPU.  The timeout lives on the caller's stack, which is safe
+   because the caller cannot return before the timeout fires and
+   unblocks it. */
 void
-timer_sleep (int64_t ticks) 
+timer_sleep (int64_t ticks)
 {
-  int64_t start = timer_ticks ();
+  struct timeout t;
+  enum intr_level old_level;
 
   ASSERT (intr_get_level () == INTR_ON);
-  while (timer_elapsed (start) < ticks) 
-    thread_yield ();
+
+  if (ticks <= 0)
+    return;
+
+  /* Interrupts must be off between queueing the timeout and
+     blocking, so that the timer interrupt cannot try to wake us
+     before we have gone to sleep. */
+  old_level = intr_disable ();
+  timeout_set (&t, ticks, wake_sleeper, thread_current ());
+  thread_block ();
+  intr_set_level (old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -105,11 +400,31 @@ timer_msleep (int64_t ms)
 }
 
 /* Sleeps for approximately US microseconds.  Interrupts must be
-   turned on. */
+   turned on.
+
+   Once the TSC is calibrated this is a hybrid: intervals of two
+   ticks or more block in timer_sleep() for all whole ticks but
+   the last, and the remainder is spun away against
+   timer_now_ns(), giving sub-tick accuracy without burning a
+   whole tick of CPU. */
 void
-timer_usleep (int64_t us) 
+timer_usleep (int64_t us)
 {
-  real_time_sleep (us, 1000 * 1000);
+  int64_t deadline;
+
+  if (tsc_per_tick == 0)
+    {
+      real_time_sleep (us, 1000 * 1000);
+      return;
+    }
+
+  ASSERT (intr_get_level () == INTR_ON);
+
+  deadline = timer_now_ns () + us * 1000;
+  if (us >= 2 * (1000 * 1000 / TIMER_FREQ))
+    timer_sleep (udiv64_const (us * TIMER_FREQ, 1000 * 1000) - 1);
+  while (timer_now_ns () < deadline)
+    barrier ();
 }
 
 /* Sleeps for approximately NS nanoseconds.  Interrupts must be
@@ -161,17 +476,111 @@ timer_ndelay (int64_t ns)
 
 /* Prints timer statistics. */
 void
-timer_print_stats (void) 
+timer_print_stats (void)
 {
-  printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  printf ("Timer: %"PRId64" ticks, %zu timeouts pending\n",
+          timer_ticks (), timeout_cnt);
 }
 
 /* Timer interrupt handler. */
 static void
-timer_interrupt (struct intr_frame *args UNUSED)
+timer_interrupt (struct intr_frame *args)
 {
-  ticks++;
+  ticks += skip_ticks;
+
+  /* Publish the new tick count to the time page under the
+     sequence number, so user readers cannot see a torn value. */
+  time_page.tp.seq++;
+  barrier ();
+  time_page.tp.ticks = ticks;
+  barrier ();
+  time_page.tp.seq++;
+
+  if (skip_ticks > 1)
+    {
+      /* A tickless-idle stretch just ended; return the PIT to
+         the normal rate. */
+      skip_ticks = 1;
+      pit_configure_channel (0, 2, TIMER_FREQ);
+    }
   thread_tick ();
+  profile_tick ((void *) args->eip);
+
+  /* Fire the timeouts whose time has come.  Only the buckets for
+     the ticks that just elapsed are touched, so the cost is
+     proportional to expirations, not to the number of timeouts
+     pending.  Entries hashed into a due bucket but belonging to
+     a later lap of the wheel are skipped in place.  Callbacks
+     run under the wheel lock, so they must not set or cancel
+     timeouts; today the callbacks are wake_sleeper() and
+     cond_timeout_expired() in synch.c, and both obey. */
+  spinlock_acquire (&wheel_lock);
+  while (wheel_tick <= ticks)
+    {
+      struct list *bucket = WHEEL_BUCKET (wheel_tick);
+      struct list_elem *e = list_begin (bucket);
+
+      while (e != list_end (bucket))
+        {
+          struct timeout *t = list_entry (e, struct timeout, elem);
+          if (t->expire_tick <= ticks)
+            {
+              e = list_remove (e);
+              t->queued = false;
+              timeout_cnt--;
+              t->func (t->aux);
+            }
+          else
+            e = list_next (e);
+        }
+      wheel_tick++;
+    }
+  spinlock_release (&wheel_lock);
+
+  /* Tickless idle: if nothing but the idle thread can run,
+     program the PIT for one long interval reaching to the
+     earliest sleeper's deadline (or TICKLESS_MAX, whichever is
+     sooner) instead of taking that many empty ticks.  A device
+     interrupt that wakes a thread mid-stretch still runs it
+     immediately; only timer_ticks() lags, by at most
+     TICKLESS_MAX - 1 ticks, until the stretched interval
+     expires.  The 4.4BSD scheduler's once-a-second bookkeeping
+     keys off exact tick counts, so the stretch is skipped under
+     -mlfqs. */
+  if (timer_tickless && !thread_mlfqs && thread_idle_only ())
+    {
+      int64_t span = next_expiry_within (TICKLESS_MAX);
+
+      if (span > 1)
+        {
+          skip_ticks = span;
+          pit_configure_channel (0, 2, TIMER_FREQ / (int) span);
+        }
+    }
+}
+
+/* Returns the number of ticks until the next pending timeout
+   expires, or SPAN if none expires within SPAN ticks.  SPAN must
+   be much smaller than the wheel, so only the few buckets inside
+   the window are examined.  Called with interrupts off. */
+static int64_t
+next_expiry_within (int64_t span)
+{
+  int64_t i;
+
+  if (timeout_cnt == 0)
+    return span;
+  for (i = 1; i < span; i++)
+    {
+      struct list *bucket = WHEEL_BUCKET (ticks + i);
+      struct list_elem *e;
+
+      for (e = list_begin (bucket); e != list_end (bucket);
+           e = list_next (e))
+        if (list_entry (e, struct timeout, elem)->expire_tick == ticks + i)
+          return i;
+    }
+  return span;
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -1,17 +1,48 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
+/* If true, stretch the timer interval while the machine is idle.
+   Controlled by the kernel command-line option "-tickless". */
+extern bool timer_tickless;
+
+/* A cancelable timeout, queued on the timer wheel until it fires
+   or is canceled.  The caller provides the storage; the struct
+   must stay valid until the timeout fires or timeout_cancel()
+   returns.  FUNC runs in the timer interrupt handler, so it must
+   not sleep and should do little more than unblock a thread or
+   set a flag. */
+typedef void timer_timeout_func (void *aux);
+struct timeout
+  {
+    struct list_elem elem;      /* Element in a timer wheel bucket. */
+    int64_t expire_tick;        /* Tick count at which to fire. */
+    timer_timeout_func *func;   /* Function called at expiry. */
+    void *aux;                  /* Argument to FUNC. */
+    bool queued;                /* Currently pending on the wheel? */
+  };
+
 void timer_init (void);
 void timer_calibrate (void);
 
+/* Cancelable timeouts. */
+void timeout_set (struct timeout *, int64_t ticks,
+                  timer_timeout_func *, void *aux);
+bool timeout_cancel (struct timeout *);
+
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
+int64_t timer_now_ns (void);
+uint64_t timer_cycles (void);
+int64_t timer_cycles_to_ns (uint64_t cycles);
+void *timer_time_page (void);
 
 /* Sleep and yield the CPU to other threads. */
 void timer_sleep (int64_t ticks);
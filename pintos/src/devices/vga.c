@@ -26,6 +26,7 @@ static size_t cx, cy;
    The attribute at (x,y) is fb[y][x][1]. */
 static uint8_t (*fb)[COL_CNT][2];
 
+static void putc_have_lock (int c, enum intr_level old_level);
 static void clear_row (size_t y);
 static void cls (void);
 static void newline (void);
@@ -56,8 +57,38 @@ vga_putc (int c)
   enum intr_level old_level = intr_disable ();
 
   init ();
-  
-  switch (c) 
+  putc_have_lock (c, old_level);
+
+  /* Update cursor position. */
+  move_cursor ();
+
+  intr_set_level (old_level);
+}
+
+/* Writes the N characters at S to the VGA text display as a
+   batch: the whole string goes out within one interrupt-off
+   window and the hardware cursor registers are touched once at
+   the end, not once per character. */
+void
+vga_write (const char *s, size_t n)
+{
+  enum intr_level old_level = intr_disable ();
+
+  init ();
+  while (n-- > 0)
+    putc_have_lock (*s++, old_level);
+  move_cursor ();
+
+  intr_set_level (old_level);
+}
+
+/* Writes C to the framebuffer at the cursor position, without
+   updating the hardware cursor.  OLD_LEVEL is the interrupt
+   level to restore while beeping for '\a'. */
+static void
+putc_have_lock (int c, enum intr_level old_level)
+{
+  switch (c)
     {
     case '\n':
       newline ();
@@ -71,7 +102,7 @@ vga_putc (int c)
       if (cx > 0)
         cx--;
       break;
-      
+
     case '\r':
       cx = 0;
       break;
@@ -87,7 +118,7 @@ vga_putc (int c)
       speaker_beep ();
       intr_disable ();
       break;
-      
+
     default:
       fb[cy][cx][0] = c;
       fb[cy][cx][1] = GRAY_ON_BLACK;
@@ -95,11 +126,6 @@ vga_putc (int c)
         newline ();
       break;
     }
-
-  /* Update cursor position. */
-  move_cursor ();
-
-  intr_set_level (old_level);
 }
 
 /* Clears the screen and moves the cursor to the upper left. */
@@ -115,17 +141,16 @@ cls (void)
   move_cursor ();
 }
 
-/* Clears row Y to spaces. */
+/* Clears row Y to spaces, a character-attribute pair at a
+   time. */
 static void
-clear_row (size_t y) 
+clear_row (size_t y)
 {
+  uint16_t *row = (uint16_t *) fb[y];
   size_t x;
 
   for (x = 0; x < COL_CNT; x++)
-    {
-      fb[y][x][0] = ' ';
-      fb[y][x][1] = GRAY_ON_BLACK;
-    }
+    row[x] = ' ' | (GRAY_ON_BLACK << 8);
 }
 
 /* Advances the cursor to the first column in the next line on
@@ -0,0 +1,332 @@
+#include "devices/virtio-blk.h"
+#include <debug.h>
+#include <round.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Driver for virtio-blk devices, the paravirtualized disks QEMU
+   offers as an alternative to emulated IDE.  Instead of a port
+   write per word of data, the driver describes each transfer in
+   a descriptor ring in ordinary kernel memory, rings a doorbell,
+   and lets the hypervisor move the whole request at memcpy
+   speed; a single interrupt signals completion.  A multi-sector
+   request costs one descriptor chain and one doorbell no matter
+   its length, so the per-request overhead that dominates
+   emulated IDE PIO disappears.
+
+   This speaks the legacy ("transitional") virtio interface over
+   PCI port I/O, which is what qemu-system-i386's virtio-blk-pci
+   presents; the pintos wrapper's --virtio option attaches disks
+   this way. */
+
+/* PCI identification. */
+#define VIRTIO_VENDOR_ID 0x1af4
+#define VIRTIO_BLK_DEVICE_ID 0x1001     /* Transitional virtio-blk. */
+
+/* Legacy virtio registers, as offsets from BAR0. */
+#define VIRTIO_DEVICE_FEATURES 0x00     /* 32 bits, read only. */
+#define VIRTIO_GUEST_FEATURES 0x04      /* 32 bits, write only. */
+#define VIRTIO_QUEUE_PFN 0x08           /* 32 bits, page frame of ring. */
+#define VIRTIO_QUEUE_SIZE 0x0c          /* 16 bits, read only. */
+#define VIRTIO_QUEUE_SEL 0x0e           /* 16 bits, write only. */
+#define VIRTIO_QUEUE_NOTIFY 0x10        /* 16 bits, the doorbell. */
+#define VIRTIO_STATUS 0x12              /* 8 bits. */
+#define VIRTIO_ISR 0x13                 /* 8 bits; reading acknowledges. */
+#define VIRTIO_CONFIG 0x14              /* Device-specific configuration. */
+
+/* VIRTIO_STATUS bits. */
+#define VIRTIO_STATUS_ACK 0x01          /* Device noticed. */
+#define VIRTIO_STATUS_DRIVER 0x02       /* Driver attached. */
+#define VIRTIO_STATUS_DRIVER_OK 0x04    /* Driver ready. */
+
+/* virtio-blk configuration: 64-bit capacity in sectors. */
+#define VIRTIO_BLK_CAPACITY (VIRTIO_CONFIG + 0)
+
+/* Virtqueue descriptor. */
+struct vring_desc
+  {
+    uint64_t addr;              /* Physical address of buffer. */
+    uint32_t len;               /* Length in bytes. */
+    uint16_t flags;             /* VRING_DESC_F_*. */
+    uint16_t next;              /* Next descriptor if F_NEXT. */
+  };
+#define VRING_DESC_F_NEXT 1     /* Chain continues. */
+#define VRING_DESC_F_WRITE 2    /* Device writes this buffer. */
+
+/* Ring of descriptor chain heads the driver hands the device. */
+struct vring_avail
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Where the next entry will go. */
+    uint16_t ring[0];           /* q_size entries. */
+  };
+
+/* Ring of chain heads the device hands back when complete. */
+struct vring_used_elem
+  {
+    uint32_t id;                /* Head descriptor of completed chain. */
+    uint32_t len;               /* Bytes the device wrote. */
+  };
+struct vring_used
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Where the next entry will go. */
+    struct vring_used_elem ring[0];     /* q_size entries. */
+  };
+
+/* Request header and status the descriptors point at.  The
+   device reads TYPE and SECTOR and writes STATUS last, after the
+   data transfer. */
+struct virtio_blk_req
+  {
+    uint32_t type;              /* VIRTIO_BLK_T_*. */
+    uint32_t reserved;
+    uint64_t sector;            /* First sector. */
+    volatile uint8_t status;    /* VIRTIO_BLK_S_*, written by device. */
+  };
+#define VIRTIO_BLK_T_IN 0       /* Read. */
+#define VIRTIO_BLK_T_OUT 1      /* Write. */
+#define VIRTIO_BLK_S_OK 0
+
+/* A virtio-blk device. */
+struct virtio_blk
+  {
+    char name[8];               /* "vda", "vdb", ... */
+    uint16_t io;                /* BAR0 I/O port base. */
+    uint8_t irq;                /* PCI interrupt line. */
+
+    struct lock lock;           /* One request in flight at a time. */
+    struct semaphore done;      /* Upped by the interrupt handler. */
+
+    uint16_t q_size;            /* Descriptors in the virtqueue. */
+    struct vring_desc *desc;    /* Descriptor table. */
+    struct vring_avail *avail;  /* Driver-to-device ring. */
+    struct vring_used *used;    /* Device-to-driver ring. */
+    uint16_t used_idx;          /* used->idx last seen. */
+
+    struct virtio_blk_req *req; /* Header/status area. */
+  };
+
+/* Devices found, in probe order. */
+#define VIRTIO_BLK_MAX 4
+static struct virtio_blk *devices[VIRTIO_BLK_MAX];
+static int device_cnt;
+
+static struct block_operations virtio_blk_operations;
+static void interrupt_handler (struct intr_frame *);
+
+/* Performs one transfer of CNT sectors at SECTOR.  The whole
+   request is three descriptors -- header, data, status -- handed
+   to the device with one doorbell write; the completion
+   interrupt ups DONE.  Kernel memory is mapped linearly, so any
+   buffer is physically contiguous and vtop() of its start
+   describes all of it. */
+static void
+transfer (struct virtio_blk *d, block_sector_t sector, size_t cnt,
+          void *buffer, bool is_write)
+{
+  struct virtio_blk_req *r = d->req;
+
+  lock_acquire (&d->lock);
+
+  r->type = is_write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+  r->reserved = 0;
+  r->sector = sector;
+  r->status = 0xff;
+
+  d->desc[0].addr = vtop (r);
+  d->desc[0].len = offsetof (struct virtio_blk_req, status);
+  d->desc[0].flags = VRING_DESC_F_NEXT;
+  d->desc[0].next = 1;
+
+  d->desc[1].addr = vtop (buffer);
+  d->desc[1].len = cnt * BLOCK_SECTOR_SIZE;
+  d->desc[1].flags = VRING_DESC_F_NEXT | (is_write ? 0 : VRING_DESC_F_WRITE);
+  d->desc[1].next = 2;
+
+  d->desc[2].addr = vtop (r) + offsetof (struct virtio_blk_req, status);
+  d->desc[2].len = 1;
+  d->desc[2].flags = VRING_DESC_F_WRITE;
+  d->desc[2].next = 0;
+
+  d->avail->ring[d->avail->idx % d->q_size] = 0;
+  barrier ();
+  d->avail->idx++;
+  barrier ();
+  outw (d->io + VIRTIO_QUEUE_NOTIFY, 0);
+
+  sema_down (&d->done);
+  if (r->status != VIRTIO_BLK_S_OK)
+    PANIC ("%s: %s failed at sector %"PRDSNu" (status %d)",
+           d->name, is_write ? "write" : "read", sector, r->status);
+
+  lock_release (&d->lock);
+}
+
+static void
+virtio_blk_read (void *d_, block_sector_t sector, void *buffer)
+{
+  transfer (d_, sector, 1, buffer, false);
+}
+
+static void
+virtio_blk_write (void *d_, block_sector_t sector, const void *buffer)
+{
+  transfer (d_, sector, 1, (void *) buffer, true);
+}
+
+static void
+virtio_blk_read_multiple (void *d_, block_sector_t sector, size_t cnt,
+                          void *buffer)
+{
+  transfer (d_, sector, cnt, buffer, false);
+}
+
+static void
+virtio_blk_write_multiple (void *d_, block_sector_t sector, size_t cnt,
+                           const void *buffer)
+{
+  transfer (d_, sector, cnt, (void *) buffer, true);
+}
+
+static struct block_operations virtio_blk_operations =
+  {
+    virtio_blk_read,
+    virtio_blk_write,
+    virtio_blk_read_multiple,
+    virtio_blk_write_multiple,
+  };
+
+/* Interrupt handler.  Devices may share an interrupt line, so
+   every device is checked; reading ISR acknowledges and
+   deasserts the line. */
+static void
+interrupt_handler (struct intr_frame *f)
+{
+  int i;
+
+  for (i = 0; i < device_cnt; i++)
+    {
+      struct virtio_blk *d = devices[i];
+
+      if (f->vec_no != 0x20u + d->irq)
+        continue;
+      if ((inb (d->io + VIRTIO_ISR) & 1)
+          && d->used->idx != d->used_idx)
+        {
+          d->used_idx = d->used->idx;
+          sema_up (&d->done);
+        }
+    }
+}
+
+/* Sets up the virtqueue for D, which the legacy interface lays
+   out as one physically contiguous, page-aligned block: the
+   descriptor table and available ring, then the used ring on the
+   next page boundary. */
+static void
+setup_queue (struct virtio_blk *d)
+{
+  size_t front, pages;
+  uint8_t *ring;
+
+  outw (d->io + VIRTIO_QUEUE_SEL, 0);
+  d->q_size = inw (d->io + VIRTIO_QUEUE_SIZE);
+  ASSERT (d->q_size >= 4);
+
+  front = ROUND_UP (16 * d->q_size + 4 + 2 * d->q_size, PGSIZE);
+  pages = (front + ROUND_UP (4 + 8 * d->q_size, PGSIZE)) / PGSIZE;
+  ring = palloc_get_multiple (PAL_ASSERT | PAL_ZERO, pages);
+
+  d->desc = (struct vring_desc *) ring;
+  d->avail = (struct vring_avail *) (ring + 16 * d->q_size);
+  d->used = (struct vring_used *) (ring + front);
+  d->used_idx = 0;
+
+  outl (d->io + VIRTIO_QUEUE_PFN, vtop (ring) >> 12);
+}
+
+/* Probes for virtio-blk devices on the PCI bus and registers
+   each with the block layer, scanning it for partitions exactly
+   as the IDE driver does its disks. */
+void
+virtio_blk_init (void)
+{
+  int i;
+
+  for (i = 0; i < VIRTIO_BLK_MAX; i++)
+    {
+      struct pci_dev pd;
+      struct virtio_blk *d;
+      struct block *block;
+      block_sector_t capacity;
+      uint32_t bar0;
+      char extra_info[32];
+      int vec;
+      bool vec_used;
+      int j;
+
+      if (!pci_find (VIRTIO_VENDOR_ID, VIRTIO_BLK_DEVICE_ID, i, &pd))
+        break;
+
+      d = malloc (sizeof *d);
+      if (d == NULL)
+        PANIC ("virtio-blk: out of memory");
+      snprintf (d->name, sizeof d->name, "vd%c", 'a' + i);
+
+      bar0 = pci_read_cfg (&pd, PCI_BAR0, 4);
+      ASSERT (bar0 & 1);        /* Legacy registers are port I/O. */
+      d->io = bar0 & ~3u;
+      d->irq = pci_read_cfg (&pd, PCI_INTR_LINE, 1);
+      pci_write_cfg (&pd, PCI_COMMAND, 2,
+                     pci_read_cfg (&pd, PCI_COMMAND, 2)
+                     | PCI_CMD_IO | PCI_CMD_MASTER);
+
+      lock_init (&d->lock);
+      lock_set_name (&d->lock, d->name);
+      sema_init (&d->done, 0);
+
+      /* Reset, attach, and decline every optional feature: the
+         baseline device does all we need. */
+      outb (d->io + VIRTIO_STATUS, 0);
+      outb (d->io + VIRTIO_STATUS, VIRTIO_STATUS_ACK);
+      outb (d->io + VIRTIO_STATUS, VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER);
+      outl (d->io + VIRTIO_GUEST_FEATURES, 0);
+
+      setup_queue (d);
+
+      /* An interrupt line may be shared between devices; the
+         handler checks each, so register each vector once. */
+      vec = 0x20 + d->irq;
+      vec_used = false;
+      for (j = 0; j < device_cnt; j++)
+        vec_used = vec_used || devices[j]->irq == d->irq;
+      if (!vec_used)
+        intr_register_ext (vec, interrupt_handler, "virtio-blk");
+      devices[device_cnt++] = d;
+
+      outb (d->io + VIRTIO_STATUS,
+            VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER
+            | VIRTIO_STATUS_DRIVER_OK);
+
+      capacity = inl (d->io + VIRTIO_BLK_CAPACITY);
+      snprintf (extra_info, sizeof extra_info, "virtio-blk, queue %d",
+                d->q_size);
+      block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
+                              &virtio_blk_operations, d);
+      /* Each device has its own virtqueue, so each transfers
+         independently of the others and of the IDE channels. */
+      block_set_channel (block, 2 + i);
+      partition_scan (block);
+    }
+}
@@ -0,0 +1,506 @@
+#include "filesys/cache.h"
+#include <cachestat.h>
+#include <debug.h>
+#include <list.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+
+/* Buffer cache for file system sectors.
+
+   Holds up to CACHE_SIZE recently used sectors in memory so that
+   repeated accesses to hot data (inodes, directories, the free
+   map) do not hit the disk each time.  Entries are kept on a list
+   in least-recently-used order; a miss on a full cache evicts the
+   front of the list, writing it back first if it is dirty.
+
+   Entries are tagged metadata or data, and entries holding plain
+   file data may fill at most DATA_MAX slots: a large sequential
+   scan is confined to that partition instead of flushing the hot
+   inode, directory and free-map sectors everything else depends
+   on.  An entry may also be pinned, which exempts it from both
+   eviction and write-behind while its sector is being modified;
+   the journal pins each logged sector until the transaction
+   commits, so a half-updated metadata sector never reaches its
+   home location ahead of the journal record.
+
+   A single lock serializes cache operations.  Since the block
+   layer serializes disk access anyway, finer-grained locking
+   would buy little here. */
+
+/* Number of cached sectors.  64 sectors is 32 kB of data. */
+#define CACHE_SIZE 64
+
+/* Upper bound on entries holding plain file data.  Metadata is
+   never squeezed below the remainder. */
+#define DATA_MAX (CACHE_SIZE / 2)
+
+/* Interval between write-behind passes, in timer ticks. */
+#define FLUSH_INTERVAL TIMER_FREQ
+
+/* A cached sector. */
+struct cache_entry
+  {
+    block_sector_t sector;              /* Sector number, if valid. */
+    bool valid;                         /* Does this entry hold a sector? */
+    bool dirty;                         /* Modified since read from disk? */
+    enum cache_type type;               /* Metadata or file data? */
+    int pin_cnt;                        /* Pins outstanding; a pinned entry
+                                           is neither evicted nor flushed. */
+    struct list_elem elem;              /* Element in lru_list. */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Sector contents. */
+  };
+
+static struct cache_entry cache[CACHE_SIZE];
+
+/* All cache entries, least recently used first. */
+static struct list lru_list;
+
+/* Entries currently tagged CACHE_DATA, to enforce DATA_MAX. */
+static size_t data_cnt;
+
+/* Protects the cache. */
+static struct lock cache_lock;
+
+/* Hit/miss/eviction counts, for the "cachestat" action. */
+static struct cache_stats cache_stats;
+
+/* A sector queued for asynchronous read-ahead, run as a
+   workqueue item. */
+struct readahead_request
+  {
+    struct work work;                   /* Workqueue item. */
+    block_sector_t sector;              /* Sector to prefetch. */
+  };
+
+/* Protects readahead_cnt. */
+static struct lock readahead_lock;
+
+/* Upper bound on outstanding read-ahead requests.  Beyond this
+   the workers are hopelessly behind and further hints are
+   dropped. */
+#define READAHEAD_MAX 64
+static size_t readahead_cnt;
+
+/* Slab cache for readahead requests. */
+static struct slab_cache *readahead_cache;
+
+static struct cache_entry *cache_find (block_sector_t);
+static struct cache_entry *cache_get (block_sector_t, bool load,
+                                      enum cache_type);
+static thread_func flush_daemon;
+static thread_func readahead_work;
+
+/* Initializes the buffer cache and starts the write-behind
+   daemon. */
+void
+cache_init (void)
+{
+  int i;
+
+  lock_init (&cache_lock);
+  lock_set_name (&cache_lock, "cache");
+  lock_set_adaptive (&cache_lock, true);
+  list_init (&lru_list);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      cache[i].valid = false;
+      cache[i].pin_cnt = 0;
+      list_push_back (&lru_list, &cache[i].elem);
+    }
+
+  cache_stats.name = "buffer";
+  cache_stats.size = CACHE_SIZE;
+  cache_stats_register (&cache_stats);
+
+  lock_init (&readahead_lock);
+  readahead_cache = slab_create ("readahead", sizeof (struct readahead_request));
+  if (readahead_cache == NULL)
+    PANIC ("Failed to create readahead slab cache");
+
+  thread_create ("flushd", PRI_MIN, flush_daemon, NULL);
+}
+
+/* Queues SECTOR to be read into the cache in the background.
+   Callers use this to prefetch the next sector of a file being
+   read sequentially, so that by the time it is wanted it is
+   already in memory.  The hint is dropped if memory is short or
+   the queue is full; read-ahead is only an optimization. */
+void
+cache_readahead (block_sector_t sector)
+{
+  struct readahead_request *req;
+  bool room;
+
+  /* Speculative work is the first thing to give up memory. */
+  if (palloc_under_pressure ())
+    return;
+
+  req = slab_alloc (readahead_cache);
+  if (req == NULL)
+    return;
+  req->sector = sector;
+
+  lock_acquire (&readahead_lock);
+  room = readahead_cnt < READAHEAD_MAX;
+  if (room)
+    readahead_cnt++;
+  lock_release (&readahead_lock);
+
+  if (room)
+    workqueue_submit (&req->work, readahead_work, req, PRI_MIN);
+  else
+    slab_free (readahead_cache, req);
+}
+
+/* Workqueue item: faults one prefetched sector into the
+   cache. */
+static void
+readahead_work (void *req_)
+{
+  struct readahead_request *req = req_;
+
+  lock_acquire (&cache_lock);
+  cache_get (req->sector, true, CACHE_DATA);
+  lock_release (&cache_lock);
+
+  lock_acquire (&readahead_lock);
+  readahead_cnt--;
+  lock_release (&readahead_lock);
+  slab_free (readahead_cache, req);
+}
+
+/* Write-behind daemon.  Wakes up periodically and writes all
+   dirty cache entries back to disk, so that a cached write does
+   not stay memory-only indefinitely and the dirty data lost in a
+   crash is bounded by FLUSH_INTERVAL. */
+static void
+flush_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (FLUSH_INTERVAL);
+      free_map_flush ();
+      cache_flush ();
+      /* Only after the data sectors above are durable may the
+         inode lengths that cover them be journaled; the
+         checkpoint below then carries them home. */
+      inode_flush_all ();
+      journal_checkpoint ();
+    }
+}
+
+/* Returns the cache entry holding SECTOR, or a null pointer if
+   it is not cached.  Does not touch the LRU order.  cache_lock
+   must be held. */
+static struct cache_entry *
+cache_find (block_sector_t sector)
+{
+  struct list_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  for (e = list_begin (&lru_list); e != list_end (&lru_list);
+       e = list_next (e))
+    {
+      struct cache_entry *ce = list_entry (e, struct cache_entry, elem);
+      if (ce->valid && ce->sector == sector)
+        return ce;
+    }
+  return NULL;
+}
+
+/* Returns the cache entry holding SECTOR, reading it from disk
+   on a miss if LOAD is true.  (A caller about to overwrite the
+   whole sector passes false to skip the useless read.)  Evicts
+   the least recently used unpinned entry if necessary -- a data
+   sector that would push the data tier past DATA_MAX may only
+   displace another data entry -- and marks the returned entry
+   most recently used.  cache_lock must be held. */
+static struct cache_entry *
+cache_get (block_sector_t sector, bool load, enum cache_type type)
+{
+  struct cache_entry *ce = cache_find (sector);
+  struct list_elem *e;
+
+  if (ce != NULL)
+    {
+      counter_inc (&cache_stats.hits);
+      goto found;
+    }
+
+  /* Miss.  Pick an eviction victim. */
+  counter_inc (&cache_stats.misses);
+  ce = NULL;
+  for (e = list_begin (&lru_list); e != list_end (&lru_list);
+       e = list_next (e))
+    {
+      struct cache_entry *c = list_entry (e, struct cache_entry, elem);
+      if (c->pin_cnt > 0)
+        continue;
+      if (type == CACHE_DATA && data_cnt >= DATA_MAX
+          && c->valid && c->type != CACHE_DATA)
+        continue;
+      ce = c;
+      break;
+    }
+  if (ce == NULL)
+    PANIC ("buffer cache: every evictable entry is pinned");
+
+  if (ce->valid)
+    counter_inc (&cache_stats.evictions);
+  if (ce->valid && ce->dirty)
+    block_write (fs_device, ce->sector, ce->data);
+  if (ce->valid && ce->type == CACHE_DATA)
+    data_cnt--;
+  ce->sector = sector;
+  ce->valid = true;
+  ce->dirty = false;
+  ce->type = type;
+  if (type == CACHE_DATA)
+    data_cnt++;
+  if (load)
+    block_read (fs_device, sector, ce->data);
+
+ found:
+  /* A sector changes roles when it is freed and reallocated;
+     keep the tier accounting in step with the latest caller. */
+  if (ce->type != type)
+    {
+      if (ce->type == CACHE_DATA)
+        data_cnt--;
+      else
+        data_cnt++;
+      ce->type = type;
+    }
+  list_remove (&ce->elem);
+  list_push_back (&lru_list, &ce->elem);
+  return ce;
+}
+
+/* Pins SECTOR's entry in the cache, reading it from disk if it
+   is not resident.  Until the matching cache_unpin(), the entry
+   is neither evicted nor written back by write-behind, so a
+   sector under active modification cannot reach the disk
+   half-updated.  Pins nest. */
+void
+cache_pin (block_sector_t sector)
+{
+  lock_acquire (&cache_lock);
+  cache_get (sector, true, CACHE_META)->pin_cnt++;
+  lock_release (&cache_lock);
+}
+
+/* Releases one pin on SECTOR. */
+void
+cache_unpin (block_sector_t sector)
+{
+  struct cache_entry *ce;
+
+  lock_acquire (&cache_lock);
+  ce = cache_find (sector);
+  ASSERT (ce != NULL && ce->pin_cnt > 0);
+  ce->pin_cnt--;
+  lock_release (&cache_lock);
+}
+
+/* Reads SIZE bytes starting at byte offset SECTOR_OFS within
+   SECTOR into BUFFER.  TYPE says whether the sector holds
+   metadata or file data. */
+void
+cache_read (block_sector_t sector, void *buffer, int sector_ofs, int size,
+            enum cache_type type)
+{
+  struct cache_entry *ce;
+
+  ASSERT (sector_ofs >= 0 && size >= 0);
+  ASSERT (sector_ofs + size <= BLOCK_SECTOR_SIZE);
+
+  lock_acquire (&cache_lock);
+  ce = cache_get (sector, true, type);
+  memcpy (buffer, ce->data + sector_ofs, size);
+  lock_release (&cache_lock);
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR starting at byte
+   offset SECTOR_OFS.  The data goes to disk when the entry is
+   evicted or the cache is flushed.  TYPE says whether the sector
+   holds metadata or file data. */
+void
+cache_write (block_sector_t sector, const void *buffer, int sector_ofs,
+             int size, enum cache_type type)
+{
+  struct cache_entry *ce;
+
+  ASSERT (sector_ofs >= 0 && size >= 0);
+  ASSERT (sector_ofs + size <= BLOCK_SECTOR_SIZE);
+
+  lock_acquire (&cache_lock);
+  /* A write that covers the whole sector need not read the old
+     contents from disk first. */
+  ce = cache_get (sector, sector_ofs > 0 || size < BLOCK_SECTOR_SIZE, type);
+  memcpy (ce->data + sector_ofs, buffer, size);
+  ce->dirty = true;
+  lock_release (&cache_lock);
+
+  /* A sector dirtied inside a metadata transaction is logged in
+     the journal. */
+  if (journal_active ())
+    journal_log (sector);
+}
+
+/* Reads CNT consecutive whole sectors starting at SECTOR into
+   BUFFER, bypassing the cache's data copy.  Sectors already
+   cached are copied from the cache, since it may hold dirty data
+   newer than the disk; runs of uncached sectors go straight from
+   disk to BUFFER in a single request each and are not cached, so
+   a large streaming read does not evict the whole cache. */
+void
+cache_read_direct (block_sector_t sector, size_t cnt, void *buffer_)
+{
+  uint8_t *buffer = buffer_;
+
+  lock_acquire (&cache_lock);
+  while (cnt > 0)
+    {
+      struct cache_entry *ce = cache_find (sector);
+      size_t run = 1;
+
+      if (ce != NULL)
+        {
+          memcpy (buffer, ce->data, BLOCK_SECTOR_SIZE);
+          list_remove (&ce->elem);
+          list_push_back (&lru_list, &ce->elem);
+        }
+      else
+        {
+          while (run < cnt && cache_find (sector + run) == NULL)
+            run++;
+          block_read_multiple (fs_device, sector, run, buffer);
+        }
+
+      sector += run;
+      cnt -= run;
+      buffer += run * BLOCK_SECTOR_SIZE;
+    }
+  lock_release (&cache_lock);
+}
+
+/* Writes CNT consecutive whole sectors from BUFFER starting at
+   SECTOR, bypassing the cache's data copy.  Sectors already
+   cached are updated in place and left dirty so later readers
+   see the new data; runs of uncached sectors go straight from
+   BUFFER to disk in a single request each. */
+void
+cache_write_direct (block_sector_t sector, size_t cnt, const void *buffer_)
+{
+  const uint8_t *buffer = buffer_;
+
+  /* Writes inside a metadata transaction must pass through the
+     journal's logging path, sector by sector. */
+  if (journal_active ())
+    {
+      size_t i;
+
+      for (i = 0; i < cnt; i++)
+        cache_write (sector + i, buffer + i * BLOCK_SECTOR_SIZE, 0,
+                     BLOCK_SECTOR_SIZE, CACHE_META);
+      return;
+    }
+
+  lock_acquire (&cache_lock);
+  while (cnt > 0)
+    {
+      struct cache_entry *ce = cache_find (sector);
+      size_t run = 1;
+
+      if (ce != NULL)
+        {
+          memcpy (ce->data, buffer, BLOCK_SECTOR_SIZE);
+          ce->dirty = true;
+          list_remove (&ce->elem);
+          list_push_back (&lru_list, &ce->elem);
+        }
+      else
+        {
+          while (run < cnt && cache_find (sector + run) == NULL)
+            run++;
+          block_write_multiple (fs_device, sector, run, buffer);
+        }
+
+      sector += run;
+      cnt -= run;
+      buffer += run * BLOCK_SECTOR_SIZE;
+    }
+  lock_release (&cache_lock);
+}
+
+/* Sectors coalesced into a single write during a flush.  A run
+   of physically contiguous dirty sectors is copied into
+   flush_buf and submitted as one device command; the window
+   bounds the copy, so a fully dirty sequential cache flushes in
+   two commands instead of sixty-four. */
+#define FLUSH_WINDOW 32
+static uint8_t flush_buf[FLUSH_WINDOW * BLOCK_SECTOR_SIZE];
+
+/* Writes all dirty cache entries back to disk.  They stay cached
+   clean.  The dirty set is sorted by sector and contiguous runs
+   go out as single multi-sector commands, so writeback cost
+   tracks the number of dirty extents, not dirty sectors.
+   Pinned entries are skipped: their sectors are mid modification
+   and go to disk after the pin is dropped. */
+void
+cache_flush (void)
+{
+  struct cache_entry *dirty[CACHE_SIZE];
+  size_t cnt = 0, i, j;
+
+  lock_acquire (&cache_lock);
+
+  /* Collect the dirty entries, insertion-sorted by sector, so
+     that physically contiguous sectors end up adjacent. */
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *ce = &cache[i];
+      if (ce->valid && ce->dirty && ce->pin_cnt == 0)
+        {
+          for (j = cnt; j > 0 && dirty[j - 1]->sector > ce->sector; j--)
+            dirty[j] = dirty[j - 1];
+          dirty[j] = ce;
+          cnt++;
+        }
+    }
+
+  /* Write each run of contiguous sectors as one request. */
+  i = 0;
+  while (i < cnt)
+    {
+      size_t run = 1;
+
+      while (i + run < cnt && run < FLUSH_WINDOW
+             && dirty[i + run]->sector == dirty[i]->sector + run)
+        run++;
+      if (run == 1)
+        block_write (fs_device, dirty[i]->sector, dirty[i]->data);
+      else
+        {
+          for (j = 0; j < run; j++)
+            memcpy (flush_buf + j * BLOCK_SECTOR_SIZE, dirty[i + j]->data,
+                    BLOCK_SECTOR_SIZE);
+          block_write_multiple (fs_device, dirty[i]->sector, run, flush_buf);
+        }
+      for (j = 0; j < run; j++)
+        dirty[i + j]->dirty = false;
+      i += run;
+    }
+
+  lock_release (&cache_lock);
+}
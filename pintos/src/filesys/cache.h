@@ -0,0 +1,29 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include "devices/block.h"
+#include "filesys/off_t.h"
+
+/* What a cached sector holds.  Metadata is what the rest of the
+   workload waits on, so the cache retains it preferentially; see
+   cache.c. */
+enum cache_type
+  {
+    CACHE_DATA,                 /* Ordinary file contents. */
+    CACHE_META                  /* Inode, index, directory, free-map
+                                   or journal sectors. */
+  };
+
+void cache_init (void);
+void cache_read (block_sector_t, void *buffer, int sector_ofs, int size,
+                 enum cache_type);
+void cache_read_direct (block_sector_t, size_t cnt, void *buffer);
+void cache_readahead (block_sector_t);
+void cache_write (block_sector_t, const void *buffer, int sector_ofs,
+                  int size, enum cache_type);
+void cache_write_direct (block_sector_t, size_t cnt, const void *buffer);
+void cache_pin (block_sector_t);
+void cache_unpin (block_sector_t);
+void cache_flush (void);
+
+#endif /* filesys/cache.h */
@@ -1,18 +1,25 @@
 #include "filesys/directory.h"
+#include <cachestat.h>
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 
 /* A directory. */
-struct dir 
+struct dir
   {
     struct inode *inode;                /* Backing store. */
+    struct dir_index *index;            /* Name index, or null. */
     off_t pos;                          /* Current position. */
   };
 
+/* Slab cache for struct dir, created on first use. */
+static struct slab_cache *dir_cache;
+
 /* A single directory entry. */
 struct dir_entry 
   {
@@ -21,31 +28,369 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
-/* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+/* In-memory index of one directory's entries, shared by every
+   open handle on that directory and kept in step with it, so
+   name lookups cost a hash probe instead of reading the whole
+   directory from the inode.  A directory whose index cannot be
+   allocated still works; lookups just fall back to the scan.
+
+   Indexes survive the last close: up to DIR_INDEX_CACHE of them
+   sit on an idle list, so a path walked repeatedly finds each
+   component's index already built and skips the directory reads
+   entirely.  Removing a directory detaches its index so a later
+   reuse of the sector cannot see stale entries.
+
+   The index also keeps the offsets of the directory's free entry
+   slots, collected by the same scan that builds it, so that
+   dir_add() allocates a slot with one list pop and one entry
+   write instead of rereading the whole directory. */
+struct dir_index
+  {
+    block_sector_t sector;              /* Directory inode's sector. */
+    int open_cnt;                       /* Handles using this index. */
+    bool detached;                      /* Directory removed: destroy on
+                                           last close, never cache. */
+    struct hash entries;                /* Entries, hashed by name. */
+    struct list free_slots;             /* Offsets of free entry slots. */
+    struct hash_elem elem;              /* Element in dir_indexes. */
+    struct list_elem lru_elem;          /* Element in idle_indexes. */
+  };
+
+/* Idle (fully closed) indexes kept as a cache, oldest first. */
+#define DIR_INDEX_CACHE 16
+static struct list idle_indexes = LIST_INITIALIZER (idle_indexes);
+static size_t idle_cnt;
+
+/* One free entry slot recorded in a directory index. */
+struct free_slot
+  {
+    off_t ofs;                          /* Slot's offset in the inode. */
+    struct list_elem elem;              /* Element in free_slots. */
+  };
+
+/* One name in a directory index. */
+struct index_entry
+  {
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+    block_sector_t inode_sector;        /* Sector number of header. */
+    off_t ofs;                          /* Entry's offset in the inode. */
+    struct hash_elem elem;              /* Element in dir_index. */
+  };
+
+/* All live directory indexes, hashed by inode sector. */
+static struct hash dir_indexes;
+static bool dir_indexes_inited;
+
+/* Hit/miss/eviction counts, for the "cachestat" action.  A hit
+   is an index found already built, whether open or idle; a miss
+   builds one from the directory's contents. */
+static struct cache_stats index_stats;
+
+/* Hashes the index entry E by its name. */
+static unsigned
+index_entry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_string (hash_entry (e, struct index_entry, elem)->name);
+}
+
+/* Orders index entries A and B by name. */
+static bool
+index_entry_less (const struct hash_elem *a, const struct hash_elem *b,
+                  void *aux UNUSED)
+{
+  return strcmp (hash_entry (a, struct index_entry, elem)->name,
+                 hash_entry (b, struct index_entry, elem)->name) < 0;
+}
+
+/* Frees the index entry E on index destruction. */
+static void
+index_entry_destructor (struct hash_elem *e, void *aux UNUSED)
+{
+  free (hash_entry (e, struct index_entry, elem));
+}
+
+/* Hashes the directory index E by its inode sector. */
+static unsigned
+dir_index_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct dir_index, elem)->sector);
+}
+
+/* Orders directory indexes A and B by inode sector. */
+static bool
+dir_index_less (const struct hash_elem *a, const struct hash_elem *b,
+                void *aux UNUSED)
+{
+  return hash_entry (a, struct dir_index, elem)->sector
+    < hash_entry (b, struct dir_index, elem)->sector;
+}
+
+/* Adds NAME -> (INODE_SECTOR, OFS) to INDEX.  Quietly does
+   nothing if memory is short; a missed insertion only costs the
+   index, not correctness, because misses fall back to scanning. */
+static void
+index_insert (struct dir_index *index, const char *name,
+              block_sector_t inode_sector, off_t ofs)
+{
+  struct index_entry *ie;
+
+  if (index == NULL)
+    return;
+  ie = malloc (sizeof *ie);
+  if (ie == NULL)
+    return;
+  strlcpy (ie->name, name, sizeof ie->name);
+  ie->inode_sector = inode_sector;
+  ie->ofs = ofs;
+  if (hash_insert (&index->entries, &ie->elem) != NULL)
+    free (ie);
+}
+
+/* Records that the entry slot at OFS in INDEX's directory is
+   free.  Quietly does nothing if memory is short: a forgotten
+   slot costs only the space, until a rebuild of the index finds
+   it again. */
+static void
+free_slot_put (struct dir_index *index, off_t ofs)
+{
+  struct free_slot *fs;
+
+  if (index == NULL)
+    return;
+  fs = malloc (sizeof *fs);
+  if (fs == NULL)
+    return;
+  fs->ofs = ofs;
+  list_push_back (&index->free_slots, &fs->elem);
+}
+
+/* Removes NAME from INDEX, if present. */
+static void
+index_delete (struct dir_index *index, const char *name)
+{
+  struct index_entry key;
+  struct hash_elem *e;
+
+  if (index == NULL)
+    return;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_delete (&index->entries, &key.elem);
+  if (e != NULL)
+    free (hash_entry (e, struct index_entry, elem));
+}
+
+/* Returns INDEX's entry for the LEN characters of NAME, or a
+   null pointer if absent or there is no index. */
+static struct index_entry *
+index_find (const struct dir_index *index, const char *name, size_t len)
+{
+  struct index_entry key;
+  struct hash_elem *e;
+
+  if (index == NULL || len > NAME_MAX)
+    return NULL;
+  memcpy (key.name, name, len);
+  key.name[len] = '\0';
+  e = hash_find (&((struct dir_index *) index)->entries, &key.elem);
+  return e != NULL ? hash_entry (e, struct index_entry, elem) : NULL;
+}
+
+/* Repoints NAME in the index for the directory at SECTOR, if
+   such an index exists and holds NAME, at INODE_SECTOR.  Used
+   when an entry is rewritten in place. */
+static void
+index_update (block_sector_t sector, const char *name,
+              block_sector_t inode_sector)
+{
+  struct dir_index key;
+  struct index_entry *ie;
+  struct hash_elem *e;
+
+  if (!dir_indexes_inited)
+    return;
+  key.sector = sector;
+  e = hash_find (&dir_indexes, &key.elem);
+  if (e == NULL)
+    return;
+  ie = index_find (hash_entry (e, struct dir_index, elem), name,
+                   strlen (name));
+  if (ie != NULL)
+    ie->inode_sector = inode_sector;
+}
+
+/* Returns the index for the directory held in INODE, building it
+   from the directory's contents if no handle has it open yet.
+   Returns a null pointer if memory is short. */
+static struct dir_index *
+index_open (struct inode *inode)
+{
+  struct dir_index key, *index;
+  struct hash_elem *e;
+  struct dir_entry de;
+  off_t ofs;
+
+  if (!dir_indexes_inited)
+    {
+      if (!hash_init (&dir_indexes, dir_index_hash, dir_index_less, NULL))
+        return NULL;
+      dir_indexes_inited = true;
+
+      index_stats.name = "dirindex";
+      index_stats.size = DIR_INDEX_CACHE;
+      cache_stats_register (&index_stats);
+    }
+
+  key.sector = inode_get_inumber (inode);
+  e = hash_find (&dir_indexes, &key.elem);
+  if (e != NULL)
+    {
+      index = hash_entry (e, struct dir_index, elem);
+      if (index->open_cnt++ == 0)
+        {
+          /* Revive an idle index. */
+          list_remove (&index->lru_elem);
+          idle_cnt--;
+        }
+      counter_inc (&index_stats.hits);
+      return index;
+    }
+
+  counter_inc (&index_stats.misses);
+  index = malloc (sizeof *index);
+  if (index == NULL)
+    return NULL;
+  index->sector = key.sector;
+  index->open_cnt = 1;
+  index->detached = false;
+  if (!hash_init (&index->entries, index_entry_hash, index_entry_less, NULL))
+    {
+      free (index);
+      return NULL;
+    }
+  list_init (&index->free_slots);
+
+  for (ofs = 0; inode_read_at (inode, &de, sizeof de, ofs) == sizeof de;
+       ofs += sizeof de)
+    if (de.in_use)
+      index_insert (index, de.name, de.inode_sector, ofs);
+    else
+      free_slot_put (index, ofs);
+
+  hash_insert (&dir_indexes, &index->elem);
+  return index;
+}
+
+/* Destroys INDEX outright. */
+static void
+index_destroy (struct dir_index *index)
+{
+  while (!list_empty (&index->free_slots))
+    free (list_entry (list_pop_front (&index->free_slots),
+                      struct free_slot, elem));
+  hash_destroy (&index->entries, index_entry_destructor);
+  free (index);
+}
+
+/* Drops one handle's reference to INDEX.  A fully closed index
+   moves to the idle cache rather than dying, evicting the oldest
+   idle index if the cache is full. */
+static void
+index_close (struct dir_index *index)
+{
+  if (index == NULL)
+    return;
+  if (--index->open_cnt == 0)
+    {
+      if (index->detached)
+        {
+          index_destroy (index);
+          return;
+        }
+
+      list_push_back (&idle_indexes, &index->lru_elem);
+      if (++idle_cnt > DIR_INDEX_CACHE)
+        {
+          struct dir_index *victim
+            = list_entry (list_pop_front (&idle_indexes),
+                          struct dir_index, lru_elem);
+
+          idle_cnt--;
+          hash_delete (&dir_indexes, &victim->elem);
+          index_destroy (victim);
+          counter_inc (&index_stats.evictions);
+        }
+    }
+}
+
+/* Forgets any index for the directory at SECTOR, called when the
+   directory is removed so a reused sector starts clean. */
+static void
+index_invalidate (block_sector_t sector)
+{
+  struct dir_index key, *index;
+  struct hash_elem *e;
+
+  if (!dir_indexes_inited)
+    return;
+  key.sector = sector;
+  e = hash_delete (&dir_indexes, &key.elem);
+  if (e == NULL)
+    return;
+  index = hash_entry (e, struct dir_index, elem);
+  if (index->open_cnt == 0)
+    {
+      list_remove (&index->lru_elem);
+      idle_cnt--;
+      index_destroy (index);
+    }
+  else
+    index->detached = true;
+}
+
+/* Creates a directory in the given SECTOR whose parent is the
+   directory in PARENT_SECTOR, with "." and ".." entries.  The
+   root directory is its own parent.  Returns true if successful,
+   false on failure. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector, block_sector_t parent_sector)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  struct dir *dir;
+  bool success;
+
+  if (!inode_create (sector, 2 * sizeof (struct dir_entry), true))
+    return false;
+
+  dir = dir_open (inode_open (sector));
+  if (dir == NULL)
+    return false;
+  success = dir_add (dir, ".", sector) && dir_add (dir, "..", parent_sector);
+  dir_close (dir);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
    it takes ownership.  Returns a null pointer on failure. */
 struct dir *
-dir_open (struct inode *inode) 
+dir_open (struct inode *inode)
 {
-  struct dir *dir = calloc (1, sizeof *dir);
+  struct dir *dir;
+
+  if (dir_cache == NULL)
+    dir_cache = slab_create ("dir", sizeof (struct dir));
+
+  dir = dir_cache != NULL ? slab_alloc (dir_cache) : NULL;
   if (inode != NULL && dir != NULL)
     {
       dir->inode = inode;
+      dir->index = index_open (inode);
       dir->pos = 0;
       return dir;
     }
   else
     {
       inode_close (inode);
-      free (dir);
-      return NULL; 
+      slab_free (dir_cache, dir);
+      return NULL;
     }
 }
 
@@ -71,8 +416,9 @@ dir_close (struct dir *dir)
 {
   if (dir != NULL)
     {
+      index_close (dir->index);
       inode_close (dir->inode);
-      free (dir);
+      slab_free (dir_cache, dir);
     }
 }
 
@@ -83,24 +429,46 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
-/* Searches DIR for a file with the given NAME.
+/* Searches DIR for a file named by the LEN characters of NAME,
+   which need not be null terminated.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
    otherwise, returns false and ignores EP and OFSP. */
 static bool
-lookup (const struct dir *dir, const char *name,
-        struct dir_entry *ep, off_t *ofsp) 
+lookup_len (const struct dir *dir, const char *name, size_t len,
+            struct dir_entry *ep, off_t *ofsp)
 {
   struct dir_entry e;
   size_t ofs;
-  
+
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (len > NAME_MAX)
+    return false;
+
+  /* The index answers in one hash probe when we have one. */
+  if (dir->index != NULL)
+    {
+      struct index_entry *ie = index_find (dir->index, name, len);
+
+      if (ie == NULL)
+        return false;
+      if (ep != NULL)
+        {
+          ep->inode_sector = ie->inode_sector;
+          strlcpy (ep->name, ie->name, sizeof ep->name);
+          ep->in_use = true;
+        }
+      if (ofsp != NULL)
+        *ofsp = ie->ofs;
+      return true;
+    }
+
   for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
+       ofs += sizeof e)
+    if (e.in_use && !memcmp (name, e.name, len) && e.name[len] == '\0')
       {
         if (ep != NULL)
           *ep = e;
@@ -111,13 +479,22 @@ lookup (const struct dir *dir, const char *name,
   return false;
 }
 
+/* Searches DIR for a file with the given null-terminated NAME;
+   see lookup_len(). */
+static bool
+lookup (const struct dir *dir, const char *name,
+        struct dir_entry *ep, off_t *ofsp)
+{
+  return lookup_len (dir, name, strlen (name), ep, ofsp);
+}
+
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
    a null pointer.  The caller must close *INODE. */
 bool
 dir_lookup (const struct dir *dir, const char *name,
-            struct inode **inode) 
+            struct inode **inode)
 {
   struct dir_entry e;
 
@@ -132,6 +509,101 @@ dir_lookup (const struct dir *dir, const char *name,
   return *inode != NULL;
 }
 
+/* Searches DIR for a file named by the path component COMP,
+   without copying the name anywhere; otherwise identical to
+   dir_lookup().  This is the hot call in path traversal. */
+bool
+dir_lookup_comp (const struct dir *dir, const struct path_comp *comp,
+                 struct inode **inode)
+{
+  struct dir_entry e;
+
+  ASSERT (dir != NULL);
+  ASSERT (comp != NULL);
+
+  if (lookup_len (dir, comp->name, comp->len, &e, NULL))
+    *inode = inode_open (e.inode_sector);
+  else
+    *inode = NULL;
+
+  return *inode != NULL;
+}
+
+/* Advances *PATHP past any slashes and the following file name
+   component and stores the component, in place, into *COMP.
+   Returns true if a component was found, false at the end of the
+   path.  Duplicate slashes are skipped, and "." components are
+   consumed silently since they name the directory already in
+   hand; ".." comes back like any other component and resolves
+   through the directory's own ".." entry.  Nothing is copied or
+   allocated, so walking a path costs only the scan. */
+bool
+path_next (const char **pathp, struct path_comp *comp)
+{
+  const char *p = *pathp;
+
+  for (;;)
+    {
+      while (*p == '/')
+        p++;
+      if (*p == '\0')
+        {
+          *pathp = p;
+          return false;
+        }
+
+      comp->name = p;
+      while (*p != '/' && *p != '\0')
+        p++;
+      comp->len = p - comp->name;
+
+      if (comp->len != 1 || comp->name[0] != '.')
+        {
+          *pathp = p;
+          return true;
+        }
+    }
+}
+
+/* Returns the offset of a free entry slot in DIR; if every
+   existing slot is in use, that is the current end-of-file,
+   where a write will extend the directory.  With an index the
+   answer is one list pop, since the index tracks the free slots;
+   without one it is a linear scan of the entries.
+
+   In the scan, inode_read_at() will only return a short read at
+   end of file.  Otherwise, we'd need to verify that we didn't
+   get a short read due to something intermittent such as low
+   memory. */
+static off_t
+free_slot_get (struct dir *dir)
+{
+  struct dir_entry e;
+  off_t ofs;
+
+  if (dir->index != NULL)
+    {
+      struct list *slots = &dir->index->free_slots;
+
+      if (!list_empty (slots))
+        {
+          struct free_slot *fs
+            = list_entry (list_pop_front (slots), struct free_slot, elem);
+
+          ofs = fs->ofs;
+          free (fs);
+          return ofs;
+        }
+      return inode_length (dir->inode);
+    }
+
+  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+       ofs += sizeof e)
+    if (!e.in_use)
+      break;
+  return ofs;
+}
+
 /* Adds a file named NAME to DIR, which must not already contain a
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
@@ -156,23 +628,16 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
-
-  /* Write slot. */
+  /* Write a free slot. */
+  ofs = free_slot_get (dir);
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  if (success)
+    index_insert (dir->index, name, inode_sector, ofs);
+  else
+    free_slot_put (dir->index, ofs);
 
  done:
   return success;
@@ -192,6 +657,10 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  /* The dot entries belong to the directory itself. */
+  if (!strcmp (name, ".") || !strcmp (name, ".."))
+    return false;
+
   /* Find directory entry. */
   if (!lookup (dir, name, &e, &ofs))
     goto done;
@@ -201,10 +670,22 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
 
+  /* A directory may only be removed if it is empty and we hold
+     the only reference, so nobody's open handle or working
+     directory is pulled out from under them. */
+  if (inode_is_dir (inode))
+    {
+      if (inode_open_cnt (inode) > 1 || !dir_is_empty (inode))
+        goto done;
+      index_invalidate (e.inode_sector);
+    }
+
   /* Erase directory entry. */
   e.in_use = false;
-  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
+  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
     goto done;
+  index_delete (dir->index, name);
+  free_slot_put (dir->index, ofs);
 
   /* Remove inode. */
   inode_remove (inode);
@@ -215,6 +696,171 @@ dir_remove (struct dir *dir, const char *name)
   return success;
 }
 
+/* Returns true if the directory at ANCESTOR is DIR itself or one
+   of the directories on DIR's ".." chain up to the root.  Used
+   to refuse moving a directory into its own subtree. */
+static bool
+dir_is_ancestor (block_sector_t ancestor, struct dir *dir)
+{
+  block_sector_t sector = inode_get_inumber (dir_get_inode (dir));
+
+  for (;;)
+    {
+      struct inode *inode;
+      struct dir_entry e;
+
+      if (sector == ancestor)
+        return true;
+      if (sector == ROOT_DIR_SECTOR)
+        return false;
+
+      /* The ".." entry is the second in every directory. */
+      inode = inode_open (sector);
+      if (inode == NULL
+          || inode_read_at (inode, &e, sizeof e, sizeof e) != sizeof e)
+        {
+          /* Fail safe: a broken chain refuses the move. */
+          inode_close (inode);
+          return true;
+        }
+      inode_close (inode);
+      sector = e.inode_sector;
+    }
+}
+
+/* Renames the entry OLD_NAME in FROM to NEW_NAME in TO, which
+   may be the same directory.  If NEW_NAME already exists it is
+   replaced in place -- its entry slot is simply repointed at the
+   moved inode and its old inode removed -- so there is no window
+   in which NEW_NAME does not exist, and each directory takes at
+   most one entry-slot write.  An existing NEW_NAME directory is
+   replaced only if it is empty and unopened, as in dir_remove();
+   a directory cannot replace a file or move into its own
+   subtree.  Returns true if successful. */
+bool
+dir_rename (struct dir *from, const char *old_name,
+            struct dir *to, const char *new_name)
+{
+  struct dir_entry se, te;
+  struct inode *moved = NULL, *target = NULL;
+  off_t sofs, tofs;
+  bool erase_old = true;
+  bool success = false;
+
+  ASSERT (from != NULL);
+  ASSERT (to != NULL);
+  ASSERT (old_name != NULL);
+  ASSERT (new_name != NULL);
+
+  /* Check names for validity; the dot entries stay put. */
+  if (*new_name == '\0' || strlen (new_name) > NAME_MAX)
+    return false;
+  if (!strcmp (old_name, ".") || !strcmp (old_name, "..")
+      || !strcmp (new_name, ".") || !strcmp (new_name, ".."))
+    return false;
+
+  /* Find the entry to move. */
+  if (!lookup (from, old_name, &se, &sofs))
+    return false;
+
+  moved = inode_open (se.inode_sector);
+  if (moved == NULL)
+    return false;
+
+  /* Refuse to move a directory into itself or a descendant. */
+  if (inode_is_dir (moved) && dir_is_ancestor (se.inode_sector, to))
+    goto done;
+
+  if (lookup (to, new_name, &te, &tofs))
+    {
+      /* Renaming an entry onto itself is a no-op. */
+      if (dir_get_inode (from) == dir_get_inode (to) && tofs == sofs)
+        {
+          success = true;
+          goto done;
+        }
+
+      /* Replace the existing target, subject to the same rules
+         as dir_remove(). */
+      target = inode_open (te.inode_sector);
+      if (target == NULL)
+        goto done;
+      if (inode_is_dir (target))
+        {
+          if (inode_open_cnt (target) > 1 || !dir_is_empty (target))
+            goto done;
+          index_invalidate (te.inode_sector);
+        }
+      else if (inode_is_dir (moved))
+        goto done;
+
+      /* Repoint the target's slot at the moved inode. */
+      te.inode_sector = se.inode_sector;
+      if (inode_write_at (to->inode, &te, sizeof te, tofs) != sizeof te)
+        goto done;
+      index_update (inode_get_inumber (to->inode), new_name,
+                    se.inode_sector);
+      inode_remove (target);
+    }
+  else if (dir_get_inode (from) == dir_get_inode (to))
+    {
+      /* Rename within one directory: rewrite the slot in place
+         with the new name; there is no old entry left to erase. */
+      strlcpy (se.name, new_name, sizeof se.name);
+      if (inode_write_at (from->inode, &se, sizeof se, sofs) != sizeof se)
+        goto done;
+      index_delete (from->index, old_name);
+      index_insert (from->index, new_name, se.inode_sector, sofs);
+      erase_old = false;
+    }
+  else
+    {
+      /* Write the new entry into a free slot in TO, as in
+         dir_add(). */
+      tofs = free_slot_get (to);
+      te.in_use = true;
+      strlcpy (te.name, new_name, sizeof te.name);
+      te.inode_sector = se.inode_sector;
+      if (inode_write_at (to->inode, &te, sizeof te, tofs) != sizeof te)
+        {
+          free_slot_put (to->index, tofs);
+          goto done;
+        }
+      index_insert (to->index, new_name, se.inode_sector, tofs);
+    }
+
+  /* Erase the old entry. */
+  if (erase_old)
+    {
+      se.in_use = false;
+      if (inode_write_at (from->inode, &se, sizeof se, sofs) != sizeof se)
+        goto done;
+      index_delete (from->index, old_name);
+      free_slot_put (from->index, sofs);
+    }
+
+  /* A directory moved to a new parent repoints its "..". */
+  if (inode_is_dir (moved)
+      && inode_get_inumber (from->inode) != inode_get_inumber (to->inode))
+    {
+      struct dir_entry dd;
+
+      if (inode_read_at (moved, &dd, sizeof dd, sizeof dd) == sizeof dd)
+        {
+          dd.inode_sector = inode_get_inumber (to->inode);
+          inode_write_at (moved, &dd, sizeof dd, sizeof dd);
+          index_update (se.inode_sector, "..", dd.inode_sector);
+        }
+    }
+
+  success = true;
+
+ done:
+  inode_close (moved);
+  inode_close (target);
+  return success;
+}
+
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
    contains no more entries. */
@@ -226,7 +872,7 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
   while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
     {
       dir->pos += sizeof e;
-      if (e.in_use)
+      if (e.in_use && strcmp (e.name, ".") && strcmp (e.name, ".."))
         {
           strlcpy (name, e.name, NAME_MAX + 1);
           return true;
@@ -234,3 +880,60 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
     }
   return false;
 }
+
+/* Reads as many entry names from DIR as fit in the SIZE-byte
+   buffer BUF, packing them back to back as null-terminated
+   strings, and returns the number of bytes used; 0 means DIR has
+   no more entries (or BUF cannot hold even the next name).  "."
+   and ".." are skipped, as in dir_readdir().  Entries are pulled
+   from the inode a whole batch at a time rather than one struct
+   dir_entry per read, so listing a large directory costs one
+   cache probe per batch, and the batch reads are big enough to
+   keep the cache's sequential read-ahead running ahead of us. */
+size_t
+dir_readdir_bulk (struct dir *dir, char *buf, size_t size)
+{
+  struct dir_entry batch[16];
+  size_t used = 0;
+
+  for (;;)
+    {
+      off_t bytes = inode_read_at (dir->inode, batch, sizeof batch, dir->pos);
+      size_t cnt = bytes / sizeof *batch;
+      size_t i;
+
+      if (cnt == 0)
+        break;
+      for (i = 0; i < cnt; i++)
+        {
+          struct dir_entry *e = &batch[i];
+          size_t len;
+
+          if (e->in_use && strcmp (e->name, ".") && strcmp (e->name, ".."))
+            {
+              len = strlen (e->name) + 1;
+              if (used + len > size)
+                return used;
+              memcpy (buf + used, e->name, len);
+              used += len;
+            }
+          dir->pos += sizeof *e;
+        }
+    }
+  return used;
+}
+
+/* Returns true if the directory held in INODE contains no
+   entries besides "." and "..". */
+bool
+dir_is_empty (struct inode *inode)
+{
+  struct dir_entry e;
+  off_t ofs;
+
+  for (ofs = 0; inode_read_at (inode, &e, sizeof e, ofs) == sizeof e;
+       ofs += sizeof e)
+    if (e.in_use && strcmp (e.name, ".") && strcmp (e.name, ".."))
+      return false;
+  return true;
+}
@@ -13,8 +13,18 @@
 
 struct inode;
 
+/* One component of a file name path: a counted span inside the
+   caller's path string, so walking a path copies nothing. */
+struct path_comp
+  {
+    const char *name;           /* First character; not null terminated. */
+    size_t len;                 /* Length in characters. */
+  };
+
+bool path_next (const char **pathp, struct path_comp *);
+
 /* Opening and closing directories. */
-bool dir_create (block_sector_t sector, size_t entry_cnt);
+bool dir_create (block_sector_t sector, block_sector_t parent_sector);
 struct dir *dir_open (struct inode *);
 struct dir *dir_open_root (void);
 struct dir *dir_reopen (struct dir *);
@@ -23,8 +33,14 @@ struct inode *dir_get_inode (struct dir *);
 
 /* Reading and writing. */
 bool dir_lookup (const struct dir *, const char *name, struct inode **);
+bool dir_lookup_comp (const struct dir *, const struct path_comp *,
+                      struct inode **);
 bool dir_add (struct dir *, const char *name, block_sector_t);
 bool dir_remove (struct dir *, const char *name);
+bool dir_rename (struct dir *from, const char *old_name,
+                 struct dir *to, const char *new_name);
 bool dir_readdir (struct dir *, char name[NAME_MAX + 1]);
+size_t dir_readdir_bulk (struct dir *, char *buf, size_t size);
+bool dir_is_empty (struct inode *);
 
 #endif /* filesys/directory.h */
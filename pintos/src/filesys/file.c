@@ -1,35 +1,45 @@
 #include "filesys/file.h"
 #include <debug.h>
 #include "filesys/inode.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
 
 /* An open file. */
-struct file 
+struct file
   {
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    struct inode_cache cache;   /* Memoized sector translations. */
   };
 
+/* Slab cache for struct file, created on first use. */
+static struct slab_cache *file_cache;
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
 struct file *
-file_open (struct inode *inode) 
+file_open (struct inode *inode)
 {
-  struct file *file = calloc (1, sizeof *file);
+  struct file *file;
+
+  if (file_cache == NULL)
+    file_cache = slab_create ("file", sizeof (struct file));
+
+  file = file_cache != NULL ? slab_alloc (file_cache) : NULL;
   if (inode != NULL && file != NULL)
     {
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      inode_cache_init (&file->cache);
       return file;
     }
   else
     {
       inode_close (inode);
-      free (file);
-      return NULL; 
+      slab_free (file_cache, file);
+      return NULL;
     }
 }
 
@@ -49,7 +59,7 @@ file_close (struct file *file)
     {
       file_allow_write (file);
       inode_close (file->inode);
-      free (file); 
+      slab_free (file_cache, file);
     }
 }
 
@@ -68,7 +78,8 @@ file_get_inode (struct file *file)
 off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
-  off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  off_t bytes_read = inode_read_at_cached (file->inode, buffer, size,
+                                           file->pos, &file->cache);
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -81,7 +92,8 @@ file_read (struct file *file, void *buffer, off_t size)
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) 
 {
-  return inode_read_at (file->inode, buffer, size, file_ofs);
+  return inode_read_at_cached (file->inode, buffer, size, file_ofs,
+                               &file->cache);
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
@@ -94,7 +106,8 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
 off_t
 file_write (struct file *file, const void *buffer, off_t size) 
 {
-  off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
+  off_t bytes_written = inode_write_at_cached (file->inode, buffer, size,
+                                               file->pos, &file->cache);
   file->pos += bytes_written;
   return bytes_written;
 }
@@ -110,7 +123,8 @@ off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
                off_t file_ofs) 
 {
-  return inode_write_at (file->inode, buffer, size, file_ofs);
+  return inode_write_at_cached (file->inode, buffer, size, file_ofs,
+                                &file->cache);
 }
 
 /* Prevents write operations on FILE's underlying inode
@@ -140,6 +154,22 @@ file_allow_write (struct file *file)
     }
 }
 
+/* Switches FILE between direct and cached I/O.  A direct handle
+   moves whole sectors straight between the caller's buffer and
+   the disk and issues no read-ahead, so streaming a large file
+   through it once does not evict the buffer cache's working set.
+   Sectors the cache already holds are still read from and
+   written through it, which keeps direct and cached handles to
+   the same file coherent.  Partial-sector transfers always go
+   through the cache.  The flag is per-handle: other openers of
+   the same inode are unaffected. */
+void
+file_set_direct (struct file *file, bool direct)
+{
+  ASSERT (file != NULL);
+  file->cache.direct = direct;
+}
+
 /* Returns the size of FILE in bytes. */
 off_t
 file_length (struct file *file) 
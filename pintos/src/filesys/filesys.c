@@ -2,10 +2,15 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
+#include "filesys/fsck.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "filesys/scrub.h"
 #include "filesys/directory.h"
+#include "threads/thread.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
@@ -21,23 +26,102 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
   inode_init ();
   free_map_init ();
+  journal_init (format);
 
-  if (format) 
+  if (format)
     do_format ();
 
   free_map_open ();
+
+  /* The journal has replayed committed transactions by now; if
+     the last shutdown was unclean, the free map may still be
+     stale and must be rebuilt before the first allocation. */
+  if (!format && !journal_mounted_clean ())
+    fsck_run ();
+
+  /* Background consistency checking from here on; see scrub.c. */
+  scrub_init ();
 }
 
 /* Shuts down the file system module, writing any unwritten data
    to disk. */
 void
-filesys_done (void) 
+filesys_done (void)
 {
   free_map_close ();
+  cache_flush ();
+  inode_flush_all ();
+  journal_checkpoint ();
+  journal_mark_clean ();
 }
 
+/* Resolves all but the last component of PATH, starting from the
+   root for an absolute path and from the current thread's
+   working directory otherwise.  On success returns the parent
+   directory, open, with the final component copied into BASE;
+   BASE is "." when PATH names the starting directory itself
+   ("/", ".", or an empty relative path).  Returns a null pointer
+   if an intermediate component is missing, too long, or not a
+   directory.  Components are walked as spans inside PATH with
+   path_next(), so the only copy is the final component into
+   BASE. */
+static struct dir *
+resolve_path (const char *path, char base[NAME_MAX + 1])
+{
+  struct dir *dir;
+  struct path_comp comp;
+
+  if (path[0] == '/' || thread_current ()->cwd == NULL)
+    dir = dir_open_root ();
+  else
+    dir = dir_reopen (thread_current ()->cwd);
+  if (dir == NULL)
+    return NULL;
+
+  strlcpy (base, ".", NAME_MAX + 1);
+  if (!path_next (&path, &comp))
+    return dir;
+
+  for (;;)
+    {
+      struct path_comp next;
+      struct inode *inode;
+
+      if (!path_next (&path, &next))
+        break;
+
+      /* COMP has a component after it, so it must name a
+         directory to walk into. */
+      if (!dir_lookup_comp (dir, &comp, &inode))
+        {
+          dir_close (dir);
+          return NULL;
+        }
+      dir_close (dir);
+      if (!inode_is_dir (inode))
+        {
+          inode_close (inode);
+          return NULL;
+        }
+      dir = dir_open (inode);
+      if (dir == NULL)
+        return NULL;
+      comp = next;
+    }
+
+  if (comp.len > NAME_MAX)
+    {
+      dir_close (dir);
+      return NULL;
+    }
+  memcpy (base, comp.name, comp.len);
+  base[comp.len] = '\0';
+  return dir;
+}
+
 /* Creates a file named NAME with the given INITIAL_SIZE.
    Returns true if successful, false otherwise.
    Fails if a file named NAME already exists,
@@ -46,19 +130,82 @@ bool
 filesys_create (const char *name, off_t initial_size) 
 {
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
-  if (!success && inode_sector != 0) 
+  char base[NAME_MAX + 1];
+  struct dir *dir = resolve_path (name, base);
+  bool success;
+
+  journal_begin ();
+  success = (dir != NULL
+             && free_map_allocate (1, &inode_sector)
+             && inode_create (inode_sector, initial_size, false)
+             && dir_add (dir, base, inode_sector));
+  if (!success && inode_sector != 0)
+    free_map_release (inode_sector, 1);
+  journal_commit ();
+  dir_close (dir);
+
+  return success;
+}
+
+/* Creates a directory named NAME, which must not already exist
+   but whose parent must.  Returns true if successful. */
+bool
+filesys_mkdir (const char *name)
+{
+  block_sector_t inode_sector = 0;
+  char base[NAME_MAX + 1];
+  struct dir *dir = resolve_path (name, base);
+  bool success;
+
+  journal_begin ();
+  success = (dir != NULL
+             && strcmp (base, ".") != 0
+             && free_map_allocate (1, &inode_sector)
+             && dir_create (inode_sector,
+                            inode_get_inumber (dir_get_inode (dir)))
+             && dir_add (dir, base, inode_sector));
+  if (!success && inode_sector != 0)
     free_map_release (inode_sector, 1);
+  journal_commit ();
   dir_close (dir);
 
   return success;
 }
 
-/* Opens the file with the given NAME.
+/* Changes the current thread's working directory to NAME.
+   Returns true if successful. */
+bool
+filesys_chdir (const char *name)
+{
+  struct thread *t = thread_current ();
+  char base[NAME_MAX + 1];
+  struct dir *dir = resolve_path (name, base);
+  struct inode *inode;
+
+  if (dir == NULL)
+    return false;
+  if (!dir_lookup (dir, base, &inode))
+    {
+      dir_close (dir);
+      return false;
+    }
+  dir_close (dir);
+  if (!inode_is_dir (inode))
+    {
+      inode_close (inode);
+      return false;
+    }
+
+  dir = dir_open (inode);
+  if (dir == NULL)
+    return false;
+  if (t->cwd != NULL)
+    dir_close (t->cwd);
+  t->cwd = dir;
+  return true;
+}
+
+/* Opens the file or directory with the given NAME.
    Returns the new file if successful or a null pointer
    otherwise.
    Fails if no file named NAME exists,
@@ -66,37 +213,66 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
+  char base[NAME_MAX + 1];
+  struct dir *dir = resolve_path (name, base);
   struct inode *inode = NULL;
 
   if (dir != NULL)
-    dir_lookup (dir, name, &inode);
+    dir_lookup (dir, base, &inode);
   dir_close (dir);
 
   return file_open (inode);
 }
 
-/* Deletes the file named NAME.
+/* Deletes the file or empty directory named NAME.
    Returns true if successful, false on failure.
    Fails if no file named NAME exists,
    or if an internal memory allocation fails. */
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
-  dir_close (dir); 
+  char base[NAME_MAX + 1];
+  struct dir *dir = resolve_path (name, base);
+  bool success;
+
+  journal_begin ();
+  success = dir != NULL && dir_remove (dir, base);
+  journal_commit ();
+  dir_close (dir);
 
   return success;
 }
 
+/* Atomically renames OLD_PATH to NEW_PATH, which may be in a
+   different directory.  If NEW_PATH already exists it is
+   replaced with no window in which it is absent, which is what
+   makes the create-temp-then-rename idiom for atomic file
+   replacement work.  Returns true if successful. */
+bool
+filesys_rename (const char *old_path, const char *new_path)
+{
+  char old_base[NAME_MAX + 1], new_base[NAME_MAX + 1];
+  struct dir *from = resolve_path (old_path, old_base);
+  struct dir *to = resolve_path (new_path, new_base);
+  bool success;
+
+  journal_begin ();
+  success = (from != NULL && to != NULL
+             && dir_rename (from, old_base, to, new_base));
+  journal_commit ();
+  dir_close (from);
+  dir_close (to);
+
+  return success;
+}
+
 /* Formats the file system. */
 static void
 do_format (void)
 {
   printf ("Formatting file system...");
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  if (!dir_create (ROOT_DIR_SECTOR, ROOT_DIR_SECTOR))
     PANIC ("root directory creation failed");
   free_map_close ();
   printf ("done.\n");
@@ -1,22 +1,207 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <stdint.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct lock free_map_lock;    /* Serializes free map updates. */
+static block_sector_t alloc_rotor;   /* Where the next-fit scan resumes. */
+
+/* On-disk format.  The free map file holds a header followed by
+   32-bit run lengths that alternate between in-use and free
+   sectors, starting with in-use (sector 0 holds the free map
+   inode itself, so the first run is never empty in practice).
+   An aged disk is mostly long runs, so the image is a handful of
+   sectors where the flat bitmap took hundreds, and mount-time
+   free-map I/O shrinks accordingly.  The in-memory form stays
+   the flat bitmap the allocator scans.
+
+   The image is rewritten as a whole by the flush daemon and at
+   clean shutdown; it is only ever trusted after a clean
+   shutdown, since fsck rebuilds the map from the inode walk
+   after an unclean one. */
+struct free_map_header
+  {
+    uint32_t magic;             /* FREE_MAP_MAGIC. */
+    uint32_t run_cnt;           /* Number of run lengths that follow. */
+  };
+#define FREE_MAP_MAGIC 0x464d5231
+
+/* Buffer for streaming runs to and from the file, so no
+   allocation proportional to the run count is ever needed.
+   Protected by free_map_lock. */
+#define RUN_BUF_CNT 128
+static uint32_t run_buf[RUN_BUF_CNT];
+
+/* True when the in-memory map has changes the file lacks. */
+static bool dirty;
+
+/* Bumped on every release, so the scrubber can tell whether
+   sectors were recycled while one of its passes was in flight; a
+   recycled sector can legitimately appear under two inodes
+   visited at different times.  See scrub.c. */
+static unsigned release_gen;
+
+/* Writes the free map to its file as a run-length image.
+   free_map_lock must be held.  Returns true if successful. */
+static bool
+write_encoded (void)
+{
+  struct free_map_header hdr;
+  size_t bit_cnt = bitmap_size (free_map);
+  size_t pos = 0;               /* Next bit to encode. */
+  bool value = true;            /* Value of the current run's bits. */
+  uint32_t run_cnt = 0;
+  size_t buf_cnt = 0;
+  off_t ofs = sizeof hdr;
+
+  while (pos < bit_cnt)
+    {
+      size_t next = bitmap_scan (free_map, pos, 1, !value);
+      size_t run = (next != BITMAP_ERROR ? next : bit_cnt) - pos;
+
+      run_buf[buf_cnt++] = run;
+      run_cnt++;
+      pos += run;
+      value = !value;
+
+      if (buf_cnt == RUN_BUF_CNT || pos >= bit_cnt)
+        {
+          off_t bytes = buf_cnt * sizeof *run_buf;
+
+          if (file_write_at (free_map_file, run_buf, bytes, ofs) != bytes)
+            return false;
+          ofs += bytes;
+          buf_cnt = 0;
+        }
+    }
+
+  hdr.magic = FREE_MAP_MAGIC;
+  hdr.run_cnt = run_cnt;
+  return file_write_at (free_map_file, &hdr, sizeof hdr, 0) == sizeof hdr;
+}
+
+/* Reads the run-length image from the free map file into the
+   in-memory bitmap. */
+static void
+read_encoded (void)
+{
+  struct free_map_header hdr;
+  size_t bit_cnt = bitmap_size (free_map);
+  size_t pos = 0;
+  bool value = true;
+  uint32_t run_no;
+  off_t ofs = sizeof hdr;
+  size_t buf_cnt = 0, buf_pos = 0;
+
+  if (file_read_at (free_map_file, &hdr, sizeof hdr, 0) != sizeof hdr
+      || hdr.magic != FREE_MAP_MAGIC)
+    PANIC ("free map image corrupted");
+
+  bitmap_set_all (free_map, false);
+  for (run_no = 0; run_no < hdr.run_cnt; run_no++)
+    {
+      size_t run;
+
+      if (buf_pos == buf_cnt)
+        {
+          uint32_t left = hdr.run_cnt - run_no;
+          off_t bytes;
+
+          buf_cnt = left < RUN_BUF_CNT ? left : RUN_BUF_CNT;
+          bytes = buf_cnt * sizeof *run_buf;
+          if (file_read_at (free_map_file, run_buf, bytes, ofs) != bytes)
+            PANIC ("can't read free map");
+          ofs += bytes;
+          buf_pos = 0;
+        }
+
+      run = run_buf[buf_pos++];
+      if (run > bit_cnt - pos)
+        PANIC ("free map image corrupted");
+      if (value && run > 0)
+        bitmap_set_multiple (free_map, pos, run, true);
+      pos += run;
+      value = !value;
+    }
+}
+
+/* Writes the free map to its file if the in-memory map has
+   changed.  free_map_lock must be held.  Returns true if
+   successful or nothing was dirty. */
+static bool
+flush_dirty (void)
+{
+  bool success = true;
+
+  ASSERT (lock_held_by_current_thread (&free_map_lock));
+
+  if (dirty && free_map_file != NULL)
+    {
+      success = write_encoded ();
+      if (success)
+        dirty = false;
+    }
+  return success;
+}
+
+/* Marks the sectors that are in use on every disk regardless of
+   its contents: the free map and root directory inodes and the
+   journal region. */
+static void
+mark_fixed_regions (void)
+{
+  block_sector_t sector;
+
+  bitmap_mark (free_map, FREE_MAP_SECTOR);
+  bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  for (sector = JOURNAL_START; sector < JOURNAL_START + JOURNAL_SECTORS;
+       sector++)
+    bitmap_mark (free_map, sector);
+}
 
 /* Initializes the free map. */
 void
-free_map_init (void) 
+free_map_init (void)
 {
+  lock_init (&free_map_lock);
+  lock_set_name (&free_map_lock, "free_map");
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
-  bitmap_mark (free_map, FREE_MAP_SECTOR);
-  bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  mark_fixed_regions ();
+}
+
+/* Discards the free map read from disk in favor of one where
+   only the fixed regions are in use, and marks the whole map
+   dirty so that the rebuilt map is written back in full.  The
+   starting point for fsck's rebuild after an unclean
+   shutdown. */
+void
+free_map_reset (void)
+{
+  lock_acquire (&free_map_lock);
+  bitmap_set_all (free_map, false);
+  mark_fixed_regions ();
+  dirty = true;
+  release_gen++;
+  lock_release (&free_map_lock);
+}
+
+/* Marks SECTOR as in use, for fsck's rebuild. */
+void
+free_map_mark (block_sector_t sector)
+{
+  lock_acquire (&free_map_lock);
+  bitmap_mark (free_map, sector);
+  dirty = true;
+  lock_release (&free_map_lock);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
@@ -24,17 +209,62 @@ free_map_init (void)
    Returns true if successful, false if not enough consecutive
    sectors were available or if the free_map file could not be
    written. */
-bool
-free_map_allocate (size_t cnt, block_sector_t *sectorp)
+/* Allocates CNT consecutive sectors, scanning forward from
+   START and wrapping around to the start of the disk if nothing
+   is free past it.  The write-back of the on-disk image is left
+   to the flush daemon: after a crash the image is rebuilt by
+   fsck anyway, so there is nothing to write through for a
+   journal transaction to cover.  Returns the first sector, or
+   BITMAP_ERROR on failure.  free_map_lock must be held. */
+static block_sector_t
+scan_and_mark (block_sector_t start, size_t cnt)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  block_sector_t sector;
+
+  ASSERT (lock_held_by_current_thread (&free_map_lock));
+
+  sector = bitmap_scan_and_flip (free_map, start, cnt, false);
+  if (sector == BITMAP_ERROR && start > 0)
+    sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+  if (sector != BITMAP_ERROR)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      dirty = true;
+      alloc_rotor = sector + cnt;
     }
+  return sector;
+}
+
+bool
+free_map_allocate (size_t cnt, block_sector_t *sectorp)
+{
+  block_sector_t sector;
+
+  lock_acquire (&free_map_lock);
+  /* Resume scanning where the last allocation stopped, rather
+     than from sector 0 each time: sectors allocated in sequence
+     come out adjacent instead of reusing scattered holes near
+     the start of the disk. */
+  sector = scan_and_mark (alloc_rotor, cnt);
+  lock_release (&free_map_lock);
+
+  if (sector != BITMAP_ERROR)
+    *sectorp = sector;
+  return sector != BITMAP_ERROR;
+}
+
+/* Like free_map_allocate() for a single sector, but scans
+   forward from HINT, so that a caller growing a file gets a
+   sector close to the file's existing data.  A zero HINT falls
+   back to the next-fit rotor. */
+bool
+free_map_allocate_near (block_sector_t hint, block_sector_t *sectorp)
+{
+  block_sector_t sector;
+
+  lock_acquire (&free_map_lock);
+  sector = scan_and_mark (hint != 0 ? hint : alloc_rotor, 1);
+  lock_release (&free_map_lock);
+
   if (sector != BITMAP_ERROR)
     *sectorp = sector;
   return sector != BITMAP_ERROR;
@@ -44,42 +274,78 @@ free_map_allocate (size_t cnt, block_sector_t *sectorp)
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  dirty = true;
+  release_gen++;
+  lock_release (&free_map_lock);
+}
+
+/* Returns true if SECTOR is marked in use. */
+bool
+free_map_test (block_sector_t sector)
+{
+  bool in_use;
+
+  lock_acquire (&free_map_lock);
+  in_use = bitmap_test (free_map, sector);
+  lock_release (&free_map_lock);
+  return in_use;
+}
+
+/* Returns the release generation, which changes whenever sectors
+   are freed.  A scrubber pass across which it is stable saw no
+   recycling, so its findings can be trusted. */
+unsigned
+free_map_generation (void)
+{
+  return release_gen;
+}
+
+/* Writes any deferred free map changes to the free map file.
+   The flush daemon calls this each pass, before the buffer
+   cache itself is flushed. */
+void
+free_map_flush (void)
+{
+  lock_acquire (&free_map_lock);
+  flush_dirty ();
+  lock_release (&free_map_lock);
 }
 
-/* Opens the free map file and reads it from disk. */
+/* Opens the free map file and decodes its run-length image. */
 void
-free_map_open (void) 
+free_map_open (void)
 {
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_read (free_map, free_map_file))
-    PANIC ("can't read free map");
+  read_encoded ();
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
-free_map_close (void) 
+free_map_close (void)
 {
+  free_map_flush ();
   file_close (free_map_file);
 }
 
 /* Creates a new free map file on disk and writes the free map to
-   it. */
+   it.  The file starts at header size and grows with the
+   image. */
 void
-free_map_create (void) 
+free_map_create (void)
 {
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create (FREE_MAP_SECTOR, sizeof (struct free_map_header), false))
     PANIC ("free map creation failed");
 
-  /* Write bitmap to file. */
+  /* Write the image to the file. */
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_write (free_map, free_map_file))
+  if (!write_encoded ())
     PANIC ("can't write free map");
 }
@@ -12,6 +12,13 @@ void free_map_open (void);
 void free_map_close (void);
 
 bool free_map_allocate (size_t, block_sector_t *);
+bool free_map_allocate_near (block_sector_t hint, block_sector_t *);
 void free_map_release (block_sector_t, size_t);
+void free_map_flush (void);
+
+void free_map_reset (void);
+void free_map_mark (block_sector_t);
+bool free_map_test (block_sector_t);
+unsigned free_map_generation (void);
 
 #endif /* filesys/free-map.h */
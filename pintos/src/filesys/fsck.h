@@ -0,0 +1,6 @@
+#ifndef FILESYS_FSCK_H
+#define FILESYS_FSCK_H
+
+void fsck_run (void);
+
+#endif /* filesys/fsck.h */
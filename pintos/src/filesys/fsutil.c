@@ -1,14 +1,20 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <random.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ustar.h>
+#include "devices/timer.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* List files in the root directory. */
@@ -67,26 +73,186 @@ fsutil_rm (char **argv)
     PANIC ("%s: delete failed\n", file_name);
 }
 
-/* Extracts a ustar-format tar archive from the scratch block
-   device into the Pintos file system. */
+/* Defragments every inode in the tree rooted at DIR, recursing
+   into subdirectories, and counts into *DONE the inodes whose
+   data is contiguous afterward and into *FAILED those the free
+   map could not place. */
+static void
+defrag_dir (struct dir *dir, int *done, int *failed)
+{
+  char name[NAME_MAX + 1];
+
+  while (dir_readdir (dir, name))
+    {
+      struct inode *inode;
+
+      if (!dir_lookup (dir, name, &inode))
+        continue;
+      if (inode_is_dir (inode))
+        {
+          struct dir *sub = dir_open (inode);
+
+          if (sub != NULL)
+            {
+              defrag_dir (sub, done, failed);
+              dir_close (sub);
+            }
+          else
+            inode_close (inode);
+        }
+      else
+        {
+          (*(inode_defrag (inode) ? done : failed))++;
+          inode_close (inode);
+        }
+    }
+
+  /* The directory's own sectors fragment just like a file's. */
+  (*(inode_defrag (dir_get_inode (dir)) ? done : failed))++;
+}
+
+/* Relocates every file's and directory's data sectors into
+   contiguous runs.  See inode_defrag(). */
 void
-fsutil_extract (char **argv UNUSED) 
+fsutil_defrag (char **argv UNUSED)
 {
-  static block_sector_t sector = 0;
+  struct dir *dir;
+  int done = 0, failed = 0;
 
-  struct block *src;
-  void *header, *data;
+  printf ("Defragmenting the file system...\n");
+  dir = dir_open_root ();
+  if (dir == NULL)
+    PANIC ("root dir open failed");
+  defrag_dir (dir, &done, &failed);
+  dir_close (dir);
+  printf ("defrag: %d inode(s) contiguous, %d without room.\n",
+          done, failed);
+}
 
-  /* Allocate buffers. */
-  header = malloc (BLOCK_SECTOR_SIZE);
-  data = malloc (BLOCK_SECTOR_SIZE);
-  if (header == NULL || data == NULL)
-    PANIC ("couldn't allocate buffers");
+/* Sectors moved to or from the scratch device in one batch. */
+#define BATCH_SECTORS 64
+#define BATCH_BYTES (BATCH_SECTORS * BLOCK_SECTOR_SIZE)
 
-  /* Open source block device. */
-  src = block_get_role (BLOCK_SCRATCH);
-  if (src == NULL)
+/* Cumulative scratch-device traffic in the extract and append
+   phases, for fsutil_print_stats(). */
+static int64_t extract_bytes, extract_ns;
+static int64_t append_bytes, append_ns;
+
+static int64_t rate_kbps (int64_t bytes, int64_t ns);
+
+/* A double-buffered stream over the scratch device.  A reader
+   thread fills one batch while fsutil_extract() parses and
+   writes the other, so device reads overlap filesystem writes
+   instead of serializing sector by sector. */
+struct extract_stream
+  {
+    struct block *src;          /* Scratch device. */
+    uint8_t *buf[2];            /* The two batch buffers. */
+    size_t cnt[2];              /* Sectors in each buffer. */
+    struct semaphore filled[2]; /* Upped when a buffer is full. */
+    struct semaphore empty[2];  /* Upped when a buffer is spent. */
+    block_sector_t pos;         /* Next sector the reader fetches. */
+    bool stop;                  /* Tells the reader to exit. */
+    struct semaphore done;      /* Upped when the reader exits. */
+
+    /* Consumer side. */
+    int cur;                    /* Buffer being consumed. */
+    size_t ofs;                 /* Sectors consumed from buf[cur]. */
+    block_sector_t consumed;    /* Total sectors consumed. */
+  };
+
+/* Thread function: fills the stream's buffers in turn from the
+   scratch device until told to stop or the device runs out. */
+static void
+extract_read_thread (void *stream_)
+{
+  struct extract_stream *s = stream_;
+  int i = 0;
+
+  for (;;)
+    {
+      size_t n, j;
+
+      sema_down (&s->empty[i]);
+      if (s->stop)
+        break;
+      n = block_size (s->src) - s->pos;
+      if (n > BATCH_SECTORS)
+        n = BATCH_SECTORS;
+      for (j = 0; j < n; j++)
+        block_read (s->src, s->pos + j, s->buf[i] + j * BLOCK_SECTOR_SIZE);
+      s->pos += n;
+      s->cnt[i] = n;
+      sema_up (&s->filled[i]);
+      if (n == 0)
+        break;
+      i = !i;
+    }
+  sema_up (&s->done);
+}
+
+/* Returns a pointer to the next unconsumed sector in S, without
+   consuming it.  Swaps to the other buffer, waiting for the
+   reader to fill it, when the current one is spent. */
+static uint8_t *
+extract_peek (struct extract_stream *s)
+{
+  while (s->ofs >= s->cnt[s->cur])
+    {
+      sema_up (&s->empty[s->cur]);
+      s->cur = !s->cur;
+      s->ofs = 0;
+      sema_down (&s->filled[s->cur]);
+      if (s->cnt[s->cur] == 0)
+        PANIC ("scratch device ran out in mid-archive");
+    }
+  return s->buf[s->cur] + s->ofs * BLOCK_SECTOR_SIZE;
+}
+
+/* Consumes CNT sectors from S. */
+static void
+extract_advance (struct extract_stream *s, size_t cnt)
+{
+  s->ofs += cnt;
+  s->consumed += cnt;
+}
+
+/* Extracts a ustar-format tar archive from the scratch block
+   device into the Pintos file system, streaming it through a
+   double buffer so that reading batch N+1 overlaps writing
+   batch N.  Each file's data sectors sit contiguously in the
+   batch, so they go to file_write() in runs of up to
+   BATCH_BYTES rather than one sector at a time; the
+   destination is created at its final size up front, so no
+   write ever has to grow the file. */
+void
+fsutil_extract (char **argv UNUSED)
+{
+  static block_sector_t start = 0;
+
+  struct extract_stream s;
+  int64_t start_ns;
+  int i;
+
+  /* Open source block device and start the reader. */
+  s.src = block_get_role (BLOCK_SCRATCH);
+  if (s.src == NULL)
     PANIC ("couldn't open scratch device");
+  for (i = 0; i < 2; i++)
+    {
+      s.buf[i] = palloc_get_multiple (PAL_ASSERT, BATCH_BYTES / PGSIZE);
+      s.cnt[i] = 0;
+      sema_init (&s.filled[i], 0);
+      sema_init (&s.empty[i], i == 0 ? 1 : 0);
+    }
+  s.pos = start;
+  s.stop = false;
+  sema_init (&s.done, 0);
+  s.cur = 1;
+  s.ofs = 0;
+  s.consumed = 0;
+  start_ns = timer_now_ns ();
+  thread_create ("fs-extract", PRI_DEFAULT, extract_read_thread, &s);
 
   printf ("Extracting ustar archive from scratch device "
           "into file system...\n");
@@ -98,11 +264,13 @@ fsutil_extract (char **argv UNUSED)
       enum ustar_type type;
       int size;
 
-      /* Read and parse ustar header. */
-      block_read (src, sector++, header);
-      error = ustar_parse_header (header, &file_name, &type, &size);
+      /* Parse the next ustar header in place. */
+      error = ustar_parse_header ((char *) extract_peek (&s),
+                                  &file_name, &type, &size);
       if (error != NULL)
-        PANIC ("bad ustar header in sector %"PRDSNu" (%s)", sector - 1, error);
+        PANIC ("bad ustar header in sector %"PRDSNu" (%s)",
+               start + s.consumed, error);
+      extract_advance (&s, 1);
 
       if (type == USTAR_EOF)
         {
@@ -124,16 +292,18 @@ fsutil_extract (char **argv UNUSED)
           if (dst == NULL)
             PANIC ("%s: open failed", file_name);
 
-          /* Do copy. */
+          /* Copy data in the longest runs the batch allows. */
           while (size > 0)
             {
-              int chunk_size = (size > BLOCK_SECTOR_SIZE
-                                ? BLOCK_SECTOR_SIZE
-                                : size);
-              block_read (src, sector++, data);
+              uint8_t *data = extract_peek (&s);
+              size_t avail = (s.cnt[s.cur] - s.ofs) * BLOCK_SECTOR_SIZE;
+              int chunk_size = size < (int) avail ? size : (int) avail;
+
               if (file_write (dst, data, chunk_size) != chunk_size)
                 PANIC ("%s: write failed with %d bytes unwritten",
                        file_name, size);
+              extract_advance (&s, DIV_ROUND_UP (chunk_size,
+                                                 BLOCK_SECTOR_SIZE));
               size -= chunk_size;
             }
 
@@ -142,17 +312,27 @@ fsutil_extract (char **argv UNUSED)
         }
     }
 
+  /* Stop the reader and wait for it to exit.  It may be asleep
+     on either buffer. */
+  s.stop = true;
+  sema_up (&s.empty[0]);
+  sema_up (&s.empty[1]);
+  sema_down (&s.done);
+  extract_ns += timer_now_ns () - start_ns;
+  extract_bytes += (int64_t) s.consumed * BLOCK_SECTOR_SIZE;
+  start += s.consumed;
+
   /* Erase the ustar header from the start of the block device,
      so that the extraction operation is idempotent.  We erase
      two blocks because two blocks of zeros are the ustar
      end-of-archive marker. */
   printf ("Erasing ustar archive...\n");
-  memset (header, 0, BLOCK_SECTOR_SIZE);
-  block_write (src, 0, header);
-  block_write (src, 1, header);
+  memset (s.buf[0], 0, BLOCK_SECTOR_SIZE);
+  block_write (s.src, 0, s.buf[0]);
+  block_write (s.src, 1, s.buf[0]);
 
-  free (data);
-  free (header);
+  for (i = 0; i < 2; i++)
+    palloc_free_multiple (s.buf[i], BATCH_BYTES / PGSIZE);
 }
 
 /* Copies file FILE_NAME from the file system to the scratch
@@ -169,17 +349,17 @@ fsutil_append (char **argv)
   static block_sector_t sector = 0;
 
   const char *file_name = argv[1];
-  void *buffer;
+  uint8_t *buffer;
   struct file *src;
   struct block *dst;
   off_t size;
+  size_t used;
+  int64_t start_ns;
 
   printf ("Appending '%s' to ustar archive on scratch device...\n", file_name);
 
-  /* Allocate buffer. */
-  buffer = malloc (BLOCK_SECTOR_SIZE);
-  if (buffer == NULL)
-    PANIC ("couldn't allocate buffer");
+  /* Allocate batch buffer. */
+  buffer = palloc_get_multiple (PAL_ASSERT, BATCH_BYTES / PGSIZE);
 
   /* Open source file. */
   src = filesys_open (file_name);
@@ -191,23 +371,48 @@ fsutil_append (char **argv)
   dst = block_get_role (BLOCK_SCRATCH);
   if (dst == NULL)
     PANIC ("couldn't open scratch device");
-  
-  /* Write ustar header to first sector. */
-  if (!ustar_make_header (file_name, USTAR_REGULAR, size, buffer))
+
+  start_ns = timer_now_ns ();
+
+  /* The ustar header takes the first sector of the first batch;
+     data accumulates behind it, so the header costs no separate
+     device write. */
+  if (!ustar_make_header (file_name, USTAR_REGULAR, size, (char *) buffer))
     PANIC ("%s: name too long for ustar format", file_name);
-  block_write (dst, sector++, buffer);
+  used = 1;
 
-  /* Do copy. */
-  while (size > 0) 
+  /* Fill the batch from the source file and flush it whole, so
+     the device sees BATCH_SECTORS-sector bursts instead of a
+     read/write round trip per sector. */
+  for (;;)
     {
-      int chunk_size = size > BLOCK_SECTOR_SIZE ? BLOCK_SECTOR_SIZE : size;
-      if (sector >= block_size (dst))
+      off_t room = (BATCH_SECTORS - used) * BLOCK_SECTOR_SIZE;
+      off_t chunk_size = size < room ? size : room;
+      size_t i;
+
+      if (chunk_size > 0)
+        {
+          if (file_read (src, buffer + used * BLOCK_SECTOR_SIZE, chunk_size)
+              != chunk_size)
+            PANIC ("%s: read failed with %"PROTd" bytes unread",
+                   file_name, size);
+          if (chunk_size % BLOCK_SECTOR_SIZE != 0)
+            memset (buffer + used * BLOCK_SECTOR_SIZE + chunk_size, 0,
+                    BLOCK_SECTOR_SIZE - chunk_size % BLOCK_SECTOR_SIZE);
+          used += DIV_ROUND_UP (chunk_size, BLOCK_SECTOR_SIZE);
+          size -= chunk_size;
+        }
+
+      /* Flush the batch. */
+      if (sector + used > block_size (dst))
         PANIC ("%s: out of space on scratch device", file_name);
-      if (file_read (src, buffer, chunk_size) != chunk_size)
-        PANIC ("%s: read failed with %"PROTd" bytes unread", file_name, size);
-      memset (buffer + chunk_size, 0, BLOCK_SECTOR_SIZE - chunk_size);
-      block_write (dst, sector++, buffer);
-      size -= chunk_size;
+      for (i = 0; i < used; i++)
+        block_write (dst, sector + i, buffer + i * BLOCK_SECTOR_SIZE);
+      sector += used;
+      append_bytes += (int64_t) used * BLOCK_SECTOR_SIZE;
+      used = 0;
+      if (size == 0)
+        break;
     }
 
   /* Write ustar end-of-archive marker, which is two consecutive
@@ -215,9 +420,409 @@ fsutil_append (char **argv)
      them, though, in case we have more files to append. */
   memset (buffer, 0, BLOCK_SECTOR_SIZE);
   block_write (dst, sector, buffer);
-  block_write (dst, sector, buffer + 1);
+  block_write (dst, sector + 1, buffer);
+
+  append_ns += timer_now_ns () - start_ns;
 
   /* Finish up. */
   file_close (src);
-  free (buffer);
+  palloc_free_multiple (buffer, BATCH_BYTES / PGSIZE);
+}
+
+/* Prints scratch-device throughput for the extract and append
+   phases. */
+void
+fsutil_print_stats (void)
+{
+  if (extract_bytes > 0)
+    printf ("fsutil: extract %'lld kB in %lld ms (%'lld kB/s)\n",
+            extract_bytes / 1024, extract_ns / 1000000,
+            rate_kbps (extract_bytes, extract_ns));
+  if (append_bytes > 0)
+    printf ("fsutil: append %'lld kB in %lld ms (%'lld kB/s)\n",
+            append_bytes / 1024, append_ns / 1000000,
+            rate_kbps (append_bytes, append_ns));
+}
+
+/* Size of the files used by fsutil_bench(). */
+#define BENCH_FILE_SIZE (512 * 1024)
+
+/* Number of random reads in the random-read phase. */
+#define BENCH_RANDOM_OPS 256
+
+/* Size of each random read. */
+#define BENCH_RANDOM_SIZE 4096
+
+/* Number of create/write/delete rounds in the churn phase. */
+#define BENCH_CHURN_OPS 128
+
+/* Returns BYTES transferred in NS nanoseconds as KB/s. */
+static int64_t
+rate_kbps (int64_t bytes, int64_t ns)
+{
+  return ns > 0 ? bytes * 1000000000 / ns / 1024 : 0;
+}
+
+/* Returns OPS operations completed in NS nanoseconds as ops/s. */
+static int64_t
+rate_ops (int64_t ops, int64_t ns)
+{
+  return ns > 0 ? ops * 1000000000 / ns : 0;
+}
+
+/* Creates NAME with SIZE bytes and fills it from BUF, PGSIZE
+   bytes at a time. */
+static void
+bench_write_file (const char *name, off_t size, void *buf)
+{
+  struct file *file;
+  off_t ofs;
+
+  if (!filesys_create (name, size))
+    PANIC ("%s: create failed", name);
+  file = filesys_open (name);
+  if (file == NULL)
+    PANIC ("%s: open failed", name);
+  for (ofs = 0; ofs < size; ofs += PGSIZE)
+    if (file_write (file, buf, PGSIZE) != PGSIZE)
+      PANIC ("%s: write failed at offset %"PROTd, name, ofs);
+  file_close (file);
+}
+
+/* Reads NAME from beginning to end, PGSIZE bytes at a time, and
+   returns the number of bytes read. */
+static off_t
+bench_read_file (const char *name)
+{
+  struct file *file;
+  void *buf;
+  off_t total = 0;
+  off_t n;
+
+  file = filesys_open (name);
+  if (file == NULL)
+    PANIC ("%s: open failed", name);
+  buf = palloc_get_page (PAL_ASSERT);
+  while ((n = file_read (file, buf, PGSIZE)) > 0)
+    total += n;
+  palloc_free_page (buf);
+  file_close (file);
+  return total;
+}
+
+/* A concurrent reader and the rendezvous for waiting on it. */
+struct bench_reader
+  {
+    const char *name;           /* File to read. */
+    struct semaphore done;      /* Upped when the read finishes. */
+  };
+
+/* Thread function: reads its file from end to end. */
+static void
+bench_read_thread (void *reader_)
+{
+  struct bench_reader *reader = reader_;
+
+  bench_read_file (reader->name);
+  sema_up (&reader->done);
+}
+
+/* Filesystem benchmark: sequential write and read bandwidth,
+   4 kB random reads, small-file create/delete churn, and
+   concurrent access to two files.  Prints machine-parsable
+   figures so cache and allocator changes can be compared across
+   commits. */
+void
+fsutil_bench (char **argv UNUSED)
+{
+  struct bench_reader readers[2];
+  struct file *file;
+  void *buf;
+  int64_t start, ns;
+  off_t total;
+  int i;
+
+  printf ("Running filesystem benchmark...\n");
+  buf = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+
+  /* Sequential write. */
+  start = timer_now_ns ();
+  bench_write_file ("bench0", BENCH_FILE_SIZE, buf);
+  ns = timer_now_ns () - start;
+  printf ("fsbench: seq_write_kbps=%lld\n",
+          rate_kbps (BENCH_FILE_SIZE, ns));
+
+  /* Sequential read. */
+  start = timer_now_ns ();
+  total = bench_read_file ("bench0");
+  ns = timer_now_ns () - start;
+  if (total != BENCH_FILE_SIZE)
+    PANIC ("bench0: read %"PROTd" bytes, expected %d",
+           total, BENCH_FILE_SIZE);
+  printf ("fsbench: seq_read_kbps=%lld\n", rate_kbps (total, ns));
+
+  /* Random reads. */
+  file = filesys_open ("bench0");
+  if (file == NULL)
+    PANIC ("bench0: open failed");
+  start = timer_now_ns ();
+  for (i = 0; i < BENCH_RANDOM_OPS; i++)
+    {
+      off_t ofs = random_ulong_fast () % (BENCH_FILE_SIZE - BENCH_RANDOM_SIZE);
+
+      if (file_read_at (file, buf, BENCH_RANDOM_SIZE, ofs)
+          != BENCH_RANDOM_SIZE)
+        PANIC ("bench0: random read failed at offset %"PROTd, ofs);
+    }
+  ns = timer_now_ns () - start;
+  file_close (file);
+  printf ("fsbench: random_read_ops=%lld random_read_kbps=%lld\n",
+          rate_ops (BENCH_RANDOM_OPS, ns),
+          rate_kbps ((int64_t) BENCH_RANDOM_OPS * BENCH_RANDOM_SIZE, ns));
+
+  /* Small-file churn. */
+  start = timer_now_ns ();
+  for (i = 0; i < BENCH_CHURN_OPS; i++)
+    {
+      if (!filesys_create ("churn", BLOCK_SECTOR_SIZE))
+        PANIC ("churn: create failed on round %d", i);
+      file = filesys_open ("churn");
+      if (file == NULL)
+        PANIC ("churn: open failed on round %d", i);
+      if (file_write (file, buf, BLOCK_SECTOR_SIZE) != BLOCK_SECTOR_SIZE)
+        PANIC ("churn: write failed on round %d", i);
+      file_close (file);
+      if (!filesys_remove ("churn"))
+        PANIC ("churn: delete failed on round %d", i);
+    }
+  ns = timer_now_ns () - start;
+  printf ("fsbench: churn_ops=%lld\n", rate_ops (BENCH_CHURN_OPS, ns));
+
+  /* Concurrent readers on two files. */
+  bench_write_file ("bench1", BENCH_FILE_SIZE, buf);
+  start = timer_now_ns ();
+  for (i = 0; i < 2; i++)
+    {
+      readers[i].name = i == 0 ? "bench0" : "bench1";
+      sema_init (&readers[i].done, 0);
+      thread_create ("bench-reader", PRI_DEFAULT, bench_read_thread,
+                     &readers[i]);
+    }
+  for (i = 0; i < 2; i++)
+    sema_down (&readers[i].done);
+  ns = timer_now_ns () - start;
+  printf ("fsbench: concurrent_read_kbps=%lld\n",
+          rate_kbps (2 * (int64_t) BENCH_FILE_SIZE, ns));
+
+  /* Clean up. */
+  if (!filesys_remove ("bench0") || !filesys_remove ("bench1"))
+    PANIC ("benchmark cleanup failed");
+  palloc_free_page (buf);
+  printf ("Filesystem benchmark done.\n");
+}
+
+/* Number of files in the workload generator's working set, and
+   the size of each. */
+#define WL_FILE_CNT 64
+#define WL_FILE_SIZE (16 * 1024)
+
+/* Bytes moved by one read or write operation. */
+#define WL_IO_SIZE 4096
+
+/* Ceiling on operations per run, which bounds the latency
+   arrays. */
+#define WL_MAX_OPS 16384
+
+/* The three operation classes. */
+enum wl_class
+  {
+    WL_READ,                    /* Read WL_IO_SIZE bytes. */
+    WL_WRITE,                   /* Overwrite WL_IO_SIZE bytes. */
+    WL_META,                    /* Create, fill, and delete a file. */
+    WL_CLASS_CNT
+  };
+
+static const char *wl_class_names[WL_CLASS_CNT] = {"read", "write", "meta"};
+
+/* Cumulative Zipf(1) weights over the working-set files, in
+   16.16 fixed point: file I carries weight 1/(I+1), so a few hot
+   files absorb most operations the way production working sets
+   do instead of spreading accesses uniformly. */
+static uint32_t wl_cum[WL_FILE_CNT];
+
+static void
+wl_zipf_init (void)
+{
+  uint32_t total = 0;
+  int i;
+
+  for (i = 0; i < WL_FILE_CNT; i++)
+    {
+      total += (1 << 16) / (i + 1);
+      wl_cum[i] = total;
+    }
+}
+
+/* Returns a file index drawn from the Zipfian distribution. */
+static int
+wl_pick_file (void)
+{
+  uint32_t r = random_ulong_fast () % wl_cum[WL_FILE_CNT - 1];
+  int i;
+
+  for (i = 0; ; i++)
+    if (r < wl_cum[i])
+      return i;
+}
+
+/* Orders latencies for qsort(). */
+static int
+wl_compare_ns (const void *a_, const void *b_)
+{
+  const int64_t *a = a_;
+  const int64_t *b = b_;
+
+  return *a < *b ? -1 : *a > *b;
+}
+
+/* Sorts the CNT latencies of class NAME in LAT and prints their
+   count, rate over the whole run of TOTAL_NS nanoseconds, and
+   50th, 90th, and 99th percentiles and maximum, in
+   microseconds. */
+static void
+wl_report (const char *name, int64_t *lat, size_t cnt, int64_t total_ns)
+{
+  if (cnt == 0)
+    return;
+  qsort (lat, cnt, sizeof *lat, wl_compare_ns);
+  printf ("workload: %s_ops=%zu %s_ops_per_s=%lld %s_p50_us=%lld "
+          "%s_p90_us=%lld %s_p99_us=%lld %s_max_us=%lld\n",
+          name, cnt, name, rate_ops (cnt, total_ns),
+          name, lat[(cnt - 1) * 50 / 100] / 1000,
+          name, lat[(cnt - 1) * 90 / 100] / 1000,
+          name, lat[(cnt - 1) * 99 / 100] / 1000,
+          name, lat[cnt - 1] / 1000);
+}
+
+/* Workload generator: runs ARGV[1] file operations mixed
+   according to ARGV[2], given as READ/WRITE/META percentages
+   such as 70/20/10, against a working set of WL_FILE_CNT files
+   chosen Zipfian per operation, and prints per-class throughput
+   and latency percentiles.  Unlike fsbench's microbenchmark
+   phases, the classes interleave in one stream, so cache and
+   scheduler changes are judged against a production-shaped mix.
+
+   Every random choice comes from the kernel generator, so
+   booting with -rs=SEED replays the identical operation
+   sequence; latencies come from timer_now_ns(), which reads the
+   TSC. */
+void
+fsutil_workload (char **argv)
+{
+  int cnt = atoi (argv[1]);
+  struct file *files[WL_FILE_CNT];
+  int64_t *lat[WL_CLASS_CNT];
+  size_t n[WL_CLASS_CNT];
+  size_t lat_pages;
+  int pct[WL_CLASS_CNT];
+  char *save_ptr;
+  void *buf;
+  int64_t start, total_ns;
+  int i;
+
+  if (cnt <= 0 || cnt > WL_MAX_OPS)
+    PANIC ("workload: operation count must be 1...%d", WL_MAX_OPS);
+  for (i = 0; i < WL_CLASS_CNT; i++)
+    {
+      char *token = strtok_r (i == 0 ? argv[2] : NULL, "/", &save_ptr);
+
+      if (token == NULL)
+        PANIC ("workload: mix must be READ/WRITE/META percentages");
+      pct[i] = atoi (token);
+    }
+  if (pct[WL_READ] + pct[WL_WRITE] + pct[WL_META] != 100)
+    PANIC ("workload: mix percentages must sum to 100");
+
+  printf ("Running workload: %d ops, %d/%d/%d read/write/meta, "
+          "%d files...\n",
+          cnt, pct[WL_READ], pct[WL_WRITE], pct[WL_META], WL_FILE_CNT);
+
+  /* Build and open the working set. */
+  wl_zipf_init ();
+  buf = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  lat_pages = DIV_ROUND_UP (cnt * sizeof (int64_t), PGSIZE);
+  for (i = 0; i < WL_CLASS_CNT; i++)
+    {
+      lat[i] = palloc_get_multiple (PAL_ASSERT, lat_pages);
+      n[i] = 0;
+    }
+  for (i = 0; i < WL_FILE_CNT; i++)
+    {
+      char name[16];
+
+      snprintf (name, sizeof name, "wl%d", i);
+      bench_write_file (name, WL_FILE_SIZE, buf);
+      files[i] = filesys_open (name);
+      if (files[i] == NULL)
+        PANIC ("%s: open failed", name);
+    }
+
+  start = timer_now_ns ();
+  for (i = 0; i < cnt; i++)
+    {
+      int r = random_ulong_fast () % 100;
+      enum wl_class class = r < pct[WL_READ] ? WL_READ
+        : r < pct[WL_READ] + pct[WL_WRITE] ? WL_WRITE : WL_META;
+      int64_t op_start = timer_now_ns ();
+
+      if (class == WL_READ || class == WL_WRITE)
+        {
+          struct file *file = files[wl_pick_file ()];
+          off_t ofs = random_ulong_fast () % (WL_FILE_SIZE - WL_IO_SIZE + 1);
+
+          if (class == WL_READ
+              ? file_read_at (file, buf, WL_IO_SIZE, ofs) != WL_IO_SIZE
+              : file_write_at (file, buf, WL_IO_SIZE, ofs) != WL_IO_SIZE)
+            PANIC ("workload: %s failed at offset %"PROTd" on op %d",
+                   wl_class_names[class], ofs, i);
+        }
+      else
+        {
+          struct file *file;
+
+          if (!filesys_create ("wl-tmp", BLOCK_SECTOR_SIZE))
+            PANIC ("wl-tmp: create failed on op %d", i);
+          file = filesys_open ("wl-tmp");
+          if (file == NULL)
+            PANIC ("wl-tmp: open failed on op %d", i);
+          if (file_write (file, buf, BLOCK_SECTOR_SIZE) != BLOCK_SECTOR_SIZE)
+            PANIC ("wl-tmp: write failed on op %d", i);
+          file_close (file);
+          if (!filesys_remove ("wl-tmp"))
+            PANIC ("wl-tmp: delete failed on op %d", i);
+        }
+
+      lat[class][n[class]++] = timer_now_ns () - op_start;
+    }
+  total_ns = timer_now_ns () - start;
+
+  printf ("workload: total_ops=%d total_ops_per_s=%lld\n",
+          cnt, rate_ops (cnt, total_ns));
+  for (i = 0; i < WL_CLASS_CNT; i++)
+    wl_report (wl_class_names[i], lat[i], n[i], total_ns);
+
+  /* Clean up. */
+  for (i = 0; i < WL_FILE_CNT; i++)
+    {
+      char name[16];
+
+      snprintf (name, sizeof name, "wl%d", i);
+      file_close (files[i]);
+      if (!filesys_remove (name))
+        PANIC ("%s: delete failed", name);
+    }
+  for (i = 0; i < WL_CLASS_CNT; i++)
+    palloc_free_multiple (lat[i], lat_pages);
+  palloc_free_page (buf);
+  printf ("Workload done.\n");
 }
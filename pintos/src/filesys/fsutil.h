@@ -4,7 +4,11 @@
 void fsutil_ls (char **argv);
 void fsutil_cat (char **argv);
 void fsutil_rm (char **argv);
+void fsutil_defrag (char **argv);
 void fsutil_extract (char **argv);
 void fsutil_append (char **argv);
+void fsutil_bench (char **argv);
+void fsutil_workload (char **argv);
+void fsutil_print_stats (void);
 
 #endif /* filesys/fsutil.h */
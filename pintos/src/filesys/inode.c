@@ -1,23 +1,69 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <bitmap.h>
 #include <debug.h>
+#include <hash.h>
+#include <mpsc.h>
 #include <round.h>
+#include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/slab.h"
+#include "threads/thread.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Sector pointer counts for the indexed inode layout. */
+#define DIRECT_CNT 122                          /* Direct pointers. */
+#define PTRS_PER_SECTOR \
+        (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+#define INDIRECT_CNT PTRS_PER_SECTOR            /* Via indirect block. */
+#define DBL_INDIRECT_CNT \
+        (PTRS_PER_SECTOR * PTRS_PER_SECTOR)     /* Via doubly indirect. */
+#define INODE_MAX_SECTORS \
+        (DIRECT_CNT + INDIRECT_CNT + DBL_INDIRECT_CNT)
+
+/* Bytes of file data that fit inside the inode sector itself.
+   An inline inode stores file bytes in its pointer area instead
+   of sector pointers. */
+#define INODE_INLINE_MAX ((DIRECT_CNT + 2) * sizeof (block_sector_t))
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   An inline inode (is_inline nonzero) keeps all of its data in
+   inline_data, so a small file costs no data sectors at all and
+   is read with the single sector fetch that loads the inode.  It
+   is converted to the indexed layout the first time a write
+   lands past INODE_INLINE_MAX; see inode_spill_inline().
+
+   In the indexed layout, data sectors are located through
+   DIRECT_CNT direct pointers, one indirect block and one doubly
+   indirect block, giving a maximum file size just over 8 MB.  A
+   zero pointer means "not allocated"; sector 0 holds the free
+   map and can never be file data, so zero is unambiguous. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
+    union
+      {
+        struct                          /* Indexed layout. */
+          {
+            block_sector_t direct[DIRECT_CNT];  /* Direct data sectors. */
+            block_sector_t indirect;            /* Indirect block. */
+            block_sector_t doubly_indirect;     /* Doubly indirect block. */
+          };
+        uint8_t inline_data[INODE_INLINE_MAX];  /* Inline layout. */
+      };
     off_t length;                       /* File size in bytes. */
+    uint32_t is_dir;                    /* Directory or ordinary file? */
+    uint32_t is_inline;                 /* Data inline in this sector? */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -29,48 +75,567 @@ bytes_to_sectors (off_t size)
 }
 
 /* In-memory inode. */
-struct inode 
+struct inode
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open_inodes. */
+    struct mpsc_elem kill_elem;         /* Element in the reaper's
+                                           kill queue; see inode_close(). */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct rwlock io_lock;              /* Shared by readers, exclusive for
+                                           writers; see inode_read_at(). */
+    bool dirty;                         /* In-memory metadata changed since
+                                           the last flush; see
+                                           inode_flush(). */
+    unsigned map_gen;                   /* Bumped whenever the index
+                                           changes, invalidating the
+                                           per-handle inode caches. */
     struct inode_disk data;             /* Inode content. */
   };
 
+/* Returns the data sector mapped at sector index INDEX in DISK,
+   or 0 if none is allocated there.  Indirect blocks are consulted
+   through the buffer cache one pointer at a time. */
+static block_sector_t
+index_to_sector (const struct inode_disk *disk, size_t index)
+{
+  block_sector_t sector;
+
+  if (index < DIRECT_CNT)
+    return disk->direct[index];
+  index -= DIRECT_CNT;
+
+  if (index < INDIRECT_CNT)
+    {
+      if (disk->indirect == 0)
+        return 0;
+      cache_read (disk->indirect, &sector, index * sizeof sector,
+                  sizeof sector, CACHE_META);
+      return sector;
+    }
+  index -= INDIRECT_CNT;
+
+  if (index < DBL_INDIRECT_CNT)
+    {
+      if (disk->doubly_indirect == 0)
+        return 0;
+      cache_read (disk->doubly_indirect, &sector,
+                  index / PTRS_PER_SECTOR * sizeof sector, sizeof sector,
+                  CACHE_META);
+      if (sector == 0)
+        return 0;
+      cache_read (sector, &sector,
+                  index % PTRS_PER_SECTOR * sizeof sector, sizeof sector,
+                  CACHE_META);
+      return sector;
+    }
+
+  return 0;
+}
+
+/* Empties cache C.  Every file handle initializes its cache
+   through this before first use. */
+void
+inode_cache_init (struct inode_cache *c)
+{
+  c->gen = 0;
+  c->start = 0;
+  c->cnt = 0;
+  c->ra_next = 0;
+  c->ra_last = 0;
+  c->ra_stride = 0;
+  c->ra_issued = 0;
+  c->ra_window = 0;
+  c->direct = false;
+}
+
+/* As index_to_sector(), but memoizing translations in C, which
+   may be null for the uncached behavior.  A hit costs a couple
+   of comparisons; a miss refills C with the run of consecutive
+   pointers containing INDEX, read in one pass, so walking a
+   file sequentially touches the index chain once per
+   INODE_CACHE_PTRS sectors regardless of index depth.  Hole
+   runs (an absent index block) cache as zeros; the mapping
+   generation check catches the holes being filled later. */
+static block_sector_t
+index_to_sector_cached (const struct inode *inode, size_t index,
+                        struct inode_cache *c)
+{
+  const struct inode_disk *disk = &inode->data;
+  block_sector_t table;
+  size_t ofs, run;
+
+  if (c == NULL)
+    return index_to_sector (disk, index);
+  if (c->gen == inode->map_gen
+      && index >= c->start && index - c->start < c->cnt)
+    return c->sectors[index - c->start];
+
+  c->gen = inode->map_gen;
+  c->start = index;
+  c->cnt = 0;
+
+  if (index < DIRECT_CNT)
+    {
+      run = DIRECT_CNT - index;
+      if (run > INODE_CACHE_PTRS)
+        run = INODE_CACHE_PTRS;
+      memcpy (c->sectors, &disk->direct[index], run * sizeof *c->sectors);
+      c->cnt = run;
+    }
+  else if ((ofs = index - DIRECT_CNT) < INDIRECT_CNT)
+    {
+      run = INDIRECT_CNT - ofs;
+      if (run > INODE_CACHE_PTRS)
+        run = INODE_CACHE_PTRS;
+      if (disk->indirect == 0)
+        memset (c->sectors, 0, run * sizeof *c->sectors);
+      else
+        cache_read (disk->indirect, c->sectors, ofs * sizeof *c->sectors,
+                    run * sizeof *c->sectors, CACHE_META);
+      c->cnt = run;
+    }
+  else if ((ofs -= INDIRECT_CNT) < DBL_INDIRECT_CNT)
+    {
+      run = PTRS_PER_SECTOR - ofs % PTRS_PER_SECTOR;
+      if (run > INODE_CACHE_PTRS)
+        run = INODE_CACHE_PTRS;
+      if (disk->doubly_indirect == 0)
+        table = 0;
+      else
+        cache_read (disk->doubly_indirect, &table,
+                    ofs / PTRS_PER_SECTOR * sizeof table, sizeof table,
+                    CACHE_META);
+      if (table == 0)
+        memset (c->sectors, 0, run * sizeof *c->sectors);
+      else
+        cache_read (table, c->sectors,
+                    ofs % PTRS_PER_SECTOR * sizeof *c->sectors,
+                    run * sizeof *c->sectors, CACHE_META);
+      c->cnt = run;
+    }
+  else
+    return 0;
+
+  return c->sectors[0];
+}
+
+/* Allocates a free sector near *HINTP, fills it with zeros
+   through the buffer cache, and stores its number in *SECTORP
+   and *HINTP.  Returns true on success, false if the disk is
+   full. */
+static bool
+alloc_zeroed_sector (block_sector_t *sectorp, block_sector_t *hintp)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+
+  if (!free_map_allocate_near (*hintp, sectorp))
+    return false;
+  *hintp = *sectorp;
+  cache_write (*sectorp, zeros, 0, BLOCK_SECTOR_SIZE, CACHE_DATA);
+  return true;
+}
+
+/* Ensures that a zeroed data sector is mapped at sector index
+   INDEX in DISK, allocating it and any index blocks on the way
+   as needed.  New sectors are allocated near *HINTP, and *HINTP
+   is left holding the data sector mapped at INDEX, so that a
+   caller walking a file in order allocates it contiguously.
+   Returns true on success, false if INDEX is out of range or
+   the disk is full. */
+static bool
+extend_index (struct inode_disk *disk, size_t index, block_sector_t *hintp)
+{
+  block_sector_t table, sector;
+  size_t slot;
+
+  if (index < DIRECT_CNT)
+    {
+      if (disk->direct[index] != 0)
+        {
+          *hintp = disk->direct[index];
+          return true;
+        }
+      return alloc_zeroed_sector (&disk->direct[index], hintp);
+    }
+  index -= DIRECT_CNT;
+
+  if (index < INDIRECT_CNT)
+    {
+      if (disk->indirect == 0
+          && !alloc_zeroed_sector (&disk->indirect, hintp))
+        return false;
+      table = disk->indirect;
+      slot = index;
+    }
+  else
+    {
+      index -= INDIRECT_CNT;
+      if (index >= DBL_INDIRECT_CNT)
+        return false;
+      if (disk->doubly_indirect == 0
+          && !alloc_zeroed_sector (&disk->doubly_indirect, hintp))
+        return false;
+
+      slot = index / PTRS_PER_SECTOR;
+      cache_read (disk->doubly_indirect, &table, slot * sizeof table,
+                  sizeof table, CACHE_META);
+      if (table == 0)
+        {
+          if (!alloc_zeroed_sector (&table, hintp))
+            return false;
+          cache_write (disk->doubly_indirect, &table, slot * sizeof table,
+                       sizeof table, CACHE_META);
+        }
+      slot = index % PTRS_PER_SECTOR;
+    }
+
+  cache_read (table, &sector, slot * sizeof sector, sizeof sector,
+              CACHE_META);
+  if (sector == 0)
+    {
+      if (!alloc_zeroed_sector (&sector, hintp))
+        return false;
+      cache_write (table, &sector, slot * sizeof sector, sizeof sector,
+                   CACHE_META);
+    }
+  else
+    *hintp = sector;
+  return true;
+}
+
+/* Sectors released per journal transaction while reaping a
+   deleted inode.  A larger batch amortizes the journal overhead;
+   a smaller one keeps each transaction, and thus each stretch of
+   free-map activity, short. */
+#define REAP_BATCH 64
+
+/* Sectors collected for release in one journal transaction. */
+struct reap_batch
+  {
+    block_sector_t sectors[REAP_BATCH]; /* Sectors awaiting release. */
+    size_t cnt;                         /* Number in use. */
+  };
+
+/* Releases every sector collected in BATCH inside a single
+   journal transaction and empties it. */
+static void
+reap_flush (struct reap_batch *batch)
+{
+  size_t i;
+
+  if (batch->cnt == 0)
+    return;
+  journal_begin ();
+  for (i = 0; i < batch->cnt; i++)
+    free_map_release (batch->sectors[i], 1);
+  journal_commit ();
+  batch->cnt = 0;
+}
+
+/* Adds SECTOR to BATCH, flushing first if it is full. */
+static void
+reap_add (struct reap_batch *batch, block_sector_t sector)
+{
+  if (batch->cnt == REAP_BATCH)
+    reap_flush (batch);
+  batch->sectors[batch->cnt++] = sector;
+}
+
+/* Collects all data and index sectors mapped by DISK into BATCH
+   for release. */
+static void
+inode_disk_release (struct inode_disk *disk, struct reap_batch *batch)
+{
+  block_sector_t table, sector;
+  size_t i, j;
+
+  if (disk->is_inline)
+    return;
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    if (disk->direct[i] != 0)
+      reap_add (batch, disk->direct[i]);
+
+  if (disk->indirect != 0)
+    {
+      for (i = 0; i < PTRS_PER_SECTOR; i++)
+        {
+          cache_read (disk->indirect, &sector, i * sizeof sector,
+                      sizeof sector, CACHE_META);
+          if (sector != 0)
+            reap_add (batch, sector);
+        }
+      reap_add (batch, disk->indirect);
+    }
+
+  if (disk->doubly_indirect != 0)
+    {
+      for (i = 0; i < PTRS_PER_SECTOR; i++)
+        {
+          cache_read (disk->doubly_indirect, &table, i * sizeof table,
+                      sizeof table, CACHE_META);
+          if (table == 0)
+            continue;
+          for (j = 0; j < PTRS_PER_SECTOR; j++)
+            {
+              cache_read (table, &sector, j * sizeof sector, sizeof sector,
+                          CACHE_META);
+              if (sector != 0)
+                reap_add (batch, sector);
+            }
+          reap_add (batch, table);
+        }
+      reap_add (batch, disk->doubly_indirect);
+    }
+}
+
+/* Points sector index INDEX in DISK at SECTOR, overwriting the
+   previous mapping, which must exist.  Index blocks are reused
+   in place; only the data pointer changes.  The caller must have
+   a journal transaction open, so the update is logged. */
+static void
+index_set (struct inode_disk *disk, size_t index, block_sector_t sector)
+{
+  block_sector_t table;
+  size_t slot;
+
+  if (index < DIRECT_CNT)
+    {
+      disk->direct[index] = sector;
+      return;
+    }
+  index -= DIRECT_CNT;
+
+  if (index < INDIRECT_CNT)
+    {
+      table = disk->indirect;
+      slot = index;
+    }
+  else
+    {
+      index -= INDIRECT_CNT;
+      ASSERT (index < DBL_INDIRECT_CNT);
+      cache_read (disk->doubly_indirect, &table,
+                  index / PTRS_PER_SECTOR * sizeof table, sizeof table,
+                  CACHE_META);
+      slot = index % PTRS_PER_SECTOR;
+    }
+  ASSERT (table != 0);
+  cache_write (table, &sector, slot * sizeof sector, sizeof sector,
+               CACHE_META);
+}
+
 /* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   within INODE, 0 if POS falls in a hole -- an unallocated
+   sector, which reads as zeros -- or -1 if INODE does not
+   contain data for a byte at offset POS.  Memoizes translations
+   in C, which may be null. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector_cached (const struct inode *inode, off_t pos,
+                       struct inode_cache *c)
 {
   ASSERT (inode != NULL);
   if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+    return index_to_sector_cached (inode, pos / BLOCK_SECTOR_SIZE, c);
   else
     return -1;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Returns the sector mapped at sector index INDEX in INODE,
+   allocating a zeroed sector there -- filling a hole -- if none
+   is.  New sectors are placed near *HINTP when it is nonzero, or
+   near the preceding data sector otherwise, so sequential writes
+   lay the file out contiguously; *HINTP is left holding the
+   mapped sector.  The allocation, including any index-block and
+   inode updates, is journaled.  Translations are memoized in C,
+   which may be null.  Returns 0 if the disk is full.  The
+   caller must hold INODE's io_lock for writing. */
+static block_sector_t
+sector_for_write (struct inode *inode, size_t index, block_sector_t *hintp,
+                  struct inode_cache *c)
+{
+  block_sector_t sector = index_to_sector_cached (inode, index, c);
+
+  if (sector != 0)
+    {
+      *hintp = sector;
+      return sector;
+    }
+
+  journal_begin ();
+  if (*hintp == 0 && index > 0)
+    *hintp = index_to_sector (&inode->data, index - 1);
+  if (!extend_index (&inode->data, index, hintp))
+    {
+      journal_commit ();
+      return 0;
+    }
+  sector = *hintp;
+  inode->map_gen++;
+  cache_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE,
+               CACHE_META);
+  journal_commit ();
+  return sector;
+}
+
+/* Converts inline INODE to the indexed layout, moving its inline
+   bytes into a freshly allocated data sector.  *HINTP receives
+   that sector, so a caller growing the file keeps allocating
+   after it.  The conversion is journaled, so a crash leaves the
+   inode wholly inline or wholly indexed.  Returns true on
+   success, false if the disk is full, in which case INODE is
+   left inline and unchanged.  The caller must hold INODE's
+   io_lock for writing. */
+static bool
+inode_spill_inline (struct inode *inode, block_sector_t *hintp)
+{
+  uint8_t copy[INODE_INLINE_MAX];
+  off_t length = inode->data.length;
+
+  ASSERT (inode->data.is_inline);
+
+  memcpy (copy, inode->data.inline_data, sizeof copy);
+  journal_begin ();
+  memset (inode->data.inline_data, 0, sizeof copy);
+  inode->data.is_inline = 0;
+  if (length > 0)
+    {
+      if (!extend_index (&inode->data, 0, hintp))
+        {
+          memcpy (inode->data.inline_data, copy, sizeof copy);
+          inode->data.is_inline = 1;
+          journal_commit ();
+          return false;
+        }
+      cache_write (inode->data.direct[0], copy, 0, length, CACHE_DATA);
+    }
+  inode->map_gen++;
+  cache_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE,
+               CACHE_META);
+  journal_commit ();
+  return true;
+}
+
+/* Open inodes, hashed by sector number, so that opening a single
+   inode twice returns the same `struct inode' and the lookup
+   costs a hash probe rather than a walk of every open inode. */
+static struct hash open_inodes;
+
+/* Protects open_inodes.  Lookups take it for reading, so
+   concurrent opens of already-open inodes proceed in parallel;
+   only inserting or removing an inode takes it for writing.
+   open_cnt itself is kept with lock-prefixed atomics, so
+   reopening or closing an already-open inode is a single atomic
+   op with no lock at all; only the transitions that change the
+   table -- first open and last close -- take the write side.
+   The 1 -> 0 transition in inode_close() must hold it, because
+   a lookup takes its reference under the read side and would
+   otherwise revive an inode mid-removal. */
+static struct rwlock open_inodes_lock;
+
+/* Atomic operations on open_cnt.  The lock prefix makes each
+   atomic against other processors as well as interrupts; see the
+   commentary on cas() in lib/kernel/mpsc.c. */
+
+/* Atomically increments *P. */
+static inline void
+refcount_inc (int *p)
+{
+  asm volatile ("lock incl %0" : "+m" (*p) : : "memory", "cc");
+}
+
+/* Atomically decrements *P and returns true if it reached
+   zero. */
+static inline bool
+refcount_dec_and_test (int *p)
+{
+  uint8_t zero;
+
+  asm volatile ("lock decl %1; sete %0"
+                : "=q" (zero), "+m" (*p) : : "memory", "cc");
+  return zero;
+}
+
+/* Atomically sets *P to NEW if it still equals OLD.  Returns
+   true if the swap happened, false if *P had changed. */
+static inline bool
+refcount_cas (int *p, int old, int new_)
+{
+  uint8_t ok;
+
+  asm volatile ("lock cmpxchgl %3, %1; sete %0"
+                : "=q" (ok), "+m" (*p), "+a" (old)
+                : "r" (new_)
+                : "memory", "cc");
+  return ok;
+}
+
+/* Slab cache for struct inode. */
+static struct slab_cache *inode_cache;
+
+/* Inodes whose last opener closed them after removal, awaiting
+   deallocation.  The closer pushes onto the lock-free queue and
+   ups kill_sema; the reaper daemon pops the whole backlog at
+   once and releases each inode's sectors in the background, so
+   the last closer of a large deleted file is not stalled for the
+   whole free-walk and never contends with a reaper mid-walk. */
+static struct mpsc_queue kill_queue;
+static struct semaphore kill_sema;
+
+static thread_func reaper_daemon;
+
+/* Hashes the inode E by its sector number. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct inode *inode = hash_entry (e, struct inode, elem);
+
+  return hash_int (inode->sector);
+}
+
+/* Orders inodes A and B by sector number. */
+static bool
+inode_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct inode *a = hash_entry (a_, struct inode, elem);
+  const struct inode *b = hash_entry (b_, struct inode, elem);
+
+  return a->sector < b->sector;
+}
 
 /* Initializes the inode module. */
 void
-inode_init (void) 
+inode_init (void)
 {
-  list_init (&open_inodes);
+  if (!hash_init (&open_inodes, inode_hash, inode_less, NULL))
+    PANIC ("Failed to create open inode table");
+  rwlock_init (&open_inodes_lock);
+  lock_set_name (&open_inodes_lock.lock, "open_inodes");
+  inode_cache = slab_create ("inode", sizeof (struct inode));
+  if (inode_cache == NULL)
+    PANIC ("Failed to create inode slab cache");
+
+  mpsc_init (&kill_queue);
+  sema_init (&kill_sema, 0);
+  thread_create ("reaperd", PRI_MIN, reaper_daemon, NULL);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  A file small enough to fit is created inline; a
+   larger one is created entirely sparse, with no data sectors
+   allocated.  Either way creation costs one sector write no
+   matter how large LENGTH is, and the whole file reads as zeros
+   until it is written.
    Returns true if successful.
-   Returns false if memory or disk allocation fails. */
+   Returns false if memory allocation fails or LENGTH exceeds the
+   maximum file size. */
 bool
-inode_create (block_sector_t sector, off_t length)
+inode_create (block_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *disk_inode = NULL;
   bool success = false;
@@ -81,25 +646,18 @@ inode_create (block_sector_t sector, off_t length)
      one sector in size, and you should fix that. */
   ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
 
+  if (bytes_to_sectors (length) > INODE_MAX_SECTORS)
+    return false;
+
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
       disk_inode->length = length;
+      disk_inode->is_dir = is_dir;
+      disk_inode->is_inline = length <= (off_t) INODE_INLINE_MAX;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
-        {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
-          success = true; 
-        } 
+      cache_write (sector, disk_inode, 0, BLOCK_SECTOR_SIZE, CACHE_META);
+      success = true;
       free (disk_inode);
     }
   return success;
@@ -111,33 +669,53 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  struct inode key;
+  struct hash_elem *e;
   struct inode *inode;
 
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  key.sector = sector;
+  rwlock_acquire_read (&open_inodes_lock);
+  e = hash_find (&open_inodes, &key.elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
+      inode = hash_entry (e, struct inode, elem);
+      refcount_inc (&inode->open_cnt);
+      rwlock_release_read (&open_inodes_lock);
+      return inode;
     }
+  rwlock_release_read (&open_inodes_lock);
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  inode = slab_alloc (inode_cache);
   if (inode == NULL)
     return NULL;
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  inode->dirty = false;
+  inode->map_gen = 0;
+  rwlock_init (&inode->io_lock);
+  cache_read (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE,
+              CACHE_META);
+
+  rwlock_acquire_write (&open_inodes_lock);
+  e = hash_insert (&open_inodes, &inode->elem);
+  if (e != NULL)
+    {
+      /* Somebody opened the same sector while we were reading it
+         in; use their inode and drop ours. */
+      struct inode *existing = hash_entry (e, struct inode, elem);
+
+      refcount_inc (&existing->open_cnt);
+      rwlock_release_write (&open_inodes_lock);
+      slab_free (inode_cache, inode);
+      return existing;
+    }
+  rwlock_release_write (&open_inodes_lock);
   return inode;
 }
 
@@ -146,7 +724,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      /* The caller already holds a reference, so the inode
+         cannot go away; one atomic increment suffices. */
+      refcount_inc (&inode->open_cnt);
+    }
   return inode;
 }
 
@@ -157,31 +739,148 @@ inode_get_inumber (const struct inode *inode)
   return inode->sector;
 }
 
+/* Returns true if INODE holds a directory. */
+bool
+inode_is_dir (const struct inode *inode)
+{
+  return inode->data.is_dir != 0;
+}
+
+/* Returns the number of openers INODE currently has. */
+int
+inode_open_cnt (const struct inode *inode)
+{
+  return inode->open_cnt;
+}
+
+/* Deletion daemon.  Pulls removed inodes off the kill list and
+   releases their sectors, REAP_BATCH per journal transaction, so
+   that no single transaction -- and no single stretch of
+   free-map activity -- covers the whole file. */
+static void
+reaper_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct mpsc_elem *e;
+
+      sema_down (&kill_sema);
+      for (e = mpsc_pop_all (&kill_queue); e != NULL; )
+        {
+          struct inode *inode = mpsc_entry (e, struct inode, kill_elem);
+          struct reap_batch batch;
+
+          /* Advance before releasing: the chain runs through the
+             inode being freed. */
+          e = e->next;
+
+          batch.cnt = 0;
+          reap_add (&batch, inode->sector);
+          inode_disk_release (&inode->data, &batch);
+          reap_flush (&batch);
+          slab_free (inode_cache, inode);
+        }
+    }
+}
+
+/* Writes INODE's in-memory metadata back through the journal if
+   it has changed since the last flush.  Callers must exclude
+   writers, by holding io_lock in either mode or by being the
+   last opener. */
+static void
+inode_flush (struct inode *inode)
+{
+  if (!inode->dirty)
+    return;
+  journal_begin ();
+  cache_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE,
+               CACHE_META);
+  journal_commit ();
+  inode->dirty = false;
+}
+
+/* Flushes every open inode's changed metadata.  Called from the
+   cache's write-behind daemon after the cache itself has been
+   flushed, so a length that covers freshly appended data is
+   journaled only once the data's home sectors are durable, and
+   from filesys_done().  See inode_write_at() for why lengths are
+   deferred at all. */
+void
+inode_flush_all (void)
+{
+  struct hash_iterator i;
+
+  rwlock_acquire_read (&open_inodes_lock);
+  hash_first (&i, &open_inodes);
+  while (hash_next (&i))
+    {
+      struct inode *inode = hash_entry (hash_cur (&i), struct inode, elem);
+
+      if (inode->dirty && !inode->removed)
+        {
+          rwlock_acquire_read (&inode->io_lock);
+          inode_flush (inode);
+          rwlock_release_read (&inode->io_lock);
+        }
+    }
+  rwlock_release_read (&open_inodes_lock);
+}
+
 /* Closes INODE and writes it to disk.
    If this was the last reference to INODE, frees its memory.
-   If INODE was also a removed inode, frees its blocks. */
+   If INODE was also a removed inode, hands it to the reaper
+   daemon, which frees its blocks in the background; the closer
+   returns without waiting for the deallocation. */
 void
-inode_close (struct inode *inode) 
+inode_close (struct inode *inode)
 {
+  bool last;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
-  /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  /* Drop a reference that is provably not the last with one
+     compare-and-swap and no lock; this is the common case for a
+     busy file.  The loop retries only if the count changed under
+     us. */
+  for (;;)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
-      /* Deallocate blocks if removed. */
-      if (inode->removed) 
+      int cnt = inode->open_cnt;
+
+      ASSERT (cnt > 0);
+      if (cnt == 1)
+        break;
+      if (refcount_cas (&inode->open_cnt, cnt, cnt - 1))
+        return;
+    }
+
+  /* Possibly the last reference.  The 1 -> 0 transition must
+     exclude openers, who take their references under the read
+     side of the table lock; an opener may still slip in before
+     we get the write side, so the count is checked again once we
+     hold it. */
+  rwlock_acquire_write (&open_inodes_lock);
+  last = refcount_dec_and_test (&inode->open_cnt);
+  if (last)
+    hash_delete (&open_inodes, &inode->elem);
+  rwlock_release_write (&open_inodes_lock);
+
+  /* Release resources if this was the last opener.  A removed
+     inode goes to the reaper instead of being deallocated here,
+     so unlinking a large file costs the closer O(1). */
+  if (last)
+    {
+      if (inode->removed)
         {
-          free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          mpsc_push (&kill_queue, &inode->kill_elem);
+          sema_up (&kill_sema);
+        }
+      else
+        {
+          inode_flush (inode);
+          slab_free (inode_cache, inode);
         }
-
-      free (inode); 
     }
 }
 
@@ -194,20 +893,120 @@ inode_remove (struct inode *inode)
   inode->removed = true;
 }
 
+/* Largest read-ahead window, in sectors.  The daemon's request
+   queue holds READAHEAD_MAX entries for all readers together, so
+   one scanner may fill at most a quarter of it per read. */
+#define RA_WINDOW_MAX 16
+
+/* Classifies the read that just covered [START, END) against the
+   handle's previous reads and prefetches accordingly.  A read
+   that begins where the last one ended extends a sequential run
+   and doubles the window, up to RA_WINDOW_MAX sectors; a read
+   whose distance from the last matches the previous gap is
+   strided, and the sector at the predicted next position is
+   fetched; anything else looks random and turns prefetch off
+   until a pattern reappears, so mispredicted fetches do not
+   pollute the cache.  RA_ISSUED keeps a widening window from
+   re-requesting sectors already asked for.  The inode's read
+   lock must be held. */
+static void
+pattern_readahead (struct inode *inode, struct inode_cache *c,
+                   off_t start, off_t end)
+{
+  off_t length = inode_length (inode);
+
+  if (start == c->ra_next)
+    {
+      /* Sequential run continues. */
+      c->ra_window = (c->ra_window == 0 ? 1
+                      : c->ra_window < RA_WINDOW_MAX ? c->ra_window * 2
+                      : RA_WINDOW_MAX);
+      c->ra_stride = 0;
+    }
+  else if (c->ra_stride != 0 && start - c->ra_last == c->ra_stride)
+    {
+      /* Same gap twice in a row: a strided scanner.  Fetch the
+         one sector the next stride will land on. */
+      off_t predicted = start + c->ra_stride;
+
+      c->ra_window = 0;
+      if (predicted >= 0 && predicted < length)
+        {
+          block_sector_t s = byte_to_sector_cached (inode, predicted, c);
+
+          if (s != (block_sector_t) -1 && s != 0)
+            cache_readahead (s);
+        }
+    }
+  else
+    {
+      /* Neither sequential nor a known stride; remember the gap
+         so a stride can be confirmed next time, and stop
+         prefetching meanwhile. */
+      c->ra_stride = start - c->ra_last;
+      c->ra_window = 0;
+      c->ra_issued = 0;
+    }
+  c->ra_last = start;
+  c->ra_next = end;
+
+  if (c->ra_window > 0 && end < length)
+    {
+      off_t pos = ROUND_UP (end, BLOCK_SECTOR_SIZE);
+      off_t limit = end + (off_t) c->ra_window * BLOCK_SECTOR_SIZE;
+
+      if (limit > length)
+        limit = length;
+      if (pos < c->ra_issued)
+        pos = c->ra_issued;
+      for (; pos < limit; pos += BLOCK_SECTOR_SIZE)
+        {
+          block_sector_t s = byte_to_sector_cached (inode, pos, c);
+
+          if (s != (block_sector_t) -1 && s != 0)
+            cache_readahead (s);
+        }
+      c->ra_issued = limit;
+    }
+}
+
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
+   than SIZE if an error occurs or end of file is reached.
+   Memoizes translations in C, which may be null; a file handle
+   reading sequentially through its own cache resolves each
+   sector without walking the index chain. */
 off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
+inode_read_at_cached (struct inode *inode, void *buffer_, off_t size,
+                      off_t offset, struct inode_cache *c)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
+  off_t start = offset;
+
+  rwlock_acquire_read (&inode->io_lock);
+
+  /* An inline inode's data is already in memory; copy it out
+     without touching the cache at all. */
+  if (inode->data.is_inline)
+    {
+      off_t inode_left = inode->data.length - offset;
+
+      if (size > inode_left)
+        size = inode_left;
+      if (size > 0)
+        {
+          memcpy (buffer, inode->data.inline_data + offset, size);
+          bytes_read = size;
+        }
+      rwlock_release_read (&inode->io_lock);
+      return bytes_read;
+    }
 
-  while (size > 0) 
+  while (size > 0)
     {
       /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx = byte_to_sector_cached (inode, offset, c);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -220,55 +1019,169 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      if (sector_idx == 0)
         {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
+          /* A hole: unallocated sectors read as zeros without
+             touching the disk.  A run of whole-sector holes is
+             cleared in one pass. */
+          if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
             {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
+              size_t cnt = 1;
+
+              while ((off_t) (cnt + 1) * BLOCK_SECTOR_SIZE <= size
+                     && (off_t) (cnt + 1) * BLOCK_SECTOR_SIZE <= inode_left
+                     && byte_to_sector_cached (inode,
+                                               offset + cnt
+                                               * BLOCK_SECTOR_SIZE, c) == 0)
+                cnt++;
+              chunk_size = cnt * BLOCK_SECTOR_SIZE;
             }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+          memset (buffer + bytes_read, 0, chunk_size);
+        }
+      else if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+        {
+          /* A span of whole sectors is transferred directly,
+             batching sectors that are consecutive on disk into a
+             single request. */
+          size_t cnt = 1;
+
+          while ((off_t) (cnt + 1) * BLOCK_SECTOR_SIZE <= size
+                 && (off_t) (cnt + 1) * BLOCK_SECTOR_SIZE <= inode_left
+                 && byte_to_sector_cached (inode,
+                                           offset + cnt * BLOCK_SECTOR_SIZE,
+                                           c) == sector_idx + cnt)
+            cnt++;
+          cache_read_direct (sector_idx, cnt, buffer + bytes_read);
+          chunk_size = cnt * BLOCK_SECTOR_SIZE;
         }
-      
+      else
+        {
+          /* The buffer cache does the sector I/O and any partial-
+             sector copying. */
+          cache_read (sector_idx, buffer + bytes_read, sector_ofs,
+                      chunk_size, CACHE_DATA);
+        }
+
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
 
+  /* Ask the read-ahead daemon to prefetch ahead of a reader
+     whose next access is predictable.  A file handle's cache
+     carries its access-pattern state, which decides how much to
+     fetch, if anything; a caller without one gets the old
+     fixed next-sector prefetch. */
+  if (bytes_read > 0)
+    {
+      if (c != NULL)
+        {
+          /* A direct handle streams data it will read exactly
+             once: prefetching it would evict everyone else's
+             working set for nothing. */
+          if (!c->direct)
+            pattern_readahead (inode, c, start, offset);
+        }
+      else if (offset < inode_length (inode))
+        {
+          block_sector_t next = byte_to_sector_cached (inode, offset, c);
+          if (next != (block_sector_t) -1 && next != 0)
+            cache_readahead (next);
+        }
+    }
+
+  rwlock_release_read (&inode->io_lock);
   return bytes_read;
 }
 
+/* As inode_read_at_cached() without a translation cache. */
+off_t
+inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
+{
+  return inode_read_at_cached (inode, buffer_, size, offset, NULL);
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
-   Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   A write past end of file extends the inode, so the number of
+   bytes actually written is less than SIZE only if an error
+   occurs, e.g. the disk fills up.  Memoizes translations in C,
+   which may be null, as in inode_read_at_cached(); allocations
+   bump the mapping generation, so the cache helps overwrites
+   and goes quietly stale while holes fill. */
 off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
-                off_t offset) 
+inode_write_at_cached (struct inode *inode, const void *buffer_, off_t size,
+                       off_t offset, struct inode_cache *c)
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
+  block_sector_t hint = 0;
 
   if (inode->deny_write_cnt)
     return 0;
 
-  while (size > 0) 
+  rwlock_acquire_write (&inode->io_lock);
+
+  /* A write that fits in an inline inode updates the inode
+     sector directly; one that does not spills the inline bytes
+     out to a data sector and falls through to the indexed path
+     below.  Bytes between the old end of file and OFFSET are
+     already zero: the inline area is zeroed at creation and
+     files never shrink. */
+  if (inode->data.is_inline)
+    {
+      if (offset + size <= (off_t) INODE_INLINE_MAX)
+        {
+          if (offset + size > inode->data.length)
+            inode->data.length = offset + size;
+          memcpy (inode->data.inline_data + offset, buffer, size);
+          inode->dirty = true;
+          if (journal_active ())
+            inode_flush (inode);
+          rwlock_release_write (&inode->io_lock);
+          return size;
+        }
+      if (!inode_spill_inline (inode, &hint))
+        {
+          rwlock_release_write (&inode->io_lock);
+          return 0;
+        }
+    }
+
+  /* Grow the file if the write extends past end of file.  Only
+     the length changes: the gap between the old end of file and
+     OFFSET stays a hole that reads as zeros, and data sectors
+     are allocated below only where this write actually lands.
+     The new length changes only in memory here; writing the
+     inode sector -- and its synchronous journal record -- per
+     append would turn a 1 MB append done in 1 kB chunks into a
+     thousand metadata transactions.  Instead the inode is marked
+     dirty and flushed by the write-behind daemon, after the data
+     it covers, or at the latest by inode_flush() on close. */
+  if (offset + size > inode_length (inode))
     {
-      /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      if (bytes_to_sectors (offset + size) > INODE_MAX_SECTORS)
+        {
+          rwlock_release_write (&inode->io_lock);
+          return 0;
+        }
+      inode->data.length = offset + size;
+      inode->dirty = true;
+
+      /* Inside a caller's transaction -- a directory operation
+         extending its entry array -- the new length rides along
+         in the caller's journal record for free and keeps the
+         whole operation atomic. */
+      if (journal_active ())
+        inode_flush (inode);
+    }
+
+  while (size > 0)
+    {
+      /* Sector to write, starting byte offset within sector.
+         Writing into a hole allocates the sector. */
+      block_sector_t sector_idx
+        = sector_for_write (inode, offset / BLOCK_SECTOR_SIZE, &hint, c);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -278,33 +1191,33 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 
       /* Number of bytes to actually write into this sector. */
       int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
+      if (chunk_size <= 0 || sector_idx == 0)
         break;
 
       if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
         {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
+          /* A span of whole sectors is transferred directly, as
+             in inode_read_at().  Allocating each sector with the
+             previous one as the hint keeps the run contiguous on
+             disk, so it usually extends the batch. */
+          size_t cnt = 1;
+
+          while ((off_t) (cnt + 1) * BLOCK_SECTOR_SIZE <= size
+                 && (off_t) (cnt + 1) * BLOCK_SECTOR_SIZE <= inode_left
+                 && sector_for_write (inode,
+                                      offset / BLOCK_SECTOR_SIZE + cnt,
+                                      &hint, c) == sector_idx + cnt)
+            cnt++;
+          cache_write_direct (sector_idx, cnt, buffer + bytes_written);
+          chunk_size = cnt * BLOCK_SECTOR_SIZE;
         }
-      else 
+      else
         {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
+          /* The buffer cache merges partial-sector writes with
+             the sector's other contents and defers the disk
+             write. */
+          cache_write (sector_idx, buffer + bytes_written, sector_ofs,
+                       chunk_size, CACHE_DATA);
         }
 
       /* Advance. */
@@ -312,11 +1225,19 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
 
+  rwlock_release_write (&inode->io_lock);
   return bytes_written;
 }
 
+/* As inode_write_at_cached() without a translation cache. */
+off_t
+inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+                off_t offset)
+{
+  return inode_write_at_cached (inode, buffer_, size, offset, NULL);
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
@@ -343,3 +1264,254 @@ inode_length (const struct inode *inode)
 {
   return inode->data.length;
 }
+
+/* Relocates INODE's data into a single contiguous run of sectors,
+   so that sequential reads of an aged, fragmented file cost the
+   same seeks as a freshly written one.  Index blocks are reused
+   in place; only data sectors move.  Returns true if INODE's
+   data is contiguous on return -- including the cases where it
+   already was, is stored inline, or spans at most one sector --
+   and false if the free map held no contiguous run of the
+   required size, in which case INODE is untouched.
+
+   The data is copied into the new run before any pointer is
+   switched, so while the journaled switch runs the old and new
+   sectors hold identical bytes and a crash at any point leaves
+   the file readable.  A crash between allocating the run and
+   committing the switch strands the new sectors until the next
+   format, the same exposure as any interrupted creation. */
+bool
+inode_defrag (struct inode *inode)
+{
+  struct reap_batch batch;
+  block_sector_t start, base = 0;
+  bool contiguous = true;
+  size_t cnt, i;
+  void *bounce;
+
+  ASSERT (inode != NULL);
+
+  rwlock_acquire_write (&inode->io_lock);
+  cnt = bytes_to_sectors (inode->data.length);
+  if (inode->data.is_inline || cnt <= 1)
+    {
+      rwlock_release_write (&inode->io_lock);
+      return true;
+    }
+
+  /* Nothing to do if the allocated sectors already line up.
+     Holes may fall anywhere; only allocated sectors count. */
+  for (i = 0; i < cnt && contiguous; i++)
+    {
+      block_sector_t old = index_to_sector (&inode->data, i);
+
+      if (old == 0)
+        continue;
+      if (base == 0)
+        base = old - i;
+      else if (old != base + i)
+        contiguous = false;
+    }
+  if (contiguous)
+    {
+      rwlock_release_write (&inode->io_lock);
+      return true;
+    }
+
+  bounce = malloc (BLOCK_SECTOR_SIZE);
+  if (bounce == NULL)
+    {
+      rwlock_release_write (&inode->io_lock);
+      return false;
+    }
+
+  journal_begin ();
+  if (!free_map_allocate (cnt, &start))
+    {
+      journal_commit ();
+      free (bounce);
+      rwlock_release_write (&inode->io_lock);
+      return false;
+    }
+  journal_commit ();
+
+  /* Copy the data first, outside any transaction: data blocks do
+     not belong in the journal, and until the pointers flip below
+     the copies are invisible. */
+  for (i = 0; i < cnt; i++)
+    {
+      block_sector_t old = index_to_sector (&inode->data, i);
+
+      if (old == 0)
+        continue;
+      cache_read (old, bounce, 0, BLOCK_SECTOR_SIZE, CACHE_DATA);
+      cache_write (start + i, bounce, 0, BLOCK_SECTOR_SIZE, CACHE_DATA);
+    }
+
+  /* Switch every pointer to the new run in one transaction and
+     collect the displaced sectors.  Slots under holes stay holes;
+     their share of the run goes straight back to the free map. */
+  batch.cnt = 0;
+  journal_begin ();
+  for (i = 0; i < cnt; i++)
+    {
+      block_sector_t old = index_to_sector (&inode->data, i);
+
+      if (old != 0)
+        {
+          index_set (&inode->data, i, start + i);
+          reap_add (&batch, old);
+        }
+      else
+        reap_add (&batch, start + i);
+    }
+  inode->map_gen++;
+  cache_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE, CACHE_META);
+  journal_commit ();
+  reap_flush (&batch);
+
+  free (bounce);
+  rwlock_release_write (&inode->io_lock);
+  return true;
+}
+
+/* Marks INODE's own sector and every data and index sector it
+   maps as in use in the free map.  fsck calls this for each
+   reachable inode to rebuild the free map after an unclean
+   shutdown; see fsck_run(). */
+void
+inode_mark_sectors (struct inode *inode)
+{
+  struct inode_disk *disk = &inode->data;
+  block_sector_t table, sector;
+  size_t i, j;
+
+  free_map_mark (inode->sector);
+  if (disk->is_inline)
+    return;
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    if (disk->direct[i] != 0)
+      free_map_mark (disk->direct[i]);
+
+  if (disk->indirect != 0)
+    {
+      free_map_mark (disk->indirect);
+      for (i = 0; i < PTRS_PER_SECTOR; i++)
+        {
+          cache_read (disk->indirect, &sector, i * sizeof sector,
+                      sizeof sector, CACHE_META);
+          if (sector != 0)
+            free_map_mark (sector);
+        }
+    }
+
+  if (disk->doubly_indirect != 0)
+    {
+      free_map_mark (disk->doubly_indirect);
+      for (i = 0; i < PTRS_PER_SECTOR; i++)
+        {
+          cache_read (disk->doubly_indirect, &table, i * sizeof table,
+                      sizeof table, CACHE_META);
+          if (table == 0)
+            continue;
+          free_map_mark (table);
+          for (j = 0; j < PTRS_PER_SECTOR; j++)
+            {
+              cache_read (table, &sector, j * sizeof sector, sizeof sector,
+                          CACHE_META);
+              if (sector != 0)
+                free_map_mark (sector);
+            }
+        }
+    }
+}
+
+/* Checks one SECTOR mapped by INODE for the scrubber: it must be
+   in use in the free map and not yet claimed by another inode
+   this pass.  Returns the number of inconsistencies. */
+static int
+check_sector (const struct inode *inode, block_sector_t sector,
+              struct bitmap *shadow)
+{
+  int bad = 0;
+
+  if (!free_map_test (sector))
+    {
+      printf ("scrub: sector %"PRDSNu" of inode %"PRDSNu
+              " is free in the free map\n", sector, inode->sector);
+      bad++;
+    }
+  if (bitmap_test (shadow, sector))
+    {
+      printf ("scrub: sector %"PRDSNu" of inode %"PRDSNu
+              " is also mapped by another inode\n", sector, inode->sector);
+      bad++;
+    }
+  else
+    bitmap_mark (shadow, sector);
+  return bad;
+}
+
+/* Cross-checks INODE's own sector and every data and index
+   sector it maps against the free map and against SHADOW, the
+   sectors that inodes visited earlier in the same scrubber pass
+   already claimed.  A mapped sector that the free map calls free
+   is a stale map; one that SHADOW already holds is a double
+   allocation.  Holds the index read lock across the walk so the
+   view of the index is consistent.  Returns the number of
+   inconsistencies found; see scrub.c. */
+int
+inode_check_sectors (struct inode *inode, struct bitmap *shadow)
+{
+  struct inode_disk *disk = &inode->data;
+  block_sector_t table, sector;
+  size_t i, j;
+  int bad = 0;
+
+  rwlock_acquire_read (&inode->io_lock);
+
+  bad += check_sector (inode, inode->sector, shadow);
+  if (disk->is_inline)
+    goto done;
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    if (disk->direct[i] != 0)
+      bad += check_sector (inode, disk->direct[i], shadow);
+
+  if (disk->indirect != 0)
+    {
+      bad += check_sector (inode, disk->indirect, shadow);
+      for (i = 0; i < PTRS_PER_SECTOR; i++)
+        {
+          cache_read (disk->indirect, &sector, i * sizeof sector,
+                      sizeof sector, CACHE_META);
+          if (sector != 0)
+            bad += check_sector (inode, sector, shadow);
+        }
+    }
+
+  if (disk->doubly_indirect != 0)
+    {
+      bad += check_sector (inode, disk->doubly_indirect, shadow);
+      for (i = 0; i < PTRS_PER_SECTOR; i++)
+        {
+          cache_read (disk->doubly_indirect, &table, i * sizeof table,
+                      sizeof table, CACHE_META);
+          if (table == 0)
+            continue;
+          bad += check_sector (inode, table, shadow);
+          for (j = 0; j < PTRS_PER_SECTOR; j++)
+            {
+              cache_read (table, &sector, j * sizeof sector, sizeof sector,
+                          CACHE_META);
+              if (sector != 0)
+                bad += check_sector (inode, sector, shadow);
+            }
+        }
+    }
+
+ done:
+  rwlock_release_read (&inode->io_lock);
+  return bad;
+}
@@ -2,22 +2,69 @@
 #define FILESYS_INODE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "filesys/off_t.h"
 #include "devices/block.h"
 
 struct bitmap;
 
+/* Number of consecutive sector pointers an inode cache
+   memoizes: 64 bytes, one read of an index block's worth of
+   neighboring pointers. */
+#define INODE_CACHE_PTRS 16
+
+/* Memoized file-block-to-sector translations for one file
+   handle.  Holds a run of consecutive sector pointers, so
+   sequential access resolves the next sector with a comparison
+   instead of a walk down the index chain.  GEN is checked
+   against the inode's mapping generation, which growth and
+   relocation bump, so a stale cache misses harmlessly.
+
+   Also carries the handle's read-pattern state, which drives
+   adaptive read-ahead; see pattern_readahead() in inode.c. */
+struct inode_cache
+  {
+    unsigned gen;               /* Inode mapping generation at fill. */
+    size_t start;               /* First cached sector index. */
+    size_t cnt;                 /* Cached pointers; 0 when empty. */
+    block_sector_t sectors[INODE_CACHE_PTRS];   /* The translations. */
+
+    off_t ra_next;              /* End of the last read; a read starting
+                                   here continues a sequential run. */
+    off_t ra_last;              /* Start of the last read. */
+    off_t ra_stride;            /* Gap between the last two read starts. */
+    off_t ra_issued;            /* Prefetch already issued up to here. */
+    unsigned ra_window;         /* Sectors to prefetch ahead; 0 = none. */
+
+    bool direct;                /* Direct I/O: suppress read-ahead, so a
+                                   file streamed once through this handle
+                                   does not fill the buffer cache with
+                                   sectors nobody will read again. */
+  };
+
+void inode_cache_init (struct inode_cache *);
+
 void inode_init (void);
-bool inode_create (block_sector_t, off_t);
+void inode_flush_all (void);
+bool inode_create (block_sector_t, off_t, bool is_dir);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
 block_sector_t inode_get_inumber (const struct inode *);
+bool inode_is_dir (const struct inode *);
+int inode_open_cnt (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
+off_t inode_read_at_cached (struct inode *, void *, off_t size, off_t offset,
+                            struct inode_cache *);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+off_t inode_write_at_cached (struct inode *, const void *, off_t size,
+                             off_t offset, struct inode_cache *);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
+bool inode_defrag (struct inode *);
+void inode_mark_sectors (struct inode *);
+int inode_check_sectors (struct inode *, struct bitmap *);
 
 #endif /* filesys/inode.h */
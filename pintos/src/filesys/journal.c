@@ -0,0 +1,312 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Write-ahead journal for file system metadata.
+
+   A metadata operation (creating, extending or removing a file
+   or directory) dirties several sectors -- inode, directory
+   data, index blocks, the free map -- and a crash between the
+   in-place writes of those sectors leaves the file system
+   inconsistent.  Callers bracket such an operation with
+   journal_begin() and journal_commit(); every sector the buffer
+   cache dirties in between is logged, and commit writes the
+   whole set sequentially into a reserved journal region,
+   finishing with a record sector that makes the transaction
+   valid.  Only after that may the home sectors go to disk in
+   place.  Recovery at mount replays every valid record, so an
+   operation either happened entirely or not at all.
+
+   Checkpointing is lazy: the flush daemon clears the journal
+   after writing the cache back, and a commit that runs out of
+   journal space forces the same thing.  A single transaction
+   may hold at most TXN_MAX sectors; an oversized transaction is
+   split into several records and is atomic only record by
+   record. */
+
+/* Identifies a valid journal record sector. */
+#define JOURNAL_MAGIC 0x4a524e4c
+
+/* Identifies the clean-shutdown marker stamped on the journal's
+   first sector by journal_mark_clean(). */
+#define JOURNAL_CLEAN_MAGIC 0x4a434c4e
+
+/* Maximum sectors logged per journal record. */
+#define TXN_MAX 32
+
+/* On-disk journal record.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.  The CNT data
+   sectors follow it in the journal region; SECTORS gives their
+   home locations. */
+struct journal_record
+  {
+    uint32_t magic;                     /* JOURNAL_MAGIC. */
+    uint32_t seq;                       /* Transaction sequence number. */
+    uint32_t cnt;                       /* Number of data sectors. */
+    block_sector_t sectors[TXN_MAX];    /* Home sector of each. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 12 - TXN_MAX * 4];
+  };
+
+/* Held by the owner for the whole life of a transaction, so
+   that transactions are serialized and their journal writes do
+   not interleave. */
+static struct lock journal_lock;
+
+/* Thread inside a journal_begin/journal_commit bracket, or null,
+   and the bracket nesting depth. */
+static struct thread *txn_owner;
+static int txn_depth;
+
+/* The current transaction's logged sectors and their contents. */
+static block_sector_t txn_sectors[TXN_MAX];
+static uint8_t txn_data[TXN_MAX][BLOCK_SECTOR_SIZE];
+static size_t txn_cnt;
+
+/* Next record sequence number, next free sector in the journal
+   region (relative to JOURNAL_START), and whether any committed
+   record awaits a checkpoint. */
+static uint32_t next_seq;
+static size_t journal_ofs;
+static bool checkpoint_needed;
+
+/* True if the last shutdown stamped the clean marker; see
+   journal_mounted_clean(). */
+static bool mounted_clean;
+
+static void journal_reset (void);
+static void journal_recover (void);
+static void flush_txn (void);
+
+/* Initializes the journal.  A freshly formatted disk gets an
+   empty journal; otherwise any transactions committed before a
+   crash are replayed first. */
+void
+journal_init (bool format)
+{
+  ASSERT (sizeof (struct journal_record) == BLOCK_SECTOR_SIZE);
+
+  lock_init (&journal_lock);
+  lock_set_name (&journal_lock, "journal");
+  next_seq = 1;
+  mounted_clean = true;
+  if (!format)
+    {
+      static struct journal_record rec;
+
+      block_read (fs_device, JOURNAL_START, &rec);
+      mounted_clean = rec.magic == JOURNAL_CLEAN_MAGIC;
+      journal_recover ();
+    }
+  journal_reset ();
+}
+
+/* Returns true if the last shutdown went through filesys_done()
+   and stamped the clean marker.  When it did not, committed
+   transactions have already been replayed by the time this can
+   be called, but deferred state -- the free map above all --
+   may be stale, so fsck runs. */
+bool
+journal_mounted_clean (void)
+{
+  return mounted_clean;
+}
+
+/* Stamps the journal's first sector with the clean-shutdown
+   marker.  Called at the end of filesys_done(), after the last
+   checkpoint; any boot that does not find the marker knows the
+   previous run ended in a crash. */
+void
+journal_mark_clean (void)
+{
+  static struct journal_record rec;
+
+  memset (&rec, 0, sizeof rec);
+  rec.magic = JOURNAL_CLEAN_MAGIC;
+  block_write (fs_device, JOURNAL_START, &rec);
+}
+
+/* Starts a transaction, or deepens the current thread's
+   transaction if it already has one.  Blocks while another
+   thread's transaction is open. */
+void
+journal_begin (void)
+{
+  if (txn_owner == thread_current ())
+    {
+      txn_depth++;
+      return;
+    }
+  lock_acquire (&journal_lock);
+  txn_owner = thread_current ();
+  txn_depth = 1;
+  txn_cnt = 0;
+}
+
+/* Returns true if the current thread has a transaction open. */
+bool
+journal_active (void)
+{
+  return txn_owner == thread_current ();
+}
+
+/* Logs SECTOR's new contents, as held by the buffer cache, in
+   the current transaction.  A sector already logged is updated
+   in place.  Called by the buffer cache for every sector dirtied
+   while a transaction is open. */
+void
+journal_log (block_sector_t sector)
+{
+  size_t i;
+
+  ASSERT (journal_active ());
+
+  for (i = 0; i < txn_cnt; i++)
+    if (txn_sectors[i] == sector)
+      break;
+  if (i == txn_cnt)
+    {
+      if (txn_cnt == TXN_MAX)
+        {
+          /* Too big for one record: commit what is logged so far
+             as its own record and start a new one. */
+          flush_txn ();
+          i = 0;
+        }
+      txn_sectors[i] = sector;
+      txn_cnt = i + 1;
+      /* Pinned until the record is durable, so the home sector
+         cannot be written in place before the journal record
+         that covers it. */
+      cache_pin (sector);
+    }
+  cache_read (sector, txn_data[i], 0, BLOCK_SECTOR_SIZE, CACHE_META);
+}
+
+/* Ends the current thread's transaction bracket.  The outermost
+   commit writes the logged sectors into the journal as one
+   sequential burst. */
+void
+journal_commit (void)
+{
+  ASSERT (journal_active ());
+
+  if (--txn_depth > 0)
+    return;
+  flush_txn ();
+  txn_owner = NULL;
+  lock_release (&journal_lock);
+}
+
+/* Clears the journal once the home sectors of every committed
+   record are on disk.  The flush daemon calls this after each
+   write-behind pass; the cache flush inside the lock makes sure
+   no record is dropped while its home sectors are still only in
+   memory. */
+void
+journal_checkpoint (void)
+{
+  lock_acquire (&journal_lock);
+  if (checkpoint_needed)
+    {
+      cache_flush ();
+      journal_reset ();
+    }
+  lock_release (&journal_lock);
+}
+
+/* Writes the current transaction into the journal region: first
+   the data sectors, then the record sector that makes them
+   valid.  The record goes last so that a crash mid-commit leaves
+   an invalid record, which recovery ignores. */
+static void
+flush_txn (void)
+{
+  static struct journal_record rec;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&journal_lock));
+
+  if (txn_cnt == 0)
+    return;
+
+  /* Out of journal space: checkpoint to make room. */
+  if (journal_ofs + 1 + txn_cnt > JOURNAL_SECTORS)
+    {
+      cache_flush ();
+      journal_reset ();
+    }
+
+  block_write_multiple (fs_device, JOURNAL_START + journal_ofs + 1,
+                        txn_cnt, txn_data);
+  memset (&rec, 0, sizeof rec);
+  rec.magic = JOURNAL_MAGIC;
+  rec.seq = next_seq++;
+  rec.cnt = txn_cnt;
+  for (i = 0; i < txn_cnt; i++)
+    rec.sectors[i] = txn_sectors[i];
+  block_write (fs_device, JOURNAL_START + journal_ofs, &rec);
+
+  /* The record is durable; the home sectors may go to disk in
+     place now. */
+  for (i = 0; i < txn_cnt; i++)
+    cache_unpin (txn_sectors[i]);
+
+  journal_ofs += 1 + txn_cnt;
+  checkpoint_needed = true;
+  txn_cnt = 0;
+}
+
+/* Replays every valid record left in the journal by a crash,
+   copying its data sectors to their home locations. */
+static void
+journal_recover (void)
+{
+  static struct journal_record rec;
+  static uint8_t data[BLOCK_SECTOR_SIZE];
+  uint32_t seq = 0;
+  size_t ofs = 0;
+  int applied = 0;
+
+  while (ofs + 1 < JOURNAL_SECTORS)
+    {
+      size_t i;
+
+      block_read (fs_device, JOURNAL_START + ofs, &rec);
+      if (rec.magic != JOURNAL_MAGIC
+          || rec.cnt == 0 || rec.cnt > TXN_MAX
+          || ofs + 1 + rec.cnt > JOURNAL_SECTORS
+          || (seq != 0 && rec.seq != seq + 1))
+        break;
+      seq = rec.seq;
+
+      for (i = 0; i < rec.cnt; i++)
+        {
+          block_read (fs_device, JOURNAL_START + ofs + 1 + i, data);
+          block_write (fs_device, rec.sectors[i], data);
+        }
+      applied++;
+      ofs += 1 + rec.cnt;
+    }
+
+  if (applied > 0)
+    printf ("journal: replayed %d committed transactions.\n", applied);
+  next_seq = seq + 1;
+}
+
+/* Empties the journal region by invalidating its first record
+   sector.  Recovery stops at the invalid record, so the stale
+   records beyond it are unreachable. */
+static void
+journal_reset (void)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+
+  block_write (fs_device, JOURNAL_START, zeros);
+  journal_ofs = 0;
+  checkpoint_needed = false;
+}
@@ -0,0 +1,21 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Journal region on fs_device, following the free map and root
+   directory inodes.  These sectors never hold file data. */
+#define JOURNAL_START 2         /* First journal sector. */
+#define JOURNAL_SECTORS 64      /* Size of journal region in sectors. */
+
+void journal_init (bool format);
+bool journal_mounted_clean (void);
+void journal_mark_clean (void);
+void journal_begin (void);
+void journal_commit (void);
+bool journal_active (void);
+void journal_log (block_sector_t);
+void journal_checkpoint (void);
+
+#endif /* filesys/journal.h */
@@ -0,0 +1,134 @@
+#include "filesys/scrub.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "filesys/directory.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/inode.h"
+#include "threads/thread.h"
+
+/* Background free-map scrubber.
+
+   A free map that hands the same sector to two inodes does not
+   fail at the time of the bug; it surfaces much later as data
+   corruption, with the evidence long gone.  The scrubber walks
+   every inode reachable from the root the way fsck does and
+   cross-checks the sectors each one maps against the free map
+   and against each other, so a double allocation or a stale map
+   is flagged while the code that caused it is still fresh.
+
+   The walk runs in a thread at PRI_MIN that yields between
+   inodes, so anything at all runnable takes the CPU first and
+   the check costs nothing in the foreground.  (The idle thread
+   proper cannot block, so PRI_MIN is as close to "only when the
+   CPU would halt" as a thread doing I/O can get.) */
+
+/* Ticks between scrub passes. */
+#define SCRUB_INTERVAL (30 * TIMER_FREQ)
+
+static thread_func scrub_daemon;
+
+/* Starts the scrub daemon. */
+void
+scrub_init (void)
+{
+  thread_create ("scrubd", PRI_MIN, scrub_daemon, NULL);
+}
+
+/* Cross-checks every inode in DIR, recursing into
+   subdirectories.  Returns the number of inconsistencies
+   found. */
+static int
+scrub_dir (struct dir *dir, struct bitmap *shadow)
+{
+  char name[NAME_MAX + 1];
+  int bad;
+
+  bad = inode_check_sectors (dir_get_inode (dir), shadow);
+  while (dir_readdir (dir, name))
+    {
+      struct inode *inode;
+
+      thread_yield ();
+      if (!dir_lookup (dir, name, &inode))
+        continue;
+      if (inode_is_dir (inode))
+        {
+          struct dir *sub = dir_open (inode);
+
+          if (sub != NULL)
+            {
+              bad += scrub_dir (sub, shadow);
+              dir_close (sub);
+            }
+          else
+            inode_close (inode);
+        }
+      else
+        {
+          bad += inode_check_sectors (inode, shadow);
+          inode_close (inode);
+        }
+    }
+  return bad;
+}
+
+/* One scrub pass over the whole tree.  SHADOW collects the
+   sectors the inodes visited so far map, so a sector two inodes
+   both claim is caught on the second visit.  A pass during which
+   sectors were released proves nothing: a released sector may
+   have been reallocated to an inode visited later, which looks
+   exactly like a double allocation but is not. */
+static void
+scrub_pass (void)
+{
+  struct bitmap *shadow = bitmap_create (block_size (fs_device));
+  struct inode *map_inode;
+  struct dir *root;
+  unsigned gen = free_map_generation ();
+  int bad = 0;
+
+  if (shadow == NULL)
+    return;
+
+  /* The free map file's sectors are in use but the file hangs
+     off no directory. */
+  map_inode = inode_open (FREE_MAP_SECTOR);
+  if (map_inode != NULL)
+    {
+      bad += inode_check_sectors (map_inode, shadow);
+      inode_close (map_inode);
+    }
+
+  root = dir_open_root ();
+  if (root != NULL)
+    {
+      bad += scrub_dir (root, shadow);
+      dir_close (root);
+    }
+
+  bitmap_destroy (shadow);
+
+  if (bad > 0)
+    {
+      if (free_map_generation () == gen)
+        printf ("scrub: %d free-map inconsistency(ies) found\n", bad);
+      else
+        printf ("scrub: sectors were freed during the pass; "
+                "findings above may be stale\n");
+    }
+}
+
+/* Scrub daemon.  Wakes up periodically and cross-checks the
+   whole tree against the free map. */
+static void
+scrub_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (SCRUB_INTERVAL);
+      scrub_pass ();
+    }
+}
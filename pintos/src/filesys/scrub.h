@@ -0,0 +1,6 @@
+#ifndef FILESYS_SCRUB_H
+#define FILESYS_SCRUB_H
+
+void scrub_init (void);
+
+#endif /* filesys/scrub.h */
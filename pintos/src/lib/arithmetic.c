@@ -72,13 +72,63 @@ nlz (uint32_t x)
   return n;
 }
 
+/* Returns the number of trailing zero bits in X,
+   which must be nonzero. */
+static int
+ntz (uint64_t x)
+{
+  /* Counts against the lower 32-bit half when it is nonzero, so
+     the binary search below only ever works on 32 bits. */
+  uint32_t h = x;
+  int n = 0;
+  if (h == 0)
+    {
+      n = 32;
+      h = x >> 32;
+    }
+  if ((h & 0x0000FFFF) == 0)
+    {
+      n += 16;
+      h >>= 16;
+    }
+  if ((h & 0x00FF) == 0)
+    {
+      n += 8;
+      h >>= 8;
+    }
+  if ((h & 0x0F) == 0)
+    {
+      n += 4;
+      h >>= 4;
+    }
+  if ((h & 0x3) == 0)
+    {
+      n += 2;
+      h >>= 2;
+    }
+  if ((h & 0x1) == 0)
+    n++;
+  return n;
+}
+
 /* Divides unsigned 64-bit N by unsigned 64-bit D and returns the
    quotient. */
 static uint64_t
 udiv64 (uint64_t n, uint64_t d)
 {
-  if ((d >> 32) == 0) 
+  /* A power-of-two divisor reduces to a shift.  (If D is zero,
+     fall through so that divl() raises the divide error.) */
+  if (d != 0 && (d & (d - 1)) == 0)
+    return n >> ntz (d);
+
+  if ((d >> 32) == 0)
     {
+      /* A dividend that fits in 32 bits takes a single DIVL with
+         no fixup arithmetic, and small dividends dominate the
+         kernel's time-unit conversions. */
+      if ((n >> 32) == 0)
+        return (uint32_t) n / (uint32_t) d;
+
       /* Proof of correctness:
 
          Let n, d, b, n1, and n0 be defined as in this function.
@@ -128,9 +178,13 @@ udiv64 (uint64_t n, uint64_t d)
 
 /* Divides unsigned 64-bit N by unsigned 64-bit D and returns the
    remainder. */
-static uint32_t
+static uint64_t
 umod64 (uint64_t n, uint64_t d)
 {
+  /* A power-of-two divisor reduces to a mask. */
+  if (d != 0 && (d & (d - 1)) == 0)
+    return n & (d - 1);
+
   return n - d * udiv64 (n, d);
 }
 
@@ -147,7 +201,7 @@ sdiv64 (int64_t n, int64_t d)
 
 /* Divides signed 64-bit N by signed 64-bit D and returns the
    remainder. */
-static int32_t
+static int64_t
 smod64 (int64_t n, int64_t d)
 {
   return n - d * sdiv64 (n, d);
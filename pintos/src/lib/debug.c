@@ -5,6 +5,43 @@
 #include <stdio.h>
 #include <string.h>
 
+/* Runtime logging level: LOG() calls above it print nothing.
+   The -log=LEVEL kernel option changes it. */
+int log_level = LOG_LEVEL_INFO;
+
+/* Level names accepted by log_set_level(), indexed by level. */
+static const char *log_level_names[] = {"error", "warn", "info", "debug"};
+
+/* Sets the runtime logging level to the one called NAME.
+   Returns false if no level is so named. */
+bool
+log_set_level (const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof log_level_names / sizeof *log_level_names; i++)
+    if (!strcmp (log_level_names[i], name))
+      {
+        log_level = i;
+        return true;
+      }
+  return false;
+}
+
+/* Prints a message that passed both logging gates; see the LOG()
+   macro in debug.h.  A separate function, rather than printf()
+   in the macro itself, so that including <debug.h> suffices to
+   log. */
+void
+log_printf (const char *format, ...)
+{
+  va_list args;
+
+  va_start (args, format);
+  vprintf (format, args);
+  va_end (args);
+}
+
 /* Prints the call stack, that is, a list of addresses, one in
    each of the functions we are nested within.  gdb or addr2line
    may be applied to kernel.o to translate these into file names,
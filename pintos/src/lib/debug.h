@@ -1,6 +1,8 @@
 #ifndef __LIB_DEBUG_H
 #define __LIB_DEBUG_H
 
+#include <stdbool.h>
+
 /* GCC lets us add "attributes" to functions, function
    parameters, etc. to indicate their properties.
    See the GCC manual for details. */
@@ -18,6 +20,60 @@ void debug_panic (const char *file, int line, const char *function,
 void debug_backtrace (void);
 void debug_backtrace_all (void);
 
+/* Leveled logging.  Each message names the least important
+   level at which it still prints: LOG_ERROR() for failures that
+   need attention, LOG_WARN() for trouble that was papered over,
+   LOG_INFO() for ordinary progress messages, LOG_DEBUG() for
+   development chatter.
+
+   Two gates apply.  LOG_COMPILED_LEVEL is the compile-time
+   ceiling: a call above it constant-folds to nothing, its
+   arguments unevaluated, so a production build pays zero cycles
+   for DEBUG statements left in the source.  It defaults to
+   LOG_LEVEL_DEBUG, or LOG_LEVEL_INFO when NDEBUG is defined, and
+   may be overridden on the compiler command line.  log_level is
+   the runtime gate, raised or lowered in the kernel with the
+   -log=LEVEL option, so a test build can carry DEBUG statements
+   and still boot quiet.  In the kernel, messages that pass both
+   gates go out through the same path as printf() and so inherit
+   the console daemon's queue. */
+enum log_level
+  {
+    LOG_LEVEL_ERROR,            /* Failures that need attention. */
+    LOG_LEVEL_WARN,             /* Trouble that was recovered from. */
+    LOG_LEVEL_INFO,             /* Ordinary progress messages. */
+    LOG_LEVEL_DEBUG             /* Development chatter. */
+  };
+
+#ifndef LOG_COMPILED_LEVEL
+#ifndef NDEBUG
+#define LOG_COMPILED_LEVEL LOG_LEVEL_DEBUG
+#else
+#define LOG_COMPILED_LEVEL LOG_LEVEL_INFO
+#endif
+#endif
+
+extern int log_level;
+bool log_set_level (const char *name);
+void log_printf (const char *format, ...) PRINTF_FORMAT (1, 2);
+
+/* The LEVEL comparison against the constant ceiling folds at
+   compile time, taking the whole statement, arguments included,
+   with it when the call is above the ceiling. */
+#define LOG(LEVEL, ...)                                 \
+        do                                              \
+          {                                             \
+            if ((LEVEL) <= LOG_COMPILED_LEVEL           \
+                && (LEVEL) <= log_level)                \
+              log_printf (__VA_ARGS__);                 \
+          }                                             \
+        while (0)
+
+#define LOG_ERROR(...) LOG (LOG_LEVEL_ERROR, "ERROR: " __VA_ARGS__)
+#define LOG_WARN(...) LOG (LOG_LEVEL_WARN, "WARN: " __VA_ARGS__)
+#define LOG_INFO(...) LOG (LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG (LOG_LEVEL_DEBUG, "DEBUG: " __VA_ARGS__)
+
 #endif
 
 
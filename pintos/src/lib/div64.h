@@ -0,0 +1,67 @@
+#ifndef __LIB_DIV64_H
+#define __LIB_DIV64_H
+
+#include <stdint.h>
+
+/* Inline 64-bit division by a constant 32-bit divisor.
+
+   GCC compiles 64-bit division on the 32-bit x86 into a call to
+   __udivdi3() in lib/arithmetic.c, even when the divisor is a
+   compile-time constant such as the 1000 and 1000000 scale
+   factors in time-unit conversions.  udiv64_const() below avoids
+   the call: it divides by multiplying with the divisor's
+   reciprocal scaled by 2^64, which the compiler folds to a
+   constant, and fixes up the off-by-one the truncated reciprocal
+   can introduce.  The whole computation inlines to a handful of
+   multiplies.
+
+   The divisor need not actually be constant for the result to be
+   correct, but with a variable divisor the reciprocal costs a
+   64-bit division of its own and the call path in arithmetic.c
+   is cheaper. */
+
+/* Returns the high 64 bits of the 128-bit product A * B,
+   computed in 32-bit halves since the compiler has no 128-bit
+   type on this target. */
+static inline uint64_t
+mulhi64 (uint64_t a, uint64_t b)
+{
+  uint32_t a1 = a >> 32, a0 = a;
+  uint32_t b1 = b >> 32, b0 = b;
+  uint64_t lo = (uint64_t) a0 * b0;
+  uint64_t mid1 = (uint64_t) a1 * b0;
+  uint64_t mid2 = (uint64_t) a0 * b1;
+  uint64_t hi = (uint64_t) a1 * b1;
+  uint64_t carry = (lo >> 32) + (uint32_t) mid1 + mid2;
+
+  return hi + (mid1 >> 32) + (carry >> 32);
+}
+
+/* Divides unsigned 64-bit N by 32-bit D, which should be a
+   nonzero compile-time constant, and returns the quotient.
+
+   For a power-of-two divisor this is a plain shift.  Otherwise
+   the quotient is N * floor(2^64 / D) / 2^64, which
+   underestimates the true quotient by at most one, followed by a
+   remainder check to correct it. */
+static inline uint64_t
+udiv64_const (uint64_t n, uint32_t d)
+{
+  uint64_t q;
+
+  if ((d & (d - 1)) == 0)
+    {
+      int shift = 0;
+
+      while ((d >> shift) > 1)
+        shift++;
+      return n >> shift;
+    }
+
+  q = mulhi64 (n, (uint64_t) -1 / d);
+  if (n - q * d >= d)
+    q++;
+  return q;
+}
+
+#endif /* lib/div64.h */
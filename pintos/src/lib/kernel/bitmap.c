@@ -3,6 +3,7 @@
 #include <limits.h>
 #include <round.h>
 #include <stdio.h>
+#include <string.h>
 #include "threads/malloc.h"
 #ifdef FILESYS
 #include "filesys/file.h"
@@ -23,11 +24,22 @@ typedef unsigned long elem_type;
 
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
-   simulates an array of bits. */
+   simulates an array of bits.
+
+   A second, much smaller array summarizes the first: summary bit
+   E is set when element E contains at least one usable false
+   bit.  Scans for false bits test one summary word to skip
+   ELEM_BITS exhausted elements at a time, so allocation from a
+   nearly full bitmap stays flat instead of degrading toward a
+   linear scan of the whole array.  The summary is kept in sync
+   by the single-bit operations, under whatever synchronization
+   the caller already applies to them. */
 struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
     elem_type *bits;    /* Elements that represent bits. */
+    elem_type *summary; /* One bit per element of BITS: any
+                           usable false bit in that element? */
   };
 
 /* Returns the index of the element that contains the bit
@@ -63,11 +75,75 @@ byte_cnt (size_t bit_cnt)
 /* Returns a bit mask in which the bits actually used in the last
    element of B's bits are set to 1 and the rest are set to 0. */
 static inline elem_type
-last_mask (const struct bitmap *b) 
+last_mask (const struct bitmap *b)
 {
   int last_bits = b->bit_cnt % ELEM_BITS;
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
+
+/* Returns the number of summary elements required for BIT_CNT
+   bits: one summary bit per element of the main array. */
+static inline size_t
+summary_cnt (size_t bit_cnt)
+{
+  return DIV_ROUND_UP (elem_cnt (bit_cnt), ELEM_BITS);
+}
+
+/* Returns a mask of the bits of element E of B's bits that fall
+   inside the bitmap. */
+static inline elem_type
+used_mask (const struct bitmap *b, size_t e)
+{
+  return e == elem_cnt (b->bit_cnt) - 1 ? last_mask (b) : (elem_type) -1;
+}
+
+/* Recomputes the summary bit for element E of B's bits. */
+static void
+summary_update (struct bitmap *b, size_t e)
+{
+  elem_type mask = (elem_type) 1 << e % ELEM_BITS;
+
+  if ((b->bits[e] & used_mask (b, e)) != used_mask (b, e))
+    b->summary[e / ELEM_BITS] |= mask;
+  else
+    b->summary[e / ELEM_BITS] &= ~mask;
+}
+
+#ifdef FILESYS
+/* Recomputes every summary bit of B from its bits.  Only
+   bitmap_read() needs this, after overwriting the bits
+   wholesale. */
+static void
+summary_rebuild (struct bitmap *b)
+{
+  size_t e;
+
+  for (e = 0; e < elem_cnt (b->bit_cnt); e++)
+    summary_update (b, e);
+}
+#endif
+
+/* Returns the index of the first element of B's bits, at or
+   after element E, whose summary bit shows a usable false bit,
+   or the element count if there is none. */
+static size_t
+summary_next (const struct bitmap *b, size_t e)
+{
+  size_t s = e / ELEM_BITS;
+  elem_type w;
+
+  if (s >= summary_cnt (b->bit_cnt))
+    return elem_cnt (b->bit_cnt);
+
+  w = b->summary[s] & ((elem_type) -1 << e % ELEM_BITS);
+  while (w == 0)
+    {
+      if (++s >= summary_cnt (b->bit_cnt))
+        return elem_cnt (b->bit_cnt);
+      w = b->summary[s];
+    }
+  return s * ELEM_BITS + __builtin_ctzl (w);
+}
 
 /* Creation and destruction. */
 
@@ -83,11 +159,15 @@ bitmap_create (size_t bit_cnt)
     {
       b->bit_cnt = bit_cnt;
       b->bits = malloc (byte_cnt (bit_cnt));
-      if (b->bits != NULL || bit_cnt == 0)
+      b->summary = malloc (summary_cnt (bit_cnt) * sizeof (elem_type));
+      if ((b->bits != NULL && b->summary != NULL) || bit_cnt == 0)
         {
+          memset (b->summary, 0, summary_cnt (bit_cnt) * sizeof (elem_type));
           bitmap_set_all (b, false);
           return b;
         }
+      free (b->summary);
+      free (b->bits);
       free (b);
     }
   return NULL;
@@ -105,6 +185,8 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 
   b->bit_cnt = bit_cnt;
   b->bits = (elem_type *) (b + 1);
+  b->summary = (elem_type *) ((uint8_t *) b->bits + byte_cnt (bit_cnt));
+  memset (b->summary, 0, summary_cnt (bit_cnt) * sizeof (elem_type));
   bitmap_set_all (b, false);
   return b;
 }
@@ -112,18 +194,20 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 /* Returns the number of bytes required to accomodate a bitmap
    with BIT_CNT bits (for use with bitmap_create_in_buf()). */
 size_t
-bitmap_buf_size (size_t bit_cnt) 
+bitmap_buf_size (size_t bit_cnt)
 {
-  return sizeof (struct bitmap) + byte_cnt (bit_cnt);
+  return sizeof (struct bitmap) + byte_cnt (bit_cnt)
+         + summary_cnt (bit_cnt) * sizeof (elem_type);
 }
 
 /* Destroys bitmap B, freeing its storage.
    Not for use on bitmaps created by bitmap_create_in_buf(). */
 void
-bitmap_destroy (struct bitmap *b) 
+bitmap_destroy (struct bitmap *b)
 {
-  if (b != NULL) 
+  if (b != NULL)
     {
+      free (b->summary);
       free (b->bits);
       free (b);
     }
@@ -163,6 +247,10 @@ bitmap_mark (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the OR instruction in [IA32-v2b]. */
   asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+
+  /* The element may just have become exhausted. */
+  if ((b->bits[idx] & used_mask (b, idx)) == used_mask (b, idx))
+    summary_update (b, idx);
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
@@ -176,6 +264,9 @@ bitmap_reset (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the AND instruction in [IA32-v2a]. */
   asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+
+  /* The element now certainly holds a false bit. */
+  b->summary[idx / ELEM_BITS] |= (elem_type) 1 << idx % ELEM_BITS;
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -191,6 +282,8 @@ bitmap_flip (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the XOR instruction in [IA32-v2b]. */
   asm ("xorl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+
+  summary_update (b, idx);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -227,39 +320,100 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
     bitmap_set (b, start + i, value);
 }
 
+/* Returns a mask of the bits of the element containing bit
+   LAST that are at or below LAST. */
+static inline elem_type
+tail_mask (size_t last)
+{
+  return bit_mask (last) | (bit_mask (last) - 1);
+}
+
+/* Returns the number of 1 bits in W by bit-parallel reduction:
+   sum adjacent bit pairs, then nibbles, then spread the byte
+   sums with a multiply.  The kernel does not link libgcc, whose
+   helper the popcount builtin falls back on without POPCNT
+   support, so the fallback is spelled out here. */
+static inline size_t
+popcount (elem_type w)
+{
+  w = w - ((w >> 1) & (elem_type) 0x5555555555555555ull);
+  w = (w & (elem_type) 0x3333333333333333ull)
+      + ((w >> 2) & (elem_type) 0x3333333333333333ull);
+  w = (w + (w >> 4)) & (elem_type) 0x0f0f0f0f0f0f0f0full;
+  return w * (elem_type) 0x0101010101010101ull >> (ELEM_BITS - 8);
+}
+
+/* Returns the number of true bits in B between START and
+   START + CNT, exclusive.  CNT must be positive.  Counts a whole
+   element at a time with popcount() rather than testing bits one
+   by one. */
+static size_t
+count_true (const struct bitmap *b, size_t start, size_t cnt)
+{
+  size_t e = elem_idx (start);
+  size_t last_e = elem_idx (start + cnt - 1);
+  elem_type head = (elem_type) -1 << start % ELEM_BITS;
+  elem_type tail = tail_mask (start + cnt - 1);
+  size_t true_cnt;
+
+  if (e == last_e)
+    return popcount (b->bits[e] & head & tail);
+
+  true_cnt = popcount (b->bits[e] & head);
+  while (++e < last_e)
+    true_cnt += popcount (b->bits[e]);
+  return true_cnt + popcount (b->bits[last_e] & tail);
+}
+
 /* Returns the number of bits in B between START and START + CNT,
    exclusive, that are set to VALUE. */
 size_t
-bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
+bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 {
-  size_t i, value_cnt;
+  size_t true_cnt;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
-  return value_cnt;
+  if (cnt == 0)
+    return 0;
+  true_cnt = count_true (b, start, cnt);
+  return value ? true_cnt : cnt - true_cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
-   exclusive, are set to VALUE, and false otherwise. */
+   exclusive, are set to VALUE, and false otherwise.  Tests a
+   whole element per step and stops at the first hit. */
 bool
-bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
+bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value)
 {
-  size_t i;
-  
+  size_t e, last_e;
+  elem_type head, tail, w;
+
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
+  if (cnt == 0)
+    return false;
+
+  e = elem_idx (start);
+  last_e = elem_idx (start + cnt - 1);
+  head = (elem_type) -1 << start % ELEM_BITS;
+  tail = tail_mask (start + cnt - 1);
+
+  w = value ? b->bits[e] : ~b->bits[e];
+  w &= head;
+  if (e == last_e)
+    return (w & tail) != 0;
+  if (w != 0)
+    return true;
+  while (++e < last_e)
+    if ((value ? b->bits[e] : ~b->bits[e]) != 0)
       return true;
-  return false;
+  w = value ? b->bits[last_e] : ~b->bits[last_e];
+  return (w & tail) != 0;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -288,23 +442,77 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 
 /* Finding set or unset bits. */
 
+/* Returns the index of the first bit in B at or after START that
+   is set to VALUE, or B's bit count if there is none.  Scans a
+   whole element at a time, so elements containing no bit equal
+   to VALUE cost one comparison each; a scan for false bits
+   additionally skips runs of exhausted elements through the
+   summary, one word test per ELEM_BITS of them. */
+static size_t
+scan_forward (const struct bitmap *b, size_t start, bool value)
+{
+  size_t e, idx;
+  elem_type w;
+
+  if (start >= b->bit_cnt)
+    return b->bit_cnt;
+
+  /* In W, a 1 bit is a candidate.  Mask off bits below START. */
+  e = elem_idx (start);
+  w = value ? b->bits[e] : ~b->bits[e];
+  w &= (elem_type) -1 << start % ELEM_BITS;
+
+  while (w == 0)
+    {
+      if (++e >= elem_cnt (b->bit_cnt))
+        return b->bit_cnt;
+      if (!value)
+        {
+          e = summary_next (b, e);
+          if (e >= elem_cnt (b->bit_cnt))
+            return b->bit_cnt;
+        }
+      w = value ? b->bits[e] : ~b->bits[e];
+    }
+
+  /* The unused bits of the last element read as "false", so when
+     scanning for false bits the result can point past the end. */
+  idx = e * ELEM_BITS + __builtin_ctzl (w);
+  return idx < b->bit_cnt ? idx : b->bit_cnt;
+}
+
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
    If there is no such group, returns BITMAP_ERROR. */
 size_t
-bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
+bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
 {
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt) 
+  if (cnt <= b->bit_cnt)
     {
       size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t i = start;
+
+      if (cnt == 0)
+        return start;
+
+      /* Hop from one bit equal to VALUE to the end of its run,
+         instead of re-testing CNT bits at every position. */
+      while (i <= last)
+        {
+          size_t run_start = scan_forward (b, i, value);
+          size_t run_end;
+
+          if (run_start > last)
+            break;
+          run_end = scan_forward (b, run_start + 1, !value);
+          if (run_end - run_start >= cnt)
+            return run_start;
+          i = run_end + 1;
+        }
     }
   return BITMAP_ERROR;
 }
@@ -346,6 +554,7 @@ bitmap_read (struct bitmap *b, struct file *file)
       off_t size = byte_cnt (b->bit_cnt);
       success = file_read_at (file, b->bits, size, 0) == size;
       b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+      summary_rebuild (b);
     }
   return success;
 }
@@ -358,6 +567,25 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the portion of B covering the CNT bits starting at
+   START to FILE, leaving the rest of the file alone.  Return
+   true if successful, false otherwise. */
+bool
+bitmap_write_range (const struct bitmap *b, struct file *file,
+                    size_t start, size_t cnt)
+{
+  off_t ofs, size;
+
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (start + cnt <= b->bit_cnt);
+
+  if (cnt == 0)
+    return true;
+  ofs = start / 8;
+  size = DIV_ROUND_UP (start + cnt, 8) - ofs;
+  return file_write_at (file, (uint8_t *) b->bits + ofs, size, ofs) == size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -0,0 +1,56 @@
+#include <cachestat.h>
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+
+/* Registered caches.  A handful of fixed slots is plenty; raise
+   the cap when a new cache actually hits it. */
+#define CACHE_STATS_MAX 8
+static struct cache_stats *caches[CACHE_STATS_MAX];
+static size_t cache_cnt;
+
+/* Registers STATS to be included in cache_stats_print().
+   Call once per cache, at setup. */
+void
+cache_stats_register (struct cache_stats *stats)
+{
+  enum intr_level old_level;
+
+  ASSERT (stats->name != NULL);
+
+  /* Caches initialize lazily from different subsystems, so two
+     registrations can race; a brief cli is the cheapest way to
+     serialize an append this rare. */
+  old_level = intr_disable ();
+  ASSERT (cache_cnt < CACHE_STATS_MAX);
+  caches[cache_cnt++] = stats;
+  intr_set_level (old_level);
+}
+
+/* Prints one line per registered cache: capacity, hit, miss, and
+   eviction counts, and the derived hit ratio. */
+void
+cache_stats_print (void)
+{
+  size_t i;
+
+  if (cache_cnt == 0)
+    return;
+
+  printf ("Caches:    size       hits     misses  evictions   hit%%\n");
+  for (i = 0; i < cache_cnt; i++)
+    {
+      struct cache_stats *c = caches[i];
+      unsigned long long hits = counter_read (&c->hits);
+      unsigned long long misses = counter_read (&c->misses);
+      unsigned long long lookups = hits + misses;
+
+      printf ("%-9s %5zu %10llu %10llu %10llu ",
+              c->name, c->size, hits, misses,
+              (unsigned long long) counter_read (&c->evictions));
+      if (lookups > 0)
+        printf ("%5llu%%\n", hits * 100 / lookups);
+      else
+        printf ("    --\n");
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef __LIB_KERNEL_CACHESTAT_H
+#define __LIB_KERNEL_CACHESTAT_H
+
+/* Cache statistics registry.
+
+   Every cache in the kernel answers the same two questions --
+   how often does it hit, and how often does it throw useful
+   entries away -- so rather than each one inventing its own
+   counters and report format, a cache embeds a struct
+   cache_stats, bumps its counters on the hot path, and registers
+   it once at setup.  cache_stats_print() then reports every
+   registered cache in one table, with hit ratios derived, which
+   is what makes the numbers comparable when deciding which cache
+   deserves more memory.
+
+   The counters are wait-free (see counter.h), so bumping them
+   from the owning cache's hot path costs one instruction and
+   needs no extra locking beyond what the cache already holds. */
+
+#include <stddef.h>
+#include <counter.h>
+
+/* Statistics for one cache.  The owner fills in NAME and SIZE
+   before registering; the counters start at zero like any other
+   static object. */
+struct cache_stats
+  {
+    const char *name;           /* Cache name, for the report. */
+    size_t size;                /* Capacity, in entries. */
+    struct counter hits;        /* Lookups served from the cache. */
+    struct counter misses;      /* Lookups that went past it. */
+    struct counter evictions;   /* Entries displaced to make room. */
+  };
+
+void cache_stats_register (struct cache_stats *);
+void cache_stats_print (void);
+
+#endif /* lib/kernel/cachestat.h */
@@ -1,13 +1,33 @@
 #include <console.h>
+#include <counter.h>
+#include <mpsc.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/serial.h"
 #include "devices/vga.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Accumulates vprintf() output so that the vga and serial layers
+   receive it a chunk at a time instead of byte by byte. */
+struct vprintf_aux
+  {
+    char buf[64];               /* Pending output. */
+    size_t len;                 /* Number of bytes in BUF. */
+    int char_cnt;               /* Total characters written. */
+  };
 
 static void vprintf_helper (char, void *);
+static void vprintf_flush (struct vprintf_aux *);
+static void acquire_console (void);
+static void release_console (void);
+static bool console_enqueue (const char *, size_t, const char *, size_t);
+static void console_daemon (void *) NO_RETURN;
+static void putbuf_have_lock (const char *buffer, size_t n);
 static void putchar_have_lock (uint8_t c);
 
 /* The console lock.
@@ -57,30 +77,97 @@ static bool use_console_lock;
 static int console_lock_depth;
 
 /* Number of characters written to console. */
-static int64_t write_cnt;
+static struct counter write_cnt;
+
+/* Asynchronous output.
+
+   Holding console_lock across serial and vga output means that
+   when the holder is preempted, every other printf()-ing thread
+   piles up behind it in lock_acquire() -- a convoy that
+   debug-heavy runs measure as real throughput loss.  So once the
+   scheduler is up, thread-context output does not take the lock
+   at all: it is copied into a message, pushed onto a lock-free
+   MPSC queue, and written out in order by a single low-priority
+   writer thread.  A printf() in a hot path then costs a malloc()
+   and an enqueue, never a convoy.
+
+   Interrupt context, early boot, allocation failure, and panic
+   all fall back to the synchronous path above.  console_flush()
+   reverts to synchronous output and drains the backlog, so that
+   nothing queued is lost at power-off or panic. */
+
+/* A queued chunk of console output. */
+struct console_msg
+  {
+    struct mpsc_elem elem;      /* Queue element. */
+    size_t len;                 /* Number of bytes in TEXT. */
+    char text[];                /* The output itself. */
+  };
+
+/* Messages awaiting the writer thread, and its wakeup. */
+static struct mpsc_queue msg_queue;
+static struct semaphore msg_sema;
+
+/* True once the writer thread is running and thread-context
+   output should be enqueued instead of written directly. */
+static bool console_async;
 
 /* Enable console locking. */
 void
 console_init (void) 
 {
   lock_init (&console_lock);
+  lock_set_name (&console_lock, "console");
   use_console_lock = true;
 }
 
+/* Starts the console writer thread and switches thread-context
+   output over to the message queue. */
+void
+console_start_daemon (void)
+{
+  mpsc_init (&msg_queue);
+  sema_init (&msg_sema, 0);
+  thread_create ("consoled", PRI_MIN, console_daemon, NULL);
+  console_async = true;
+}
+
 /* Notifies the console that a kernel panic is underway,
    which warns it to avoid trying to take the console lock from
-   now on. */
+   now on.  Also writes out any queued messages, so that the
+   output leading up to the panic is not lost. */
 void
-console_panic (void) 
+console_panic (void)
 {
   use_console_lock = false;
+  console_flush ();
+}
+
+/* Permanently reverts to synchronous output and writes out any
+   messages still queued.  Called before powering off and on
+   panic; the messages are deliberately not freed, since in
+   neither case will the system run long enough to care. */
+void
+console_flush (void)
+{
+  struct mpsc_elem *e;
+
+  console_async = false;
+  acquire_console ();
+  for (e = mpsc_pop_all (&msg_queue); e != NULL; e = e->next)
+    {
+      struct console_msg *msg = mpsc_entry (e, struct console_msg, elem);
+      putbuf_have_lock (msg->text, msg->len);
+    }
+  release_console ();
 }
 
 /* Prints console statistics. */
 void
 console_print_stats (void) 
 {
-  printf ("Console: %lld characters output\n", write_cnt);
+  printf ("Console: %llu characters output\n",
+          (unsigned long long) counter_read (&write_cnt));
 }
 
 /* Acquires the console lock. */
@@ -119,30 +206,102 @@ console_locked_by_current_thread (void)
           || lock_held_by_current_thread (&console_lock));
 }
 
+/* Hands the N1 bytes at B1 followed by the N2 bytes at B2 to the
+   writer thread as a single message, so that they cannot be
+   split by another thread's output.  Returns true on success,
+   false if the caller must fall back to writing synchronously:
+   asynchronous output is off, we are in interrupt context (where
+   malloc() may not block), or memory is short. */
+static bool
+console_enqueue (const char *b1, size_t n1, const char *b2, size_t n2)
+{
+  struct console_msg *msg;
+
+  if (!console_async || intr_context ())
+    return false;
+
+  msg = malloc (sizeof *msg + n1 + n2);
+  if (msg == NULL)
+    return false;
+
+  msg->len = n1 + n2;
+  memcpy (msg->text, b1, n1);
+  memcpy (msg->text + n1, b2, n2);
+  mpsc_push (&msg_queue, &msg->elem);
+  sema_up (&msg_sema);
+  return true;
+}
+
+/* Console writer thread.  Drains the message queue in push
+   order, taking console_lock only here, where being preempted
+   delays nobody but the console itself. */
+static void
+console_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct mpsc_elem *e;
+
+      sema_down (&msg_sema);
+      for (e = mpsc_pop_all (&msg_queue); e != NULL;)
+        {
+          struct console_msg *msg
+            = mpsc_entry (e, struct console_msg, elem);
+
+          e = e->next;
+          acquire_console ();
+          putbuf_have_lock (msg->text, msg->len);
+          release_console ();
+          free (msg);
+        }
+    }
+}
+
 /* The standard vprintf() function,
    which is like printf() but uses a va_list.
    Writes its output to both vga display and serial port. */
 int
-vprintf (const char *format, va_list args) 
+vprintf (const char *format, va_list args)
 {
-  int char_cnt = 0;
+  struct vprintf_aux aux;
+
+  /* Format into a stack buffer and enqueue it; oversized or
+     unlucky messages take the synchronous path below. */
+  if (console_async && !intr_context ())
+    {
+      char buf[256];
+      va_list copy;
+      int n;
+
+      va_copy (copy, args);
+      n = vsnprintf (buf, sizeof buf, format, copy);
+      va_end (copy);
+      if (n >= 0 && n < (int) sizeof buf && console_enqueue (buf, n, "", 0))
+        return n;
+    }
+
+  aux.len = 0;
+  aux.char_cnt = 0;
 
   acquire_console ();
-  __vprintf (format, args, vprintf_helper, &char_cnt);
+  __vprintf (format, args, vprintf_helper, &aux);
+  vprintf_flush (&aux);
   release_console ();
 
-  return char_cnt;
+  return aux.char_cnt;
 }
 
 /* Writes string S to the console, followed by a new-line
    character. */
 int
-puts (const char *s) 
+puts (const char *s)
 {
+  if (console_enqueue (s, strlen (s), "\n", 1))
+    return 0;
+
   acquire_console ();
-  while (*s != '\0')
-    putchar_have_lock (*s++);
-  putchar_have_lock ('\n');
+  putbuf_have_lock (s, strlen (s));
+  putbuf_have_lock ("\n", 1);
   release_console ();
 
   return 0;
@@ -150,42 +309,74 @@ puts (const char *s)
 
 /* Writes the N characters in BUFFER to the console. */
 void
-putbuf (const char *buffer, size_t n) 
+putbuf (const char *buffer, size_t n)
 {
+  if (console_enqueue (buffer, n, "", 0))
+    return;
+
   acquire_console ();
-  while (n-- > 0)
-    putchar_have_lock (*buffer++);
+  putbuf_have_lock (buffer, n);
   release_console ();
 }
 
 /* Writes C to the vga display and serial port. */
 int
-putchar (int c) 
+putchar (int c)
 {
+  char c2 = c;
+
+  if (console_enqueue (&c2, 1, "", 0))
+    return c;
+
   acquire_console ();
   putchar_have_lock (c);
   release_console ();
-  
+
   return c;
 }
 
-/* Helper function for vprintf(). */
+/* Helper function for vprintf(): buffers C, flushing a full
+   chunk to the output layers in one call. */
 static void
-vprintf_helper (char c, void *char_cnt_) 
+vprintf_helper (char c, void *aux_)
 {
-  int *char_cnt = char_cnt_;
-  (*char_cnt)++;
-  putchar_have_lock (c);
+  struct vprintf_aux *aux = aux_;
+
+  aux->char_cnt++;
+  aux->buf[aux->len++] = c;
+  if (aux->len >= sizeof aux->buf)
+    vprintf_flush (aux);
+}
+
+/* Writes AUX's buffered output to the console. */
+static void
+vprintf_flush (struct vprintf_aux *aux)
+{
+  putbuf_have_lock (aux->buf, aux->len);
+  aux->len = 0;
+}
+
+/* Writes the N characters in BUFFER to the vga display and
+   serial port, handing each output layer the whole buffer at
+   once rather than a character at a time.  The caller has
+   already acquired the console lock if appropriate. */
+static void
+putbuf_have_lock (const char *buffer, size_t n)
+{
+  ASSERT (console_locked_by_current_thread ());
+  counter_add (&write_cnt, n);
+  serial_write (buffer, n);
+  vga_write (buffer, n);
 }
 
 /* Writes C to the vga display and serial port.
    The caller has already acquired the console lock if
    appropriate. */
 static void
-putchar_have_lock (uint8_t c) 
+putchar_have_lock (uint8_t c)
 {
   ASSERT (console_locked_by_current_thread ());
-  write_cnt++;
+  counter_inc (&write_cnt);
   serial_putc (c);
   vga_putc (c);
 }
@@ -0,0 +1,71 @@
+#ifndef __LIB_KERNEL_COUNTER_H
+#define __LIB_KERNEL_COUNTER_H
+
+/* Wait-free event counters.
+
+   Statistics counters bumped on hot paths -- console output,
+   block I/O, timer ticks -- want increments that cost one
+   instruction and need no lock or cli/sti.  A struct counter
+   provides that: counter_inc() and counter_add() are a single
+   aligned 32-bit add to memory, which the CPU cannot take an
+   interrupt in the middle of, so thread code and interrupt
+   handlers can bump the same counter without losing updates.
+
+   The price is paid at read time instead: the hot word is only
+   32 bits, so counter_read() folds it into a wider running
+   total, and a counter must be read at least once per 2**32
+   events to observe every wrap.  In practice every statistics
+   dump does this.  The struct is padded to a 64-byte cache line
+   so that distinct hot counters never share one; on a
+   multiprocessor the slot would become per-CPU, with
+   counter_read() summing the slots, without changing callers.
+
+   Increments are wait-free and may race freely with a reader.
+   Two concurrent counter_read() calls on the same counter do
+   need mutual exclusion, because the fold mutates bookkeeping;
+   statistics dumps are rare enough that callers just do not
+   overlap them.
+
+   A counter at file scope starts at zero like any other static
+   object; no initializer is needed. */
+
+#include <stdint.h>
+
+/* An event counter, padded to its own cache line. */
+struct counter
+  {
+    volatile uint32_t cur;      /* Hot word, bumped by single adds. */
+    uint32_t folded;            /* Value of CUR at the last fold. */
+    uint64_t total;             /* Folded 64-bit total. */
+    uint32_t pad[12];           /* Pad to one 64-byte cache line. */
+  };
+
+/* Counts one event in C. */
+static inline void
+counter_inc (struct counter *c)
+{
+  asm volatile ("incl %0" : "+m" (c->cur));
+}
+
+/* Counts N events in C. */
+static inline void
+counter_add (struct counter *c, uint32_t n)
+{
+  asm volatile ("addl %1, %0" : "+m" (c->cur) : "ir" (n));
+}
+
+/* Returns the number of events counted in C, folding any wraps
+   of the hot word into the 64-bit total.  C's increments are
+   unaffected by concurrent reads, but two overlapping reads of
+   the same counter would corrupt the fold. */
+static inline uint64_t
+counter_read (struct counter *c)
+{
+  uint32_t cur = c->cur;
+
+  c->total += (uint32_t) (cur - c->folded);
+  c->folded = cur;
+  return c->total;
+}
+
+#endif /* lib/kernel/counter.h */
@@ -5,6 +5,7 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
+#include <symbol.h>
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
@@ -13,6 +14,30 @@
 #include "devices/serial.h"
 #include "devices/shutdown.h"
 
+/* Maximum stack frames symbolized per backtrace. */
+#define FRAME_MAX 32
+
+/* Prints the CNT addresses in ADDRS one per line with the
+   function and offset each falls in, so a backtrace reads on the
+   box without the external backtrace utility.  The raw "Call
+   stack:" line stays as it was, since the test harness and the
+   utility both parse it.  Prints nothing when no symbol table
+   was linked in. */
+static void
+print_symbols (void *const *addrs, size_t cnt)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      const struct symbol *s = symbol_lookup (addrs[i]);
+
+      if (s != NULL)
+        printf ("  %p: %s+0x%x\n", addrs[i], s->name,
+                (unsigned) ((uint32_t) addrs[i] - s->addr));
+    }
+}
+
 /* Halts the OS, printing the source file name, line number, and
    function name, plus a user-specific message. */
 void
@@ -26,8 +51,11 @@ debug_panic (const char *file, int line, const char *function,
   console_panic ();
 
   level++;
-  if (level == 1) 
+  if (level == 1)
     {
+      void *addrs[FRAME_MAX], **frame;
+      size_t cnt = 0;
+
       printf ("Kernel PANIC at %s:%d in %s(): ", file, line, function);
 
       va_start (args, message);
@@ -36,6 +64,15 @@ debug_panic (const char *file, int line, const char *function,
       va_end (args);
 
       debug_backtrace ();
+
+      /* The same walk again, symbolized. */
+      addrs[cnt++] = __builtin_return_address (0);
+      for (frame = __builtin_frame_address (1);
+           cnt < FRAME_MAX && (uintptr_t) frame >= 0x1000
+             && frame[0] != NULL;
+           frame = frame[0])
+        addrs[cnt++] = frame[1];
+      print_symbols (addrs, cnt);
     }
   else if (level == 2)
     printf ("Kernel PANIC recursion at %s:%d in %s().\n",
@@ -56,6 +93,8 @@ static void
 print_stacktrace(struct thread *t, void *aux UNUSED)
 {
   void *retaddr = NULL, **frame = NULL;
+  void *addrs[FRAME_MAX];
+  size_t cnt = 0;
   const char *status = "UNKNOWN";
 
   switch (t->status) {
@@ -107,9 +146,15 @@ print_stacktrace(struct thread *t, void *aux UNUSED)
     }
 
   printf (" %p", retaddr);
+  addrs[cnt++] = retaddr;
   for (; (uintptr_t) frame >= 0x1000 && frame[0] != NULL; frame = frame[0])
-    printf (" %p", frame[1]);
+    {
+      printf (" %p", frame[1]);
+      if (cnt < FRAME_MAX)
+        addrs[cnt++] = frame[1];
+    }
   printf (".\n");
+  print_symbols (addrs, cnt);
 }
 
 /* Prints call stack of all threads. */
@@ -0,0 +1,123 @@
+#ifndef __LIB_KERNEL_FIXED_POINT_H
+#define __LIB_KERNEL_FIXED_POINT_H
+
+#include <stdint.h>
+
+/* Signed fixed-point arithmetic, 17.14 by default.
+
+   The kernel cannot use floating point (the FPU is never
+   initialized), so real-valued quantities -- the 4.4BSD
+   scheduler's load_avg and recent_cpu, bandwidth figures, any
+   exponentially weighted average -- are kept as a signed 32-bit
+   integer with the low FP_SHIFT bits holding the fraction.  A
+   translation unit may define FP_SHIFT before including this
+   header to pick a different split; the default of 14 leaves 17
+   magnitude bits, enough for the scheduler math.
+
+   All routines here are trivial enough to inline everywhere, so
+   there is no fixed-point.c. */
+
+typedef int fixed_point;
+
+#ifndef FP_SHIFT
+#define FP_SHIFT 14
+#endif
+#define FP_F (1 << FP_SHIFT)
+
+/* Converts integer N to fixed point. */
+static inline fixed_point
+fp_from_int (int n)
+{
+  return n * FP_F;
+}
+
+/* Converts X to an integer, truncating toward zero. */
+static inline int
+fp_to_int_trunc (fixed_point x)
+{
+  return x / FP_F;
+}
+
+/* Converts X to an integer, rounding to nearest. */
+static inline int
+fp_to_int_round (fixed_point x)
+{
+  return x >= 0 ? (x + FP_F / 2) / FP_F : (x - FP_F / 2) / FP_F;
+}
+
+/* Returns X + Y. */
+static inline fixed_point
+fp_add (fixed_point x, fixed_point y)
+{
+  return x + y;
+}
+
+/* Returns X - Y. */
+static inline fixed_point
+fp_sub (fixed_point x, fixed_point y)
+{
+  return x - y;
+}
+
+/* Returns X + N, for integer N. */
+static inline fixed_point
+fp_add_int (fixed_point x, int n)
+{
+  return x + n * FP_F;
+}
+
+/* Returns X - N, for integer N. */
+static inline fixed_point
+fp_sub_int (fixed_point x, int n)
+{
+  return x - n * FP_F;
+}
+
+/* Returns X * Y, truncated.  The intermediate product needs 64
+   bits. */
+static inline fixed_point
+fp_mul (fixed_point x, fixed_point y)
+{
+  return (int64_t) x * y / FP_F;
+}
+
+/* Returns X * Y, rounded to nearest. */
+static inline fixed_point
+fp_mul_round (fixed_point x, fixed_point y)
+{
+  int64_t p = (int64_t) x * y;
+  return p >= 0 ? (p + FP_F / 2) / FP_F : (p - FP_F / 2) / FP_F;
+}
+
+/* Returns X * N, for integer N. */
+static inline fixed_point
+fp_mul_int (fixed_point x, int n)
+{
+  return x * n;
+}
+
+/* Returns X / Y, truncated.  The scaled dividend needs 64
+   bits. */
+static inline fixed_point
+fp_div (fixed_point x, fixed_point y)
+{
+  return (int64_t) x * FP_F / y;
+}
+
+/* Returns X / Y, rounded to nearest. */
+static inline fixed_point
+fp_div_round (fixed_point x, fixed_point y)
+{
+  int64_t n = (int64_t) x * FP_F;
+  int64_t half = (y >= 0 ? y : -(int64_t) y) / 2;
+  return (n >= 0) == (y >= 0) ? (n + half) / y : (n - half) / y;
+}
+
+/* Returns X / N, for integer N. */
+static inline fixed_point
+fp_div_int (fixed_point x, int n)
+{
+  return x / n;
+}
+
+#endif /* lib/kernel/fixed-point.h */
@@ -0,0 +1,259 @@
+/* Intrusive binary min-heap.
+
+   See heap.h for an overview.  The heap is a complete binary
+   tree linked through parent and child pointers.  The node at
+   1-based position N is reached from the root by reading N's
+   binary representation below its most significant bit, going
+   left on 0 and right on 1, so finding the attachment point for
+   an insertion or the last node for a removal is O(lg n) with no
+   auxiliary storage.
+
+   Sifting moves whole nodes, not values: a node is swapped with
+   its parent by relinking, so embedded elements keep their
+   identity and callers may hold pointers to them across heap
+   operations. */
+
+#include "heap.h"
+#include "../debug.h"
+
+static struct heap_elem *node_at (struct heap *, size_t n);
+static void swap_with_parent (struct heap *, struct heap_elem *);
+static void sift_up (struct heap *, struct heap_elem *);
+static void sift_down (struct heap *, struct heap_elem *);
+static struct heap_elem *detach_last (struct heap *);
+static void take_place_of (struct heap *, struct heap_elem *e,
+                           const struct heap_elem *old);
+
+/* Initializes HEAP as an empty heap ordered according to LESS
+   given auxiliary data AUX. */
+void
+heap_init (struct heap *heap, heap_less_func *less, void *aux)
+{
+  ASSERT (heap != NULL);
+  ASSERT (less != NULL);
+
+  heap->root = NULL;
+  heap->size = 0;
+  heap->less = less;
+  heap->aux = aux;
+}
+
+/* Inserts ELEM into HEAP. */
+void
+heap_insert (struct heap *heap, struct heap_elem *elem)
+{
+  ASSERT (heap != NULL);
+  ASSERT (elem != NULL);
+
+  elem->left = elem->right = NULL;
+  heap->size++;
+  if (heap->size == 1)
+    {
+      elem->parent = NULL;
+      heap->root = elem;
+      return;
+    }
+
+  /* Attach as a child of the node at position SIZE / 2: left if
+     SIZE is even, right if odd. */
+  elem->parent = node_at (heap, heap->size / 2);
+  if (heap->size % 2 == 0)
+    elem->parent->left = elem;
+  else
+    elem->parent->right = elem;
+
+  sift_up (heap, elem);
+}
+
+/* Returns the least element in HEAP, without removing it.
+   Undefined behavior if HEAP is empty. */
+struct heap_elem *
+heap_min (struct heap *heap)
+{
+  ASSERT (heap != NULL);
+  ASSERT (!heap_empty (heap));
+
+  return heap->root;
+}
+
+/* Removes the least element from HEAP and returns it.
+   Undefined behavior if HEAP is empty. */
+struct heap_elem *
+heap_pop_min (struct heap *heap)
+{
+  struct heap_elem *min, *last;
+
+  ASSERT (heap != NULL);
+  ASSERT (!heap_empty (heap));
+
+  min = heap->root;
+  last = detach_last (heap);
+  if (last != min)
+    {
+      take_place_of (heap, last, min);
+      sift_down (heap, last);
+    }
+  return min;
+}
+
+/* Removes ELEM, which must be in HEAP, from HEAP. */
+void
+heap_delete (struct heap *heap, struct heap_elem *elem)
+{
+  struct heap_elem *last;
+
+  ASSERT (heap != NULL);
+  ASSERT (!heap_empty (heap));
+
+  last = detach_last (heap);
+  if (last != elem)
+    {
+      take_place_of (heap, last, elem);
+      sift_up (heap, last);
+      sift_down (heap, last);
+    }
+}
+
+/* Returns the number of elements in HEAP. */
+size_t
+heap_size (struct heap *heap)
+{
+  ASSERT (heap != NULL);
+
+  return heap->size;
+}
+
+/* Returns true if HEAP is empty, false otherwise. */
+bool
+heap_empty (struct heap *heap)
+{
+  ASSERT (heap != NULL);
+
+  return heap->size == 0;
+}
+
+/* Returns the node at 1-based position N in HEAP, reached by
+   following N's binary digits below the most significant bit:
+   left on 0, right on 1. */
+static struct heap_elem *
+node_at (struct heap *heap, size_t n)
+{
+  struct heap_elem *e = heap->root;
+  size_t mask;
+
+  ASSERT (n >= 1 && n <= heap->size);
+
+  /* Find the bit just below N's most significant bit. */
+  for (mask = 1; mask <= n; mask <<= 1)
+    continue;
+  mask >>= 2;
+
+  for (; mask > 0; mask >>= 1)
+    e = n & mask ? e->right : e->left;
+  return e;
+}
+
+/* Exchanges E with its parent by relinking, preserving the shape
+   of the tree. */
+static void
+swap_with_parent (struct heap *heap, struct heap_elem *e)
+{
+  struct heap_elem *p = e->parent;
+  struct heap_elem *g = p->parent;
+  struct heap_elem *sibling = p->left == e ? p->right : p->left;
+  struct heap_elem *l = e->left, *r = e->right;
+
+  /* E takes P's place under G. */
+  e->parent = g;
+  if (g == NULL)
+    heap->root = e;
+  else if (g->left == p)
+    g->left = e;
+  else
+    g->right = e;
+
+  /* P becomes E's child, keeping the sibling on its old side. */
+  if (p->left == e)
+    {
+      e->left = p;
+      e->right = sibling;
+    }
+  else
+    {
+      e->left = sibling;
+      e->right = p;
+    }
+  p->parent = e;
+  if (sibling != NULL)
+    sibling->parent = e;
+
+  /* P inherits E's children. */
+  p->left = l;
+  p->right = r;
+  if (l != NULL)
+    l->parent = p;
+  if (r != NULL)
+    r->parent = p;
+}
+
+/* Moves E toward the root until its parent is not greater. */
+static void
+sift_up (struct heap *heap, struct heap_elem *e)
+{
+  while (e->parent != NULL && heap->less (e, e->parent, heap->aux))
+    swap_with_parent (heap, e);
+}
+
+/* Moves E away from the root until no child is less. */
+static void
+sift_down (struct heap *heap, struct heap_elem *e)
+{
+  for (;;)
+    {
+      struct heap_elem *c = e->left;
+
+      if (e->right != NULL && heap->less (e->right, c, heap->aux))
+        c = e->right;
+      if (c == NULL || !heap->less (c, e, heap->aux))
+        break;
+      swap_with_parent (heap, c);
+    }
+}
+
+/* Unlinks and returns the node at the last position in HEAP,
+   decrementing its size. */
+static struct heap_elem *
+detach_last (struct heap *heap)
+{
+  struct heap_elem *last = node_at (heap, heap->size);
+
+  if (last->parent == NULL)
+    heap->root = NULL;
+  else if (last->parent->left == last)
+    last->parent->left = NULL;
+  else
+    last->parent->right = NULL;
+  heap->size--;
+  return last;
+}
+
+/* Links E into the tree position occupied by OLD, whose links
+   must still be intact.  OLD is left dangling. */
+static void
+take_place_of (struct heap *heap, struct heap_elem *e,
+               const struct heap_elem *old)
+{
+  e->parent = old->parent;
+  e->left = old->left;
+  e->right = old->right;
+  if (e->parent == NULL)
+    heap->root = e;
+  else if (e->parent->left == old)
+    e->parent->left = e;
+  else
+    e->parent->right = e;
+  if (e->left != NULL)
+    e->left->parent = e;
+  if (e->right != NULL)
+    e->right->parent = e;
+}
@@ -0,0 +1,81 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Intrusive binary min-heap.
+
+   Like the doubly linked list in list.h, this container does not
+   require any dynamic allocation: each element that can go in a
+   heap must embed a `struct heap_elem' member, and the heap
+   itself links the embedded elements together.  Conversion from
+   a heap element back to the enclosing structure uses the
+   heap_entry macro, the counterpart of list_entry:
+
+     struct sleeper
+       {
+         struct heap_elem elem;
+         int64_t wakeup_tick;
+       };
+
+     struct sleeper *s = heap_entry (heap_min (&h), struct sleeper, elem);
+
+   The heap keeps the element that compares least at the root,
+   so heap_min() is O(1) and heap_insert()/heap_pop_min() are
+   O(lg n), unlike list_insert_ordered()'s O(n) insertion.  The
+   tree is threaded with parent and child pointers rather than
+   laid out in an array, so it never allocates and never needs to
+   grow.
+
+   Unlike list.h's comparison functions, which order list
+   elements, heap_less_func compares heap elements; otherwise the
+   convention (strict less-than with an AUX pointer) is the
+   same. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element.  Embed this in the structure to be kept in a
+   heap, like a list_elem. */
+struct heap_elem
+  {
+    struct heap_elem *parent;   /* Parent node, or null for root. */
+    struct heap_elem *left;     /* Left child, or null. */
+    struct heap_elem *right;    /* Right child, or null. */
+  };
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool heap_less_func (const struct heap_elem *a,
+                             const struct heap_elem *b,
+                             void *aux);
+
+/* Binary min-heap. */
+struct heap
+  {
+    struct heap_elem *root;     /* Least element, or null if empty. */
+    size_t size;                /* Number of elements. */
+    heap_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for LESS. */
+  };
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+   the structure that HEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element.  See the big comment at the top of the
+   file for an example. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)                   \
+        ((STRUCT *) ((uint8_t *) &(HEAP_ELEM)->parent           \
+                     - offsetof (STRUCT, MEMBER.parent)))
+
+void heap_init (struct heap *, heap_less_func *, void *aux);
+
+void heap_insert (struct heap *, struct heap_elem *);
+struct heap_elem *heap_min (struct heap *);
+struct heap_elem *heap_pop_min (struct heap *);
+void heap_delete (struct heap *, struct heap_elem *);
+
+size_t heap_size (struct heap *);
+bool heap_empty (struct heap *);
+
+#endif /* lib/kernel/heap.h */
@@ -1,5 +1,6 @@
 #include "list.h"
 #include "../debug.h"
+#include "threads/malloc.h"
 
 /* Our doubly linked lists have two header elements: the "head"
    just before the first element and the "tail" just after the
@@ -398,17 +399,17 @@ inplace_merge (struct list_elem *a0, struct list_elem *a1b0,
       }
 }
 
-/* Sorts LIST according to LESS given auxiliary data AUX, using a
-   natural iterative merge sort that runs in O(n lg n) time and
-   O(1) space in the number of elements in LIST. */
-void
-list_sort (struct list *list, list_less_func *less, void *aux)
+/* Sorts LIST with a natural iterative merge sort that runs in
+   O(n lg n) time and O(1) space in the number of elements in
+   LIST.  Every pass chases prev/next pointers across the whole
+   list, so this is slow on big lists, but it needs no scratch
+   memory: it is the fallback when staged_sort() cannot get a
+   bounce buffer. */
+static void
+natural_sort (struct list *list, list_less_func *less, void *aux)
 {
   size_t output_run_cnt;        /* Number of runs output in current pass. */
 
-  ASSERT (list != NULL);
-  ASSERT (less != NULL);
-
   /* Pass over the list repeatedly, merging adjacent runs of
      nondecreasing elements, until only one run is left. */
   do
@@ -435,6 +436,106 @@ list_sort (struct list *list, list_less_func *less, void *aux)
         }
     }
   while (output_run_cnt > 1);
+}
+
+/* Merges the sorted pointer ranges SRC[A0...A1B0) and
+   SRC[A1B0...B1) into DST[A0...B1), comparing the pointed-to
+   elements with LESS given auxiliary data AUX. */
+static void
+merge_ptrs (struct list_elem **src, struct list_elem **dst,
+            size_t a0, size_t a1b0, size_t b1,
+            list_less_func *less, void *aux)
+{
+  size_t a = a0, b = a1b0, o = a0;
+
+  while (a < a1b0 && b < b1)
+    dst[o++] = !less (src[b], src[a], aux) ? src[a++] : src[b++];
+  while (a < a1b0)
+    dst[o++] = src[a++];
+  while (b < b1)
+    dst[o++] = src[b++];
+}
+
+/* Sorts the CNT elements of LIST through the CNT-element bounce
+   buffers BUF and AUX_BUF: spills element pointers into BUF,
+   runs a bottom-up merge sort that ping-pongs between the two
+   flat arrays, and relinks the list once at the end.  Merging
+   through arrays touches memory sequentially instead of chasing
+   prev/next pointers across the heap every pass. */
+static void
+staged_sort (struct list *list, struct list_elem **buf,
+             struct list_elem **aux_buf, size_t cnt,
+             list_less_func *less, void *aux)
+{
+  struct list_elem **src = buf, **dst = aux_buf;
+  struct list_elem *e, *prev;
+  size_t width, i;
+
+  i = 0;
+  for (e = list_begin (list); e != list_end (list); e = list_next (e))
+    src[i++] = e;
+  ASSERT (i == cnt);
+
+  for (width = 1; width < cnt; width *= 2)
+    {
+      struct list_elem **t;
+
+      for (i = 0; i < cnt; i += 2 * width)
+        {
+          size_t a1b0 = i + width < cnt ? i + width : cnt;
+          size_t b1 = i + 2 * width < cnt ? i + 2 * width : cnt;
+
+          merge_ptrs (src, dst, i, a1b0, b1, less, aux);
+        }
+      t = src, src = dst, dst = t;
+    }
+
+  /* Rebuild the links in sorted order. */
+  prev = list_head (list);
+  for (i = 0; i < cnt; i++)
+    {
+      prev->next = src[i];
+      src[i]->prev = prev;
+      prev = src[i];
+    }
+  prev->next = list_tail (list);
+  list_tail (list)->prev = prev;
+}
+
+/* Number of element pointers staged on the kernel stack before
+   staged_sort() needs a heap buffer instead. */
+#define SORT_STACK_MAX 32
+
+/* Sorts LIST according to LESS given auxiliary data AUX in
+   O(n lg n) time in the number of elements in LIST.  Stages
+   element pointers into a flat bounce buffer, on the stack for
+   short lists and from the heap for long ones, so the merge
+   passes scan sequential memory; if no buffer is available it
+   falls back to a pointer-chasing natural merge in place. */
+void
+list_sort (struct list *list, list_less_func *less, void *aux)
+{
+  struct list_elem *stack_buf[2 * SORT_STACK_MAX];
+  struct list_elem **heap_buf = NULL;
+  struct list_elem **buf;
+  size_t cnt;
+
+  ASSERT (list != NULL);
+  ASSERT (less != NULL);
+
+  cnt = list_size (list);
+  if (cnt <= SORT_STACK_MAX)
+    buf = stack_buf;
+  else
+    buf = heap_buf = malloc (2 * cnt * sizeof *buf);
+
+  if (buf != NULL)
+    {
+      staged_sort (list, buf, buf + cnt, cnt, less, aux);
+      free (heap_buf);
+    }
+  else
+    natural_sort (list, less, aux);
 
   ASSERT (is_sorted (list_begin (list), list_end (list), less, aux));
 }
@@ -0,0 +1,161 @@
+#include "lz.h"
+#include "../debug.h"
+#include <stdint.h>
+#include <string.h>
+
+/* LZ77-class compressor.
+
+   The output is a stream of groups: one control byte followed by
+   up to eight items, one per control bit, least significant bit
+   first.  A clear bit stands for a literal byte copied through
+   verbatim.  A set bit stands for a two-byte match reference:
+   the high four bits of the first byte hold the match length
+   minus LZ_MIN_MATCH, and the remaining twelve bits hold the
+   backward offset, so matches reach LZ_MAX_MATCH bytes and
+   LZ_MAX_OFFSET bytes back.  Incompressible input grows by one
+   control byte per eight literals, an overhead lz_compress()
+   reports by failing when the output does not fit.
+
+   The match finder is a single static position table, kept out
+   of the caller's small kernel stack, so concurrent calls must
+   be serialized by the caller.  The kernel's one user, the swap
+   layer, already holds its own lock across each call. */
+
+#define LZ_MIN_MATCH 3                  /* Shortest encodable match. */
+#define LZ_MAX_MATCH (LZ_MIN_MATCH + 15) /* Longest encodable match. */
+#define LZ_MAX_OFFSET 0x0fff            /* Farthest encodable offset. */
+#define LZ_HASH_BITS 12                 /* log2 of match table size. */
+#define LZ_HASH_SIZE (1 << LZ_HASH_BITS)
+
+/* Maps a hash of three input bytes to the position just past
+   where they were last seen, or 0 for never. */
+static uint16_t match_pos[LZ_HASH_SIZE];
+
+/* Hashes the three bytes at P into a match_pos index. */
+static unsigned
+lz_hash (const uint8_t *p)
+{
+  unsigned x = p[0] | (unsigned) p[1] << 8 | (unsigned) p[2] << 16;
+
+  return x * 2654435761u >> (32 - LZ_HASH_BITS);
+}
+
+/* Compresses the SRC_SIZE bytes at SRC, at most 64 kB, into DST.
+   Returns the compressed size, or 0 if it would exceed DST_SIZE;
+   passing a DST_SIZE below the acceptable compressed size thus
+   doubles as a cheap compressibility test. */
+size_t
+lz_compress (const void *src_, size_t src_size, void *dst_, size_t dst_size)
+{
+  const uint8_t *src = src_;
+  uint8_t *dst = dst_;
+  size_t si = 0, di = 0;
+  uint8_t *ctrl = NULL;
+  int bit = 8;
+
+  ASSERT (src_size < UINT16_MAX);
+  memset (match_pos, 0, sizeof match_pos);
+
+  while (si < src_size)
+    {
+      size_t len = 0, pos = 0;
+
+      if (bit == 8)
+        {
+          if (di >= dst_size)
+            return 0;
+          ctrl = &dst[di++];
+          *ctrl = 0;
+          bit = 0;
+        }
+
+      /* Look for a match at the position the last occurrence of
+         these three bytes hashed to.  One probe, no chains. */
+      if (si + LZ_MIN_MATCH <= src_size)
+        {
+          unsigned h = lz_hash (src + si);
+          size_t cand = match_pos[h];
+
+          match_pos[h] = si + 1;
+          if (cand != 0)
+            {
+              pos = cand - 1;
+              if (si - pos <= LZ_MAX_OFFSET
+                  && src[pos] == src[si] && src[pos + 1] == src[si + 1]
+                  && src[pos + 2] == src[si + 2])
+                {
+                  len = LZ_MIN_MATCH;
+                  while (len < LZ_MAX_MATCH && si + len < src_size
+                         && src[pos + len] == src[si + len])
+                    len++;
+                }
+            }
+        }
+
+      if (len > 0)
+        {
+          size_t off = si - pos;
+
+          if (di + 2 > dst_size)
+            return 0;
+          dst[di++] = (len - LZ_MIN_MATCH) << 4 | off >> 8;
+          dst[di++] = off & 0xff;
+          *ctrl |= 1 << bit;
+          si += len;
+        }
+      else
+        {
+          if (di >= dst_size)
+            return 0;
+          dst[di++] = src[si++];
+        }
+      bit++;
+    }
+
+  return di;
+}
+
+/* Decompresses the SRC_SIZE bytes at SRC, as produced by
+   lz_compress(), into DST.  Returns the number of bytes
+   produced, or 0 if the stream is malformed or would overrun
+   DST_SIZE. */
+size_t
+lz_decompress (const void *src_, size_t src_size, void *dst_, size_t dst_size)
+{
+  const uint8_t *src = src_;
+  uint8_t *dst = dst_;
+  size_t si = 0, di = 0;
+
+  while (si < src_size)
+    {
+      uint8_t ctrl = src[si++];
+      int bit;
+
+      for (bit = 0; bit < 8 && si < src_size; bit++)
+        if (ctrl & (1 << bit))
+          {
+            size_t len, off, i;
+
+            if (si + 2 > src_size)
+              return 0;
+            len = (src[si] >> 4) + LZ_MIN_MATCH;
+            off = (size_t) (src[si] & 0x0f) << 8 | src[si + 1];
+            si += 2;
+            if (off == 0 || off > di || di + len > dst_size)
+              return 0;
+
+            /* Byte by byte: a match may overlap its own output,
+               e.g. offset 1 repeating the previous byte. */
+            for (i = 0; i < len; i++, di++)
+              dst[di] = dst[di - off];
+          }
+        else
+          {
+            if (di >= dst_size)
+              return 0;
+            dst[di++] = src[si++];
+          }
+    }
+
+  return di;
+}
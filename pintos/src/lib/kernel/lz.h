@@ -0,0 +1,18 @@
+#ifndef __LIB_KERNEL_LZ_H
+#define __LIB_KERNEL_LZ_H
+
+/* Simple LZ77-class compressor.
+
+   Trades compression ratio for speed and size: a single pass
+   with a small match table, no entropy coding.  Meant for
+   kernel data that is cheap to regenerate if a copy is lost,
+   such as swapped-out pages.  See lz.c for the format. */
+
+#include <stddef.h>
+
+size_t lz_compress (const void *src, size_t src_size,
+                    void *dst, size_t dst_size);
+size_t lz_decompress (const void *src, size_t src_size,
+                      void *dst, size_t dst_size);
+
+#endif /* lib/kernel/lz.h */
@@ -0,0 +1,85 @@
+#include "mpsc.h"
+#include "../debug.h"
+
+/* Atomically sets *P to NEW if it still equals OLD.  Returns
+   true if the swap happened, false if *P had changed.  See
+   [IA32-v2a] "CMPXCHG"; the lock prefix makes it atomic against
+   other processors as well as interrupts. */
+static inline bool
+cas (struct mpsc_elem **p, struct mpsc_elem *old, struct mpsc_elem *new_)
+{
+  uint8_t ok;
+
+  asm volatile ("lock cmpxchgl %3, %1; sete %0"
+                : "=q" (ok), "+m" (*p), "+a" (old)
+                : "r" (new_)
+                : "memory", "cc");
+  return ok;
+}
+
+/* Initializes Q as an empty queue. */
+void
+mpsc_init (struct mpsc_queue *q)
+{
+  ASSERT (q != NULL);
+
+  q->top = NULL;
+}
+
+/* Pushes E onto Q.  Safe in any context, including with
+   intr_context() true: the compare-and-swap loop retries only if
+   another push landed between the read and the swap, so it
+   cannot spin indefinitely against a consumer and never
+   sleeps. */
+void
+mpsc_push (struct mpsc_queue *q, struct mpsc_elem *e)
+{
+  struct mpsc_elem *old;
+
+  ASSERT (e != NULL);
+
+  do
+    {
+      old = q->top;
+      e->next = old;
+    }
+  while (!cas (&q->top, old, e));
+}
+
+/* Takes Q's whole backlog in one atomic exchange and returns it
+   as a null-terminated chain in push order (oldest first); Q is
+   left empty.  Follow the chain through each element's `next'
+   pointer.  Only the single consumer may call this. */
+struct mpsc_elem *
+mpsc_pop_all (struct mpsc_queue *q)
+{
+  struct mpsc_elem *top;
+  struct mpsc_elem *out = NULL;
+
+  /* Detach the stack.  An xchg would do; cas in a loop keeps the
+     code to one atomic primitive. */
+  do
+    top = q->top;
+  while (top != NULL && !cas (&q->top, top, NULL));
+
+  /* The stack is in reverse push order; reverse it so the
+     consumer sees oldest first. */
+  while (top != NULL)
+    {
+      struct mpsc_elem *next = top->next;
+
+      top->next = out;
+      out = top;
+      top = next;
+    }
+  return out;
+}
+
+/* Returns true if Q contains no elements.  Only a hint for
+   anyone but the single consumer: a producer may push at any
+   moment. */
+bool
+mpsc_empty (const struct mpsc_queue *q)
+{
+  return q->top == NULL;
+}
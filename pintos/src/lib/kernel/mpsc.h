@@ -0,0 +1,50 @@
+#ifndef __LIB_KERNEL_MPSC_H
+#define __LIB_KERNEL_MPSC_H
+
+/* Lock-free multi-producer, single-consumer queue.
+
+   Any number of producers -- including code running in interrupt
+   context -- push elements with a compare-and-swap loop; one
+   consumer takes the whole backlog in a single atomic exchange
+   and walks it in push order.  Neither side blocks, sleeps, or
+   disables interrupts, which is what makes the queue usable for
+   handing structured work (completion records, deferred frees)
+   from an interrupt handler to a thread.  The queue carries no
+   wakeup of its own: pair it with a semaphore when the consumer
+   sleeps.
+
+   Like struct list, the queue is intrusive: embed a struct
+   mpsc_elem in the element type and convert back with
+   mpsc_entry.  An element may be on only one queue at a time,
+   and must not be reused until the consumer has popped it. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Queue element. */
+struct mpsc_elem
+  {
+    struct mpsc_elem *next;     /* Next element toward older pushes. */
+  };
+
+/* Queue: the top of a singly linked stack of pushed elements. */
+struct mpsc_queue
+  {
+    struct mpsc_elem *top;      /* Most recently pushed element. */
+  };
+
+/* Converts pointer to mpsc element MPSC_ELEM into a pointer to
+   the structure that MPSC_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the element, as in the examples for list_entry. */
+#define mpsc_entry(MPSC_ELEM, STRUCT, MEMBER)                   \
+        ((STRUCT *) ((uint8_t *) &(MPSC_ELEM)->next             \
+                     - offsetof (STRUCT, MEMBER.next)))
+
+void mpsc_init (struct mpsc_queue *);
+void mpsc_push (struct mpsc_queue *, struct mpsc_elem *);
+struct mpsc_elem *mpsc_pop_all (struct mpsc_queue *);
+bool mpsc_empty (const struct mpsc_queue *);
+
+#endif /* lib/kernel/mpsc.h */
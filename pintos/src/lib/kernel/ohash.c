@@ -0,0 +1,361 @@
+/* Open-addressing hash table with robin-hood probing and
+   incremental rehashing.
+
+   See ohash.h for an overview.  The implementation keeps at most
+   two slot arrays alive at a time: the active array and, while a
+   growth is in progress, the old array being drained.  Each
+   mutating operation migrates a bounded number of old slots, so
+   table growth never stalls a single caller for the whole
+   rehash. */
+
+#include "ohash.h"
+#include <string.h>
+#include "../debug.h"
+#include "threads/malloc.h"
+
+/* Initial slot count, a power of 2. */
+#define OHASH_INIT_SLOTS 8
+
+/* Old slots migrated per mutating operation. */
+#define MIGRATE_STEP 4
+
+static size_t probe_distance (size_t bucket_cnt, unsigned hash, size_t pos);
+static void slot_insert (struct ohash_slot *slots, size_t bucket_cnt,
+                         struct hash_elem *e, unsigned hash);
+static struct hash_elem *slot_find (struct ohash *o,
+                                    struct ohash_slot *slots,
+                                    size_t bucket_cnt,
+                                    const struct hash_elem *e, unsigned hash,
+                                    size_t *pos_out);
+static void slot_remove (struct ohash_slot *slots, size_t bucket_cnt,
+                         size_t pos);
+static bool grow (struct ohash *o);
+static void migrate (struct ohash *o, size_t steps);
+static void drain (struct ohash *o);
+
+/* Initializes open-addressing hash table O to compute hash
+   values using HASH and compare hash elements using LESS, given
+   auxiliary data AUX.  Returns true if successful, false on
+   failure (typically out of memory). */
+bool
+ohash_init (struct ohash *o,
+            hash_hash_func *hash, hash_less_func *less, void *aux)
+{
+  o->elem_cnt = 0;
+  o->bucket_cnt = OHASH_INIT_SLOTS;
+  o->slots = calloc (o->bucket_cnt, sizeof *o->slots);
+  o->old_slots = NULL;
+  o->old_bucket_cnt = 0;
+  o->migrate_pos = 0;
+  o->hash = hash;
+  o->less = less;
+  o->aux = aux;
+
+  return o->slots != NULL;
+}
+
+/* Removes all the elements from O.
+
+   If DESTRUCTOR is non-null, then it is called for each element
+   in the hash.  DESTRUCTOR may, if appropriate, deallocate the
+   memory used by the hash element.  However, modifying table O
+   while ohash_clear() is running, using any of the ohash_xxx()
+   functions, yields undefined behavior, whether done in
+   DESTRUCTOR or elsewhere. */
+void
+ohash_clear (struct ohash *o, hash_action_func *destructor)
+{
+  if (destructor != NULL)
+    ohash_apply (o, destructor);
+
+  free (o->old_slots);
+  o->old_slots = NULL;
+  o->old_bucket_cnt = 0;
+  o->migrate_pos = 0;
+
+  memset (o->slots, 0, o->bucket_cnt * sizeof *o->slots);
+  o->elem_cnt = 0;
+}
+
+/* Destroys open-addressing hash table O.
+
+   If DESTRUCTOR is non-null, then it is first called for each
+   element in the hash, with the same semantics as
+   ohash_clear(). */
+void
+ohash_destroy (struct ohash *o, hash_action_func *destructor)
+{
+  if (destructor != NULL)
+    ohash_apply (o, destructor);
+
+  free (o->old_slots);
+  free (o->slots);
+}
+
+/* Inserts NEW into table O and returns a null pointer, if no
+   equal element is already in the table.  If an equal element is
+   already in the table, returns it without inserting NEW. */
+struct hash_elem *
+ohash_insert (struct ohash *o, struct hash_elem *new)
+{
+  unsigned hash = o->hash (new, o->aux);
+  struct hash_elem *old;
+
+  migrate (o, MIGRATE_STEP);
+
+  old = slot_find (o, o->slots, o->bucket_cnt, new, hash, NULL);
+  if (old == NULL && o->old_slots != NULL)
+    old = slot_find (o, o->old_slots, o->old_bucket_cnt, new, hash, NULL);
+  if (old != NULL)
+    return old;
+
+  /* Grow when the active array passes 3/4 full.  If allocation
+     fails, fall through and insert anyway: the table degrades to
+     longer probes but stays correct. */
+  if (o->elem_cnt >= o->bucket_cnt - o->bucket_cnt / 4 && o->old_slots == NULL)
+    grow (o);
+
+  slot_insert (o->slots, o->bucket_cnt, new, hash);
+  o->elem_cnt++;
+  return NULL;
+}
+
+/* Finds and returns an element equal to E in table O, or a null
+   pointer if no equal element exists in the table. */
+struct hash_elem *
+ohash_find (struct ohash *o, const struct hash_elem *e)
+{
+  unsigned hash = o->hash (e, o->aux);
+  struct hash_elem *found;
+
+  found = slot_find (o, o->slots, o->bucket_cnt, e, hash, NULL);
+  if (found == NULL && o->old_slots != NULL)
+    found = slot_find (o, o->old_slots, o->old_bucket_cnt, e, hash, NULL);
+  return found;
+}
+
+/* Finds, removes, and returns an element equal to E in table O.
+   Returns a null pointer if no equal element existed in the
+   table.
+
+   If the elements of the hash table are dynamically allocated,
+   or own resources that are, then it is the caller's
+   responsibility to deallocate them. */
+struct hash_elem *
+ohash_delete (struct ohash *o, const struct hash_elem *e)
+{
+  unsigned hash = o->hash (e, o->aux);
+  struct hash_elem *found;
+  size_t pos;
+
+  migrate (o, MIGRATE_STEP);
+
+  found = slot_find (o, o->slots, o->bucket_cnt, e, hash, &pos);
+  if (found != NULL)
+    slot_remove (o->slots, o->bucket_cnt, pos);
+  else if (o->old_slots != NULL)
+    {
+      found = slot_find (o, o->old_slots, o->old_bucket_cnt, e, hash, &pos);
+      if (found != NULL)
+        slot_remove (o->old_slots, o->old_bucket_cnt, pos);
+    }
+
+  if (found != NULL)
+    o->elem_cnt--;
+  return found;
+}
+
+/* Calls ACTION for each element in table O in arbitrary order.
+   Modifying table O while ohash_apply() is running, using any of
+   the ohash_xxx() functions, yields undefined behavior, whether
+   done from ACTION or elsewhere. */
+void
+ohash_apply (struct ohash *o, hash_action_func *action)
+{
+  size_t i;
+
+  ASSERT (action != NULL);
+
+  for (i = 0; i < o->bucket_cnt; i++)
+    if (o->slots[i].elem != NULL)
+      action (o->slots[i].elem, o->aux);
+  for (i = o->migrate_pos; i < o->old_bucket_cnt; i++)
+    if (o->old_slots[i].elem != NULL)
+      action (o->old_slots[i].elem, o->aux);
+}
+
+/* Returns the number of elements in O. */
+size_t
+ohash_size (struct ohash *o)
+{
+  return o->elem_cnt;
+}
+
+/* Returns true if O contains no elements, false otherwise. */
+bool
+ohash_empty (struct ohash *o)
+{
+  return o->elem_cnt == 0;
+}
+
+/* Returns how far position POS is from the home bucket of an
+   element with hash value HASH, in a table of BUCKET_CNT
+   slots. */
+static size_t
+probe_distance (size_t bucket_cnt, unsigned hash, size_t pos)
+{
+  return (pos - hash) & (bucket_cnt - 1);
+}
+
+/* Inserts E with hash value HASH into the slot array SLOTS of
+   BUCKET_CNT slots, which must have a free slot.  Robin-hood
+   probing: while looking for a free slot, E swaps places with
+   any resident element closer to its own home bucket, so no
+   element's probe sequence is much longer than any other's. */
+static void
+slot_insert (struct ohash_slot *slots, size_t bucket_cnt,
+             struct hash_elem *e, unsigned hash)
+{
+  size_t pos = hash & (bucket_cnt - 1);
+  size_t dist = 0;
+
+  for (;;)
+    {
+      struct ohash_slot *s = &slots[pos];
+
+      if (s->elem == NULL)
+        {
+          s->elem = e;
+          s->hash = hash;
+          return;
+        }
+
+      if (probe_distance (bucket_cnt, s->hash, pos) < dist)
+        {
+          struct hash_elem *tmp_elem = s->elem;
+          unsigned tmp_hash = s->hash;
+
+          s->elem = e;
+          s->hash = hash;
+          e = tmp_elem;
+          hash = tmp_hash;
+          dist = probe_distance (bucket_cnt, hash, pos);
+        }
+
+      pos = (pos + 1) & (bucket_cnt - 1);
+      dist++;
+    }
+}
+
+/* Searches the slot array SLOTS of BUCKET_CNT slots for an
+   element equal to E with hash value HASH.  Returns the element
+   found, storing its position into *POS_OUT if POS_OUT is
+   non-null, or a null pointer if there is none.
+
+   The robin-hood invariant bounds the search: once we reach a
+   free slot, or a resident element closer to its home bucket
+   than we are to ours, the sought element cannot be further
+   along. */
+static struct hash_elem *
+slot_find (struct ohash *o, struct ohash_slot *slots, size_t bucket_cnt,
+           const struct hash_elem *e, unsigned hash, size_t *pos_out)
+{
+  size_t pos = hash & (bucket_cnt - 1);
+  size_t dist = 0;
+
+  for (;;)
+    {
+      struct ohash_slot *s = &slots[pos];
+
+      if (s->elem == NULL
+          || probe_distance (bucket_cnt, s->hash, pos) < dist)
+        return NULL;
+
+      if (s->hash == hash
+          && !o->less (s->elem, e, o->aux) && !o->less (e, s->elem, o->aux))
+        {
+          if (pos_out != NULL)
+            *pos_out = pos;
+          return s->elem;
+        }
+
+      pos = (pos + 1) & (bucket_cnt - 1);
+      dist++;
+    }
+}
+
+/* Removes the element at position POS from the slot array SLOTS
+   of BUCKET_CNT slots by shifting displaced successors backward,
+   which keeps probe sequences contiguous without tombstones. */
+static void
+slot_remove (struct ohash_slot *slots, size_t bucket_cnt, size_t pos)
+{
+  for (;;)
+    {
+      size_t next = (pos + 1) & (bucket_cnt - 1);
+      struct ohash_slot *s = &slots[next];
+
+      if (s->elem == NULL
+          || probe_distance (bucket_cnt, s->hash, next) == 0)
+        break;
+
+      slots[pos] = *s;
+      pos = next;
+    }
+  slots[pos].elem = NULL;
+}
+
+/* Starts growing table O: allocates an array twice the active
+   size, demotes the active array to "old", and leaves migration
+   to subsequent operations.  Returns true if successful, false
+   on allocation failure (in which case O is unchanged). */
+static bool
+grow (struct ohash *o)
+{
+  struct ohash_slot *new_slots;
+  size_t new_bucket_cnt = o->bucket_cnt * 2;
+
+  ASSERT (o->old_slots == NULL);
+
+  new_slots = calloc (new_bucket_cnt, sizeof *new_slots);
+  if (new_slots == NULL)
+    return false;
+
+  o->old_slots = o->slots;
+  o->old_bucket_cnt = o->bucket_cnt;
+  o->migrate_pos = 0;
+  o->slots = new_slots;
+  o->bucket_cnt = new_bucket_cnt;
+  return true;
+}
+
+/* Migrates up to STEPS slots from O's old array into the active
+   array, freeing the old array once it is drained.  No-op if no
+   growth is in progress. */
+static void
+migrate (struct ohash *o, size_t steps)
+{
+  if (o->old_slots == NULL)
+    return;
+
+  while (steps-- > 0 && o->migrate_pos < o->old_bucket_cnt)
+    {
+      struct ohash_slot *s = &o->old_slots[o->migrate_pos++];
+
+      if (s->elem != NULL)
+        slot_insert (o->slots, o->bucket_cnt, s->elem, s->hash);
+    }
+
+  if (o->migrate_pos >= o->old_bucket_cnt)
+    drain (o);
+}
+
+/* Frees O's drained old array. */
+static void
+drain (struct ohash *o)
+{
+  free (o->old_slots);
+  o->old_slots = NULL;
+  o->old_bucket_cnt = 0;
+  o->migrate_pos = 0;
+}
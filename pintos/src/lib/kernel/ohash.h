@@ -0,0 +1,68 @@
+#ifndef __LIB_KERNEL_OHASH_H
+#define __LIB_KERNEL_OHASH_H
+
+/* Open-addressing hash table.
+
+   A flat-array companion to the chained hash table in hash.h,
+   for hot lookup tables where pointer chasing dominates: a
+   lookup probes consecutive slots of one array instead of
+   walking a bucket list, so the common case costs a single
+   cache miss.
+
+   Collisions are resolved with robin-hood probing: an element
+   being inserted steals the slot of any resident element that
+   sits closer to its home bucket, which keeps probe sequences
+   short and uniform.  Growth is incremental: when the table
+   fills past three quarters, a new array twice the size is
+   allocated and each subsequent operation migrates a few old
+   buckets, so no single insertion pays for rehashing the whole
+   table.
+
+   Elements are the same `struct hash_elem' handles used by
+   hash.h, compared and hashed with the same hash_hash_func and
+   hash_less_func, so code can move between the two containers
+   by renaming calls.  The table stores pointers to elements; it
+   never links through the embedded list element. */
+
+#include <hash.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* One slot of the flat array: an element pointer plus its
+   cached hash value, so probing rarely calls back into the
+   element. */
+struct ohash_slot
+  {
+    struct hash_elem *elem;     /* Element, or null if empty. */
+    unsigned hash;              /* Cached hash of ELEM. */
+  };
+
+/* Open-addressing hash table. */
+struct ohash
+  {
+    size_t elem_cnt;            /* Number of elements in table. */
+    struct ohash_slot *slots;   /* Active slot array. */
+    size_t bucket_cnt;          /* Slot count, a power of 2. */
+    struct ohash_slot *old_slots; /* Array being drained, or null. */
+    size_t old_bucket_cnt;      /* Slot count of old array. */
+    size_t migrate_pos;         /* Next old slot to migrate. */
+    hash_hash_func *hash;       /* Hash function. */
+    hash_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for HASH and LESS. */
+  };
+
+bool ohash_init (struct ohash *, hash_hash_func *, hash_less_func *,
+                 void *aux);
+void ohash_clear (struct ohash *, hash_action_func *);
+void ohash_destroy (struct ohash *, hash_action_func *);
+
+struct hash_elem *ohash_insert (struct ohash *, struct hash_elem *);
+struct hash_elem *ohash_find (struct ohash *, const struct hash_elem *);
+struct hash_elem *ohash_delete (struct ohash *, const struct hash_elem *);
+
+void ohash_apply (struct ohash *, hash_action_func *);
+
+size_t ohash_size (struct ohash *);
+bool ohash_empty (struct ohash *);
+
+#endif /* lib/kernel/ohash.h */
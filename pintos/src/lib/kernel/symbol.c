@@ -0,0 +1,33 @@
+#include <symbol.h>
+
+/* Overridden at link time by the table utils/mksymtab generates
+   from the kernel's own nm output: the first link pass uses
+   these empty definitions, the second links the real table.  The
+   table holds only text symbols and the generated object
+   contains no code, so linking it in moves no address it
+   records; see the kernel.o rule in src/Makefile.build. */
+__attribute__ ((weak)) const struct symbol symbol_table[1];
+__attribute__ ((weak)) const size_t symbol_cnt;
+
+/* Returns the table entry for the function containing ADDR, or a
+   null pointer if ADDR precedes the first symbol or no table was
+   linked in. */
+const struct symbol *
+symbol_lookup (const void *addr)
+{
+  uint32_t a = (uint32_t) addr;
+  size_t lo = 0, hi = symbol_cnt;
+
+  if (symbol_cnt == 0 || a < symbol_table[0].addr)
+    return NULL;
+  while (hi - lo > 1)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+
+      if (symbol_table[mid].addr <= a)
+        lo = mid;
+      else
+        hi = mid;
+    }
+  return &symbol_table[lo];
+}
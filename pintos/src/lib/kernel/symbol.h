@@ -0,0 +1,30 @@
+#ifndef __LIB_KERNEL_SYMBOL_H
+#define __LIB_KERNEL_SYMBOL_H
+
+/* Kernel symbol table.
+
+   The build embeds a sorted table of the kernel's own text
+   symbols into the image (see the kernel.o rule in
+   src/Makefile.build), so that panic backtraces and profiler
+   reports can be translated into function names on the box,
+   without the round-trip through the external backtrace
+   utility. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* One text symbol: the address where a function starts.  An
+   address belongs to the last symbol at or below it. */
+struct symbol
+  {
+    uint32_t addr;              /* First address of the function. */
+    const char *name;           /* Function name. */
+  };
+
+/* The table, sorted by address, generated by utils/mksymtab. */
+extern const struct symbol symbol_table[];
+extern const size_t symbol_cnt;
+
+const struct symbol *symbol_lookup (const void *);
+
+#endif /* lib/kernel/symbol.h */
@@ -0,0 +1,344 @@
+#include "tree.h"
+#include "../debug.h"
+
+static struct tree_elem *subtree_min (struct tree_elem *);
+static struct tree_elem *subtree_max (struct tree_elem *);
+static void rebalance (struct tree *, struct tree_elem *);
+
+/* Initializes tree T to compare elements with LESS, given
+   auxiliary data AUX. */
+void
+tree_init (struct tree *t, tree_less_func *less, void *aux)
+{
+  ASSERT (t != NULL);
+  ASSERT (less != NULL);
+
+  t->root = NULL;
+  t->elem_cnt = 0;
+  t->less = less;
+  t->aux = aux;
+}
+
+/* Removes all the elements from T.
+
+   If ACTION is non-null, then it is called once for each element
+   in the tree, which gives the caller an opportunity to
+   deallocate any memory associated with the element.  While
+   tree_clear() is running, it is unsafe to access T from within
+   ACTION. */
+void
+tree_clear (struct tree *t, tree_action_func *action)
+{
+  struct tree_elem *e = t->root;
+
+  /* Post-order walk using the parent pointers, so no element is
+     touched after ACTION has destroyed it. */
+  while (e != NULL)
+    {
+      if (e->left != NULL)
+        e = e->left;
+      else if (e->right != NULL)
+        e = e->right;
+      else
+        {
+          struct tree_elem *parent = e->parent;
+
+          if (parent != NULL)
+            {
+              if (parent->left == e)
+                parent->left = NULL;
+              else
+                parent->right = NULL;
+            }
+          if (action != NULL)
+            action (e, t->aux);
+          e = parent;
+        }
+    }
+  t->root = NULL;
+  t->elem_cnt = 0;
+}
+
+/* Returns the height of the subtree rooted at E, taking a null
+   pointer as the empty subtree of height 0. */
+static int
+height (struct tree_elem *e)
+{
+  return e != NULL ? e->height : 0;
+}
+
+/* Recomputes E's height from its children's. */
+static void
+update_height (struct tree_elem *e)
+{
+  int l = height (e->left), r = height (e->right);
+
+  e->height = (l > r ? l : r) + 1;
+}
+
+/* Replaces the subtree rooted at OLD, as seen from OLD's parent
+   or from T's root pointer, by the subtree rooted at NEW, which
+   may be null.  OLD's own child pointers are not changed. */
+static void
+transplant (struct tree *t, struct tree_elem *old, struct tree_elem *new)
+{
+  if (old->parent == NULL)
+    t->root = new;
+  else if (old->parent->left == old)
+    old->parent->left = new;
+  else
+    old->parent->right = new;
+  if (new != NULL)
+    new->parent = old->parent;
+}
+
+/* Rotates the subtree rooted at X to the left, making X's right
+   child the new subtree root.  Returns the new root. */
+static struct tree_elem *
+rotate_left (struct tree *t, struct tree_elem *x)
+{
+  struct tree_elem *y = x->right;
+
+  x->right = y->left;
+  if (y->left != NULL)
+    y->left->parent = x;
+  transplant (t, x, y);
+  y->left = x;
+  x->parent = y;
+  update_height (x);
+  update_height (y);
+  return y;
+}
+
+/* Rotates the subtree rooted at X to the right, making X's left
+   child the new subtree root.  Returns the new root. */
+static struct tree_elem *
+rotate_right (struct tree *t, struct tree_elem *x)
+{
+  struct tree_elem *y = x->left;
+
+  x->left = y->right;
+  if (y->right != NULL)
+    y->right->parent = x;
+  transplant (t, x, y);
+  y->right = x;
+  x->parent = y;
+  update_height (x);
+  update_height (y);
+  return y;
+}
+
+/* Restores the AVL balance invariant on the path from E up to
+   the root, after an insertion or deletion below E. */
+static void
+rebalance (struct tree *t, struct tree_elem *e)
+{
+  while (e != NULL)
+    {
+      struct tree_elem *parent = e->parent;
+      int balance;
+
+      update_height (e);
+      balance = height (e->left) - height (e->right);
+      if (balance > 1)
+        {
+          if (height (e->left->left) < height (e->left->right))
+            rotate_left (t, e->left);
+          rotate_right (t, e);
+        }
+      else if (balance < -1)
+        {
+          if (height (e->right->right) < height (e->right->left))
+            rotate_right (t, e->right);
+          rotate_left (t, e);
+        }
+      e = parent;
+    }
+}
+
+/* Inserts NEW into tree T and returns a null pointer, if no
+   equal element is already in the tree.  If an equal element is
+   already in the tree, returns it without inserting NEW. */
+struct tree_elem *
+tree_insert (struct tree *t, struct tree_elem *new)
+{
+  struct tree_elem **p = &t->root, *parent = NULL;
+
+  ASSERT (t != NULL);
+  ASSERT (new != NULL);
+
+  while (*p != NULL)
+    {
+      parent = *p;
+      if (t->less (new, parent, t->aux))
+        p = &parent->left;
+      else if (t->less (parent, new, t->aux))
+        p = &parent->right;
+      else
+        return parent;
+    }
+
+  new->parent = parent;
+  new->left = new->right = NULL;
+  new->height = 1;
+  *p = new;
+  t->elem_cnt++;
+  rebalance (t, parent);
+  return NULL;
+}
+
+/* Removes E, which must be in tree T, from T. */
+void
+tree_delete (struct tree *t, struct tree_elem *e)
+{
+  struct tree_elem *fix;
+
+  ASSERT (t != NULL);
+  ASSERT (e != NULL);
+  ASSERT (t->elem_cnt > 0);
+
+  if (e->left == NULL || e->right == NULL)
+    {
+      /* At most one child: splice E out directly. */
+      fix = e->parent;
+      transplant (t, e, e->left != NULL ? e->left : e->right);
+    }
+  else
+    {
+      /* Two children: E's in-order successor S has no left
+         child.  Splice S out of its own position and relink it
+         into E's, so the element, not its contents, moves. */
+      struct tree_elem *s = subtree_min (e->right);
+
+      if (s->parent != e)
+        {
+          fix = s->parent;
+          transplant (t, s, s->right);
+          s->right = e->right;
+          s->right->parent = s;
+        }
+      else
+        fix = s;
+      transplant (t, e, s);
+      s->left = e->left;
+      s->left->parent = s;
+      s->height = e->height;
+    }
+  t->elem_cnt--;
+  rebalance (t, fix);
+}
+
+/* Searches T for an element equal to E.  Returns the element if
+   found, or a null pointer otherwise. */
+struct tree_elem *
+tree_find (struct tree *t, const struct tree_elem *e)
+{
+  struct tree_elem *cur = t->root;
+
+  while (cur != NULL)
+    {
+      if (t->less (e, cur, t->aux))
+        cur = cur->left;
+      else if (t->less (cur, e, t->aux))
+        cur = cur->right;
+      else
+        return cur;
+    }
+  return NULL;
+}
+
+/* Returns the first element in T that is not less than E, in the
+   tree's order, or a null pointer if every element is less than
+   E.  With an address key this answers "which entry covers or
+   follows this address". */
+struct tree_elem *
+tree_lower_bound (struct tree *t, const struct tree_elem *e)
+{
+  struct tree_elem *cur = t->root, *best = NULL;
+
+  while (cur != NULL)
+    {
+      if (t->less (cur, e, t->aux))
+        cur = cur->right;
+      else
+        {
+          best = cur;
+          cur = cur->left;
+        }
+    }
+  return best;
+}
+
+/* Returns the smallest element in the subtree rooted at E, which
+   must not be null. */
+static struct tree_elem *
+subtree_min (struct tree_elem *e)
+{
+  while (e->left != NULL)
+    e = e->left;
+  return e;
+}
+
+/* Returns the largest element in the subtree rooted at E, which
+   must not be null. */
+static struct tree_elem *
+subtree_max (struct tree_elem *e)
+{
+  while (e->right != NULL)
+    e = e->right;
+  return e;
+}
+
+/* Returns the smallest element in T, or a null pointer if T is
+   empty. */
+struct tree_elem *
+tree_min (struct tree *t)
+{
+  return t->root != NULL ? subtree_min (t->root) : NULL;
+}
+
+/* Returns the largest element in T, or a null pointer if T is
+   empty. */
+struct tree_elem *
+tree_max (struct tree *t)
+{
+  return t->root != NULL ? subtree_max (t->root) : NULL;
+}
+
+/* Returns the element after E in the tree's order, or a null
+   pointer if E is the largest.  E must be in a tree. */
+struct tree_elem *
+tree_next (struct tree_elem *e)
+{
+  if (e->right != NULL)
+    return subtree_min (e->right);
+  while (e->parent != NULL && e->parent->right == e)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns the element before E in the tree's order, or a null
+   pointer if E is the smallest.  E must be in a tree. */
+struct tree_elem *
+tree_prev (struct tree_elem *e)
+{
+  if (e->left != NULL)
+    return subtree_max (e->left);
+  while (e->parent != NULL && e->parent->left == e)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns the number of elements in T. */
+size_t
+tree_size (struct tree *t)
+{
+  return t->elem_cnt;
+}
+
+/* Returns true if T contains no elements, false otherwise. */
+bool
+tree_empty (struct tree *t)
+{
+  return t->elem_cnt == 0;
+}
@@ -0,0 +1,87 @@
+#ifndef __LIB_KERNEL_TREE_H
+#define __LIB_KERNEL_TREE_H
+
+/* Balanced binary tree.
+
+   This is an intrusive AVL tree: each structure that can
+   potentially be in a tree must embed a struct tree_elem member,
+   and all of the tree functions operate on these `struct
+   tree_elem's.  The tree_entry macro allows conversion from a
+   struct tree_elem back to a structure object that contains it.
+   This is the same technique used in the linked list
+   implementation.  Refer to lib/kernel/list.h for a detailed
+   explanation.
+
+   Unlike the hash table, the tree keeps its elements ordered by
+   the comparison function, so besides O(lg n) insertion,
+   deletion, and exact lookup it supports ordered traversal and
+   lower-bound queries: "the first element not less than this
+   key", which a hash cannot answer.  That makes it the container
+   of choice for address-indexed structures where the interesting
+   question is which entry covers, or follows, a given address. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tree element. */
+struct tree_elem
+  {
+    struct tree_elem *parent;   /* Parent node, or null for the root. */
+    struct tree_elem *left;     /* Left child, or null. */
+    struct tree_elem *right;    /* Right child, or null. */
+    int height;                 /* Height of the subtree rooted here. */
+  };
+
+/* Converts pointer to tree element TREE_ELEM into a pointer to
+   the structure that TREE_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the tree element.  See the big comment at the top of the
+   file for an example. */
+#define tree_entry(TREE_ELEM, STRUCT, MEMBER)           \
+        ((STRUCT *) ((uint8_t *) (TREE_ELEM)            \
+                     - offsetof (STRUCT, MEMBER)))
+
+/* Compares the value of two tree elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool tree_less_func (const struct tree_elem *a,
+                             const struct tree_elem *b,
+                             void *aux);
+
+/* Performs some operation on tree element E, given auxiliary
+   data AUX. */
+typedef void tree_action_func (struct tree_elem *e, void *aux);
+
+/* Balanced binary tree. */
+struct tree
+  {
+    struct tree_elem *root;     /* Root node, or null if empty. */
+    size_t elem_cnt;            /* Number of elements in tree. */
+    tree_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+/* Basic life cycle. */
+void tree_init (struct tree *, tree_less_func *, void *aux);
+void tree_clear (struct tree *, tree_action_func *);
+
+/* Insertion, deletion. */
+struct tree_elem *tree_insert (struct tree *, struct tree_elem *);
+void tree_delete (struct tree *, struct tree_elem *);
+
+/* Search. */
+struct tree_elem *tree_find (struct tree *, const struct tree_elem *);
+struct tree_elem *tree_lower_bound (struct tree *, const struct tree_elem *);
+
+/* Ordered traversal. */
+struct tree_elem *tree_min (struct tree *);
+struct tree_elem *tree_max (struct tree *);
+struct tree_elem *tree_next (struct tree_elem *);
+struct tree_elem *tree_prev (struct tree_elem *);
+
+/* Information. */
+size_t tree_size (struct tree *);
+bool tree_empty (struct tree *);
+
+#endif /* lib/kernel/tree.h */
@@ -7,4 +7,8 @@ void random_init (unsigned seed);
 void random_bytes (void *, size_t);
 unsigned long random_ulong (void);
 
+/* Fast non-cryptographic generator, kernel only; implemented in
+   lib/kernel/fast-random.c. */
+unsigned long random_ulong_fast (void);
+
 #endif /* lib/random.h */
@@ -140,6 +140,8 @@ static const struct integer_base base_o = {8, "01234567", 0, 3};
 static const struct integer_base base_x = {16, "0123456789abcdef", 'x', 4};
 static const struct integer_base base_X = {16, "0123456789ABCDEF", 'X', 4};
 
+static void emit_decimal (unsigned value, bool negative,
+                          void (*output) (char, void *), void *aux);
 static const char *parse_conversion (const char *format,
                                      struct printf_conversion *,
                                      va_list *);
@@ -161,21 +163,63 @@ __vprintf (const char *format, va_list args,
     {
       struct printf_conversion c;
 
-      /* Literally copy non-conversions to output. */
-      if (*format != '%') 
+      /* Literally copy non-conversions to output.  Runs of them
+         are emitted in one tight loop rather than bouncing
+         through the conversion dispatch once per character;
+         format strings are mostly literal text. */
+      if (*format != '%')
         {
-          output (*format, aux);
+          do
+            output (*format++, aux);
+          while (*format != '\0' && *format != '%');
+          format--;
           continue;
         }
       format++;
 
       /* %% => %. */
-      if (*format == '%') 
+      if (*format == '%')
         {
           output ('%', aux);
           continue;
         }
 
+      /* Fast paths for the conversions that dominate kernel
+         logging, applicable only in their plain form with no
+         flags, field width, precision, or length modifier. */
+      switch (*format)
+        {
+        case 'd':
+        case 'i':
+          {
+            int value = va_arg (args, int);
+            emit_decimal (value < 0 ? -(unsigned) value : (unsigned) value,
+                          value < 0, output, aux);
+          }
+          continue;
+
+        case 'u':
+          emit_decimal (va_arg (args, unsigned), false, output, aux);
+          continue;
+
+        case 'c':
+          output (va_arg (args, int), aux);
+          continue;
+
+        case 's':
+          {
+            const char *s = va_arg (args, char *);
+            if (s == NULL)
+              s = "(null)";
+            while (*s != '\0')
+              output (*s++, aux);
+          }
+          continue;
+
+        default:
+          break;
+        }
+
       /* Parse conversion specifiers. */
       format = parse_conversion (format, &c, &args);
 
@@ -459,6 +503,30 @@ parse_conversion (const char *format, struct printf_conversion *c,
   return format;
 }
 
+/* Writes VALUE in decimal to OUTPUT with auxiliary data AUX,
+   preceded by a minus sign if NEGATIVE.  This is the fast path
+   for plain %d and %u: no flags, grouping, width, or precision,
+   and 32-bit arithmetic throughout, so the compiler turns the
+   divisions into multiplications. */
+static void
+emit_decimal (unsigned value, bool negative,
+              void (*output) (char, void *), void *aux)
+{
+  char buf[10];                 /* Enough for 2**32 - 1. */
+  char *cp = buf;
+
+  if (negative)
+    output ('-', aux);
+  do
+    {
+      *cp++ = '0' + value % 10;
+      value /= 10;
+    }
+  while (value > 0);
+  while (cp > buf)
+    output (*--cp, aux);
+}
+
 /* Performs an integer conversion, writing output to OUTPUT with
    auxiliary data AUX.  The integer converted has absolute value
    VALUE.  If IS_SIGNED is true, does a signed conversion with
@@ -1,10 +1,23 @@
 #include <string.h>
 #include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Several of the bulk functions below copy or scan a word at a
+   time once their pointers are word aligned: sector copies,
+   page zeroing and console writes all funnel through here, and
+   the byte loops were a measurable share of kernel time.  A
+   word holding the byte value 0x01 in each byte and one holding
+   0x80 in each byte support the usual trick for spotting a zero
+   byte inside a word: (X - ONES) & ~X & HIGHS is nonzero
+   exactly when X has a zero byte. */
+#define WORD_ONES  0x01010101u
+#define WORD_HIGHS 0x80808080u
 
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
 void *
-memcpy (void *dst_, const void *src_, size_t size) 
+memcpy (void *dst_, const void *src_, size_t size)
 {
   unsigned char *dst = dst_;
   const unsigned char *src = src_;
@@ -12,6 +25,40 @@ memcpy (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
+  /* If DST and SRC can be word aligned together, copy a few
+     bytes to align them, then copy words. */
+  if (size >= 8
+      && ((uintptr_t) dst & 3) == ((uintptr_t) src & 3))
+    {
+      uint32_t *dw;
+      const uint32_t *sw;
+
+      while (((uintptr_t) dst & 3) != 0)
+        {
+          *dst++ = *src++;
+          size--;
+        }
+      dw = (uint32_t *) dst;
+      sw = (const uint32_t *) src;
+      while (size >= 16)
+        {
+          dw[0] = sw[0];
+          dw[1] = sw[1];
+          dw[2] = sw[2];
+          dw[3] = sw[3];
+          dw += 4;
+          sw += 4;
+          size -= 16;
+        }
+      while (size >= 4)
+        {
+          *dw++ = *sw++;
+          size -= 4;
+        }
+      dst = (unsigned char *) dw;
+      src = (const unsigned char *) sw;
+    }
+
   while (size-- > 0)
     *dst++ = *src++;
 
@@ -29,12 +76,14 @@ memmove (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
-  if (dst < src) 
+  if (dst < src)
     {
-      while (size-- > 0)
-        *dst++ = *src++;
+      /* A forward copy is safe for this direction of overlap,
+         and memcpy()'s word-at-a-time loop reads each word in
+         full before overwriting it, so let it do the work. */
+      memcpy (dst_, src_, size);
     }
-  else 
+  else
     {
       dst += size;
       src += size;
@@ -42,7 +91,7 @@ memmove (void *dst_, const void *src_, size_t size)
         *--dst = *--src;
     }
 
-  return dst;
+  return dst_;
 }
 
 /* Find the first differing byte in the two blocks of SIZE bytes
@@ -108,33 +157,92 @@ memchr (const void *block_, int ch_, size_t size)
 /* Finds and returns the first occurrence of C in STRING, or a
    null pointer if C does not appear in STRING.  If C == '\0'
    then returns a pointer to the null terminator at the end of
-   STRING. */
+   STRING.  Scans a word at a time, flagging words that hold a
+   zero byte or a byte equal to C with the zero-byte trick, the
+   latter by XORing C into every byte first. */
 char *
-strchr (const char *string, int c_) 
+strchr (const char *string, int c_)
 {
   char c = c_;
+  uint32_t c_word = (unsigned char) c * WORD_ONES;
+  const char *p = string;
+  const uint32_t *w;
 
   ASSERT (string != NULL);
 
-  for (;;) 
-    if (*string == c)
-      return (char *) string;
-    else if (*string == '\0')
-      return NULL;
-    else
-      string++;
+  /* Check bytes up to the first word boundary.  An aligned word
+     read never crosses a page boundary, so reading a few bytes
+     past the terminator is safe. */
+  for (; ((uintptr_t) p & 3) != 0; p++)
+    {
+      if (*p == c)
+        return (char *) p;
+      if (*p == '\0')
+        return NULL;
+    }
+  for (w = (const uint32_t *) p; ; w++)
+    {
+      uint32_t x = *w;
+      uint32_t m = x ^ c_word;
+
+      /* The flagged word holds a '\0' or a C, so the byte loop
+         always resolves within it. */
+      if ((((x - WORD_ONES) & ~x & WORD_HIGHS)
+           | ((m - WORD_ONES) & ~m & WORD_HIGHS)) != 0)
+        for (p = (const char *) w; ; p++)
+          {
+            if (*p == c)
+              return (char *) p;
+            if (*p == '\0')
+              return NULL;
+          }
+    }
+}
+
+/* A set of characters, one bit per possible byte value, so that
+   membership is one shift and mask instead of a strchr() over
+   the set string per input byte. */
+struct char_set
+  {
+    uint32_t bits[256 / 32];
+  };
+
+/* Initializes SET to contain exactly the characters of STRING,
+   not including its null terminator. */
+static void
+char_set_init (struct char_set *set, const char *string)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof set->bits / sizeof *set->bits; i++)
+    set->bits[i] = 0;
+  for (; *string != '\0'; string++)
+    {
+      unsigned char c = *string;
+
+      set->bits[c / 32] |= (uint32_t) 1 << c % 32;
+    }
+}
+
+/* Returns true if SET contains C, false otherwise. */
+static inline bool
+char_set_contains (const struct char_set *set, unsigned char c)
+{
+  return (set->bits[c / 32] >> c % 32) & 1;
 }
 
 /* Returns the length of the initial substring of STRING that
    consists of characters that are not in STOP. */
 size_t
-strcspn (const char *string, const char *stop) 
+strcspn (const char *string, const char *stop)
 {
+  struct char_set set;
   size_t length;
 
-  for (length = 0; string[length] != '\0'; length++)
-    if (strchr (stop, string[length]) != NULL)
-      break;
+  char_set_init (&set, stop);
+  set.bits[0] |= 1;             /* Stop at the terminator too. */
+  for (length = 0; !char_set_contains (&set, string[length]); length++)
+    continue;
   return length;
 }
 
@@ -142,12 +250,15 @@ strcspn (const char *string, const char *stop)
    also in STOP.  If no character in STRING is in STOP, returns a
    null pointer. */
 char *
-strpbrk (const char *string, const char *stop) 
+strpbrk (const char *string, const char *stop)
 {
-  for (; *string != '\0'; string++)
-    if (strchr (stop, *string) != NULL)
-      return (char *) string;
-  return NULL;
+  struct char_set set;
+
+  char_set_init (&set, stop);
+  set.bits[0] |= 1;             /* Stop at the terminator too. */
+  while (!char_set_contains (&set, *string))
+    string++;
+  return *string != '\0' ? (char *) string : NULL;
 }
 
 /* Returns a pointer to the last occurrence of C in STRING.
@@ -167,13 +278,14 @@ strrchr (const char *string, int c_)
 /* Returns the length of the initial substring of STRING that
    consists of characters in SKIP. */
 size_t
-strspn (const char *string, const char *skip) 
+strspn (const char *string, const char *skip)
 {
+  struct char_set set;
   size_t length;
-  
-  for (length = 0; string[length] != '\0'; length++)
-    if (strchr (skip, string[length]) == NULL)
-      break;
+
+  char_set_init (&set, skip);
+  for (length = 0; char_set_contains (&set, string[length]); length++)
+    continue;
   return length;
 }
 
@@ -234,8 +346,9 @@ strstr (const char *haystack, const char *needle)
 char *
 strtok_r (char *s, const char *delimiters, char **save_ptr) 
 {
+  struct char_set delim;
   char *token;
-  
+
   ASSERT (delimiters != NULL);
   ASSERT (save_ptr != NULL);
 
@@ -245,24 +358,23 @@ strtok_r (char *s, const char *delimiters, char **save_ptr)
     s = *save_ptr;
   ASSERT (s != NULL);
 
+  /* One bitmap of the delimiters serves both scans, instead of a
+     strchr() over DELIMITERS for every input byte. */
+  char_set_init (&delim, delimiters);
+
   /* Skip any DELIMITERS at our current position. */
-  while (strchr (delimiters, *s) != NULL) 
+  while (char_set_contains (&delim, *s))
+    s++;
+  if (*s == '\0')
     {
-      /* strchr() will always return nonnull if we're searching
-         for a null byte, because every string contains a null
-         byte (at the end). */
-      if (*s == '\0')
-        {
-          *save_ptr = s;
-          return NULL;
-        }
-
-      s++;
+      *save_ptr = s;
+      return NULL;
     }
 
   /* Skip any non-DELIMITERS up to the end of the string. */
   token = s;
-  while (strchr (delimiters, *s) == NULL)
+  delim.bits[0] |= 1;           /* Stop at the terminator too. */
+  while (!char_set_contains (&delim, *s))
     s++;
   if (*s != '\0') 
     {
@@ -276,12 +388,41 @@ strtok_r (char *s, const char *delimiters, char **save_ptr)
 
 /* Sets the SIZE bytes in DST to VALUE. */
 void *
-memset (void *dst_, int value, size_t size) 
+memset (void *dst_, int value, size_t size)
 {
   unsigned char *dst = dst_;
 
   ASSERT (dst != NULL || size == 0);
-  
+
+  /* Fill whole words at a time once DST is aligned. */
+  if (size >= 8)
+    {
+      uint32_t word = (unsigned char) value * WORD_ONES;
+      uint32_t *dw;
+
+      while (((uintptr_t) dst & 3) != 0)
+        {
+          *dst++ = value;
+          size--;
+        }
+      dw = (uint32_t *) dst;
+      while (size >= 16)
+        {
+          dw[0] = word;
+          dw[1] = word;
+          dw[2] = word;
+          dw[3] = word;
+          dw += 4;
+          size -= 16;
+        }
+      while (size >= 4)
+        {
+          *dw++ = word;
+          size -= 4;
+        }
+      dst = (unsigned char *) dw;
+    }
+
   while (size-- > 0)
     *dst++ = value;
 
@@ -290,15 +431,32 @@ memset (void *dst_, int value, size_t size)
 
 /* Returns the length of STRING. */
 size_t
-strlen (const char *string) 
+strlen (const char *string)
 {
-  const char *p;
+  const char *p = string;
+  const uint32_t *w;
 
   ASSERT (string != NULL);
 
-  for (p = string; *p != '\0'; p++)
-    continue;
-  return p - string;
+  /* Check bytes up to the first word boundary, then scan a word
+     at a time for a word containing a zero byte.  An aligned
+     word read never crosses a page boundary, so reading a few
+     bytes past the terminator is safe. */
+  for (; ((uintptr_t) p & 3) != 0; p++)
+    if (*p == '\0')
+      return p - string;
+  for (w = (const uint32_t *) p; ; w++)
+    {
+      uint32_t x = *w;
+
+      if (((x - WORD_ONES) & ~x & WORD_HIGHS) != 0)
+        {
+          p = (const char *) w;
+          while (*p != '\0')
+            p++;
+          return p - string;
+        }
+    }
 }
 
 /* If STRING is less than MAXLEN characters in length, returns
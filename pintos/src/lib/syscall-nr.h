@@ -28,7 +28,22 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_FORK,                   /* Clone the current process. */
+    SYS_READV,                  /* Read into multiple buffers. */
+    SYS_WRITEV,                 /* Write from multiple buffers. */
+    SYS_PIPE,                   /* Create an in-kernel pipe. */
+    SYS_SHM_ATTACH,             /* Attach a named shared segment. */
+    SYS_SHM_DETACH,             /* Detach a shared segment. */
+    SYS_FUTEX_WAIT,             /* Block on a word in shared memory. */
+    SYS_FUTEX_WAKE,             /* Wake futex_wait() sleepers. */
+    SYS_RENAME,                 /* Atomically rename a file. */
+    SYS_WAIT2,                  /* Wait, returning resource usage. */
+    SYS_BATCH,                  /* Submit several calls in one trap. */
+    SYS_GETDENTS,               /* Read many directory entries. */
+    SYS_FDIRECT                 /* Toggle direct (uncached) I/O on a fd. */
   };
 
 #endif /* lib/syscall-nr.h */
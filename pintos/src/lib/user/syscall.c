@@ -1,16 +1,60 @@
 #include <syscall.h>
+#include <stdint.h>
 #include "../syscall-nr.h"
 
+/* Whether to enter the kernel with sysenter: 0 if not yet
+   probed, greater if the CPU supports it, less if not.  The
+   kernel programs the sysenter entry point exactly when CPUID
+   advertises the instruction (see gdt_init() in userprog/gdt.c),
+   so checking the same bit here keeps the two sides agreed. */
+static int sysenter_state;
+
+/* Returns true if system calls should use sysenter, probing
+   CPUID on the first call. */
+static bool
+use_sysenter (void)
+{
+  if (sysenter_state == 0)
+    {
+      uint32_t eax, ebx, ecx, edx;
+
+      asm ("cpuid"
+           : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "0" (0));
+      if (eax >= 1)
+        asm ("cpuid"
+             : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "0" (1));
+      else
+        edx = 0;
+      sysenter_state = (edx & (1 << 11)) != 0 ? 1 : -1;
+    }
+  return sysenter_state > 0;
+}
+
+/* The system call ABI is the same either way: the call number
+   and arguments go on the stack and the return value comes back
+   in eax.  `int $0x30' saves and restores everything else
+   itself; sysenter saves nothing, so its variant passes the
+   stack pointer in ecx and the return address in edx for the
+   kernel to restore, the convention sysexit expects. */
+
 /* Invokes syscall NUMBER, passing no arguments, and returns the
    return value as an `int'. */
 #define syscall0(NUMBER)                                        \
         ({                                                      \
           int retval;                                           \
-          asm volatile                                          \
-            ("pushl %[number]; int $0x30; addl $4, %%esp"       \
-               : "=a" (retval)                                  \
-               : [number] "i" (NUMBER)                          \
-               : "memory");                                     \
+          if (use_sysenter ())                                  \
+            asm volatile                                        \
+              ("pushl %[number]; movl %%esp, %%ecx; "           \
+               "leal 1f, %%edx; sysenter; 1: addl $4, %%esp"    \
+                 : "=a" (retval)                                \
+                 : [number] "i" (NUMBER)                        \
+                 : "ecx", "edx", "memory");                     \
+          else                                                  \
+            asm volatile                                        \
+              ("pushl %[number]; int $0x30; addl $4, %%esp"     \
+                 : "=a" (retval)                                \
+                 : [number] "i" (NUMBER)                        \
+                 : "memory");                                   \
           retval;                                               \
         })
 
@@ -19,12 +63,22 @@
 #define syscall1(NUMBER, ARG0)                                           \
         ({                                                               \
           int retval;                                                    \
-          asm volatile                                                   \
-            ("pushl %[arg0]; pushl %[number]; int $0x30; addl $8, %%esp" \
-               : "=a" (retval)                                           \
-               : [number] "i" (NUMBER),                                  \
-                 [arg0] "g" (ARG0)                                       \
-               : "memory");                                              \
+          if (use_sysenter ())                                           \
+            asm volatile                                                 \
+              ("pushl %[arg0]; pushl %[number]; movl %%esp, %%ecx; "     \
+               "leal 1f, %%edx; sysenter; 1: addl $8, %%esp"             \
+                 : "=a" (retval)                                         \
+                 : [number] "i" (NUMBER),                                \
+                   [arg0] "r" (ARG0)                                     \
+                 : "ecx", "edx", "memory");                              \
+          else                                                           \
+            asm volatile                                                 \
+              ("pushl %[arg0]; pushl %[number]; int $0x30; "             \
+               "addl $8, %%esp"                                          \
+                 : "=a" (retval)                                         \
+                 : [number] "i" (NUMBER),                                \
+                   [arg0] "g" (ARG0)                                     \
+                 : "memory");                                            \
           retval;                                                        \
         })
 
@@ -33,14 +87,25 @@
 #define syscall2(NUMBER, ARG0, ARG1)                            \
         ({                                                      \
           int retval;                                           \
-          asm volatile                                          \
-            ("pushl %[arg1]; pushl %[arg0]; "                   \
-             "pushl %[number]; int $0x30; addl $12, %%esp"      \
-               : "=a" (retval)                                  \
-               : [number] "i" (NUMBER),                         \
-                 [arg0] "r" (ARG0),                             \
-                 [arg1] "r" (ARG1)                              \
-               : "memory");                                     \
+          if (use_sysenter ())                                  \
+            asm volatile                                        \
+              ("pushl %[arg1]; pushl %[arg0]; "                 \
+               "pushl %[number]; movl %%esp, %%ecx; "           \
+               "leal 1f, %%edx; sysenter; 1: addl $12, %%esp"   \
+                 : "=a" (retval)                                \
+                 : [number] "i" (NUMBER),                       \
+                   [arg0] "r" (ARG0),                           \
+                   [arg1] "r" (ARG1)                            \
+                 : "ecx", "edx", "memory");                     \
+          else                                                  \
+            asm volatile                                        \
+              ("pushl %[arg1]; pushl %[arg0]; "                 \
+               "pushl %[number]; int $0x30; addl $12, %%esp"    \
+                 : "=a" (retval)                                \
+                 : [number] "i" (NUMBER),                       \
+                   [arg0] "r" (ARG0),                           \
+                   [arg1] "r" (ARG1)                            \
+                 : "memory");                                   \
           retval;                                               \
         })
 
@@ -49,15 +114,27 @@
 #define syscall3(NUMBER, ARG0, ARG1, ARG2)                      \
         ({                                                      \
           int retval;                                           \
-          asm volatile                                          \
-            ("pushl %[arg2]; pushl %[arg1]; pushl %[arg0]; "    \
-             "pushl %[number]; int $0x30; addl $16, %%esp"      \
-               : "=a" (retval)                                  \
-               : [number] "i" (NUMBER),                         \
-                 [arg0] "r" (ARG0),                             \
-                 [arg1] "r" (ARG1),                             \
-                 [arg2] "r" (ARG2)                              \
-               : "memory");                                     \
+          if (use_sysenter ())                                  \
+            asm volatile                                        \
+              ("pushl %[arg2]; pushl %[arg1]; pushl %[arg0]; "  \
+               "pushl %[number]; movl %%esp, %%ecx; "           \
+               "leal 1f, %%edx; sysenter; 1: addl $16, %%esp"   \
+                 : "=a" (retval)                                \
+                 : [number] "i" (NUMBER),                       \
+                   [arg0] "r" (ARG0),                           \
+                   [arg1] "r" (ARG1),                           \
+                   [arg2] "r" (ARG2)                            \
+                 : "ecx", "edx", "memory");                     \
+          else                                                  \
+            asm volatile                                        \
+              ("pushl %[arg2]; pushl %[arg1]; pushl %[arg0]; "  \
+               "pushl %[number]; int $0x30; addl $16, %%esp"    \
+                 : "=a" (retval)                                \
+                 : [number] "i" (NUMBER),                       \
+                   [arg0] "r" (ARG0),                           \
+                   [arg1] "r" (ARG1),                           \
+                   [arg2] "r" (ARG2)                            \
+                 : "memory");                                   \
           retval;                                               \
         })
 
@@ -81,12 +158,24 @@ exec (const char *file)
   return (pid_t) syscall1 (SYS_EXEC, file);
 }
 
+pid_t
+fork (void)
+{
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
 int
 wait (pid_t pid)
 {
   return syscall1 (SYS_WAIT, pid);
 }
 
+int
+wait2 (pid_t pid, struct rusage *usage)
+{
+  return syscall2 (SYS_WAIT2, pid, usage);
+}
+
 bool
 create (const char *file, unsigned initial_size)
 {
@@ -123,6 +212,66 @@ write (int fd, const void *buffer, unsigned size)
   return syscall3 (SYS_WRITE, fd, buffer, size);
 }
 
+int
+readv (int fd, const struct iovec *iov, int iov_cnt)
+{
+  return syscall3 (SYS_READV, fd, iov, iov_cnt);
+}
+
+int
+writev (int fd, const struct iovec *iov, int iov_cnt)
+{
+  return syscall3 (SYS_WRITEV, fd, iov, iov_cnt);
+}
+
+int
+batch (struct syscall_rec *recs, unsigned cnt)
+{
+  return syscall2 (SYS_BATCH, recs, cnt);
+}
+
+int
+pipe (int fds[2])
+{
+  return syscall1 (SYS_PIPE, fds);
+}
+
+int
+shm_attach (const char *name, void *addr, unsigned page_cnt)
+{
+  return syscall3 (SYS_SHM_ATTACH, name, addr, page_cnt);
+}
+
+int
+shm_detach (const void *addr)
+{
+  return syscall1 (SYS_SHM_DETACH, addr);
+}
+
+int
+futex_wait (int *addr, int expected)
+{
+  return syscall2 (SYS_FUTEX_WAIT, addr, expected);
+}
+
+int
+futex_wake (int *addr, int max)
+{
+  return syscall2 (SYS_FUTEX_WAKE, addr, max);
+}
+
+bool
+rename (const char *old_path, const char *new_path)
+{
+  return syscall2 (SYS_RENAME, old_path, new_path);
+}
+
+bool
+fdirect (int fd, bool enable)
+{
+  return syscall2 (SYS_FDIRECT, fd, (int) enable);
+}
+
 void
 seek (int fd, unsigned position) 
 {
@@ -166,11 +315,17 @@ mkdir (const char *dir)
 }
 
 bool
-readdir (int fd, char name[READDIR_MAX_LEN + 1]) 
+readdir (int fd, char name[READDIR_MAX_LEN + 1])
 {
   return syscall2 (SYS_READDIR, fd, name);
 }
 
+int
+getdents (int fd, char *buf, unsigned size)
+{
+  return syscall3 (SYS_GETDENTS, fd, buf, size);
+}
+
 bool
 isdir (int fd) 
 {
@@ -15,6 +15,41 @@ typedef int mapid_t;
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
+/* One buffer of a vectored I/O request.  Must match the layout
+   the kernel expects in userprog/syscall.c. */
+struct iovec
+  {
+    void *iov_base;             /* Starting address. */
+    unsigned iov_len;           /* Length in bytes. */
+  };
+
+/* Maximum buffers in one readv() or writev() call. */
+#define IOV_MAX 1024
+
+/* One call of a batch() submission.  Must match the layout the
+   kernel expects in userprog/syscall.c. */
+struct syscall_rec
+  {
+    unsigned nr;                /* System call number, SYS_*. */
+    unsigned args[3];           /* Argument words; unused ones 0. */
+    int result;                 /* Out: the call's return value. */
+  };
+
+/* Maximum records in one batch() call. */
+#define BATCH_MAX 256
+
+/* Resource usage of an exited child, filled in by wait2().
+   Must match the layout the kernel fills in userprog/process.c. */
+struct rusage
+  {
+    long long user_ticks;       /* Timer ticks running user code. */
+    long long kernel_ticks;     /* Timer ticks in system calls. */
+    long long page_faults;      /* Page faults taken. */
+    long long read_bytes;       /* Bytes read with read() and readv(). */
+    long long write_bytes;      /* Bytes written with write() and writev(). */
+    long long peak_frames;      /* Most page frames resident at once. */
+  };
+
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /* Successful execution. */
 #define EXIT_FAILURE 1          /* Unsuccessful execution. */
@@ -23,13 +58,25 @@ typedef int mapid_t;
 void halt (void) NO_RETURN;
 void exit (int status) NO_RETURN;
 pid_t exec (const char *file);
+pid_t fork (void);
 int wait (pid_t);
+int wait2 (pid_t, struct rusage *);
 bool create (const char *file, unsigned initial_size);
 bool remove (const char *file);
 int open (const char *file);
 int filesize (int fd);
 int read (int fd, void *buffer, unsigned length);
 int write (int fd, const void *buffer, unsigned length);
+int readv (int fd, const struct iovec *iov, int iov_cnt);
+int writev (int fd, const struct iovec *iov, int iov_cnt);
+int batch (struct syscall_rec *recs, unsigned cnt);
+int pipe (int fds[2]);
+int shm_attach (const char *name, void *addr, unsigned page_cnt);
+int shm_detach (const void *addr);
+int futex_wait (int *addr, int expected);
+int futex_wake (int *addr, int max);
+bool rename (const char *old_path, const char *new_path);
+bool fdirect (int fd, bool enable);
 void seek (int fd, unsigned position);
 unsigned tell (int fd);
 void close (int fd);
@@ -42,6 +89,7 @@ void munmap (mapid_t);
 bool chdir (const char *dir);
 bool mkdir (const char *dir);
 bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
+int getdents (int fd, char *buf, unsigned size);
 bool isdir (int fd);
 int inumber (int fd);
 
@@ -0,0 +1,55 @@
+#include <time.h>
+
+/* Reads the CPU's time stamp counter.  See [IA32-v2b] "RDTSC". */
+static unsigned long long
+rdtsc (void)
+{
+  unsigned long long tsc;
+
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Returns the number of timer ticks since the OS booted, read
+   from the time page without a system call.  Retries while the
+   kernel is mid-update, so the 64-bit count is never torn. */
+long long
+time_ticks (void)
+{
+  unsigned seq;
+  long long t;
+
+  do
+    {
+      seq = TIME_PAGE->seq;
+      t = TIME_PAGE->ticks;
+    }
+  while ((seq & 1) != 0 || seq != TIME_PAGE->seq);
+  return t;
+}
+
+/* Returns the number of timer ticks per second. */
+int
+time_freq (void)
+{
+  return TIME_PAGE->freq;
+}
+
+/* Returns the number of nanoseconds since the kernel calibrated
+   its clocks, with sub-tick resolution from the TSC.  Falls back
+   to tick granularity if calibration has not happened. */
+long long
+time_now_ns (void)
+{
+  unsigned long long cycles, hz;
+
+  if (TIME_PAGE->tsc_per_tick == 0)
+    return time_ticks () * (1000000000 / TIME_PAGE->freq);
+
+  cycles = rdtsc () - TIME_PAGE->tsc_base;
+  hz = TIME_PAGE->tsc_per_tick * TIME_PAGE->freq;
+
+  /* Split the conversion so that neither product overflows
+     64 bits for any plausible clock rate. */
+  return cycles / hz * 1000000000 + cycles % hz * 1000000000 / hz;
+}
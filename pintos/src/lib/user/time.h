@@ -0,0 +1,32 @@
+#ifndef __LIB_USER_TIME_H
+#define __LIB_USER_TIME_H
+
+/* User-space clock.
+
+   The kernel maps a read-only time page into every process at
+   TIME_PAGE, holding the current tick count, kept up to date by
+   the timer interrupt, and the TSC calibration factors.  The
+   routines here read it, and the CPU's time stamp counter,
+   entirely in user space: no trap, so profiling-heavy code can
+   read the clock in a handful of cycles. */
+
+/* The time page.  Layout and address must match struct time_page
+   in devices/timer.c and TIME_PAGE_UADDR in userprog/process.h.
+   The sequence number is odd while the kernel updates the tick
+   count; readers retry rather than use a torn value. */
+struct time_page
+  {
+    unsigned seq;               /* Even when stable, odd mid-update. */
+    long long ticks;            /* Timer ticks since boot. */
+    int freq;                   /* Timer ticks per second. */
+    unsigned long long tsc_per_tick; /* TSC cycles per tick; 0 before
+                                        calibration. */
+    unsigned long long tsc_base;     /* TSC value at calibration. */
+  };
+#define TIME_PAGE ((const volatile struct time_page *) 0xbfeff000)
+
+long long time_ticks (void);
+int time_freq (void);
+long long time_now_ns (void);
+
+#endif /* lib/user/time.h */
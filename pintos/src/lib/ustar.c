@@ -1,6 +1,7 @@
 #include <ustar.h>
 #include <limits.h>
 #include <packed.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -36,19 +37,43 @@ PACKED;
 static unsigned int
 calculate_chksum (const struct ustar_header *h)
 {
+  const size_t chksum_start = offsetof (struct ustar_header, chksum);
   const uint8_t *header = (const uint8_t *) h;
   unsigned int chksum;
   size_t i;
 
-  chksum = 0;
-  for (i = 0; i < USTAR_HEADER_SIZE; i++)
+  if (((uintptr_t) header & 3) == 0)
     {
-      /* The ustar checksum is calculated as if the chksum field
-         were all spaces. */
-      const size_t chksum_start = offsetof (struct ustar_header, chksum);
-      const size_t chksum_end = chksum_start + sizeof h->chksum;
-      bool in_chksum_field = i >= chksum_start && i < chksum_end;
-      chksum += in_chksum_field ? ' ' : header[i];
+      /* Word-at-a-time byte sum.  Each word's bytes are folded
+         into two 16-bit lane sums; with 128 words of bytes no
+         greater than 255, neither lane can overflow into the
+         other, so the lanes are added up once at the end.  Cuts
+         the loop to a quarter of the byte version's trips, and
+         extraction runs this over every archive member. */
+      const uint32_t *word = (const uint32_t *) header;
+      uint32_t lanes = 0;
+
+      for (i = 0; i < USTAR_HEADER_SIZE / sizeof *word; i++)
+        {
+          uint32_t w = word[i];
+          lanes += (w & 0x00ff00ff) + ((w >> 8) & 0x00ff00ff);
+        }
+      chksum = (lanes & 0xffff) + (lanes >> 16);
+
+      /* The checksum is defined as if the chksum field itself
+         were all spaces; trade its bytes for spaces. */
+      for (i = 0; i < sizeof h->chksum; i++)
+        chksum += ' ' - header[chksum_start + i];
+    }
+  else
+    {
+      chksum = 0;
+      for (i = 0; i < USTAR_HEADER_SIZE; i++)
+        {
+          bool in_chksum_field = i >= chksum_start
+            && i < chksum_start + sizeof h->chksum;
+          chksum += in_chksum_field ? ' ' : header[i];
+        }
     }
   return chksum;
 }
@@ -162,10 +187,25 @@ parse_octal_field (const char *s, size_t size, unsigned long int *value)
 }
 
 /* Returns true if the CNT bytes starting at BLOCK are all zero,
-   false otherwise. */
+   false otherwise.  Compares a word at a time once BLOCK is
+   aligned; end-of-archive detection scans two full blocks of
+   zeros per archive. */
 static bool
 is_all_zeros (const char *block, size_t cnt)
 {
+  while (cnt > 0 && ((uintptr_t) block & 3) != 0)
+    {
+      if (*block++ != 0)
+        return false;
+      cnt--;
+    }
+  while (cnt >= sizeof (uint32_t))
+    {
+      if (*(const uint32_t *) block != 0)
+        return false;
+      block += sizeof (uint32_t);
+      cnt -= sizeof (uint32_t);
+    }
   while (cnt-- > 0)
     if (*block++ != 0)
       return false;
@@ -132,20 +132,33 @@ EOF
 }
 
 # Get @output without header or trailer.
+#
+# A batched run (see BATCH in tests/Make.tests) boots several tests
+# back to back, so the output may hold one Executing...complete
+# section per test; take the section whose name matches our own
+# test, falling back to the first section for an ordinary
+# single-test run.
 sub get_core_output {
     my ($run, @output) = @_;
-    my ($p);
+
+    my ($base) = $test;
+    $base =~ s%.*/%%;
 
     my ($process);
     my ($start);
-    for my $i (0...$#_) {
-	$start = $i + 1, last
-	  if ($process) = $output[$i] =~ /^Executing '(\S+).*':$/;
+    for my $i (0...$#output) {
+	my ($p) = $output[$i] =~ /^Executing '(\S+).*':$/;
+	next if !defined $p;
+	($process, $start) = ($p, $i + 1) if !defined $start || $p eq $base;
+	last if $p eq $base;
     }
 
     my ($end);
-    for my $i ($start...$#output) {
-	$end = $i - 1, last if $output[$i] =~ /^Execution of '.*' complete.$/;
+    if (defined $start) {
+	for my $i ($start...$#output) {
+	    $end = $i - 1, last
+	      if $output[$i] =~ /^Execution of '.*' complete.$/;
+	}
     }
 
     fail "\u$run didn't start a thread or process\n" if !defined $start;
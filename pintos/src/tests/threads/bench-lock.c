@@ -0,0 +1,79 @@
+/* Measures lock fairness under contention: a handful of
+   equal-priority threads hammer one lock for a fixed interval,
+   and the spread between the luckiest and unluckiest thread's
+   acquisition counts shows how evenly the lock hands itself out.
+   Prints machine-parsable numbers for tracking across
+   commits. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Number of contending threads. */
+#define CONTENDERS 8
+
+/* Measurement interval, in ticks. */
+#define DURATION 50
+
+static struct lock bench_lock;
+static volatile bool stop;
+static struct semaphore done_sema;
+static long long acquires[CONTENDERS];
+
+static void contender (void *);
+
+void
+test_bench_lock (void)
+{
+  long long total = 0, min, max;
+  int i;
+
+  lock_init (&bench_lock);
+  sema_init (&done_sema, 0);
+  stop = false;
+  for (i = 0; i < CONTENDERS; i++)
+    {
+      char name[16];
+
+      acquires[i] = 0;
+      snprintf (name, sizeof name, "contender %d", i);
+      thread_create (name, PRI_DEFAULT, contender, &acquires[i]);
+    }
+
+  timer_sleep (DURATION);
+  stop = true;
+  for (i = 0; i < CONTENDERS; i++)
+    sema_down (&done_sema);
+
+  min = max = acquires[0];
+  for (i = 0; i < CONTENDERS; i++)
+    {
+      total += acquires[i];
+      if (acquires[i] < min)
+        min = acquires[i];
+      if (acquires[i] > max)
+        max = acquires[i];
+    }
+
+  msg ("%d threads contended for %d ticks.", CONTENDERS, DURATION);
+  msg ("acquires_total=%lld acquires_min=%lld acquires_max=%lld",
+       total, min, max);
+}
+
+/* Acquires and releases the benchmark lock as fast as it can,
+   counting successes, until told to stop. */
+static void
+contender (void *count_)
+{
+  long long *count = count_;
+
+  while (!stop)
+    {
+      lock_acquire (&bench_lock);
+      (*count)++;
+      lock_release (&bench_lock);
+    }
+  sema_up (&done_sema);
+}
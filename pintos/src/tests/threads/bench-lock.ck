@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing benchmark figures in output"
+  unless grep (/^\(bench-lock\) acquires_total=\d+ acquires_min=\d+ acquires_max=\d+/, @output);
+
+pass;
@@ -0,0 +1,53 @@
+/* Measures context-switch latency by ping-ponging between two
+   threads over a pair of semaphores.  Each round trip costs two
+   switches, so the reported figure is total time divided by
+   twice the round count.  Prints machine-parsable numbers for
+   tracking across commits. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Number of ping-pong round trips. */
+#define ROUNDS 10000
+
+static struct semaphore ping, pong;
+
+static void ponger (void *);
+
+void
+test_bench_switch (void)
+{
+  int64_t start, elapsed;
+  int i;
+
+  sema_init (&ping, 0);
+  sema_init (&pong, 0);
+  thread_create ("ponger", PRI_DEFAULT, ponger, NULL);
+
+  start = timer_now_ns ();
+  for (i = 0; i < ROUNDS; i++)
+    {
+      sema_up (&ping);
+      sema_down (&pong);
+    }
+  elapsed = timer_now_ns () - start;
+
+  msg ("%d round trips, %d context switches.", ROUNDS, ROUNDS * 2);
+  msg ("switch_ns=%lld", elapsed / (ROUNDS * 2));
+}
+
+/* Echoes each "ping" with a "pong". */
+static void
+ponger (void *aux UNUSED)
+{
+  int i;
+
+  for (i = 0; i < ROUNDS; i++)
+    {
+      sema_down (&ping);
+      sema_up (&pong);
+    }
+}
@@ -0,0 +1,78 @@
+/* Measures scheduler throughput under increasing load: 1, 8, 64
+   and then 256 equal-priority threads yield as fast as they can
+   for a fixed interval, and the total number of completed yields
+   is reported per load level.  Prints machine-parsable numbers
+   for tracking across commits. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Measurement interval per load level, in ticks. */
+#define DURATION 20
+
+/* Largest load level. */
+#define THREADS_MAX 256
+
+static volatile bool stop;
+static struct semaphore done_sema;
+static long long counts[THREADS_MAX];
+
+static void run_level (int thread_cnt);
+static void yielder (void *);
+
+void
+test_bench_throughput (void)
+{
+  sema_init (&done_sema, 0);
+  run_level (1);
+  run_level (8);
+  run_level (64);
+  run_level (256);
+}
+
+/* Runs THREAD_CNT yielders for DURATION ticks and reports the
+   yields they completed. */
+static void
+run_level (int thread_cnt)
+{
+  long long total = 0;
+  int i;
+
+  stop = false;
+  for (i = 0; i < thread_cnt; i++)
+    {
+      char name[16];
+
+      counts[i] = 0;
+      snprintf (name, sizeof name, "yield %d", i);
+      thread_create (name, PRI_DEFAULT, yielder, &counts[i]);
+    }
+
+  /* Blocking here hands the CPU to the yielders. */
+  timer_sleep (DURATION);
+  stop = true;
+  for (i = 0; i < thread_cnt; i++)
+    sema_down (&done_sema);
+
+  for (i = 0; i < thread_cnt; i++)
+    total += counts[i];
+  msg ("threads=%d yields=%lld yields_per_tick=%lld",
+       thread_cnt, total, total / DURATION);
+}
+
+/* Yields in a loop, counting iterations, until told to stop. */
+static void
+yielder (void *count_)
+{
+  long long *count = count_;
+
+  while (!stop)
+    {
+      (*count)++;
+      thread_yield ();
+    }
+  sema_up (&done_sema);
+}
@@ -0,0 +1,38 @@
+/* Measures wakeup-to-run latency after timer_sleep().  The TSC
+   nanosecond clock is calibrated at a tick boundary, so the
+   position of the first instruction after timer_sleep() within
+   its tick approximates the delay from the timer interrupt that
+   woke us to actually running.  Prints machine-parsable
+   numbers for tracking across commits. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Number of sleeps to sample. */
+#define ITERATIONS 50
+
+/* Nanoseconds per timer tick. */
+#define NS_PER_TICK (1000 * 1000 * 1000 / TIMER_FREQ)
+
+void
+test_bench_wakeup (void)
+{
+  int64_t total = 0, max = 0;
+  int i;
+
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      int64_t latency;
+
+      timer_sleep (1);
+      latency = timer_now_ns () % NS_PER_TICK;
+      total += latency;
+      if (latency > max)
+        max = latency;
+    }
+
+  msg ("%d sleeps sampled.", ITERATIONS);
+  msg ("wakeup_avg_ns=%lld wakeup_max_ns=%lld", total / ITERATIONS, max);
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing benchmark figures in output"
+  unless grep (/^\(bench-wakeup\) wakeup_avg_ns=\d+ wakeup_max_ns=\d+/, @output);
+
+pass;
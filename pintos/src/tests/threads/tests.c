@@ -38,6 +38,10 @@ static const struct test tests[] =
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+    {"bench-switch", test_bench_switch},
+    {"bench-wakeup", test_bench_wakeup},
+    {"bench-throughput", test_bench_throughput},
+    {"bench-lock", test_bench_lock},
   };
 
 static const char *test_name;
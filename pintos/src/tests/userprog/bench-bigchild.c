@@ -0,0 +1,24 @@
+/* Child process run by the bench-exec-big benchmark.  Carries a
+   large initialized data segment and checksums it, so every page
+   is actually read from the executable before the child exits.
+   The initializer keeps the array out of BSS, where zeroed pages
+   would never touch the disk. */
+
+#include "tests/lib.h"
+
+const char *test_name = "bench-bigchild";
+
+#define BLOB_SIZE (512 * 1024)
+
+static unsigned char blob[BLOB_SIZE] = {1};
+
+int
+main (void)
+{
+  unsigned sum = 0;
+  unsigned i;
+
+  for (i = 0; i < BLOB_SIZE; i += 64)
+    sum += blob[i];
+  return sum == 1 ? 0 : 1;
+}
@@ -0,0 +1,13 @@
+/* Child process run by the exec and wait benchmarks.
+   Does nothing at all, so the parent's figure measures the
+   process creation and teardown paths rather than the child. */
+
+#include "tests/lib.h"
+
+const char *test_name = "bench-child";
+
+int
+main (void)
+{
+  return 0;
+}
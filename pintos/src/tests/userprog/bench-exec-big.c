@@ -0,0 +1,29 @@
+/* Measures exec of a large multi-segment binary.  The child
+   carries a 512 kB initialized data segment that it checksums,
+   so load_segment() must bring every page in from disk before
+   the child can exit.  Comparing against bench-exec isolates
+   the per-page cost of segment loading. */
+
+#include <syscall.h>
+#include <time.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Number of exec-to-exit round trips. */
+#define ROUNDS 4
+
+void
+test_main (void)
+{
+  long long start, elapsed;
+  int i;
+
+  start = time_now_ns ();
+  for (i = 0; i < ROUNDS; i++)
+    if (wait (exec ("bench-bigchild")) != 0)
+      fail ("child did not exit cleanly");
+  elapsed = time_now_ns () - start;
+
+  msg ("%d exec+wait round trips.", ROUNDS);
+  msg ("exec_big_us=%lld", elapsed / 1000 / ROUNDS);
+}
@@ -0,0 +1,29 @@
+/* Measures the exec-to-exit round trip for a minimal binary.
+   Each round execs a child that returns immediately and waits
+   for it, so the figure covers executable load, stack setup,
+   the child's exit, and waking the waiting parent.  Prints
+   machine-parsable numbers for tracking across commits. */
+
+#include <syscall.h>
+#include <time.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Number of exec-to-exit round trips. */
+#define ROUNDS 16
+
+void
+test_main (void)
+{
+  long long start, elapsed;
+  int i;
+
+  start = time_now_ns ();
+  for (i = 0; i < ROUNDS; i++)
+    if (wait (exec ("bench-child")) != 0)
+      fail ("child did not exit cleanly");
+  elapsed = time_now_ns () - start;
+
+  msg ("%d exec+wait round trips.", ROUNDS);
+  msg ("exec_us=%lld", elapsed / 1000 / ROUNDS);
+}
@@ -0,0 +1,27 @@
+/* Measures bare system call latency with the cheapest call in
+   the table: tell() on a file descriptor that is not open, which
+   fails after a single table lookup.  The figure is trap entry,
+   argument copy, dispatch, and return, with no real work. */
+
+#include <syscall.h>
+#include <time.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Number of calls to time. */
+#define ROUNDS 100000
+
+void
+test_main (void)
+{
+  long long start, elapsed;
+  int i;
+
+  start = time_now_ns ();
+  for (i = 0; i < ROUNDS; i++)
+    tell (0x20);
+  elapsed = time_now_ns () - start;
+
+  msg ("%d system calls.", ROUNDS);
+  msg ("syscall_ns=%lld", elapsed / ROUNDS);
+}
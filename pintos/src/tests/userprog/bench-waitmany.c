@@ -0,0 +1,35 @@
+/* Measures wait fan-in: execs 32 children up front, then waits
+   for all of them.  Stresses the child bookkeeping that a single
+   exec-then-wait loop never does, since every child's exit
+   status must be held until the parent gets around to it. */
+
+#include <syscall.h>
+#include <time.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Number of concurrent children. */
+#define CHILDREN 32
+
+void
+test_main (void)
+{
+  pid_t pids[CHILDREN];
+  long long start, elapsed;
+  int i;
+
+  start = time_now_ns ();
+  for (i = 0; i < CHILDREN; i++)
+    {
+      pids[i] = exec ("bench-child");
+      if (pids[i] == -1)
+        fail ("exec of child %d failed", i);
+    }
+  for (i = 0; i < CHILDREN; i++)
+    if (wait (pids[i]) != 0)
+      fail ("child %d did not exit cleanly", i);
+  elapsed = time_now_ns () - start;
+
+  msg ("%d children execed and waited for.", CHILDREN);
+  msg ("wait_us_per_child=%lld", elapsed / 1000 / CHILDREN);
+}
@@ -1,4 +1,5 @@
 #include "threads/init.h"
+#include <cachestat.h>
 #include <console.h>
 #include <debug.h>
 #include <inttypes.h>
@@ -12,6 +13,7 @@
 #include "devices/input.h"
 #include "devices/serial.h"
 #include "devices/shutdown.h"
+#include "devices/pvclock.h"
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
@@ -19,9 +21,14 @@
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 #include "threads/palloc.h"
+#include "threads/profile.h"
 #include "threads/pte.h"
+#include "threads/softirq.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -34,9 +41,13 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/virtio-blk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#endif
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
@@ -60,6 +71,25 @@ static size_t user_page_limit = SIZE_MAX;
 static void bss_init (void);
 static void paging_init (void);
 
+/* Boot-phase timing.  Each init step in pintos_init() records
+   the TSC cycles it took; raw cycles, because timer_calibrate()
+   runs in the middle of the sequence, so the conversion to
+   nanoseconds has to wait until the report is printed.  Keeps
+   regressions such as longer ide_init() reset delays from
+   silently adding to time-to-first-task. */
+#define BOOT_PHASE_MAX 24
+static struct boot_phase
+  {
+    const char *name;           /* Init step. */
+    uint64_t cycles;            /* TSC cycles it took. */
+  }
+boot_phases[BOOT_PHASE_MAX];
+static int boot_phase_cnt;
+static uint64_t boot_phase_last;
+
+static void boot_phase_done (const char *name);
+static void boot_report (void);
+
 static char **read_command_line (void);
 static char **parse_options (char **argv);
 static void run_actions (char **argv);
@@ -78,17 +108,20 @@ pintos_init (void)
 {
   char **argv;
 
-  /* Clear BSS. */  
+  /* Clear BSS. */
   bss_init ();
+  boot_phase_last = timer_cycles ();
 
   /* Break command line into arguments and parse options. */
   argv = read_command_line ();
   argv = parse_options (argv);
+  boot_phase_done ("cmdline");
 
   /* Initialize ourselves as a thread so we can use locks,
      then enable console locking. */
   thread_init ();
-  console_init ();  
+  console_init ();
+  boot_phase_done ("thread/console");
 
   /* Greet user. */
   printf ("Pintos booting with %'"PRIu32" kB RAM...\n",
@@ -97,12 +130,15 @@ pintos_init (void)
   /* Initialize memory system. */
   palloc_init (user_page_limit);
   malloc_init ();
+  boot_phase_done ("palloc/malloc");
   paging_init ();
+  boot_phase_done ("paging");
 
   /* Segmentation. */
 #ifdef USERPROG
   tss_init ();
   gdt_init ();
+  boot_phase_done ("tss/gdt");
 #endif
 
   /* Initialize interrupt handlers. */
@@ -114,21 +150,34 @@ pintos_init (void)
   exception_init ();
   syscall_init ();
 #endif
+  boot_phase_done ("interrupts");
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
+  softirq_init ();
+  workqueue_init ();
   serial_init_queue ();
+  console_start_daemon ();
+  boot_phase_done ("scheduler");
+  pvclock_init ();
   timer_calibrate ();
+  boot_phase_done ("timer_calibrate");
+  palloc_start_scrubber ();
 
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init ();
+  boot_phase_done ("ide");
+  virtio_blk_init ();
+  boot_phase_done ("virtio");
   locate_block_devices ();
   filesys_init (format_filesys);
+  boot_phase_done ("filesys");
 #endif
 
   printf ("Boot complete.\n");
-  
+  boot_report ();
+
   if (*argv != NULL) {
     /* Run actions specified on kernel command line. */
     run_actions (argv);
@@ -162,9 +211,18 @@ static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
+  uint32_t cr4;
   size_t page;
   extern char _start, _end_kernel_text;
 
+  /* Enable 4 MB pages.  The linear mapping below then spends one
+     page-directory entry -- and one TLB entry -- per 4 MB of RAM
+     instead of a page-table page of 4 kB entries, which matters
+     for memcpy-heavy kernel paths that would otherwise miss the
+     TLB every 4 kB. */
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PSE));
+
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
   for (page = 0; page < init_ram_pages; page++)
@@ -177,6 +235,22 @@ paging_init (void)
 
       if (pd[pde_idx] == 0)
         {
+          /* A 4 MB span lying entirely inside RAM and free of
+             kernel text becomes a single 4 MB page.  The span
+             holding the text keeps 4 kB pages, because text is
+             mapped read-only at page granularity, and a partial
+             span at the end of RAM keeps them too, so nothing
+             beyond RAM is ever mapped. */
+          bool has_text = &_start < vaddr + PTSPAN
+                          && vaddr < &_end_kernel_text;
+
+          if (pte_idx == 0 && !has_text
+              && page + PTSPAN / PGSIZE <= init_ram_pages)
+            {
+              pd[pde_idx] = pde_create_huge (vaddr, true);
+              page += PTSPAN / PGSIZE - 1;
+              continue;
+            }
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
           pd[pde_idx] = pde_create (pt);
         }
@@ -192,6 +266,42 @@ paging_init (void)
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
 }
 
+/* Records the end of boot phase NAME, attributing to it the TSC
+   cycles elapsed since the previous phase ended. */
+static void
+boot_phase_done (const char *name)
+{
+  uint64_t now = timer_cycles ();
+
+  if (boot_phase_cnt < BOOT_PHASE_MAX)
+    {
+      boot_phases[boot_phase_cnt].name = name;
+      boot_phases[boot_phase_cnt].cycles = now - boot_phase_last;
+      boot_phase_cnt++;
+    }
+  boot_phase_last = now;
+}
+
+/* Prints the per-phase boot timing report.  Runs after
+   timer_calibrate(), so the recorded cycle counts can be
+   converted to real time. */
+static void
+boot_report (void)
+{
+  uint64_t total_cycles = 0;
+  int i;
+
+  printf ("Boot report:\n");
+  for (i = 0; i < boot_phase_cnt; i++)
+    {
+      printf ("  %-16s %'8lld us\n", boot_phases[i].name,
+              timer_cycles_to_ns (boot_phases[i].cycles) / 1000);
+      total_cycles += boot_phases[i].cycles;
+    }
+  printf ("  %-16s %'8lld us\n", "total",
+          timer_cycles_to_ns (total_cycles) / 1000);
+}
+
 /* Breaks the kernel command line into words and returns them as
    an argv-like array. */
 static char **
@@ -251,6 +361,8 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-bwlimit"))
+        block_set_write_limit (atoi (value));
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -260,9 +372,39 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-prof"))
+        profile_start ();
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
+      else if (!strcmp (name, "-stackguard"))
+        thread_stack_guard = true;
+      else if (!strcmp (name, "-log"))
+        {
+          if (value == NULL || !log_set_level (value))
+            PANIC ("unknown log level `%s' (use -h for help)", value);
+        }
+      else if (!strcmp (name, "-qs"))
+        {
+          thread_slice_short = atoi (value);
+          if (thread_slice_short == 0)
+            PANIC ("-qs requires a positive tick count");
+        }
+      else if (!strcmp (name, "-ql"))
+        {
+          thread_slice_long = atoi (value);
+          if (thread_slice_long == 0)
+            PANIC ("-ql requires a positive tick count");
+        }
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-fp"))
+        {
+          if (!frame_set_policy (value))
+            PANIC ("unknown frame policy `%s' (use -h for help)", value);
+        }
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -289,13 +431,98 @@ run_task (char **argv)
   
   printf ("Executing '%s':\n", task);
 #ifdef USERPROG
-  process_wait (process_execute (task));
+  process_wait (process_execute (task), NULL);
 #else
   run_test (task);
 #endif
   printf ("Execution of '%s' complete.\n", task);
 }
 
+/* Prints memory usage statistics for the page and block
+   allocators. */
+static void
+print_memstat (char **argv UNUSED)
+{
+  palloc_print_stats ();
+  malloc_print_stats ();
+}
+
+/* Prints statistics for named locks. */
+static void
+print_lockstat (char **argv UNUSED)
+{
+  lock_print_stats ();
+}
+
+/* Prints the per-thread CPU accounting table. */
+static void
+print_ps (char **argv UNUSED)
+{
+  thread_print_all ();
+}
+
+/* Prints per-vector interrupt counts and handler latencies. */
+static void
+print_intrstat (char **argv UNUSED)
+{
+  intr_dump_stats ();
+}
+
+/* Prints workqueue depth and latency statistics. */
+static void
+print_wqstat (char **argv UNUSED)
+{
+  workqueue_print_stats ();
+}
+
+/* Prints hit/miss/eviction statistics for every registered
+   cache. */
+static void
+print_cachestat (char **argv UNUSED)
+{
+  cache_stats_print ();
+}
+
+/* Decodes and prints the tracepoint ring buffer. */
+static void
+print_trace (char **argv UNUSED)
+{
+  trace_dump ();
+}
+
+/* Measures and prints the context switch cost. */
+static void
+run_switch_bench (char **argv UNUSED)
+{
+  thread_switch_bench ();
+}
+
+#ifdef FILESYS
+/* Prints per-device I/O counts, latency histograms, and queue
+   depths. */
+static void
+print_iostat (char **argv UNUSED)
+{
+  block_print_stats ();
+}
+#endif
+
+#ifdef USERPROG
+/* Prints per-syscall invocation counts and latencies. */
+static void
+print_syscallstat (char **argv UNUSED)
+{
+  syscall_print_stats ();
+}
+
+/* Resets the per-syscall statistics. */
+static void
+reset_syscallstat (char **argv UNUSED)
+{
+  syscall_reset_stats ();
+}
+#endif
+
 /* Executes all of the actions specified in ARGV[]
    up to the null pointer sentinel. */
 static void
@@ -313,12 +540,28 @@ run_actions (char **argv)
   static const struct action actions[] = 
     {
       {"run", 2, run_task},
+      {"memstat", 1, print_memstat},
+      {"lockstat", 1, print_lockstat},
+      {"ps", 1, print_ps},
+      {"intrstat", 1, print_intrstat},
+      {"wqstat", 1, print_wqstat},
+      {"cachestat", 1, print_cachestat},
+      {"trace", 1, print_trace},
+      {"switchbench", 1, run_switch_bench},
+#ifdef USERPROG
+      {"syscallstat", 1, print_syscallstat},
+      {"syscallreset", 1, reset_syscallstat},
+#endif
 #ifdef FILESYS
       {"ls", 1, fsutil_ls},
       {"cat", 2, fsutil_cat},
       {"rm", 2, fsutil_rm},
+      {"defrag", 1, fsutil_defrag},
+      {"iostat", 1, print_iostat},
       {"extract", 1, fsutil_extract},
       {"append", 2, fsutil_append},
+      {"fsbench", 1, fsutil_bench},
+      {"workload", 3, fsutil_workload},
 #endif
       {NULL, 0, NULL},
     };
@@ -360,11 +603,30 @@ usage (void)
           "  run 'PROG [ARG...]' Run PROG and wait for it to complete.\n"
 #else
           "  run TEST           Run TEST.\n"
+#endif
+          "  memstat            Print memory usage statistics.\n"
+          "  lockstat           Print named-lock statistics (needs LOCKSTAT).\n"
+          "  ps                 Print per-thread CPU accounting.\n"
+          "  intrstat           Print per-vector interrupt statistics.\n"
+          "  wqstat             Print workqueue depth and latency.\n"
+          "  cachestat          Print hit ratios for every cache.\n"
+          "  trace              Dump the tracepoint ring (needs TRACING).\n"
+          "  switchbench        Measure context switch cost in cycles.\n"
+#ifdef USERPROG
+          "  syscallstat        Print per-syscall counts and latencies.\n"
+          "  syscallreset       Reset the per-syscall statistics.\n"
 #endif
 #ifdef FILESYS
           "  ls                 List files in the root directory.\n"
           "  cat FILE           Print FILE to the console.\n"
           "  rm FILE            Delete FILE.\n"
+          "  defrag             Make every file's data sectors contiguous.\n"
+          "  iostat             Print per-device I/O latency statistics.\n"
+          "  fsbench            Run the filesystem benchmark.\n"
+          "  workload CNT MIX   Run CNT mixed file operations, MIX like\n"
+          "                     70/20/10 for read/write/metadata shares,\n"
+          "                     and print latency percentiles; -rs=SEED\n"
+          "                     reproduces a run exactly.\n"
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  extract            Untar from scratch device into file system.\n"
           "  append FILE        Append FILE to tar file on scratch device.\n"
@@ -377,14 +639,29 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -bwlimit=CNT       Panic after CNT more sector writes, to\n"
+          "                     exercise crash recovery.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -prof              Sample the kernel PC each timer tick and\n"
+          "                     print a profile at shutdown.\n"
+          "  -tickless          Stretch the timer interval while idle.\n"
+          "  -stackguard        Unmapped guard page below each thread\n"
+          "                     stack; \"ps\" reports stack depth.\n"
+          "  -log=LEVEL         Print messages at or below LEVEL: error,\n"
+          "                     warn, info (default), or debug.\n"
+          "  -qs=TICKS          Time slice for recently blocked threads.\n"
+          "  -ql=TICKS          Time slice for CPU-bound threads.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -fp=POLICY         Frame eviction policy, clock (default)\n"
+          "                     or random.\n"
 #endif
           );
   shutdown_power_off ();
@@ -404,8 +681,11 @@ locate_block_devices (void)
 
 /* Figures out what block device to use for the given ROLE: the
    block device with the given NAME, if NAME is non-null,
-   otherwise the first block device in probe order of type
-   ROLE. */
+   otherwise the first block device in probe order of type ROLE
+   -- except that, once the file system device is known, a device
+   on a different hardware channel is preferred, so that paging
+   and scratch transfers overlap file I/O instead of serializing
+   behind one channel. */
 static void
 locate_block_device (enum block_type role, const char *name)
 {
@@ -419,9 +699,21 @@ locate_block_device (enum block_type role, const char *name)
     }
   else
     {
+      struct block *filesys
+        = role != BLOCK_FILESYS ? block_get_role (BLOCK_FILESYS) : NULL;
+      struct block *fallback = NULL;
+
       for (block = block_first (); block != NULL; block = block_next (block))
         if (block_type (block) == role)
-          break;
+          {
+            if (fallback == NULL)
+              fallback = block;
+            if (filesys == NULL
+                || block_channel (block) != block_channel (filesys))
+              break;
+          }
+      if (block == NULL)
+        block = fallback;
     }
 
   if (block != NULL)
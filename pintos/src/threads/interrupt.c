@@ -7,6 +7,7 @@
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "devices/timer.h"
 
@@ -37,6 +38,23 @@ static const char *intr_names[INTR_CNT];
    unexpected interrupt is one that has no registered handler. */
 static unsigned int unexpected_cnt[INTR_CNT];
 
+/* Per-vector statistics, accumulated by intr_handler().
+   Durations are kept in raw TSC cycles, which costs the hot path
+   only two counter reads, and converted to time when printed.
+   For an internal interrupt whose handler can block, such as a
+   system call, the figure is wall time, not CPU time. */
+struct intr_stat
+  {
+    long long calls;            /* Handler invocations. */
+    uint64_t total_cycles;      /* TSC cycles spent in the handler. */
+    uint64_t max_cycles;        /* Longest single invocation. */
+  };
+static struct intr_stat intr_stats[INTR_CNT];
+
+/* TSC cycles spent in external interrupt handlers altogether,
+   for attributing latency that user code cannot account for. */
+static uint64_t external_cycles;
+
 /* External interrupts are those generated by devices outside the
    CPU, such as the timer.  External interrupts run with
    interrupts turned off, so they never nest, nor are they ever
@@ -342,10 +360,12 @@ make_idtr_operand (uint16_t limit, void *base)
    intr-stubs.S.  FRAME describes the interrupt and the
    interrupted thread's registers. */
 void
-intr_handler (struct intr_frame *frame) 
+intr_handler (struct intr_frame *frame)
 {
   bool external;
   intr_handler_func *handler;
+  struct intr_stat *st;
+  uint64_t start, cycles;
 
   /* External interrupts are special.
      We only handle one at a time (so interrupts must be off)
@@ -361,7 +381,10 @@ intr_handler (struct intr_frame *frame)
       yield_on_return = false;
     }
 
-  /* Invoke the interrupt's handler. */
+  TRACE (TRACE_INTR, frame->vec_no);
+
+  /* Invoke the interrupt's handler, timing it. */
+  start = timer_cycles ();
   handler = intr_handlers[frame->vec_no];
   if (handler != NULL)
     handler (frame);
@@ -374,6 +397,17 @@ intr_handler (struct intr_frame *frame)
   else
     unexpected_interrupt (frame);
 
+  cycles = timer_cycles () - start;
+  st = &intr_stats[frame->vec_no];
+  st->calls++;
+  st->total_cycles += cycles;
+  if (cycles > st->max_cycles)
+    st->max_cycles = cycles;
+  if (external)
+    external_cycles += cycles;
+
+  TRACE (TRACE_INTR_RET, frame->vec_no);
+
   /* Complete the processing of an external interrupt. */
   if (external) 
     {
@@ -432,7 +466,34 @@ intr_dump_frame (const struct intr_frame *f)
 
 /* Returns the name of interrupt VEC. */
 const char *
-intr_name (uint8_t vec) 
+intr_name (uint8_t vec)
 {
   return intr_names[vec];
 }
+
+/* Prints invocation counts and handler latencies for every
+   vector that has fired, and the total time spent in external
+   interrupt handlers, which is time that shows up in no thread's
+   own accounting. */
+void
+intr_dump_stats (void)
+{
+  int i;
+
+  printf ("%-4s %-22s %12s %12s %10s %10s\n",
+          "vec", "name", "calls", "total us", "avg us", "max us");
+  for (i = 0; i < INTR_CNT; i++)
+    {
+      const struct intr_stat *st = &intr_stats[i];
+
+      if (st->calls == 0)
+        continue;
+      printf ("%#4x %-22s %12lld %12lld %10lld %10lld\n",
+              i, intr_names[i], st->calls,
+              timer_cycles_to_ns (st->total_cycles) / 1000,
+              timer_cycles_to_ns (st->total_cycles / st->calls) / 1000,
+              timer_cycles_to_ns (st->max_cycles) / 1000);
+    }
+  printf ("External interrupt time: %lld us\n",
+          timer_cycles_to_ns (external_cycles) / 1000);
+}
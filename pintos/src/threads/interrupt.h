@@ -65,6 +65,7 @@ bool intr_context (void);
 void intr_yield_on_return (void);
 
 void intr_dump_frame (const struct intr_frame *);
+void intr_dump_stats (void);
 const char *intr_name (uint8_t vec);
 
 #endif /* threads/interrupt.h */
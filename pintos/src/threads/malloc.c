@@ -7,65 +7,119 @@
 #include <string.h>
 #include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
 
    The size of each request, in bytes, is rounded up to a power
    of 2 and assigned to the "descriptor" that manages blocks of
-   that size.  The descriptor keeps a list of free blocks.  If
-   the free list is nonempty, one of its blocks is used to
-   satisfy the request.
-
-   Otherwise, a new page of memory, called an "arena", is
-   obtained from the page allocator (if none is available,
-   malloc() returns a null pointer).  The new arena is divided
-   into blocks, all of which are added to the descriptor's free
-   list.  Then we return one of the new blocks.
-
-   When we free a block, we add it to its descriptor's free list.
-   But if the arena that the block was in now has no in-use
-   blocks, we remove all of the arena's blocks from the free list
-   and give the arena back to the page allocator.
+   that size.  The descriptor keeps lists of "arenas", pages
+   obtained from the page allocator, each of which carves its
+   page into blocks and chains its own free blocks through their
+   first words as a counted freelist.  A request is satisfied
+   from the first arena that has a free block; if none does, a
+   new arena is allocated (if no page is available, malloc()
+   returns a null pointer).
+
+   When we free a block, we push it onto its own arena's
+   freelist.  The arena's free count then tells us in O(1)
+   whether the arena has any block still in use; if not, the
+   whole page goes back to the page allocator with no list
+   scanning, since no other arena's blocks are threaded through
+   it.
+
+   Each descriptor keeps two arena pools, one for ordinary
+   allocations and one for blocks that malloc_long() hints will
+   live for a long time.  Mixing lifetimes in one arena lets a
+   single long-lived block pin a page of dead neighbors;
+   segregating them keeps short-lived arenas reclaimable.
 
    We can't handle blocks bigger than 2 kB using this scheme,
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   In front of the smallest descriptors each thread keeps a
+   small cache of free blocks, chained through their first
+   word.  Most allocations and frees of the hot small sizes
+   (list nodes, hash entries and the like) hit the cache and
+   never touch the descriptor lock; the cache is refilled from
+   and drained to the descriptor several blocks at a time, so
+   the lock is taken once per batch instead of once per block.
+   A cached block looks allocated to its arena, which keeps the
+   arena from being reclaimed under it; a dying thread gives its
+   cached blocks back. */
+
+/* Arena lifetime pools.  Allocations with different expected
+   lifetimes come from different arenas, so that one long-lived
+   block cannot pin a page of short-lived neighbors. */
+enum arena_life
+  {
+    LIFE_SHORT,                 /* Default pool. */
+    LIFE_LONG,                  /* malloc_long() pool. */
+    LIFE_CNT
+  };
 
 /* Descriptor. */
 struct desc
   {
     size_t block_size;          /* Size of each element in bytes. */
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
-    struct list free_list;      /* List of free blocks. */
+    struct list arenas[LIFE_CNT];   /* Arenas with a free block, per pool. */
     struct lock lock;           /* Lock. */
+
+    /* Statistics.  Blocks sitting in per-thread caches count as
+       in use, since they are unavailable to other threads. */
+    size_t used_cnt;            /* Blocks currently in use. */
+    size_t used_max;            /* High-water mark of used_cnt. */
+    size_t arena_cnt;           /* Arenas currently allocated. */
+    size_t arena_max;           /* High-water mark of arena_cnt. */
+    size_t reclaim_cnt;         /* Arenas given back to the allocator. */
   };
 
 /* Magic number for detecting arena corruption. */
 #define ARENA_MAGIC 0x9a548eed
 
 /* Arena. */
-struct arena 
+struct arena
   {
     unsigned magic;             /* Always set to ARENA_MAGIC. */
     struct desc *desc;          /* Owning descriptor, null for big block. */
+    enum arena_life life;       /* Pool the arena belongs to. */
     size_t free_cnt;            /* Free blocks; pages in big block. */
+    size_t big_size;            /* Bytes requested, for a big block. */
+    struct block *free;         /* Counted freelist of this arena's free
+                                   blocks, chained through first words. */
+    struct list_elem elem;      /* In the descriptor pool's arena list
+                                   while the arena has a free block. */
   };
 
-/* Free block. */
-struct block 
+/* A free block; its first word chains the arena freelist and
+   the per-thread caches. */
+struct block
   {
-    struct list_elem free_elem; /* Free list element. */
+    struct block *next;         /* Next free block. */
   };
 
 /* Our set of descriptors. */
 static struct desc descs[10];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Per-thread cache bounds: at most CACHE_MAX blocks of a size
+   class are cached, and a miss refills CACHE_REFILL blocks in
+   one locked pass. */
+#define CACHE_MAX 8
+#define CACHE_REFILL 4
+
+/* Pages currently allocated to big blocks, and the most ever. */
+static size_t big_page_cnt;
+static size_t big_page_max;
+
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static void free_block_locked (struct desc *, struct block *);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -79,19 +133,42 @@ malloc_init (void)
       ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
       d->block_size = block_size;
       d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
-      list_init (&d->free_list);
+      list_init (&d->arenas[LIFE_SHORT]);
+      list_init (&d->arenas[LIFE_LONG]);
       lock_init (&d->lock);
+      lock_set_adaptive (&d->lock, true);
+      d->used_cnt = 0;
+      d->used_max = 0;
+      d->arena_cnt = 0;
+      d->arena_max = 0;
+      d->reclaim_cnt = 0;
     }
 }
 
-/* Obtains and returns a new block of at least SIZE bytes.
-   Returns a null pointer if memory is not available. */
-void *
-malloc (size_t size) 
+/* Pops a block off arena A's freelist, which must be
+   nonempty. */
+static struct block *
+arena_pop_block (struct arena *a)
+{
+  struct block *b = a->free;
+
+  ASSERT (b != NULL);
+  a->free = b->next;
+  a->free_cnt--;
+  return b;
+}
+
+/* Obtains and returns a new block of at least SIZE bytes from
+   lifetime pool LIFE.  Returns a null pointer if memory is not
+   available. */
+static void *
+malloc_pool (size_t size, enum arena_life life)
 {
+  struct thread *t = thread_current ();
   struct desc *d;
   struct block *b;
   struct arena *a;
+  size_t class;
 
   /* A null pointer satisfies a request for 0 bytes. */
   if (size == 0)
@@ -102,7 +179,20 @@ malloc (size_t size)
   for (d = descs; d < descs + desc_cnt; d++)
     if (d->block_size >= size)
       break;
-  if (d == descs + desc_cnt) 
+  class = d - descs;
+
+  /* Fast path: a block cached by this thread needs no lock.
+     The caches hold only short-lived blocks. */
+  if (life == LIFE_SHORT
+      && class < MALLOC_CACHE_CLASSES && t->malloc_cache[class] != NULL)
+    {
+      b = t->malloc_cache[class];
+      t->malloc_cache[class] = *(void **) b;
+      t->malloc_cache_cnt[class]--;
+      return b;
+    }
+
+  if (d == descs + desc_cnt)
     {
       /* SIZE is too big for any descriptor.
          Allocate enough pages to hold SIZE plus an arena. */
@@ -115,44 +205,96 @@ malloc (size_t size)
          pages, and return it. */
       a->magic = ARENA_MAGIC;
       a->desc = NULL;
+      a->life = life;
       a->free_cnt = page_cnt;
+      a->big_size = size;
+      big_page_cnt += page_cnt;
+      if (big_page_cnt > big_page_max)
+        big_page_max = big_page_cnt;
       return a + 1;
     }
 
   lock_acquire (&d->lock);
 
-  /* If the free list is empty, create a new arena. */
-  if (list_empty (&d->free_list))
+  /* If no arena in the pool has a free block, create one. */
+  if (list_empty (&d->arenas[life]))
     {
       size_t i;
 
       /* Allocate a page. */
       a = palloc_get_page (0);
-      if (a == NULL) 
+      if (a == NULL)
         {
           lock_release (&d->lock);
-          return NULL; 
+          return NULL;
         }
 
-      /* Initialize arena and add its blocks to the free list. */
+      /* Initialize arena and chain its blocks into its
+         freelist. */
       a->magic = ARENA_MAGIC;
       a->desc = d;
+      a->life = life;
       a->free_cnt = d->blocks_per_arena;
-      for (i = 0; i < d->blocks_per_arena; i++) 
+      a->free = NULL;
+      for (i = d->blocks_per_arena; i-- > 0; )
         {
-          struct block *b = arena_to_block (a, i);
-          list_push_back (&d->free_list, &b->free_elem);
+          struct block *fb = arena_to_block (a, i);
+          fb->next = a->free;
+          a->free = fb;
         }
+      list_push_front (&d->arenas[life], &a->elem);
+      if (++d->arena_cnt > d->arena_max)
+        d->arena_max = d->arena_cnt;
     }
 
-  /* Get a block from free list and return it. */
-  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-  a = block_to_arena (b);
-  a->free_cnt--;
+  /* Take a block from the pool's first arena. */
+  a = list_entry (list_front (&d->arenas[life]), struct arena, elem);
+  b = arena_pop_block (a);
+  d->used_cnt++;
+
+  /* While we hold the lock anyway, refill this thread's cache
+     from the same arena so the next few allocations of this
+     size need no lock. */
+  if (life == LIFE_SHORT && class < MALLOC_CACHE_CLASSES)
+    while (t->malloc_cache_cnt[class] < CACHE_REFILL - 1
+           && a->free != NULL)
+      {
+        struct block *cb = arena_pop_block (a);
+        *(void **) cb = t->malloc_cache[class];
+        t->malloc_cache[class] = cb;
+        t->malloc_cache_cnt[class]++;
+        d->used_cnt++;
+      }
+  if (d->used_cnt > d->used_max)
+    d->used_max = d->used_cnt;
+
+  /* A fully used arena leaves the pool list; free() puts it
+     back when a block comes home. */
+  if (a->free_cnt == 0)
+    list_remove (&a->elem);
+
   lock_release (&d->lock);
   return b;
 }
 
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available. */
+void *
+malloc (size_t size)
+{
+  return malloc_pool (size, LIFE_SHORT);
+}
+
+/* As malloc(), but hints that the block will live for a long
+   time -- typically for the rest of the kernel's run.  Long-
+   lived blocks are segregated into their own arenas so they do
+   not pin pages of short-lived neighbors. */
+void *
+malloc_long (size_t size)
+{
+  return malloc_pool (size, LIFE_LONG);
+}
+
 /* Allocates and return A times B bytes initialized to zeroes.
    Returns a null pointer if memory is not available. */
 void *
@@ -176,13 +318,13 @@ calloc (size_t a, size_t b)
 
 /* Returns the number of bytes allocated for BLOCK. */
 static size_t
-block_size (void *block) 
+block_size (void *block)
 {
   struct block *b = block;
   struct arena *a = block_to_arena (b);
   struct desc *d = a->desc;
 
-  return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
+  return d != NULL ? d->block_size : a->big_size;
 }
 
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
@@ -194,14 +336,59 @@ block_size (void *block)
 void *
 realloc (void *old_block, size_t new_size) 
 {
-  if (new_size == 0) 
+  if (new_size == 0)
     {
       free (old_block);
       return NULL;
     }
-  else 
+  else
     {
-      void *new_block = malloc (new_size);
+      void *new_block;
+
+      /* Try to resize in place before falling back to
+         allocate-and-copy. */
+      if (old_block != NULL)
+        {
+          struct arena *a = block_to_arena (old_block);
+          struct desc *d = a->desc;
+
+          if (d != NULL)
+            {
+              /* A small block keeps its slot as long as the new
+                 size still fits it. */
+              if (new_size <= d->block_size)
+                return old_block;
+            }
+          else
+            {
+              /* A big block can shrink in place, and can grow in
+                 place when the pages just past it are free. */
+              size_t capacity = PGSIZE * a->free_cnt - sizeof *a;
+
+              if (new_size > capacity)
+                {
+                  size_t page_cnt
+                    = DIV_ROUND_UP (new_size + sizeof *a, PGSIZE);
+
+                  if (!palloc_extend (a, a->free_cnt,
+                                      page_cnt - a->free_cnt))
+                    goto move;
+                  big_page_cnt += page_cnt - a->free_cnt;
+                  if (big_page_cnt > big_page_max)
+                    big_page_max = big_page_cnt;
+                  a->free_cnt = page_cnt;
+                }
+              a->big_size = new_size;
+              return old_block;
+            }
+        }
+
+    move:
+      /* Keep the block in its lifetime pool across the move. */
+      new_block = malloc_pool (new_size,
+                               old_block != NULL
+                               ? block_to_arena (old_block)->life
+                               : LIFE_SHORT);
       if (old_block != NULL && new_block != NULL)
         {
           size_t old_size = block_size (old_block);
@@ -224,45 +411,149 @@ free (void *p)
       struct arena *a = block_to_arena (b);
       struct desc *d = a->desc;
       
-      if (d != NULL) 
+      if (d != NULL)
         {
           /* It's a normal block.  We handle it here. */
+          size_t class = d - descs;
 
 #ifndef NDEBUG
           /* Clear the block to help detect use-after-free bugs. */
           memset (b, 0xcc, d->block_size);
 #endif
-  
-          lock_acquire (&d->lock);
 
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
-
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
+          if (class < MALLOC_CACHE_CLASSES && a->life == LIFE_SHORT)
             {
-              size_t i;
+              struct thread *t = thread_current ();
+
+              /* Fast path: stash the block in this thread's
+                 cache, no lock needed. */
+              if (t->malloc_cache_cnt[class] < CACHE_MAX)
+                {
+                  *(void **) b = t->malloc_cache[class];
+                  t->malloc_cache[class] = b;
+                  t->malloc_cache_cnt[class]++;
+                  return;
+                }
 
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
+              /* Cache full: drain half of it along with the
+                 block in a single locked pass. */
+              lock_acquire (&d->lock);
+              free_block_locked (d, b);
+              while (t->malloc_cache_cnt[class] > CACHE_MAX / 2)
                 {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
+                  struct block *cb = t->malloc_cache[class];
+                  t->malloc_cache[class] = *(void **) cb;
+                  t->malloc_cache_cnt[class]--;
+                  free_block_locked (d, cb);
                 }
-              palloc_free_page (a);
+              lock_release (&d->lock);
+              return;
             }
 
+          lock_acquire (&d->lock);
+          free_block_locked (d, b);
           lock_release (&d->lock);
         }
       else
         {
           /* It's a big block.  Free its pages. */
+          big_page_cnt -= a->free_cnt;
           palloc_free_multiple (a, a->free_cnt);
           return;
         }
     }
 }
 
+/* Returns block B to its arena's freelist, giving the arena
+   back to the page allocator if B was its last block in use.
+   D's lock must be held. */
+static void
+free_block_locked (struct desc *d, struct block *b)
+{
+  struct arena *a = block_to_arena (b);
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  b->next = a->free;
+  a->free = b;
+  d->used_cnt--;
+
+  if (a->free_cnt++ == 0)
+    list_push_back (&d->arenas[a->life], &a->elem);
+  if (a->free_cnt >= d->blocks_per_arena)
+    {
+      /* Empty arena: every block is on its own freelist, so the
+         page can go back without touching any shared list. */
+      ASSERT (a->free_cnt == d->blocks_per_arena);
+      list_remove (&a->elem);
+      palloc_free_page (a);
+      d->arena_cnt--;
+      d->reclaim_cnt++;
+    }
+}
+
+/* Prints allocation statistics: blocks in use and arenas per
+   size class, with high-water marks, arenas reclaimed, free
+   blocks idling in partially used arenas per pool, and pages
+   held by big blocks.  A large idle count that never turns into
+   reclaims is pinning: a few live blocks holding pages of dead
+   neighbors. */
+void
+malloc_print_stats (void)
+{
+  struct desc *d;
+
+  printf ("malloc: size  blocks    max  arenas    max  reclaim  s-idle  l-idle\n");
+  for (d = descs; d < descs + desc_cnt; d++)
+    {
+      size_t idle[LIFE_CNT];
+      int life;
+
+      lock_acquire (&d->lock);
+      for (life = 0; life < LIFE_CNT; life++)
+        {
+          struct list_elem *e;
+
+          idle[life] = 0;
+          for (e = list_begin (&d->arenas[life]);
+               e != list_end (&d->arenas[life]); e = list_next (e))
+            idle[life] += list_entry (e, struct arena, elem)->free_cnt;
+        }
+      printf ("       %5zu  %6zu %6zu  %6zu %6zu  %7zu  %6zu  %6zu\n",
+              d->block_size, d->used_cnt, d->used_max,
+              d->arena_cnt, d->arena_max, d->reclaim_cnt,
+              idle[LIFE_SHORT], idle[LIFE_LONG]);
+      lock_release (&d->lock);
+    }
+  printf ("malloc: %zu pages in big blocks, %zu max\n",
+          big_page_cnt, big_page_max);
+}
+
+/* Gives the dying thread's cached blocks back to their
+   descriptors.  Called from thread_exit(). */
+void
+malloc_thread_exit (void)
+{
+  struct thread *t = thread_current ();
+  size_t class;
+
+  for (class = 0; class < MALLOC_CACHE_CLASSES; class++)
+    if (t->malloc_cache[class] != NULL)
+      {
+        struct desc *d = &descs[class];
+
+        lock_acquire (&d->lock);
+        while (t->malloc_cache[class] != NULL)
+          {
+            struct block *b = t->malloc_cache[class];
+            t->malloc_cache[class] = *(void **) b;
+            free_block_locked (d, b);
+          }
+        lock_release (&d->lock);
+        t->malloc_cache_cnt[class] = 0;
+      }
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
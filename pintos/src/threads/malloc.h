@@ -4,8 +4,15 @@
 #include <debug.h>
 #include <stddef.h>
 
+/* Number of small size classes with a per-thread block cache;
+   see struct thread's malloc_cache members. */
+#define MALLOC_CACHE_CLASSES 4
+
 void malloc_init (void);
+void malloc_thread_exit (void);
+void malloc_print_stats (void);
 void *malloc (size_t) __attribute__ ((malloc));
+void *malloc_long (size_t) __attribute__ ((malloc));
 void *calloc (size_t, size_t) __attribute__ ((malloc));
 void *realloc (void *, size_t);
 void free (void *);
@@ -7,9 +7,12 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "threads/workqueue.h"
 
 /* Page allocator.  Hands out memory in page-size (or
    page-multiple) chunks.  See malloc.h for an allocator that
@@ -25,20 +28,79 @@
    half to the user pool.  That should be huge overkill for the
    kernel pool, but that's just fine for demonstration purposes. */
 
+/* A free page cached for fast single-page allocation.  The node
+   is stored in the free page itself. */
+struct free_page
+  {
+    struct free_page *next;             /* Next cached free page. */
+  };
+
 /* A memory pool. */
 struct pool
   {
     struct lock lock;                   /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
     uint8_t *base;                      /* Base of pool. */
+
+    /* Cache of free pages, kept marked as in-use in used_map so
+       that multi-page scans skip them.  Single-page requests,
+       by far the common case, are served from here in constant
+       time instead of scanning the bitmap.  Pages the scrubber
+       thread has already zeroed sit on a second list, from which
+       PAL_ZERO requests are served without the memset. */
+    struct free_page *free_list;        /* Cached free pages. */
+    size_t free_cnt;                    /* Number of cached pages. */
+    struct free_page *zero_list;        /* Cached pre-zeroed pages. */
+    size_t zero_cnt;                    /* Number of pre-zeroed pages. */
+
+    /* Statistics.  Pages in the free-page cache count as free. */
+    const char *name;                   /* Pool name, for reporting. */
+    size_t page_cnt;                    /* Total pages in the pool. */
+    size_t used_cnt;                    /* Pages currently allocated. */
+    size_t used_max;                    /* High-water mark of used_cnt. */
   };
 
-/* Two pools: one for kernel data, one for user pages. */
-static struct pool kernel_pool, user_pool;
+/* Two pools: one for kernel data, one for user pages.  A third,
+   small pool is held back for DMA buffers: device transfers need
+   physically contiguous, boundary-constrained memory, and after
+   the kernel pool fragments such runs may no longer exist there.
+   The DMA pool sits at the bottom of free memory and is only
+   touched by palloc_get_dma(), so its pages stay contiguous for
+   the life of the system. */
+#define DMA_POOL_PAGES 16
+static struct pool kernel_pool, user_pool, dma_pool;
+
+/* Kernel-pool pressure thresholds, in pages.  Ordinary
+   allocations fail once only RESERVE_PAGES would remain: the
+   reserve is kept for PAL_RESERVE allocations on the reclaim
+   paths -- writeback, swap-out -- whose progress is what frees
+   memory, so that running dry cannot deadlock the very code that
+   would refill the pool.  PAL_SOFT allocations do optional work
+   and give up at SOFT_PAGES, well before anyone else feels the
+   shortage; and once free pages fall under SHRINK_PAGES the
+   registered shrinkers are asked to release cached memory before
+   the pool empties. */
+#define RESERVE_PAGES 8         /* Kept back for PAL_RESERVE callers. */
+#define SOFT_PAGES 32           /* PAL_SOFT callers fail below this. */
+#define SHRINK_PAGES 64         /* Shrinkers run below this. */
+
+/* Pressure callbacks, run from the workqueue when the kernel
+   pool runs low.  A shrinker releases clean, regenerable memory
+   and must be able to run without allocating more. */
+#define SHRINKER_MAX 4
+static void (*shrinkers[SHRINKER_MAX]) (void);
+static size_t shrinker_cnt;
+static struct work shrink_work;
+static bool shrink_queued;      /* Shrink work submitted, not yet run? */
+static bool shrink_ready;       /* Workqueue up and usable? */
 
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static void free_cache_flush (struct pool *);
+static size_t dma_scan (struct pool *, size_t page_cnt, size_t align,
+                        size_t boundary);
+static thread_func shrink_work_func;
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -49,15 +111,21 @@ palloc_init (size_t user_page_limit)
   uint8_t *free_start = ptov (1024 * 1024);
   uint8_t *free_end = ptov (init_ram_pages * PGSIZE);
   size_t free_pages = (free_end - free_start) / PGSIZE;
-  size_t user_pages = free_pages / 2;
-  size_t kernel_pages;
+  size_t dma_pages = DMA_POOL_PAGES + 1;        /* +1 for its bitmap. */
+  size_t user_pages, kernel_pages;
+
+  free_pages -= dma_pages;
+  user_pages = free_pages / 2;
   if (user_pages > user_page_limit)
     user_pages = user_page_limit;
   kernel_pages = free_pages - user_pages;
 
-  /* Give half of memory to kernel, half to user. */
-  init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
-  init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
+  /* Reserve the DMA pool at the bottom, then give half of the
+     rest to the kernel and half to user pages. */
+  init_pool (&dma_pool, free_start, dma_pages, "DMA pool");
+  init_pool (&kernel_pool, free_start + dma_pages * PGSIZE,
+             kernel_pages, "kernel pool");
+  init_pool (&user_pool, free_start + (dma_pages + kernel_pages) * PGSIZE,
              user_pages, "user pool");
 }
 
@@ -73,25 +141,100 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
   void *pages;
   size_t page_idx;
+  bool zeroed = false;
+  bool kick = false;
 
   if (page_cnt == 0)
     return NULL;
 
   lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
 
-  if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
+  /* Enforce the kernel pool's pressure thresholds.  PAL_ASSERT
+     callers get reserve access too: they cannot handle failure,
+     so holding pages back from them only converts a shortage
+     into a panic. */
+  if (pool == &kernel_pool)
+    {
+      size_t free_pages = pool->page_cnt - pool->used_cnt;
+      size_t keep = flags & (PAL_RESERVE | PAL_ASSERT) ? 0
+        : flags & PAL_SOFT ? SOFT_PAGES : RESERVE_PAGES;
+
+      if (free_pages < page_cnt + SHRINK_PAGES
+          && shrink_ready && !shrink_queued && shrinker_cnt > 0)
+        shrink_queued = kick = true;
+      if (free_pages < page_cnt + keep)
+        {
+          lock_release (&pool->lock);
+          if (kick)
+            workqueue_submit (&shrink_work, shrink_work_func, NULL,
+                              PRI_DEFAULT);
+          if (flags & PAL_ASSERT)
+            PANIC ("palloc_get: out of pages");
+          return NULL;
+        }
+    }
+
+  if (page_cnt == 1
+      && (pool->free_list != NULL || pool->zero_list != NULL))
+    {
+      /* Fast path: grab a cached free page, preferring a
+         pre-zeroed one for PAL_ZERO requests and a dirty one
+         otherwise, so zeroed pages aren't wasted. */
+      struct free_page *fp;
+
+      if (pool->zero_list != NULL
+          && ((flags & PAL_ZERO) || pool->free_list == NULL))
+        {
+          fp = pool->zero_list;
+          pool->zero_list = fp->next;
+          pool->zero_cnt--;
+          /* The page is all zeros except the list node itself. */
+          fp->next = NULL;
+          zeroed = true;
+        }
+      else
+        {
+          fp = pool->free_list;
+          pool->free_list = fp->next;
+          pool->free_cnt--;
+        }
+      pages = fp;
+    }
   else
-    pages = NULL;
+    {
+      page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+      if (page_idx == BITMAP_ERROR && pool->free_cnt + pool->zero_cnt > 0)
+        {
+          /* The cached pages are marked in-use in the bitmap, so
+             a failed scan may just mean the free memory is
+             sitting in the cache.  Return it all to the bitmap
+             and scan again. */
+          free_cache_flush (pool);
+          page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt,
+                                           false);
+        }
+      if (page_idx != BITMAP_ERROR)
+        pages = pool->base + PGSIZE * page_idx;
+      else
+        pages = NULL;
+    }
+  if (pages != NULL)
+    {
+      pool->used_cnt += page_cnt;
+      if (pool->used_cnt > pool->used_max)
+        pool->used_max = pool->used_cnt;
+    }
+  lock_release (&pool->lock);
 
-  if (pages != NULL) 
+  if (kick)
+    workqueue_submit (&shrink_work, shrink_work_func, NULL, PRI_DEFAULT);
+
+  if (pages != NULL)
     {
-      if (flags & PAL_ZERO)
+      if ((flags & PAL_ZERO) && !zeroed)
         memset (pages, 0, PGSIZE * page_cnt);
     }
-  else 
+  else
     {
       if (flags & PAL_ASSERT)
         PANIC ("palloc_get: out of pages");
@@ -113,9 +256,57 @@ palloc_get_page (enum palloc_flags flags)
   return palloc_get_multiple (flags, 1);
 }
 
+/* Obtains PAGE_CNT physically contiguous pages for device DMA
+   and returns their kernel virtual address, or a null pointer if
+   no suitable run is free.  If ALIGN_PAGES is greater than 1, it
+   must be a power of 2 and the run's physical address is aligned
+   to that many pages.  If BOUNDARY_PAGES is nonzero, it must be
+   a power of 2 no smaller than PAGE_CNT and the run will not
+   cross a boundary of that many pages -- e.g. 16 keeps a buffer
+   within one 64 kB span, as busmaster PRD entries require.
+
+   The reserved DMA pool is searched first, then the kernel pool,
+   whose pages are also physically contiguous under the kernel's
+   linear mapping.  Free with palloc_free_multiple(). */
+void *
+palloc_get_dma (size_t page_cnt, size_t align_pages, size_t boundary_pages)
+{
+  struct pool *pools[2] = {&dma_pool, &kernel_pool};
+  size_t align = align_pages > 1 ? align_pages : 1;
+  size_t i;
+
+  ASSERT (page_cnt > 0);
+  ASSERT ((align & (align - 1)) == 0);
+  ASSERT (boundary_pages == 0
+          || ((boundary_pages & (boundary_pages - 1)) == 0
+              && boundary_pages >= page_cnt));
+
+  for (i = 0; i < 2; i++)
+    {
+      struct pool *pool = pools[i];
+      size_t page_idx;
+
+      lock_acquire (&pool->lock);
+      if (pool->free_cnt + pool->zero_cnt > 0)
+        free_cache_flush (pool);
+      page_idx = dma_scan (pool, page_cnt, align, boundary_pages);
+      if (page_idx != BITMAP_ERROR)
+        {
+          pool->used_cnt += page_cnt;
+          if (pool->used_cnt > pool->used_max)
+            pool->used_max = pool->used_cnt;
+        }
+      lock_release (&pool->lock);
+
+      if (page_idx != BITMAP_ERROR)
+        return pool->base + PGSIZE * page_idx;
+    }
+  return NULL;
+}
+
 /* Frees the PAGE_CNT pages starting at PAGES. */
 void
-palloc_free_multiple (void *pages, size_t page_cnt) 
+palloc_free_multiple (void *pages, size_t page_cnt)
 {
   struct pool *pool;
   size_t page_idx;
@@ -128,6 +319,8 @@ palloc_free_multiple (void *pages, size_t page_cnt)
     pool = &kernel_pool;
   else if (page_from_pool (&user_pool, pages))
     pool = &user_pool;
+  else if (page_from_pool (&dma_pool, pages))
+    pool = &dma_pool;
   else
     NOT_REACHED ();
 
@@ -138,16 +331,240 @@ palloc_free_multiple (void *pages, size_t page_cnt)
 #endif
 
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  if (page_cnt == 1)
+    {
+      /* Cache the page for the next single-page allocation,
+         leaving it marked in-use in the bitmap. */
+      struct free_page *fp = pages;
+
+      lock_acquire (&pool->lock);
+      fp->next = pool->free_list;
+      pool->free_list = fp;
+      pool->free_cnt++;
+      pool->used_cnt--;
+      lock_release (&pool->lock);
+    }
+  else
+    {
+      lock_acquire (&pool->lock);
+      bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+      pool->used_cnt -= page_cnt;
+      lock_release (&pool->lock);
+    }
 }
 
 /* Frees the page at PAGE. */
 void
-palloc_free_page (void *page) 
+palloc_free_page (void *page)
 {
   palloc_free_multiple (page, 1);
 }
 
+/* Tries to extend the PAGE_CNT-page allocation at PAGES by
+   EXTRA further pages, in place.  Succeeds only if the pages
+   just past the allocation are free, so the caller's data stays
+   where it is.  Returns true and marks the pages in use if so,
+   false without any effect otherwise. */
+bool
+palloc_extend (void *pages, size_t page_cnt, size_t extra)
+{
+  struct pool *pool;
+  size_t page_idx, start;
+  bool ok;
+
+  ASSERT (pg_ofs (pages) == 0);
+  ASSERT (page_cnt > 0);
+
+  if (extra == 0)
+    return true;
+
+  if (page_from_pool (&kernel_pool, pages))
+    pool = &kernel_pool;
+  else if (page_from_pool (&user_pool, pages))
+    pool = &user_pool;
+  else if (page_from_pool (&dma_pool, pages))
+    pool = &dma_pool;
+  else
+    NOT_REACHED ();
+
+  page_idx = pg_no (pages) - pg_no (pool->base);
+  start = page_idx + page_cnt;
+
+  lock_acquire (&pool->lock);
+  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
+  ok = start + extra <= bitmap_size (pool->used_map)
+    && !bitmap_contains (pool->used_map, start, extra, true);
+  if (!ok && pool->free_cnt + pool->zero_cnt > 0
+      && start + extra <= bitmap_size (pool->used_map))
+    {
+      /* The adjacent pages may be free but sitting in the
+         single-page cache, where they look in-use.  Flush the
+         cache back to the bitmap and look again. */
+      free_cache_flush (pool);
+      ok = !bitmap_contains (pool->used_map, start, extra, true);
+    }
+  if (ok)
+    {
+      bitmap_set_multiple (pool->used_map, start, extra, true);
+      pool->used_cnt += extra;
+      if (pool->used_cnt > pool->used_max)
+        pool->used_max = pool->used_cnt;
+    }
+  lock_release (&pool->lock);
+
+  return ok;
+}
+
+/* Moves one page from POOL's dirty free-page cache to its
+   pre-zeroed cache, doing the memset with the pool unlocked.
+   Returns false if the dirty cache was empty. */
+static bool
+scrub_page (struct pool *pool)
+{
+  struct free_page *fp;
+
+  lock_acquire (&pool->lock);
+  fp = pool->free_list;
+  if (fp != NULL)
+    {
+      pool->free_list = fp->next;
+      pool->free_cnt--;
+    }
+  lock_release (&pool->lock);
+
+  if (fp == NULL)
+    return false;
+
+  memset (fp, 0, PGSIZE);
+
+  lock_acquire (&pool->lock);
+  fp->next = pool->zero_list;
+  pool->zero_list = fp;
+  pool->zero_cnt++;
+  lock_release (&pool->lock);
+  return true;
+}
+
+/* Background scrubber thread.  Zeroes cached free pages at the
+   lowest priority, so that PAL_ZERO allocations made while the
+   CPU was otherwise idle find pre-zeroed pages and skip the
+   memset. */
+static void
+scrubber (void *aux UNUSED)
+{
+  for (;;)
+    {
+      bool scrubbed = false;
+
+      scrubbed |= scrub_page (&kernel_pool);
+      scrubbed |= scrub_page (&user_pool);
+      if (!scrubbed)
+        timer_sleep (10);
+    }
+}
+
+/* Starts the background page scrubber.  Called once the
+   scheduler is up; memory-pressure shrink work may be queued
+   from this point on. */
+void
+palloc_start_scrubber (void)
+{
+  shrink_ready = true;
+  thread_create ("scrubber", PRI_MIN, scrubber, NULL);
+}
+
+/* Registers SHRINKER to be called from a background worker when
+   kernel-pool free pages run low.  A shrinker should release
+   clean cached memory it can rebuild later, and any pages it
+   does need while doing so must be requested with
+   PAL_RESERVE. */
+void
+palloc_register_shrinker (void (*shrinker) (void))
+{
+  lock_acquire (&kernel_pool.lock);
+  ASSERT (shrinker_cnt < SHRINKER_MAX);
+  shrinkers[shrinker_cnt++] = shrinker;
+  lock_release (&kernel_pool.lock);
+}
+
+/* Returns true if the kernel pool is low enough on pages that
+   optional work should be skipped.  This is the PAL_SOFT policy
+   in predicate form, for callers whose memory arrives through
+   allocators that cannot carry the flag -- sub-page malloc()
+   blocks, slab objects.  The unlocked read is deliberate: the
+   answer is advisory and stale by the time it is used anyway. */
+bool
+palloc_under_pressure (void)
+{
+  return kernel_pool.page_cnt - kernel_pool.used_cnt < SHRINK_PAGES;
+}
+
+/* Workqueue item: runs the registered shrinkers, then rearms.
+   Queued at most once at a time; if the pool is still under
+   pressure after this pass, the next allocation queues it
+   again. */
+static void
+shrink_work_func (void *aux UNUSED)
+{
+  size_t i;
+
+  for (i = 0; i < shrinker_cnt; i++)
+    shrinkers[i] ();
+
+  lock_acquire (&kernel_pool.lock);
+  shrink_queued = false;
+  lock_release (&kernel_pool.lock);
+}
+
+/* Prints page allocation statistics for POOL. */
+static void
+print_pool_stats (struct pool *pool)
+{
+  lock_acquire (&pool->lock);
+  printf ("%s: %'zu pages, %'zu used, %'zu free (%'zu pre-zeroed), "
+          "%'zu max used\n",
+          pool->name, pool->page_cnt, pool->used_cnt,
+          pool->page_cnt - pool->used_cnt, pool->zero_cnt,
+          pool->used_max);
+  lock_release (&pool->lock);
+}
+
+/* Prints page allocation statistics. */
+void
+palloc_print_stats (void)
+{
+  print_pool_stats (&kernel_pool);
+  print_pool_stats (&user_pool);
+  print_pool_stats (&dma_pool);
+}
+
+/* Searches POOL for PAGE_CNT contiguous free pages whose
+   physical address is aligned to ALIGN pages and, if BOUNDARY is
+   nonzero, does not cross a BOUNDARY-page boundary.  Marks the
+   run in use and returns its page index, or BITMAP_ERROR if no
+   such run is free.  The caller must hold POOL's lock. */
+static size_t
+dma_scan (struct pool *pool, size_t page_cnt, size_t align, size_t boundary)
+{
+  size_t size = bitmap_size (pool->used_map);
+  size_t base_pn = vtop (pool->base) / PGSIZE;
+  size_t idx = base_pn % align != 0 ? align - base_pn % align : 0;
+
+  for (; idx + page_cnt <= size; idx += align)
+    {
+      size_t pn = base_pn + idx;
+
+      if (boundary != 0 && pn % boundary + page_cnt > boundary)
+        continue;
+      if (!bitmap_contains (pool->used_map, idx, page_cnt, true))
+        {
+          bitmap_set_multiple (pool->used_map, idx, page_cnt, true);
+          return idx;
+        }
+    }
+  return BITMAP_ERROR;
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
@@ -167,6 +584,40 @@ init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
   lock_init (&p->lock);
   p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
   p->base = base + bm_pages * PGSIZE;
+  p->free_list = NULL;
+  p->free_cnt = 0;
+  p->zero_list = NULL;
+  p->zero_cnt = 0;
+  p->name = name;
+  p->page_cnt = page_cnt;
+  p->used_cnt = 0;
+  p->used_max = 0;
+}
+
+/* Returns every page in POOL's free-page cache to the bitmap, so
+   that a multi-page scan can find contiguous runs among them.
+   The caller must hold POOL's lock. */
+static void
+free_cache_flush (struct pool *pool)
+{
+  while (pool->free_list != NULL)
+    {
+      struct free_page *fp = pool->free_list;
+      size_t page_idx = pg_no (fp) - pg_no (pool->base);
+
+      pool->free_list = fp->next;
+      pool->free_cnt--;
+      bitmap_set (pool->used_map, page_idx, false);
+    }
+  while (pool->zero_list != NULL)
+    {
+      struct free_page *fp = pool->zero_list;
+      size_t page_idx = pg_no (fp) - pg_no (pool->base);
+
+      pool->zero_list = fp->next;
+      pool->zero_cnt--;
+      bitmap_set (pool->used_map, page_idx, false);
+    }
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -1,20 +1,33 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
-/* How to allocate pages. */
+/* How to allocate pages.  PAL_RESERVE and PAL_SOFT set the
+   allocation's priority under memory pressure: reclaim-path
+   allocations may dig into the kernel pool's emergency reserve,
+   while opportunistic ones fail well before the pool empties. */
 enum palloc_flags
   {
     PAL_ASSERT = 001,           /* Panic on failure. */
     PAL_ZERO = 002,             /* Zero page contents. */
-    PAL_USER = 004              /* User page. */
+    PAL_USER = 004,             /* User page. */
+    PAL_RESERVE = 010,          /* Reclaim path: may take the reserve. */
+    PAL_SOFT = 020              /* Optional work: fail early instead. */
   };
 
 void palloc_init (size_t user_page_limit);
+void palloc_register_shrinker (void (*shrinker) (void));
+bool palloc_under_pressure (void);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
+void *palloc_get_dma (size_t page_cnt, size_t align_pages,
+                      size_t boundary_pages);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+bool palloc_extend (void *pages, size_t page_cnt, size_t extra);
+void palloc_start_scrubber (void);
+void palloc_print_stats (void);
 
 #endif /* threads/palloc.h */
@@ -0,0 +1,143 @@
+#include "threads/profile.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <symbol.h>
+#include "threads/interrupt.h"
+
+/* Statistical sampling profiler.
+
+   When enabled with the "-prof" kernel option, the timer
+   interrupt hands each interrupted instruction pointer to
+   profile_tick(), which counts it in a hash table.  At
+   TIMER_FREQ samples per second, the share of samples that land
+   in a function approximates the share of CPU time it consumes.
+   The report printed at shutdown resolves each address against
+   the embedded symbol table, so it reads on the box; the raw
+   address stays alongside for the backtrace utility when source
+   lines are wanted. */
+
+/* Number of hash buckets.  Must be a power of two.  The table is
+   statically allocated because samples are taken in interrupt
+   context, where allocation is off limits. */
+#define BUCKET_CNT 1024
+
+/* Maximum number of addresses in the shutdown report. */
+#define REPORT_MAX 32
+
+/* One sampled instruction pointer. */
+struct sample
+  {
+    void *eip;                  /* Interrupted instruction pointer. */
+    uint32_t cnt;               /* Number of times sampled. */
+  };
+
+/* Hash table of samples, open-addressed with linear probing.
+   An entry with a null eip is empty. */
+static struct sample samples[BUCKET_CNT];
+
+static bool enabled;            /* Is sampling turned on? */
+static uint32_t sample_cnt;     /* Samples recorded. */
+static uint32_t dropped_cnt;    /* Samples dropped because the
+                                   table filled up. */
+
+/* Turns on sampling.  Sampling starts as soon as timer
+   interrupts do. */
+void
+profile_start (void)
+{
+  enabled = true;
+}
+
+/* Counts one sample at EIP.  Called from the timer interrupt, so
+   it must not sleep or allocate. */
+void
+profile_tick (void *eip)
+{
+  size_t start, probe;
+
+  if (!enabled)
+    return;
+
+  ASSERT (intr_context ());
+
+  /* Knuth's multiplicative hash of the address, which ignores
+     the low bits that instruction alignment makes poor
+     discriminators. */
+  start = ((uintptr_t) eip >> 2) * 2654435761u & (BUCKET_CNT - 1);
+  for (probe = 0; probe < BUCKET_CNT; probe++)
+    {
+      struct sample *s = &samples[(start + probe) & (BUCKET_CNT - 1)];
+
+      if (s->eip == eip)
+        {
+          s->cnt++;
+          sample_cnt++;
+          return;
+        }
+      else if (s->eip == NULL)
+        {
+          s->eip = eip;
+          s->cnt = 1;
+          sample_cnt++;
+          return;
+        }
+    }
+  dropped_cnt++;
+}
+
+/* Prints the profile report: the most frequently sampled
+   addresses in descending order of sample count.  Does nothing
+   if sampling was never enabled. */
+void
+profile_print (void)
+{
+  struct sample report[REPORT_MAX];
+  size_t report_cnt = 0;
+  size_t i, j;
+
+  if (!enabled)
+    return;
+
+  /* Keep the REPORT_MAX hottest entries, insertion-sorted by
+     descending count. */
+  for (i = 0; i < BUCKET_CNT; i++)
+    {
+      const struct sample *s = &samples[i];
+
+      if (s->eip == NULL
+          || (report_cnt == REPORT_MAX
+              && s->cnt <= report[report_cnt - 1].cnt))
+        continue;
+
+      if (report_cnt < REPORT_MAX)
+        report_cnt++;
+      for (j = report_cnt - 1;
+           j > 0 && report[j - 1].cnt < s->cnt;
+           j--)
+        report[j] = report[j - 1];
+      report[j] = *s;
+    }
+
+  printf ("\nProfile: %"PRIu32" samples (%"PRIu32" dropped).\n",
+          sample_cnt, dropped_cnt);
+  if (symbol_cnt == 0)
+    printf ("Resolve addresses with the backtrace utility,"
+            " as for a panic backtrace.\n");
+  for (i = 0; i < report_cnt; i++)
+    {
+      const struct symbol *s = symbol_lookup (report[i].eip);
+
+      printf ("%8"PRIu32"  %3d%%  %p",
+              report[i].cnt,
+              (int) ((uint64_t) report[i].cnt * 100 / sample_cnt),
+              report[i].eip);
+      if (s != NULL)
+        printf ("  %s+0x%x", s->name,
+                (unsigned) ((uint32_t) report[i].eip - s->addr));
+      printf ("\n");
+    }
+}
@@ -0,0 +1,8 @@
+#ifndef THREADS_PROFILE_H
+#define THREADS_PROFILE_H
+
+void profile_start (void);
+void profile_tick (void *eip);
+void profile_print (void);
+
+#endif /* threads/profile.h */
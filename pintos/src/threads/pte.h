@@ -66,6 +66,12 @@ static inline uintptr_t pd_no (const void *va) {
 #define PTE_U 0x4               /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20              /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40              /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80             /* 1=4 MB page (PDEs only, needs
+                                   CR4.PSE). */
+
+/* CR4 bit enabling 4 MB pages via PTE_PS.  See [IA32-v3a] 3.7.2
+   "Linear Address Translation (4-MByte Pages)". */
+#define CR4_PSE 0x10
 
 /* Returns a PDE that points to page table PT. */
 static inline uint32_t pde_create (uint32_t *pt) {
@@ -73,6 +79,15 @@ static inline uint32_t pde_create (uint32_t *pt) {
   return vtop (pt) | PTE_U | PTE_P | PTE_W;
 }
 
+/* Returns a PDE that maps the 4 MB of physical memory starting
+   at the physical address of VADDR as a single 4 MB page,
+   without a page table.  VADDR must be 4 MB aligned and CR4.PSE
+   enabled.  Kernel-only, like pte_create_kernel(). */
+static inline uint32_t pde_create_huge (void *vaddr, bool writable) {
+  ASSERT (vtop (vaddr) % PTSPAN == 0);
+  return vtop (vaddr) | PTE_P | PTE_PS | (writable ? PTE_W : 0);
+}
+
 /* Returns a pointer to the page table that page directory entry
    PDE, which must "present", points to. */
 static inline uint32_t *pde_get_pt (uint32_t pde) {
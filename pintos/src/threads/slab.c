@@ -0,0 +1,184 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* A slab cache.
+
+   Each cache manages "slabs", single pages obtained from the
+   page allocator.  A slab begins with a header and is otherwise
+   divided into equal-size objects, each at least large enough to
+   hold a free list element while unallocated.  Free objects from
+   every slab are threaded onto the cache's free list, so
+   slab_alloc() and slab_free() are ordinarily a list operation
+   apiece.  A slab whose objects are all free is returned to the
+   page allocator, the same policy malloc()'s arenas use. */
+struct slab_cache
+  {
+    char name[16];              /* For diagnostic messages. */
+    size_t obj_size;            /* Size of each object in bytes. */
+    size_t objs_per_slab;       /* Number of objects in a slab. */
+    struct list free_list;      /* Free objects in all slabs. */
+    struct lock lock;           /* Protects free_list and slab counts. */
+    size_t used_cnt;            /* Objects currently allocated. */
+    size_t limit;               /* Hard cap on used_cnt; 0 for none. */
+  };
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Header at the beginning of each slab page. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct slab_cache *cache;   /* Owning cache. */
+    size_t free_cnt;            /* Number of free objects in this slab. */
+  };
+
+/* A free object, threaded onto its cache's free list. */
+struct slab_obj
+  {
+    struct list_elem free_elem; /* Free list element. */
+  };
+
+/* Returns the slab that OBJ lies within. */
+static struct slab *
+obj_to_slab (void *obj)
+{
+  struct slab *s = pg_round_down (obj);
+  ASSERT (s->magic == SLAB_MAGIC);
+  return s;
+}
+
+/* Returns the IDX'th object within SLAB. */
+static struct slab_obj *
+slab_to_obj (struct slab *s, size_t idx)
+{
+  ASSERT (idx < s->cache->objs_per_slab);
+  return (struct slab_obj *) ((uint8_t *) (s + 1)
+                              + idx * s->cache->obj_size);
+}
+
+/* Creates and returns a new slab cache named NAME that hands out
+   objects of OBJ_SIZE bytes, or a null pointer if memory is not
+   available.  NAME is used only in diagnostic messages. */
+struct slab_cache *
+slab_create (const char *name, size_t obj_size)
+{
+  struct slab_cache *cache;
+
+  ASSERT (obj_size > 0);
+
+  /* An object must be able to hold a free list element and a
+     slab must fit at least one object alongside its header. */
+  if (obj_size < sizeof (struct slab_obj))
+    obj_size = sizeof (struct slab_obj);
+  ASSERT (obj_size <= PGSIZE - sizeof (struct slab));
+
+  cache = malloc_long (sizeof *cache);
+  if (cache == NULL)
+    return NULL;
+
+  strlcpy (cache->name, name, sizeof cache->name);
+  cache->obj_size = obj_size;
+  cache->objs_per_slab = (PGSIZE - sizeof (struct slab)) / obj_size;
+  list_init (&cache->free_list);
+  lock_init (&cache->lock);
+  cache->used_cnt = 0;
+  cache->limit = 0;
+
+  return cache;
+}
+
+/* Caps CACHE at MAX_OBJS allocated objects; once the cap is
+   reached slab_alloc() fails until objects are freed.  Bounds
+   the memory a cache of caller-controlled lifetime -- such as
+   per-child records a parent may never reap -- can pin. */
+void
+slab_set_limit (struct slab_cache *cache, size_t max_objs)
+{
+  cache->limit = max_objs;
+}
+
+/* Obtains and returns an object from CACHE, or a null pointer if
+   memory is not available. */
+void *
+slab_alloc (struct slab_cache *cache)
+{
+  struct slab_obj *obj;
+
+  lock_acquire (&cache->lock);
+  if (cache->limit != 0 && cache->used_cnt >= cache->limit)
+    {
+      lock_release (&cache->lock);
+      return NULL;
+    }
+  if (list_empty (&cache->free_list))
+    {
+      /* Carve a new slab into objects and put them all on the
+         free list. */
+      struct slab *s;
+      size_t i;
+
+      s = palloc_get_page (0);
+      if (s == NULL)
+        {
+          lock_release (&cache->lock);
+          return NULL;
+        }
+      s->magic = SLAB_MAGIC;
+      s->cache = cache;
+      s->free_cnt = cache->objs_per_slab;
+      for (i = 0; i < cache->objs_per_slab; i++)
+        list_push_back (&cache->free_list, &slab_to_obj (s, i)->free_elem);
+    }
+
+  obj = list_entry (list_pop_front (&cache->free_list),
+                    struct slab_obj, free_elem);
+  obj_to_slab (obj)->free_cnt--;
+  cache->used_cnt++;
+  lock_release (&cache->lock);
+
+  return obj;
+}
+
+/* Frees OBJ, which must previously have been obtained from CACHE
+   with slab_alloc().  Returns the containing slab to the page
+   allocator if all of its objects are now free. */
+void
+slab_free (struct slab_cache *cache, void *obj)
+{
+  struct slab *s;
+
+  if (obj == NULL)
+    return;
+
+  s = obj_to_slab (obj);
+  ASSERT (s->cache == cache);
+
+#ifndef NDEBUG
+  /* Clear the object to help detect use-after-free bugs. */
+  memset (obj, 0xcc, cache->obj_size);
+#endif
+
+  lock_acquire (&cache->lock);
+  list_push_front (&cache->free_list, &((struct slab_obj *) obj)->free_elem);
+  cache->used_cnt--;
+  if (++s->free_cnt >= cache->objs_per_slab)
+    {
+      /* The slab is now entirely free, so give it back. */
+      size_t i;
+
+      ASSERT (s->free_cnt == cache->objs_per_slab);
+      for (i = 0; i < cache->objs_per_slab; i++)
+        list_remove (&slab_to_obj (s, i)->free_elem);
+      palloc_free_page (s);
+    }
+  lock_release (&cache->lock);
+}
@@ -0,0 +1,22 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <stddef.h>
+
+/* Slab allocator.
+
+   A slab cache hands out fixed-size objects carved from pages
+   obtained from the page allocator.  Compared to malloc(), which
+   rounds each request up to a power of 2, a cache packs objects
+   of its exact size, so frequently allocated kernel structures
+   waste less memory and allocation is a constant-time free list
+   operation. */
+
+struct slab_cache;
+
+struct slab_cache *slab_create (const char *name, size_t obj_size);
+void slab_set_limit (struct slab_cache *, size_t max_objs);
+void *slab_alloc (struct slab_cache *);
+void slab_free (struct slab_cache *, void *);
+
+#endif /* threads/slab.h */
@@ -0,0 +1,112 @@
+#include "threads/softirq.h"
+#include <debug.h>
+#include <stddef.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Maximum number of registered softirqs; one bit each in
+   `pending'. */
+#define SOFTIRQ_MAX 8
+
+/* A registered softirq. */
+struct softirq
+  {
+    softirq_func *func;         /* Bottom-half function. */
+    void *aux;                  /* Auxiliary data for FUNC. */
+    const char *name;           /* For debugging purposes. */
+  };
+
+/* Table of registered softirqs.  Filled during boot, before
+   interrupts are enabled, and read-only afterward. */
+static struct softirq softirqs[SOFTIRQ_MAX];
+static size_t softirq_cnt;
+
+/* Bitmap of raised softirqs, bit N for softirq N.  Set by
+   softirq_raise(), possibly in interrupt context, and cleared by
+   the daemon; both sides hold pending_lock, a spinlock so that
+   the raise side remains legal at interrupt level. */
+static unsigned pending;
+static struct spinlock pending_lock;
+
+/* Upped once per raise to wake the daemon.  An extra up only
+   costs the daemon a wakeup that finds nothing pending. */
+static struct semaphore pending_sema;
+
+/* True once softirq_init() has run, so that a softirq raised
+   during boot, before the semaphore and daemon exist, just sits
+   in `pending' until the daemon's first pass collects it. */
+static bool started;
+
+static thread_func softirq_daemon;
+
+/* Starts the softirq daemon.  Called once the thread system is
+   up. */
+void
+softirq_init (void)
+{
+  spinlock_init (&pending_lock);
+  sema_init (&pending_sema, 0);
+  started = true;
+  thread_create ("softirqd", PRI_MAX, softirq_daemon, NULL);
+}
+
+/* Registers FUNC, to be called with AUX when the returned
+   softirq number is raised.  NAME is for debugging purposes.
+   Must be called during boot, before interrupts are enabled. */
+int
+softirq_register (softirq_func *func, void *aux, const char *name)
+{
+  struct softirq *s;
+
+  ASSERT (func != NULL);
+  ASSERT (softirq_cnt < SOFTIRQ_MAX);
+
+  s = &softirqs[softirq_cnt];
+  s->func = func;
+  s->aux = aux;
+  s->name = name;
+  return softirq_cnt++;
+}
+
+/* Raises softirq ID: its bottom half will run in the softirq
+   daemon soon.  Safe to call from an interrupt handler.  Raising
+   a softirq that is already pending is a no-op, so a burst of
+   interrupts costs one bottom-half run. */
+void
+softirq_raise (int id)
+{
+  ASSERT (id >= 0 && id < (int) softirq_cnt);
+
+  spinlock_acquire (&pending_lock);
+  pending |= 1u << id;
+  spinlock_release (&pending_lock);
+  if (started)
+    sema_up (&pending_sema);
+}
+
+/* Softirq daemon.  Collects the pending bitmap with interrupts
+   off, then runs the raised bottom halves with interrupts on, so
+   their work -- however long -- never widens an interrupts-off
+   window.  Runs at PRI_MAX so that deferral adds scheduling
+   latency only ahead of other maximum-priority threads. */
+static void
+softirq_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      unsigned raised;
+      size_t i;
+
+      spinlock_acquire (&pending_lock);
+      raised = pending;
+      pending = 0;
+      spinlock_release (&pending_lock);
+
+      for (i = 0; i < softirq_cnt; i++)
+        if (raised & (1u << i))
+          softirqs[i].func (softirqs[i].aux);
+
+      sema_down (&pending_sema);
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef THREADS_SOFTIRQ_H
+#define THREADS_SOFTIRQ_H
+
+/* Deferred interrupt processing ("bottom halves").
+
+   An external interrupt handler runs with interrupts off, so
+   every cycle it spends extends the kernel's interrupts-off
+   window.  A handler with nontrivial completion work records
+   minimal state, raises its softirq, and returns; the work runs
+   soon afterward in a maximum-priority kernel thread with
+   interrupts enabled. */
+
+typedef void softirq_func (void *aux);
+
+void softirq_init (void);
+int softirq_register (softirq_func *, void *aux, const char *name);
+void softirq_raise (int id);
+
+#endif /* threads/softirq.h */
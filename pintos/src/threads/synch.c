@@ -29,8 +29,64 @@
 #include "threads/synch.h"
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#ifdef LOCKSTAT
+#include <inttypes.h>
+#endif
+
+#ifdef LOCKSTAT
+/* Lock statistics.
+
+   Named locks (see lock_set_name()) share a small static table
+   of statistics buckets, keyed by name, so that locks embedded
+   in structures that come and go -- inodes, for example -- can
+   be accounted without keeping pointers to freed memory.  All
+   counters are updated with interrupts off, inside the windows
+   the lock code already disables. */
+
+/* Maximum number of distinct lock names. */
+#define LOCK_STATS_MAX 32
+
+/* Statistics for all locks sharing one name. */
+struct lock_stats
+  {
+    const char *name;           /* Name passed to lock_set_name(). */
+    uint32_t acquire_cnt;       /* Total acquisitions. */
+    uint32_t contended_cnt;     /* Acquisitions that had to wait. */
+    int64_t wait_ticks;         /* Total ticks spent waiting. */
+    int64_t hold_ticks_max;     /* Longest single hold, in ticks. */
+  };
+
+static struct lock_stats lock_stats[LOCK_STATS_MAX];
+static size_t lock_stats_cnt;
+
+/* Returns the statistics bucket for NAME, creating it if
+   needed, or a null pointer if the table is full. */
+static struct lock_stats *
+lock_stats_for_name (const char *name)
+{
+  enum intr_level old_level = intr_disable ();
+  struct lock_stats *s = NULL;
+  size_t i;
+
+  for (i = 0; i < lock_stats_cnt; i++)
+    if (!strcmp (lock_stats[i].name, name))
+      {
+        s = &lock_stats[i];
+        break;
+      }
+  if (s == NULL && lock_stats_cnt < LOCK_STATS_MAX)
+    {
+      s = &lock_stats[lock_stats_cnt++];
+      s->name = name;
+    }
+  intr_set_level (old_level);
+
+  return s;
+}
+#endif /* LOCKSTAT */
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -48,6 +104,7 @@ sema_init (struct semaphore *sema, unsigned value)
 
   sema->value = value;
   list_init (&sema->waiters);
+  spinlock_init (&sema->lock);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -58,66 +115,148 @@ sema_init (struct semaphore *sema, unsigned value)
    interrupts disabled, but if it sleeps then the next scheduled
    thread will probably turn interrupts back on. */
 void
-sema_down (struct semaphore *sema) 
+sema_down (struct semaphore *sema)
 {
   enum intr_level old_level;
 
   ASSERT (sema != NULL);
   ASSERT (!intr_context ());
 
+  /* Interrupts are disabled around the whole operation so that,
+     on this uniprocessor, dropping the spinlock to block cannot
+     lose a wakeup: nothing runs between the release and
+     thread_block().  On a multiprocessor that window is the
+     classic lost-wakeup race, and blocking will have to hand the
+     lock to the scheduler to close it. */
   old_level = intr_disable ();
-  while (sema->value == 0) 
+  spinlock_acquire (&sema->lock);
+  while (sema->value == 0)
     {
       list_push_back (&sema->waiters, &thread_current ()->elem);
+      spinlock_release (&sema->lock);
       thread_block ();
+      spinlock_acquire (&sema->lock);
     }
   sema->value--;
+  spinlock_release (&sema->lock);
   intr_set_level (old_level);
 }
 
+/* Returns true if thread A has lower priority than thread B,
+   for picking the highest-priority semaphore waiter. */
+static bool
+sema_waiter_less (const struct list_elem *a, const struct list_elem *b,
+                  void *aux UNUSED)
+{
+  return list_entry (a, struct thread, elem)->priority
+    < list_entry (b, struct thread, elem)->priority;
+}
+
 /* Down or "P" operation on a semaphore, but only if the
    semaphore is not already 0.  Returns true if the semaphore is
    decremented, false otherwise.
 
    This function may be called from an interrupt handler. */
 bool
-sema_try_down (struct semaphore *sema) 
+sema_try_down (struct semaphore *sema)
 {
-  enum intr_level old_level;
   bool success;
 
   ASSERT (sema != NULL);
 
-  old_level = intr_disable ();
-  if (sema->value > 0) 
+  spinlock_acquire (&sema->lock);
+  if (sema->value > 0)
     {
       sema->value--;
-      success = true; 
+      success = true;
     }
   else
     success = false;
-  intr_set_level (old_level);
+  spinlock_release (&sema->lock);
 
   return success;
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any.  If the woken thread has higher priority than
+   the caller, yields to it.
 
    This function may be called from an interrupt handler. */
 void
-sema_up (struct semaphore *sema) 
+sema_up (struct semaphore *sema)
 {
-  enum intr_level old_level;
+  struct thread *woken = NULL;
 
   ASSERT (sema != NULL);
 
-  old_level = intr_disable ();
-  if (!list_empty (&sema->waiters)) 
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+  spinlock_acquire (&sema->lock);
+  if (!list_empty (&sema->waiters))
+    {
+      struct list_elem *max = list_max (&sema->waiters, sema_waiter_less,
+                                        NULL);
+      list_remove (max);
+      woken = list_entry (max, struct thread, elem);
+      thread_unblock (woken);
+    }
   sema->value++;
-  intr_set_level (old_level);
+  spinlock_release (&sema->lock);
+
+  /* Hand over the CPU if we just woke someone more important.
+     In an interrupt handler we cannot switch directly, so ask
+     for a yield on return instead.  The spinlock is no longer
+     held, so yielding here cannot make anyone spin on it. */
+  if (woken != NULL && woken->priority > thread_current ()->priority)
+    {
+      if (intr_context ())
+        intr_yield_on_return ();
+      else
+        thread_yield ();
+    }
+}
+
+/* Up or "V" operation on a semaphore, N times under a single
+   spinlock and interrupt window.  Increments SEMA's value by N
+   and wakes up to N waiting threads, highest priority first.  A
+   caller releasing a batch of waiters -- a barrier, a completion
+   fanning out to several sleepers -- pays one lock round trip
+   and at most one yield instead of one per waiter, and no woken
+   thread can preempt it halfway through the batch: the yield
+   decision is deferred until every waiter is runnable.
+
+   This function may be called from an interrupt handler. */
+void
+sema_up_n (struct semaphore *sema, unsigned n)
+{
+  int top_priority = PRI_MIN - 1;
+  unsigned i;
+
+  ASSERT (sema != NULL);
+
+  spinlock_acquire (&sema->lock);
+  for (i = 0; i < n && !list_empty (&sema->waiters); i++)
+    {
+      struct list_elem *max = list_max (&sema->waiters, sema_waiter_less,
+                                        NULL);
+      struct thread *woken = list_entry (max, struct thread, elem);
+
+      list_remove (max);
+      thread_unblock (woken);
+      if (woken->priority > top_priority)
+        top_priority = woken->priority;
+    }
+  sema->value += n;
+  spinlock_release (&sema->lock);
+
+  /* One handover decision for the whole batch, with the lock
+     dropped, and only if someone woken outranks us. */
+  if (top_priority > thread_current ()->priority)
+    {
+      if (intr_context ())
+        intr_yield_on_return ();
+      else
+        thread_yield ();
+    }
 }
 
 static void sema_test_helper (void *sema_);
@@ -178,13 +317,124 @@ lock_init (struct lock *lock)
   ASSERT (lock != NULL);
 
   lock->holder = NULL;
+  lock->max_priority = PRI_MIN;
+  lock->adaptive = false;
   sema_init (&lock->semaphore, 1);
+#ifdef LOCKSTAT
+  lock->stats = NULL;
+  lock->acquired_at = 0;
+#endif
 }
 
+/* Marks LOCK as adaptive, or not.  An adaptive lock resolves
+   brief contention by donating to the holder and yielding to it
+   for up to a couple of slices before falling back to blocking
+   through the semaphore, on the bet that the holder will release
+   within its next slice.  Worth setting on locks whose critical
+   sections are much shorter than a block/unblock round trip,
+   such as the buffer cache and allocator locks; pointless for
+   locks held across I/O. */
+void
+lock_set_adaptive (struct lock *lock, bool adaptive)
+{
+  lock->adaptive = adaptive;
+}
+
+/* Names LOCK for the "lockstat" statistics dump.  Locks sharing
+   a name share one statistics bucket.  A no-op unless LOCKSTAT
+   is defined. */
+void
+lock_set_name (struct lock *lock UNUSED, const char *name UNUSED)
+{
+#ifdef LOCKSTAT
+  lock->stats = lock_stats_for_name (name);
+#endif
+}
+
+/* Prints statistics for all named locks. */
+void
+lock_print_stats (void)
+{
+#ifdef LOCKSTAT
+  size_t i;
+
+  printf ("%-16s %10s %10s %11s %9s\n",
+          "Lock", "acquires", "contended", "wait ticks", "max hold");
+  for (i = 0; i < lock_stats_cnt; i++)
+    {
+      const struct lock_stats *s = &lock_stats[i];
+
+      printf ("%-16s %10"PRIu32" %10"PRIu32" %11"PRId64" %9"PRId64"\n",
+              s->name, s->acquire_cnt, s->contended_cnt,
+              s->wait_ticks, s->hold_ticks_max);
+    }
+#else
+  printf ("Lock statistics not compiled in; define LOCKSTAT.\n");
+#endif
+}
+
+/* Returns the highest priority among the threads still waiting
+   for LOCK, or PRI_MIN if none are.  Interrupts must be off. */
+static int
+lock_waiters_max_priority (struct lock *lock)
+{
+  struct list *waiters = &lock->semaphore.waiters;
+  struct list_elem *e;
+  int max = PRI_MIN;
+
+  for (e = list_begin (waiters); e != list_end (waiters); e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, elem);
+      if (t->priority > max)
+        max = t->priority;
+    }
+
+  return max;
+}
+
+/* Donates the current thread's priority to LOCK's holder -- and
+   transitively to whatever the holder is itself blocked on --
+   and records the current thread as waiting on LOCK.  Each step
+   down the chain raises a holder to our priority and records the
+   donation on the lock that holder is blocked on, if any.
+   Interrupts must be off. */
+static void
+donate_to_holder (struct lock *lock)
+{
+  struct thread *cur = thread_current ();
+  struct lock *l = lock;
+  struct thread *holder = lock->holder;
+
+  cur->waiting_lock = lock;
+  if (cur->priority > l->max_priority)
+    l->max_priority = cur->priority;
+
+  while (holder != NULL && holder->priority < cur->priority)
+    {
+      thread_update_priority (holder, cur->priority);
+      l = holder->waiting_lock;
+      if (l == NULL)
+        break;
+      if (cur->priority > l->max_priority)
+        l->max_priority = cur->priority;
+      holder = l->holder;
+    }
+}
+
+/* Yield-to-holder rounds an adaptive lock attempts before
+   blocking. */
+#define LOCK_ADAPTIVE_TRIES 2
+
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
 
+   If the lock is held by a lower-priority thread, the caller
+   donates its priority to the holder -- and transitively to
+   whatever the holder is itself blocked on -- so that a
+   high-priority thread is never stalled behind a medium-priority
+   one that preempts the lock holder.
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -192,12 +442,75 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+#ifdef LOCKSTAT
+  bool contended;
+  int64_t wait_start = 0;
+#endif
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+
+#ifdef LOCKSTAT
+  contended = lock->holder != NULL;
+  if (lock->stats != NULL && contended)
+    wait_start = timer_ticks ();
+#endif
+
+  /* Adaptive path: resolve brief contention without a full
+     block/unblock round trip.  On a uniprocessor the holder
+     cannot be running while we are, so spinning on the lock
+     would only keep the holder off the CPU; the useful
+     equivalent is to donate our priority to the holder and
+     yield to it for a slice, then try again.  When the holder
+     releases within that slice -- the common case for short
+     critical sections -- we take the semaphore below without
+     ever joining its waiter list.  Skipped under mlfqs, where
+     there is no donation to make the holder run first. */
+  if (lock->adaptive && !thread_mlfqs)
+    {
+      int i;
+
+      for (i = 0; i < LOCK_ADAPTIVE_TRIES && lock->holder != NULL; i++)
+        {
+          donate_to_holder (lock);
+          intr_set_level (old_level);
+          thread_yield ();
+          old_level = intr_disable ();
+        }
+    }
+
+  if (!thread_mlfqs && lock->holder != NULL)
+    donate_to_holder (lock);
+
   sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+
+  cur->waiting_lock = NULL;
+  lock->holder = cur;
+  if (!thread_mlfqs)
+    {
+      list_push_back (&cur->locks_held, &lock->elem);
+      lock->max_priority = lock_waiters_max_priority (lock);
+    }
+
+#ifdef LOCKSTAT
+  if (lock->stats != NULL)
+    {
+      lock->acquired_at = timer_ticks ();
+      lock->stats->acquire_cnt++;
+      if (contended)
+        {
+          lock->stats->contended_cnt++;
+          lock->stats->wait_ticks += lock->acquired_at - wait_start;
+        }
+    }
+#endif
+
+  intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -216,23 +529,57 @@ lock_try_acquire (struct lock *lock)
 
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+      enum intr_level old_level = intr_disable ();
+      lock->holder = thread_current ();
+      if (!thread_mlfqs)
+        list_push_back (&thread_current ()->locks_held, &lock->elem);
+#ifdef LOCKSTAT
+      if (lock->stats != NULL)
+        {
+          lock->acquired_at = timer_ticks ();
+          lock->stats->acquire_cnt++;
+        }
+#endif
+      intr_set_level (old_level);
+    }
   return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
+   Any priority donated through LOCK is given back, which may
+   cause the caller to be preempted by the thread it wakes.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
    handler. */
 void
-lock_release (struct lock *lock) 
+lock_release (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+#ifdef LOCKSTAT
+  if (lock->stats != NULL)
+    {
+      int64_t held = timer_ticks () - lock->acquired_at;
+
+      if (held > lock->stats->hold_ticks_max)
+        lock->stats->hold_ticks_max = held;
+    }
+#endif
   lock->holder = NULL;
+  if (!thread_mlfqs)
+    {
+      list_remove (&lock->elem);
+      thread_update_priority (cur, thread_effective_priority (cur));
+    }
   sema_up (&lock->semaphore);
+  intr_set_level (old_level);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -247,12 +594,25 @@ lock_held_by_current_thread (const struct lock *lock)
 }
 
 /* One semaphore in a list. */
-struct semaphore_elem 
+struct semaphore_elem
   {
     struct list_elem elem;              /* List element. */
     struct semaphore semaphore;         /* This semaphore. */
   };
 
+/* A timed condition waiter: the ordinary waiter plus its
+   deadline on the timer wheel.  The expiry handler runs in the
+   timer interrupt, which is why the waiter lists below are
+   manipulated with interrupts off rather than relying on the
+   monitor lock alone. */
+struct cond_timed_waiter
+  {
+    struct semaphore_elem waiter;       /* Semaphore the waiter sleeps on. */
+    struct condition *cond;             /* Condition waited on. */
+    struct timeout timeout;             /* Deadline on the timer wheel. */
+    bool timed_out;                     /* Did the deadline fire first? */
+  };
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -285,54 +645,308 @@ cond_init (struct condition *cond)
    interrupts disabled, but interrupts will be turned back on if
    we need to sleep. */
 void
-cond_wait (struct condition *cond, struct lock *lock) 
+cond_wait (struct condition *cond, struct lock *lock)
 {
   struct semaphore_elem waiter;
+  enum intr_level old_level;
 
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
-  
+
   sema_init (&waiter.semaphore, 0);
+  old_level = intr_disable ();
   list_push_back (&cond->waiters, &waiter.elem);
+  intr_set_level (old_level);
   lock_release (lock);
   sema_down (&waiter.semaphore);
   lock_acquire (lock);
 }
 
+/* Fired by the timer wheel when a cond_timedwait() deadline
+   passes.  Runs in the timer interrupt: if the waiter is still
+   queued on the condition, it is taken off and released; if it
+   is gone, a signal got there first and there is nothing to
+   do. */
+static void
+cond_timeout_expired (void *w_)
+{
+  struct cond_timed_waiter *w = w_;
+  struct list_elem *e;
+
+  for (e = list_begin (&w->cond->waiters);
+       e != list_end (&w->cond->waiters); e = list_next (e))
+    if (e == &w->waiter.elem)
+      {
+        list_remove (e);
+        w->timed_out = true;
+        sema_up (&w->waiter.semaphore);
+        break;
+      }
+}
+
+/* As cond_wait(), but gives up after TICKS timer ticks.  Returns
+   true if the wait was ended by a signal, false if the deadline
+   passed first.  The deadline sits on the timer wheel next to
+   every other timeout, so there is no polling; and since the
+   monitor is Mesa style the caller must recheck the condition
+   either way -- the return value only says whether waiting any
+   longer is worthwhile. */
+bool
+cond_timedwait (struct condition *cond, struct lock *lock, int64_t ticks)
+{
+  struct cond_timed_waiter w;
+  enum intr_level old_level;
+
+  ASSERT (cond != NULL);
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (lock_held_by_current_thread (lock));
+
+  sema_init (&w.waiter.semaphore, 0);
+  w.cond = cond;
+  w.timed_out = false;
+
+  /* Queue on the condition and arm the deadline as one unit, so
+     the handler never sees the waiter half-registered. */
+  old_level = intr_disable ();
+  list_push_back (&cond->waiters, &w.waiter.elem);
+  timeout_set (&w.timeout, ticks, cond_timeout_expired, &w);
+  intr_set_level (old_level);
+
+  lock_release (lock);
+  sema_down (&w.waiter.semaphore);
+  timeout_cancel (&w.timeout);
+  lock_acquire (lock);
+  return !w.timed_out;
+}
+
+/* Returns true if the thread waiting on condition waiter A has
+   lower priority than the one waiting on B.  A waiter whose
+   thread has not yet blocked on its semaphore ranks lowest. */
+static bool
+cond_waiter_less (const struct list_elem *a, const struct list_elem *b,
+                  void *aux UNUSED)
+{
+  struct semaphore_elem *sa = list_entry (a, struct semaphore_elem, elem);
+  struct semaphore_elem *sb = list_entry (b, struct semaphore_elem, elem);
+  int pa = PRI_MIN - 1, pb = PRI_MIN - 1;
+
+  if (!list_empty (&sa->semaphore.waiters))
+    pa = list_entry (list_front (&sa->semaphore.waiters),
+                     struct thread, elem)->priority;
+  if (!list_empty (&sb->semaphore.waiters))
+    pb = list_entry (list_front (&sb->semaphore.waiters),
+                     struct thread, elem)->priority;
+
+  return pa < pb;
+}
+
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
-   LOCK must be held before calling this function.
+   this function signals the highest-priority one to wake up from
+   its wait.  LOCK must be held before calling this function.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to signal a condition variable within an
    interrupt handler. */
 void
-cond_signal (struct condition *cond, struct lock *lock UNUSED) 
+cond_signal (struct condition *cond, struct lock *lock UNUSED)
 {
+  enum intr_level old_level;
+
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
 
-  if (!list_empty (&cond->waiters)) 
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+  /* Interrupts off, not just the monitor lock: a timed waiter's
+     deadline handler also edits the list, from the timer
+     interrupt. */
+  old_level = intr_disable ();
+  if (!list_empty (&cond->waiters))
+    {
+      struct list_elem *max = list_max (&cond->waiters, cond_waiter_less,
+                                        NULL);
+      list_remove (max);
+      sema_up (&list_entry (max, struct semaphore_elem, elem)->semaphore);
+    }
+  intr_set_level (old_level);
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
    LOCK).  LOCK must be held before calling this function.
 
+   All waiters are unblocked within a single interrupt-off
+   window, highest priority first, rather than paying one
+   critical section -- and possibly one immediate preemption --
+   per waiter as repeated cond_signal() calls would.  The CPU is
+   handed over at most once, at the end, if some woken thread
+   outranks the caller.
+
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to signal a condition variable within an
    interrupt handler. */
 void
-cond_broadcast (struct condition *cond, struct lock *lock) 
+cond_broadcast (struct condition *cond, struct lock *lock UNUSED)
 {
+  enum intr_level old_level;
+  struct thread *cur = thread_current ();
+  bool yield = false;
+
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
 
+  old_level = intr_disable ();
   while (!list_empty (&cond->waiters))
-    cond_signal (cond, lock);
+    {
+      struct list_elem *max = list_max (&cond->waiters, cond_waiter_less,
+                                        NULL);
+      struct semaphore *sema;
+
+      list_remove (max);
+      sema = &list_entry (max, struct semaphore_elem, elem)->semaphore;
+
+      /* A waiter queues itself on COND before downing its
+         semaphore, so it may not have blocked yet; bumping the
+         value is then enough to keep it from blocking at all. */
+      if (!list_empty (&sema->waiters))
+        {
+          struct thread *t = list_entry (list_pop_front (&sema->waiters),
+                                         struct thread, elem);
+
+          thread_unblock (t);
+          if (t->priority > cur->priority)
+            yield = true;
+        }
+      sema->value++;
+    }
+
+  if (yield)
+    {
+      if (intr_context ())
+        intr_yield_on_return ();
+      else
+        thread_yield ();
+    }
+  intr_set_level (old_level);
+}
+
+/* Initializes RW as a new read-write lock.  A read-write lock
+   admits any number of simultaneous readers but only a single
+   writer, who also excludes all readers.  It is built from a
+   lock and a condition variable, so acquiring either side may
+   sleep and is subject to the same restrictions as
+   lock_acquire(). */
+void
+rwlock_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->lock);
+  cond_init (&rw->done);
+  rw->readers = 0;
+  rw->writers = 0;
+  rw->write_waiters = 0;
+}
+
+/* Acquires RW for reading.  Readers share the lock among
+   themselves but yield to waiting writers, so that a steady
+   stream of readers cannot starve a writer indefinitely. */
+void
+rwlock_acquire_read (struct rwlock *rw)
+{
+  lock_acquire (&rw->lock);
+  while (rw->writers > 0 || rw->write_waiters > 0)
+    cond_wait (&rw->done, &rw->lock);
+  rw->readers++;
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, held by the caller for reading. */
+void
+rwlock_release_read (struct rwlock *rw)
+{
+  lock_acquire (&rw->lock);
+  ASSERT (rw->readers > 0);
+  if (--rw->readers == 0)
+    cond_broadcast (&rw->done, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Acquires RW for writing, excluding all other readers and
+   writers. */
+void
+rwlock_acquire_write (struct rwlock *rw)
+{
+  lock_acquire (&rw->lock);
+  rw->write_waiters++;
+  while (rw->readers > 0 || rw->writers > 0)
+    cond_wait (&rw->done, &rw->lock);
+  rw->write_waiters--;
+  rw->writers = 1;
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, held by the caller for writing. */
+void
+rwlock_release_write (struct rwlock *rw)
+{
+  lock_acquire (&rw->lock);
+  ASSERT (rw->writers == 1);
+  rw->writers = 0;
+  cond_broadcast (&rw->done, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Initializes SPIN as a new spinlock. */
+void
+spinlock_init (struct spinlock *spin)
+{
+  ASSERT (spin != NULL);
+
+  spin->next = 0;
+  spin->owner = 0;
+}
+
+/* Acquires SPIN.  Interrupts are disabled first, so the holder
+   cannot be preempted inside the critical section and the lock
+   may be taken from an interrupt handler.  The lock is a ticket
+   lock: the atomic xadd ([IA32-v2b] "XADD") takes a ticket, and
+   the caller spins until the owner counter reaches it, so
+   contenders are served strictly first come, first served and
+   none can be starved.  The pause in the spin loop tells the
+   CPU it is a spin-wait, which saves power and, on
+   hyperthreaded parts, stops the spin from crowding out the
+   sibling doing real work ([IA32-v2b] "PAUSE").  On this
+   uniprocessor the loop never runs, so the uncontended cost is
+   one atomic operation on top of intr_disable(). */
+void
+spinlock_acquire (struct spinlock *spin)
+{
+  enum intr_level old_level = intr_disable ();
+  uint32_t ticket;
+
+  asm volatile ("lock xaddl %0, %1"
+                : "=r" (ticket), "+m" (spin->next)
+                : "0" (1)
+                : "memory");
+  while (*(volatile uint32_t *) &spin->owner != ticket)
+    asm volatile ("pause");
+  barrier ();
+  spin->old_level = old_level;
+}
+
+/* Releases SPIN, passing the lock to the longest-waiting
+   spinner, if any, and restores the interrupt state the holder
+   entered with. */
+void
+spinlock_release (struct spinlock *spin)
+{
+  enum intr_level old_level = spin->old_level;
+
+  ASSERT (spin->owner != spin->next);
+  barrier ();
+  spin->owner++;
+  intr_set_level (old_level);
 }
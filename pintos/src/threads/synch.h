@@ -3,44 +3,108 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+
+/* Spinlock.  Acquiring disables interrupts, so the holder
+   cannot be preempted and the lock may be taken from interrupt
+   context; a second CPU would spin, with pause, on the ticket
+   pair.  Tickets grant the lock in FIFO order, so no spinner can
+   be starved however contended the lock becomes.  On this
+   uniprocessor the spin never happens, so a spinlock costs the
+   same as the bare intr_disable() it replaces, but code written
+   against it keeps working when secondary CPUs boot.  Holders
+   must not sleep. */
+struct spinlock
+  {
+    uint32_t next;              /* Next ticket to hand out. */
+    uint32_t owner;             /* Ticket now holding the lock. */
+    enum intr_level old_level;  /* Interrupt state to restore. */
+  };
+
+void spinlock_init (struct spinlock *);
+void spinlock_acquire (struct spinlock *);
+void spinlock_release (struct spinlock *);
 
 /* A counting semaphore. */
-struct semaphore 
+struct semaphore
   {
     unsigned value;             /* Current value. */
     struct list waiters;        /* List of waiting threads. */
+    struct spinlock lock;       /* Protects value and waiters. */
   };
 
 void sema_init (struct semaphore *, unsigned value);
 void sema_down (struct semaphore *);
 bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
+void sema_up_n (struct semaphore *, unsigned n);
 void sema_self_test (void);
 
 /* Lock. */
-struct lock 
+struct lock
   {
-    struct thread *holder;      /* Thread holding lock (for debugging). */
+    struct thread *holder;      /* Thread holding lock. */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct list_elem elem;      /* Element in holder's locks_held list. */
+    int max_priority;           /* Highest priority among waiting threads,
+                                   donated to the holder. */
+    bool adaptive;              /* Resolve brief contention by yielding
+                                   to the holder before blocking?  See
+                                   lock_set_adaptive(). */
+#ifdef LOCKSTAT
+    struct lock_stats *stats;   /* Statistics bucket, or a null pointer
+                                   if the lock was never named. */
+    int64_t acquired_at;        /* Tick at which HOLDER acquired us. */
+#endif
   };
 
 void lock_init (struct lock *);
+void lock_set_adaptive (struct lock *, bool);
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
 
+/* Lock statistics, compiled in only when LOCKSTAT is defined
+   (see Make.config) so that the production fast path is
+   untouched.  lock_set_name() attaches a lock to a named
+   statistics bucket; the "lockstat" kernel action dumps all
+   buckets.  Both are no-ops without LOCKSTAT. */
+void lock_set_name (struct lock *, const char *);
+void lock_print_stats (void);
+
 /* Condition variable. */
-struct condition 
+struct condition
   {
     struct list waiters;        /* List of waiting threads. */
   };
 
 void cond_init (struct condition *);
 void cond_wait (struct condition *, struct lock *);
+bool cond_timedwait (struct condition *, struct lock *, int64_t ticks);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Read-write lock.  Any number of readers may hold it at once,
+   but writers are exclusive.  Writers are preferred: new readers
+   wait behind a waiting writer, so a steady stream of readers
+   cannot starve writers. */
+struct rwlock
+  {
+    struct lock lock;           /* Protects the fields below. */
+    struct condition done;      /* Signaled when a holder leaves. */
+    int readers;                /* Threads holding it for reading. */
+    int writers;                /* Threads holding it for writing (0 or 1). */
+    int write_waiters;          /* Writers waiting their turn. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
@@ -1,15 +1,21 @@
 #include "threads/thread.h"
+#include <counter.h>
 #include <debug.h>
+#include <fixed-point.h>
 #include <stddef.h>
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/flags.h"
+#include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
+#include "threads/pte.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #ifdef USERPROG
 #include "userprog/process.h"
@@ -20,9 +26,25 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Run queue.  One list of THREAD_READY processes per priority
+   level, plus a bitmap with bit P set exactly when
+   ready_queues[P] is non-empty.  Finding the highest-priority
+   runnable thread is then a bit scan, so enqueue and dispatch
+   are both O(1) no matter how many threads are runnable. */
+static struct list ready_queues[PRI_MAX + 1];
+static uint64_t ready_bitmap;
+
+/* EDF real-time class.  Ready real-time threads whose budget is
+   not exhausted wait here, ordered by deadline, and are
+   dispatched ahead of every priority level; ordinary threads
+   keep the existing policy underneath.  The list is expected to
+   hold at most a handful of threads, so the ordered insert is
+   cheap.  See thread_set_realtime(). */
+static struct list rt_ready_list;
+
+/* Number of threads in the run queue, maintained incrementally
+   so the load average can be computed without scanning. */
+static size_t ready_count;
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -34,9 +56,33 @@ static struct thread *idle_thread;
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
-/* Lock used by allocate_tid(). */
+/* Hash table mapping tid to struct thread, so that looking a
+   thread up by tid is O(1) instead of an interrupts-off walk of
+   all_list.  Guarded by tid_lock; not usable from interrupt
+   handlers.  The table cannot exist until malloc() works, so it
+   is built in thread_start() and backfilled from all_list; until
+   then tid_table_ready is false and threads are not indexed. */
+static struct hash tid_table;
+static bool tid_table_ready;
 static struct lock tid_lock;
 
+/* Cache of stack pages retired by dead threads, reused by
+   thread_create() so that short-lived workers do not pay a page
+   allocation and 4 kB memset per thread.  A reused page is not
+   re-zeroed: init_thread() clears the struct thread at its base
+   and alloc_frame() writes every word of the initial frames at
+   its top, and nothing reads the rest of a fresh stack.  The
+   node is stored in the free page itself, as in palloc.c's
+   free-page cache.  Accessed with interrupts off, since pages
+   are retired from thread_schedule_tail(). */
+#define STACK_CACHE_MAX 8
+struct stack_page
+  {
+    struct stack_page *next;    /* Next cached stack page. */
+  };
+static struct stack_page *stack_cache;
+static int stack_cache_cnt;
+
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame 
   {
@@ -46,12 +92,25 @@ struct kernel_thread_frame
   };
 
 /* Statistics. */
-static long long idle_ticks;    /* # of timer ticks spent idle. */
-static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
-static long long user_ticks;    /* # of timer ticks in user programs. */
-
-/* Scheduling. */
-#define TIME_SLICE 4            /* # of timer ticks to give each thread. */
+static struct counter idle_ticks;   /* # of timer ticks spent idle. */
+static struct counter kernel_ticks; /* # of timer ticks in kernel threads. */
+static struct counter user_ticks;   /* # of timer ticks in user programs. */
+
+/* Scheduling.  Rather than one fixed time slice for everybody,
+   the quantum depends on how the thread has been behaving: a
+   thread that has blocked recently -- the signature of
+   interactive work, which rarely survives even a short slice --
+   runs on the short quantum, so a compute burst in it cannot
+   hold the CPU long, while a thread with no recent blocking gets
+   the long quantum and is spared context switches it has no use
+   for.  Each block banks a point of interactivity, up to
+   SLICE_SCORE_MAX; each full slice consumed spends one, so a
+   thread that turns CPU-bound soon graduates to the long
+   quantum.  The boundary values are settable with the "-qs" and
+   "-ql" kernel options. */
+unsigned thread_slice_short = 2; /* Quantum after recent blocking. */
+unsigned thread_slice_long = 12; /* Quantum for CPU-bound threads. */
+#define SLICE_SCORE_MAX 8       /* Most interactivity a thread can bank. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
 /* If false (default), use round-robin scheduler.
@@ -59,8 +118,36 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* If true, each thread's stack page gets an unmapped guard page
+   below it, so that stack overflow faults immediately instead of
+   silently corrupting whatever sits in the page below, and each
+   stack is filled with a poison byte so that "ps" can report its
+   high-water mark.  Controlled by kernel command-line option
+   "-stackguard".  Costs a second page per thread and bypasses
+   the stack-page cache. */
+bool thread_stack_guard;
+
+/* Byte written over fresh stacks under -stackguard.  Distinct
+   from palloc's 0xcc free-page fill so that a page that skipped
+   the poisoning cannot masquerade as an untouched stack. */
+#define STACK_POISON 0xce
+
+/* System load average, an exponentially weighted moving average
+   of the number of runnable threads, in 17.14 fixed-point.
+   Updated once per second by the 4.4BSD scheduler. */
+static fixed_point load_avg;
+
 static void kernel_thread (thread_func *, void *aux);
 
+static void ready_queue_push (struct thread *);
+static struct thread *ready_queue_pop (void);
+static struct thread *rt_queue_pop (void);
+static void rt_refresh (struct thread *);
+static bool rt_active (const struct thread *);
+static bool rt_deadline_less (const struct list_elem *,
+                              const struct list_elem *, void *aux);
+static void mlfqs_update_priority (struct thread *);
+static void mlfqs_recalculate (void);
 static void idle (void *aux UNUSED);
 static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
@@ -70,6 +157,13 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static unsigned tid_hash (const struct hash_elem *, void *aux);
+static bool tid_less (const struct hash_elem *, const struct hash_elem *,
+                      void *aux);
+static void tid_table_insert (struct thread *);
+static void tid_table_remove (struct thread *);
+static void stack_guard_set (void *page, bool present);
+static size_t stack_high_water (struct thread *);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -87,10 +181,16 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  lock_set_name (&tid_lock, "tid_table");
+  for (i = PRI_MIN; i <= PRI_MAX; i++)
+    list_init (&ready_queues[i]);
+  ready_bitmap = 0;
+  list_init (&rt_ready_list);
   list_init (&all_list);
 
   /* Set up a thread structure for the running thread. */
@@ -103,10 +203,21 @@ thread_init (void)
 /* Starts preemptive thread scheduling by enabling interrupts.
    Also creates the idle thread. */
 void
-thread_start (void) 
+thread_start (void)
 {
-  /* Create the idle thread. */
   struct semaphore idle_started;
+  struct list_elem *e;
+
+  /* Build the tid lookup table, which could not exist before
+     malloc() came up, and index the threads created so far. */
+  if (!hash_init (&tid_table, tid_hash, tid_less, NULL))
+    PANIC ("Failed to allocate tid table");
+  tid_table_ready = true;
+  for (e = list_begin (&all_list); e != list_end (&all_list);
+       e = list_next (e))
+    tid_table_insert (list_entry (e, struct thread, allelem));
+
+  /* Create the idle thread. */
   sema_init (&idle_started, 0);
   thread_create ("idle", PRI_MIN, idle, &idle_started);
 
@@ -125,26 +236,200 @@ thread_tick (void)
   struct thread *t = thread_current ();
 
   /* Update statistics. */
+  t->cpu_ticks++;
   if (t == idle_thread)
-    idle_ticks++;
+    counter_inc (&idle_ticks);
 #ifdef USERPROG
   else if (t->pagedir != NULL)
-    user_ticks++;
+    {
+      counter_inc (&user_ticks);
+      /* Attribute the tick to the process as well, split by
+         whether it was spent in a system call, for wait2. */
+      if (t->in_syscall)
+        t->kernel_ticks++;
+      else
+        t->user_ticks++;
+    }
 #endif
   else
-    kernel_ticks++;
+    counter_inc (&kernel_ticks);
+
+  /* 4.4BSD scheduler bookkeeping.  The running thread's
+     recent_cpu rises every tick; once per second load_avg and
+     every thread's recent_cpu decay; every fourth tick the
+     running thread's priority is refreshed.  Other threads'
+     priorities only change when recent_cpu or nice do, so the
+     per-second pass is the only full scan. */
+  if (thread_mlfqs)
+    {
+      int64_t now = timer_ticks ();
+
+      if (t != idle_thread)
+        t->recent_cpu = fp_add_int (t->recent_cpu, 1);
+      if (now % TIMER_FREQ == 0)
+        mlfqs_recalculate ();
+      else if (now % 4 == 0 && t != idle_thread)
+        mlfqs_update_priority (t);
+    }
+
+  /* EDF budget enforcement.  The running real-time thread burns
+     one tick of budget; once the budget is gone it competes as
+     an ordinary thread at its base priority until its next
+     release, so a runaway real-time thread cannot starve the
+     box.  rt_refresh() replenishes the budget when the period
+     rolls over. */
+  if (t->rt_period > 0)
+    {
+      rt_refresh (t);
+      if (t->rt_runtime < t->rt_budget)
+        t->rt_runtime++;
+      else if (ready_bitmap != 0 || !list_empty (&rt_ready_list))
+        intr_yield_on_return ();
+    }
 
-  /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
-    intr_yield_on_return ();
+  /* Preempt in favor of a ready real-time thread with an earlier
+     deadline, or any ready real-time thread if the running
+     thread is not in the class (or has exhausted its budget). */
+  if (!list_empty (&rt_ready_list))
+    {
+      struct thread *first = list_entry (list_front (&rt_ready_list),
+                                         struct thread, elem);
+      if (!rt_active (t) || first->rt_deadline < t->rt_deadline)
+        intr_yield_on_return ();
+    }
+
+  /* Enforce preemption on the quantum the running thread's
+     recent behavior has earned it. */
+  if (++thread_ticks >= (t->slice_score > 0
+                         ? thread_slice_short : thread_slice_long))
+    {
+      if (t->slice_score > 0)
+        t->slice_score--;
+      intr_yield_on_return ();
+    }
+}
+
+/* Returns true if no thread other than the idle thread is
+   running or ready to run, so that the timer may stretch its
+   interval.  Interrupts must be off. */
+bool
+thread_idle_only (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  return thread_current () == idle_thread && ready_bitmap == 0
+    && list_empty (&rt_ready_list);
 }
 
 /* Prints thread statistics. */
 void
-thread_print_stats (void) 
+thread_print_stats (void)
 {
-  printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
-          idle_ticks, kernel_ticks, user_ticks);
+  printf ("Thread: %llu idle ticks, %llu kernel ticks, %llu user ticks\n",
+          (unsigned long long) counter_read (&idle_ticks),
+          (unsigned long long) counter_read (&kernel_ticks),
+          (unsigned long long) counter_read (&user_ticks));
+}
+
+/* Context switch benchmark: two threads ping-pong on a pair of
+   semaphores, so every round costs two block-based switches
+   through schedule().  The figure includes the semaphore and
+   scheduler path on top of switch_threads() itself -- the cost a
+   thread actually pays to sleep and be woken, which is the
+   number worth holding the line on. */
+#define SWITCH_BENCH_ROUNDS 10000
+
+struct switch_bench
+  {
+    struct semaphore ping;      /* Down'd by the partner. */
+    struct semaphore pong;      /* Down'd by the caller. */
+  };
+
+/* Partner thread for thread_switch_bench(). */
+static void
+switch_bench_partner (void *bench_)
+{
+  struct switch_bench *bench = bench_;
+  int i;
+
+  for (i = 0; i < SWITCH_BENCH_ROUNDS; i++)
+    {
+      sema_down (&bench->ping);
+      sema_up (&bench->pong);
+    }
+}
+
+/* Measures the round-trip cost of a pair of context switches and
+   prints the per-switch figure in cycles and nanoseconds. */
+void
+thread_switch_bench (void)
+{
+  struct switch_bench bench;
+  uint64_t start, cycles;
+  int64_t ns;
+  int i;
+
+  sema_init (&bench.ping, 0);
+  sema_init (&bench.pong, 0);
+  thread_create ("switchbench", PRI_DEFAULT, switch_bench_partner, &bench);
+
+  start = timer_cycles ();
+  for (i = 0; i < SWITCH_BENCH_ROUNDS; i++)
+    {
+      sema_up (&bench.ping);
+      sema_down (&bench.pong);
+    }
+  cycles = timer_cycles () - start;
+
+  cycles /= SWITCH_BENCH_ROUNDS * 2;
+  ns = timer_cycles_to_ns (cycles);
+  printf ("Switch: %llu cycles/switch (%lld ns), over %d round trips\n",
+          (unsigned long long) cycles, (long long) ns, SWITCH_BENCH_ROUNDS);
+}
+
+/* Prints one row of the thread accounting table. */
+static void
+print_thread_row (struct thread *t, void *aux UNUSED)
+{
+  static const char *status_names[] =
+    {
+      [THREAD_RUNNING] = "RUNNING",
+      [THREAD_READY] = "READY",
+      [THREAD_BLOCKED] = "BLOCKED",
+      [THREAD_DYING] = "DYING",
+    };
+
+  printf ("%3d %-16s %-8s %3d %10lld %10lld %10lld",
+          t->tid, t->name, status_names[t->status], t->priority,
+          t->cpu_ticks, t->sched_cnt, t->wait_ticks);
+  if (thread_stack_guard)
+    {
+      /* The initial thread's stack was set up by the loader and
+         never poisoned, so its depth is unknown. */
+      if (t != initial_thread)
+        printf (" %6zu", stack_high_water (t));
+      else
+        printf (" %6s", "-");
+    }
+  printf ("\n");
+}
+
+/* Prints a table of every thread's CPU accounting: ticks spent
+   running, times scheduled, and total ticks spent waiting in the
+   ready queue. */
+void
+thread_print_all (void)
+{
+  enum intr_level old_level;
+
+  printf ("%3s %-16s %-8s %3s %10s %10s %10s",
+          "tid", "name", "status", "pri", "cpu", "sched", "wait");
+  if (thread_stack_guard)
+    printf (" %6s", "stack");
+  printf ("\n");
+  old_level = intr_disable ();
+  thread_foreach (print_thread_row, NULL);
+  intr_set_level (old_level);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -170,18 +455,63 @@ thread_create (const char *name, int priority,
   struct kernel_thread_frame *kf;
   struct switch_entry_frame *ef;
   struct switch_threads_frame *sf;
+  enum intr_level old_level;
   tid_t tid;
 
   ASSERT (function != NULL);
 
-  /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
-  if (t == NULL)
-    return TID_ERROR;
+  /* Allocate thread, preferring a cached stack page from a dead
+     thread; see the comment on stack_cache.  No PAL_ZERO even on
+     the fallback: init_thread() and alloc_frame() initialize
+     every byte that will be read. */
+  if (thread_stack_guard)
+    {
+      /* Guarded stack: two pages, the lower one unmapped so that
+         overflow faults instead of corrupting the page below,
+         the upper one poisoned so "ps" can report how deep the
+         stack has grown.  Bypasses the stack cache, whose pages
+         have neither guard nor poison. */
+      uint8_t *pages = palloc_get_multiple (0, 2);
+
+      if (pages == NULL)
+        return TID_ERROR;
+      stack_guard_set (pages, false);
+      t = (struct thread *) (pages + PGSIZE);
+      memset ((uint8_t *) t + sizeof *t, STACK_POISON,
+              PGSIZE - sizeof *t);
+    }
+  else
+    {
+      old_level = intr_disable ();
+      if (stack_cache != NULL)
+        {
+          t = (struct thread *) stack_cache;
+          stack_cache = stack_cache->next;
+          stack_cache_cnt--;
+        }
+      else
+        t = NULL;
+      intr_set_level (old_level);
+      if (t == NULL)
+        t = palloc_get_page (0);
+      if (t == NULL)
+        return TID_ERROR;
+    }
 
   /* Initialize thread. */
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
+  tid_table_insert (t);
+
+  /* Under the 4.4BSD scheduler, a new thread inherits its
+     parent's nice and recent_cpu values and gets a computed
+     priority rather than the one passed in. */
+  if (thread_mlfqs)
+    {
+      t->nice = thread_current ()->nice;
+      t->recent_cpu = thread_current ()->recent_cpu;
+      mlfqs_update_priority (t);
+    }
 
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
@@ -201,6 +531,10 @@ thread_create (const char *name, int priority,
   /* Add to run queue. */
   thread_unblock (t);
 
+  /* The new thread may deserve the CPU more than we do. */
+  if (t->priority > thread_get_priority ())
+    thread_yield ();
+
   return tid;
 }
 
@@ -213,10 +547,17 @@ thread_create (const char *name, int priority,
 void
 thread_block (void) 
 {
+  struct thread *t = thread_current ();
+
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
 
-  thread_current ()->status = THREAD_BLOCKED;
+  /* Giving up the CPU voluntarily is what marks a thread
+     interactive; bank a point toward the short quantum. */
+  if (t->slice_score < SLICE_SCORE_MAX)
+    t->slice_score++;
+
+  t->status = THREAD_BLOCKED;
   schedule ();
 }
 
@@ -237,7 +578,7 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  ready_queue_push (t);
   t->status = THREAD_READY;
   intr_set_level (old_level);
 }
@@ -270,11 +611,33 @@ thread_current (void)
 
 /* Returns the running thread's tid. */
 tid_t
-thread_tid (void) 
+thread_tid (void)
 {
   return thread_current ()->tid;
 }
 
+/* Returns the thread with the given TID, or a null pointer if no
+   such thread currently exists.  The returned thread is only
+   safe to use for as long as the caller can ensure it does not
+   exit -- for example, because it is a child this thread has yet
+   to wait for.  Not for use from interrupt handlers. */
+struct thread *
+thread_by_tid (tid_t tid)
+{
+  struct thread key, *t;
+  struct hash_elem *e;
+
+  ASSERT (!intr_context ());
+  ASSERT (tid_table_ready);
+
+  key.tid = tid;
+  lock_acquire (&tid_lock);
+  e = hash_find (&tid_table, &key.tid_elem);
+  t = e != NULL ? hash_entry (e, struct thread, tid_elem) : NULL;
+  lock_release (&tid_lock);
+  return t;
+}
+
 /* Deschedules the current thread and destroys it.  Never
    returns to the caller. */
 void
@@ -286,6 +649,12 @@ thread_exit (void)
   process_exit ();
 #endif
 
+  /* Give cached malloc blocks back before we can no longer run. */
+  malloc_thread_exit ();
+
+  /* Stop being findable by tid. */
+  tid_table_remove (thread_current ());
+
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
@@ -307,8 +676,8 @@ thread_yield (void)
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
-  if (cur != idle_thread) 
-    list_push_back (&ready_list, &cur->elem);
+  if (cur != idle_thread)
+    ready_queue_push (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
@@ -331,49 +700,164 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's base priority to NEW_PRIORITY.  Its
+   effective priority may stay higher if other threads have
+   donated to it through locks it holds.  Yields if the thread no
+   longer has the highest priority.  A no-op under the 4.4BSD
+   scheduler, which controls priorities itself. */
 void
-thread_set_priority (int new_priority) 
+thread_set_priority (int new_priority)
 {
-  thread_current ()->priority = new_priority;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  bool lost_cpu;
+
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
+  cur->base_priority = new_priority;
+  thread_update_priority (cur, thread_effective_priority (cur));
+  lost_cpu = ready_bitmap >> cur->priority > 1;
+  intr_set_level (old_level);
+
+  if (lost_cpu)
+    thread_yield ();
 }
 
-/* Returns the current thread's priority. */
+/* Returns the current thread's effective priority. */
 int
-thread_get_priority (void) 
+thread_get_priority (void)
 {
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets T's effective priority to NEW_PRIORITY, moving it to the
+   run queue for its new level if it is ready.  Interrupts must
+   be off if T may be in the run queue. */
+void
+thread_update_priority (struct thread *t, int new_priority)
+{
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  if (new_priority == t->priority)
+    return;
+
+  if (t->status == THREAD_READY && t->rt_queued)
+    {
+      /* The EDF ready list is ordered by deadline, so a priority
+         change need not reposition the thread. */
+      t->priority = new_priority;
+      return;
+    }
+
+  if (t->status == THREAD_READY)
+    {
+      ASSERT (intr_get_level () == INTR_OFF);
+      list_remove (&t->elem);
+      if (list_empty (&ready_queues[t->priority]))
+        ready_bitmap &= ~((uint64_t) 1 << t->priority);
+      t->priority = new_priority;
+      list_push_back (&ready_queues[new_priority], &t->elem);
+      ready_bitmap |= (uint64_t) 1 << new_priority;
+    }
+  else
+    t->priority = new_priority;
+}
+
+/* Returns T's effective priority: its base priority, boosted by
+   the highest priority donated through any lock it holds. */
+int
+thread_effective_priority (struct thread *t)
+{
+  struct list_elem *e;
+  int priority = t->base_priority;
+
+  for (e = list_begin (&t->locks_held); e != list_end (&t->locks_held);
+       e = list_next (e))
+    {
+      const struct lock *l = list_entry (e, struct lock, elem);
+      if (l->max_priority > priority)
+        priority = l->max_priority;
+    }
+
+  return priority;
+}
+
+/* Puts the current thread in the EDF real-time class: every
+   PERIOD ticks it is released with a fresh deadline one period
+   out and a CPU allowance of BUDGET ticks.  While it has budget
+   it is dispatched ahead of every ordinary thread, earliest
+   deadline first; once the budget is exhausted it runs under the
+   ordinary policy until its next release, so it cannot starve
+   the rest of the system.  BUDGET must be positive and no larger
+   than PERIOD.  A PERIOD of zero (with zero BUDGET) returns the
+   thread to the ordinary policy. */
+void
+thread_set_realtime (int64_t period, int64_t budget)
+{
+  struct thread *t = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (period >= 0);
+  ASSERT (period == 0 ? budget == 0 : budget > 0 && budget <= period);
+
+  old_level = intr_disable ();
+  t->rt_period = period;
+  t->rt_budget = budget;
+  t->rt_runtime = 0;
+  t->rt_deadline = timer_ticks () + period;
+  intr_set_level (old_level);
+}
+
+/* Sets the current thread's nice value to NICE and updates its
+   priority accordingly.  If the thread no longer has the highest
+   priority, yields. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice)
 {
-  /* Not yet implemented. */
+  struct thread *t = thread_current ();
+  enum intr_level old_level;
+  bool lost_cpu;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  t->nice = nice;
+  mlfqs_update_priority (t);
+  lost_cpu = ready_bitmap >> t->priority > 1;
+  intr_set_level (old_level);
+
+  if (lost_cpu)
+    thread_yield ();
 }
 
 /* Returns the current thread's nice value. */
 int
-thread_get_nice (void) 
+thread_get_nice (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
-thread_get_load_avg (void) 
+thread_get_load_avg (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load_avg_100 = fp_to_int_round (fp_mul_int (load_avg, 100));
+  intr_set_level (old_level);
+  return load_avg_100;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
-thread_get_recent_cpu (void) 
+thread_get_recent_cpu (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent_cpu_100
+    = fp_to_int_round (fp_mul_int (thread_current ()->recent_cpu, 100));
+  intr_set_level (old_level);
+  return recent_cpu_100;
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -462,6 +946,25 @@ init_thread (struct thread *t, const char *name, int priority)
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
   t->priority = priority;
+  t->base_priority = priority;
+  list_init (&t->locks_held);
+#ifdef USERPROG
+  t->exit_code = -1;
+  t->cwd = NULL;
+  t->fd_table = NULL;
+  t->stdout_buf = NULL;
+  t->stdout_len = 0;
+  t->my_status = NULL;
+  list_init (&t->children);
+  list_init (&t->shm_list);
+#ifdef VM
+  t->pages = NULL;
+  t->exec_file = NULL;
+  list_init (&t->mappings);
+  t->next_mapid = 1;
+  t->user_esp = NULL;
+#endif
+#endif
   t->magic = THREAD_MAGIC;
 
   old_level = intr_disable ();
@@ -482,18 +985,188 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
+/* Adds T to the run queue: the deadline-ordered EDF list if T is
+   a real-time thread with budget left, otherwise the queue for
+   its priority, marking that level non-empty in the bitmap.
+   Interrupts must be off. */
+static void
+ready_queue_push (struct thread *t)
+{
+  ASSERT (PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+  rt_refresh (t);
+  if (rt_active (t))
+    {
+      list_insert_ordered (&rt_ready_list, &t->elem, rt_deadline_less, NULL);
+      t->rt_queued = true;
+    }
+  else
+    {
+      t->rt_queued = false;
+      list_push_back (&ready_queues[t->priority], &t->elem);
+      ready_bitmap |= (uint64_t) 1 << t->priority;
+    }
+  ready_count++;
+  t->ready_since = timer_ticks ();
+}
+
+/* Removes and returns the highest-priority thread in the run
+   queue, which must not be empty.  Interrupts must be off. */
+static struct thread *
+ready_queue_pop (void)
+{
+  uint32_t high = ready_bitmap >> 32;
+  uint32_t low = ready_bitmap;
+  int priority;
+  struct list *queue;
+  struct thread *t;
+
+  ASSERT (ready_bitmap != 0);
+
+  /* Bit scan for the highest non-empty priority level, one word
+     at a time since we target 32-bit x86. */
+  if (high != 0)
+    priority = 63 - __builtin_clz (high);
+  else
+    priority = 31 - __builtin_clz (low);
+
+  queue = &ready_queues[priority];
+  t = list_entry (list_pop_front (queue), struct thread, elem);
+  if (list_empty (queue))
+    ready_bitmap &= ~((uint64_t) 1 << priority);
+  ready_count--;
+  t->sched_cnt++;
+  t->wait_ticks += timer_ticks () - t->ready_since;
+  return t;
+}
+
+/* Removes and returns the earliest-deadline thread on the EDF
+   ready list, which must not be empty.  Interrupts must be
+   off. */
+static struct thread *
+rt_queue_pop (void)
+{
+  struct thread *t = list_entry (list_pop_front (&rt_ready_list),
+                                 struct thread, elem);
+
+  t->rt_queued = false;
+  ready_count--;
+  t->sched_cnt++;
+  t->wait_ticks += timer_ticks () - t->ready_since;
+  return t;
+}
+
+/* Rolls T's real-time period forward if its deadline has passed,
+   replenishing the budget and advancing the deadline by whole
+   periods.  No-op for ordinary threads. */
+static void
+rt_refresh (struct thread *t)
+{
+  int64_t now;
+
+  if (t->rt_period == 0)
+    return;
+  now = timer_ticks ();
+  while (now >= t->rt_deadline)
+    {
+      t->rt_deadline += t->rt_period;
+      t->rt_runtime = 0;
+    }
+}
+
+/* Returns true if T is a real-time thread that still has budget
+   this period, so that it belongs in the EDF class rather than
+   the ordinary run queue. */
+static bool
+rt_active (const struct thread *t)
+{
+  return t->rt_period > 0 && t->rt_runtime < t->rt_budget;
+}
+
+/* Returns true if thread A's deadline is earlier than B's, for
+   ordering rt_ready_list. */
+static bool
+rt_deadline_less (const struct list_elem *a, const struct list_elem *b,
+                  void *aux UNUSED)
+{
+  return (list_entry (a, struct thread, elem)->rt_deadline
+          < list_entry (b, struct thread, elem)->rt_deadline);
+}
+
+/* Recomputes T's 4.4BSD scheduler priority:
+
+     priority = PRI_MAX - recent_cpu / 4 - nice * 2,
+
+   clamped to the valid range.  If T is in the run queue and its
+   priority changed, moves it to the queue for its new level.
+   Interrupts must be off if T may be in the run queue. */
+static void
+mlfqs_update_priority (struct thread *t)
+{
+  int priority;
+
+  if (t == idle_thread)
+    return;
+
+  priority = PRI_MAX - fp_to_int_round (fp_div_int (t->recent_cpu, 4))
+    - t->nice * 2;
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+
+  thread_update_priority (t, priority);
+}
+
+/* Once-per-second 4.4BSD scheduler pass: updates load_avg, then
+   decays every thread's recent_cpu and refreshes its priority.
+   Called from the timer interrupt. */
+static void
+mlfqs_recalculate (void)
+{
+  struct list_elem *e;
+  size_t ready_threads;
+  fixed_point coeff;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* load_avg = (59/60) * load_avg + (1/60) * ready_threads,
+     where ready_threads counts the running thread too. */
+  ready_threads = ready_count + (thread_current () != idle_thread);
+  load_avg = fp_add (fp_div_int (fp_mul_int (load_avg, 59), 60),
+                     fp_div_int (fp_from_int (ready_threads), 60));
+
+  /* recent_cpu = (2 * load_avg)/(2 * load_avg + 1) * recent_cpu
+                  + nice.
+     The coefficient is the same for every thread, so hoist it
+     out of the loop. */
+  coeff = fp_div (fp_mul_int (load_avg, 2),
+                  fp_add_int (fp_mul_int (load_avg, 2), 1));
+  for (e = list_begin (&all_list); e != list_end (&all_list);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, allelem);
+      if (t == idle_thread)
+        continue;
+      t->recent_cpu = fp_add_int (fp_mul (coeff, t->recent_cpu), t->nice);
+      mlfqs_update_priority (t);
+    }
+}
+
 /* Chooses and returns the next thread to be scheduled.  Should
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
    will be in the run queue.)  If the run queue is empty, return
    idle_thread. */
 static struct thread *
-next_thread_to_run (void) 
+next_thread_to_run (void)
 {
-  if (list_empty (&ready_list))
+  if (!list_empty (&rt_ready_list))
+    return rt_queue_pop ();
+  else if (ready_bitmap == 0)
     return idle_thread;
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    return ready_queue_pop ();
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -535,10 +1208,30 @@ thread_schedule_tail (struct thread *prev)
      pull out the rug under itself.  (We don't free
      initial_thread because its memory was not obtained via
      palloc().) */
-  if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
+  if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread)
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      if (thread_stack_guard)
+        {
+          /* Remap the guard page before palloc writes its debug
+             fill over the freed pages. */
+          uint8_t *pages = (uint8_t *) prev - PGSIZE;
+
+          stack_guard_set (pages, true);
+          palloc_free_multiple (pages, 2);
+        }
+      else if (stack_cache_cnt < STACK_CACHE_MAX)
+        {
+          /* Keep the page for the next thread_create() instead of
+             a round trip through the page allocator. */
+          struct stack_page *sp = (struct stack_page *) prev;
+
+          sp->next = stack_cache;
+          stack_cache = sp;
+          stack_cache_cnt++;
+        }
+      else
+        palloc_free_page (prev);
     }
 }
 
@@ -561,24 +1254,127 @@ schedule (void)
   ASSERT (is_thread (next));
 
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      TRACE (TRACE_SCHED, next->tid);
+      prev = switch_threads (cur, next);
+    }
   thread_schedule_tail (prev);
 }
 
-/* Returns a tid to use for a new thread. */
+/* Returns the hash of the thread containing E, keyed by tid. */
+static unsigned
+tid_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct thread, tid_elem)->tid);
+}
+
+/* Orders threads A and B by tid. */
+static bool
+tid_less (const struct hash_elem *a, const struct hash_elem *b,
+          void *aux UNUSED)
+{
+  return (hash_entry (a, struct thread, tid_elem)->tid
+          < hash_entry (b, struct thread, tid_elem)->tid);
+}
+
+/* Makes T findable through thread_by_tid().  No-op before the
+   tid table exists; thread_start() backfills such threads. */
+static void
+tid_table_insert (struct thread *t)
+{
+  if (tid_table_ready)
+    {
+      lock_acquire (&tid_lock);
+      hash_insert (&tid_table, &t->tid_elem);
+      lock_release (&tid_lock);
+    }
+}
+
+/* Removes T from the tid table. */
+static void
+tid_table_remove (struct thread *t)
+{
+  if (tid_table_ready)
+    {
+      lock_acquire (&tid_lock);
+      hash_delete (&tid_table, &t->tid_elem);
+      lock_release (&tid_lock);
+    }
+}
+
+/* Returns a tid to use for a new thread.  A brief interrupts-off
+   window stands in for an atomic increment on this uniprocessor,
+   so no lock is taken on the thread-creation path. */
 static tid_t
-allocate_tid (void) 
+allocate_tid (void)
 {
   static tid_t next_tid = 1;
+  enum intr_level old_level;
   tid_t tid;
 
-  lock_acquire (&tid_lock);
+  old_level = intr_disable ();
   tid = next_tid++;
-  lock_release (&tid_lock);
+  intr_set_level (old_level);
 
   return tid;
 }
 
+/* Maps or unmaps stack guard page PAGE in the kernel address
+   space.  The kernel page tables are shared by every page
+   directory, so patching the one in init_page_dir suffices; the
+   frame address stays in the entry so the page can be remapped
+   later.  Used only under -stackguard. */
+static void
+stack_guard_set (void *page, bool present)
+{
+  uint32_t *pt = pde_get_pt (init_page_dir[pd_no (page)]);
+  uint32_t *pte = &pt[pt_no (page)];
+
+  if (present)
+    *pte |= PTE_P;
+  else
+    *pte &= ~(uint32_t) PTE_P;
+  asm volatile ("invlpg %0" : : "m" (*(char *) page) : "memory");
+}
+
+/* Returns the deepest extent, in bytes, that T's kernel stack
+   has reached, measured by how much of the poison fill laid down
+   at creation has been overwritten.  Meaningful only under
+   -stackguard, and only for threads created by
+   thread_create(). */
+static size_t
+stack_high_water (struct thread *t)
+{
+  uint8_t *p = (uint8_t *) t + sizeof *t;
+  uint8_t *end = (uint8_t *) t + PGSIZE;
+
+  while (p < end && *p == STACK_POISON)
+    p++;
+  return end - p;
+}
+
 /* Offset of `stack' member within `struct thread'.
    Used by switch.S, which can't figure it out on its own. */
 uint32_t thread_stack_ofs = offsetof (struct thread, stack);
+
+/* Verifies at compile time that MEMBER of struct thread lies
+   entirely within the struct's first cache line, so the hot
+   section declared at the top of struct thread stays hot when
+   members are added.  The array size goes negative, and the
+   build breaks, if the member has drifted past the line. */
+#define CACHE_LINE_SIZE 64
+#define ASSERT_HOT_MEMBER(MEMBER)                                \
+        extern char thread_##MEMBER##_is_hot                     \
+          [__builtin_offsetof (struct thread, MEMBER)            \
+             + sizeof ((struct thread *) 0)->MEMBER              \
+             <= CACHE_LINE_SIZE ? 1 : -1]
+ASSERT_HOT_MEMBER (status);
+ASSERT_HOT_MEMBER (stack);
+ASSERT_HOT_MEMBER (priority);
+ASSERT_HOT_MEMBER (elem);
+ASSERT_HOT_MEMBER (tid);
+ASSERT_HOT_MEMBER (base_priority);
+ASSERT_HOT_MEMBER (nice);
+ASSERT_HOT_MEMBER (recent_cpu);
+ASSERT_HOT_MEMBER (waiting_lock);
+ASSERT_HOT_MEMBER (locks_held);
@@ -2,8 +2,13 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
 #include <stdint.h>
+#include "threads/malloc.h"
+#ifdef VM
+#include "userprog/exception.h"
+#endif
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -24,6 +29,11 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread niceness, used by the 4.4BSD scheduler (-mlfqs). */
+#define NICE_MIN -20                    /* Most generous. */
+#define NICE_DEFAULT 0                  /* Neutral. */
+#define NICE_MAX 20                     /* Most selfish. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -82,20 +92,122 @@ typedef int tid_t;
    blocked state is on a semaphore wait list. */
 struct thread
   {
+    /* Scheduler-hot members, kept together so that the pointer
+       chasing in thread_unblock(), next_thread_to_run(), and
+       schedule() touches one cache line per thread instead of
+       several.  Their placement within the first 64 bytes is
+       asserted at compile time in thread.c. */
+
     /* Owned by thread.c. */
-    tid_t tid;                          /* Thread identifier. */
     enum thread_status status;          /* Thread state. */
-    char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
-    struct list_elem allelem;           /* List element for all threads list. */
+    int priority;                       /* Effective priority. */
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
 
+    /* Owned by thread.c. */
+    tid_t tid;                          /* Thread identifier. */
+    int base_priority;                  /* Priority before donation. */
+    int nice;                           /* Niceness (4.4BSD scheduler). */
+    int recent_cpu;                     /* Recent CPU use, 17.14 fixed-point. */
+
+    /* Shared between thread.c and synch.c for priority donation. */
+    struct lock *waiting_lock;          /* Lock this thread is blocked on,
+                                           or a null pointer. */
+    struct list locks_held;             /* Locks this thread holds. */
+
+    /* Cold members: debugging identity, statistics, and
+       subsystem state touched off the scheduling fast path. */
+
+    /* Owned by thread.c. */
+    char name[16];                      /* Name (for debugging purposes). */
+    struct list_elem allelem;           /* List element for all threads list. */
+
+    /* Per-thread accounting, printed by the "ps" action. */
+    int64_t cpu_ticks;                  /* Timer ticks spent running. */
+    int64_t sched_cnt;                  /* Times taken off the run queue. */
+    int64_t wait_ticks;                 /* Total ticks spent ready, waiting
+                                           for the CPU. */
+    int64_t ready_since;                /* Tick at which we last became
+                                           ready. */
+    unsigned slice_score;               /* Banked interactivity: blocking
+                                           raises it, running through a
+                                           full time slice spends it.
+                                           Nonzero selects the short
+                                           quantum. */
+
+    /* Owned by thread.c: the EDF real-time class.  See
+       thread_set_realtime(). */
+    int64_t rt_period;                  /* Release period in ticks, or 0
+                                           for an ordinary thread. */
+    int64_t rt_budget;                  /* CPU budget per period, in ticks. */
+    int64_t rt_deadline;                /* Current absolute deadline. */
+    int64_t rt_runtime;                 /* Ticks consumed this period. */
+    bool rt_queued;                     /* On the EDF ready list rather
+                                           than a priority queue? */
+
+    /* Owned by lib/kernel/fast-random.c. */
+    uint64_t fast_rand;                 /* xorshift64* state, 0 until the
+                                           first random_ulong_fast(). */
+
+    /* Owned by thread.c. */
+    struct hash_elem tid_elem;          /* Element in tid lookup table. */
+
+    /* Owned by threads/malloc.c. */
+    void *malloc_cache[MALLOC_CACHE_CLASSES];   /* Cached free blocks,
+                                                   chained per size class. */
+    uint8_t malloc_cache_cnt[MALLOC_CACHE_CLASSES]; /* Blocks per chain. */
+
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
+    int exit_code;                      /* Status passed to exit(). */
+    struct child_status *my_status;     /* Shared with parent, if any. */
+    struct list children;               /* Status records of children. */
+    struct dir *cwd;                    /* Working directory, or null
+                                           for the root. */
+
+    /* Owned by userprog/syscall.c. */
+    struct fd_table *fd_table;          /* Open files, created lazily. */
+    char *stdout_buf;                   /* Console staging buffer,
+                                           created lazily. */
+    size_t stdout_len;                  /* Bytes staged in stdout_buf. */
+
+    /* Resource accounting, reported to the parent by wait2.
+       thread_tick() splits this thread's ticks by in_syscall;
+       the syscall and fault handlers feed the rest. */
+    bool in_syscall;                    /* Executing a system call? */
+    long long user_ticks;               /* Ticks running user code. */
+    long long kernel_ticks;             /* Ticks in system calls. */
+    long long page_fault_cnt;           /* Page faults taken. */
+    long long read_bytes;               /* Bytes read via syscalls. */
+    long long write_bytes;              /* Bytes written via syscalls. */
+
+    /* Owned by userprog/shm.c. */
+    struct list shm_list;               /* Attached shared segments. */
+
+#ifdef VM
+    /* Owned by vm/page.c. */
+    struct tree *pages;                 /* Supplemental page table. */
+    struct file *exec_file;             /* Executable, held open. */
+
+    /* Owned by userprog/syscall.c. */
+    struct list mappings;               /* Memory-mapped files. */
+    int next_mapid;                     /* Next mapping id to hand out. */
+    void *user_esp;                     /* User stack pointer saved at
+                                           system call entry, for the
+                                           stack growth heuristic. */
+
+    /* Owned by userprog/exception.c. */
+    long long fault_cnt[FAULT_CLASS_CNT];   /* Faults resolved, by class. */
+    uint64_t fault_cycles[FAULT_CLASS_CNT]; /* TSC cycles spent resolving
+                                               them, by class. */
+
+    /* Owned by vm/frame.c. */
+    int resident_pages;                 /* Pages holding a frame now. */
+    int peak_pages;                     /* Most pages resident at once. */
+#endif
 #endif
 
     /* Owned by thread.c. */
@@ -107,11 +219,26 @@ struct thread
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* If true, thread stacks get an unmapped guard page below them
+   and a poison fill for high-water-mark reporting.  Controlled
+   by kernel command-line option "-stackguard". */
+extern bool thread_stack_guard;
+
+/* Preemption quanta in timer ticks: the short one for threads
+   that have blocked recently, the long one for CPU-bound
+   threads.  Controlled by kernel command-line options "-qs" and
+   "-ql". */
+extern unsigned thread_slice_short;
+extern unsigned thread_slice_long;
+
 void thread_init (void);
 void thread_start (void);
 
 void thread_tick (void);
+bool thread_idle_only (void);
 void thread_print_stats (void);
+void thread_print_all (void);
+void thread_switch_bench (void);
 
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
@@ -120,6 +247,7 @@ void thread_block (void);
 void thread_unblock (struct thread *);
 
 struct thread *thread_current (void);
+struct thread *thread_by_tid (tid_t);
 tid_t thread_tid (void);
 const char *thread_name (void);
 
@@ -132,6 +260,10 @@ void thread_foreach (thread_action_func *, void *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_update_priority (struct thread *, int new_priority);
+int thread_effective_priority (struct thread *);
+
+void thread_set_realtime (int64_t period, int64_t budget);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
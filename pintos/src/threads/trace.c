@@ -0,0 +1,97 @@
+#include "threads/trace.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/thread.h"
+
+#ifdef TRACING
+
+/* Ring capacity in records.  Must be a power of two.  4096
+   records of 16 bytes is 64 kB of BSS, enough to hold tens of
+   milliseconds of dense activity. */
+#define TRACE_BUF 4096
+
+/* One trace record.  The tid is truncated to 16 bits to keep the
+   record at 16 bytes; a system that has created 65536 threads is
+   past caring about the ambiguity in a debugging aid. */
+struct trace_rec
+  {
+    uint64_t tsc;               /* Cycle counter at the event. */
+    uint32_t arg;               /* Event argument; see trace.h. */
+    uint16_t event;             /* enum trace_event. */
+    uint16_t tid;               /* Thread recording the event. */
+  };
+
+static struct trace_rec trace_buf[TRACE_BUF];
+
+/* Next slot, free-running; the record count so far. */
+static volatile uint32_t trace_head;
+
+/* Event names, indexed by enum trace_event. */
+static const char *trace_names[TRACE_EVENT_CNT] =
+  {
+    "sched", "intr", "intr-ret", "blk-read", "blk-write",
+    "sys-enter", "sys-exit",
+  };
+
+/* Appends an EVENT record carrying ARG to the ring.
+
+   Tracepoints fire from thread and interrupt context alike, so
+   the slot is claimed with a single fetch-and-add, which an
+   interrupt cannot split.  An interrupt landing between the
+   claim and the stores below could in principle lap the ring and
+   reuse the slot, tearing one record; that takes TRACE_BUF
+   events inside one interrupt and is not worth a lock on this
+   path. */
+void
+trace_record (enum trace_event event, uint32_t arg)
+{
+  uint32_t slot = 1;
+  struct trace_rec *r;
+
+  asm volatile ("xaddl %0, %1" : "+r" (slot), "+m" (trace_head));
+  r = &trace_buf[slot & (TRACE_BUF - 1)];
+  r->tsc = timer_cycles ();
+  r->arg = arg;
+  r->event = event;
+  r->tid = thread_tid ();
+}
+
+/* Decodes and prints the ring, oldest surviving record first,
+   with each record's cycle distance from the one before it.  The
+   gaps are the point: a latency spike shows up as one huge delta
+   between two otherwise ordinary events. */
+void
+trace_dump (void)
+{
+  uint32_t head = trace_head;
+  uint32_t cnt = head < TRACE_BUF ? head : TRACE_BUF;
+  uint64_t prev_tsc = 0;
+  uint32_t i;
+
+  printf ("Trace: %"PRIu32" events recorded, newest %"PRIu32":\n", head, cnt);
+  printf ("       cycles      +delta event     arg        tid\n");
+  for (i = 0; i < cnt; i++)
+    {
+      struct trace_rec *r = &trace_buf[(head - cnt + i) & (TRACE_BUF - 1)];
+      const char *name = r->event < TRACE_EVENT_CNT
+                         ? trace_names[r->event] : "?";
+
+      printf ("%13llu %11llu %-9s %-10"PRIu32" %"PRIu16"\n",
+              (unsigned long long) r->tsc,
+              (unsigned long long) (i > 0 ? r->tsc - prev_tsc : 0),
+              name, r->arg, r->tid);
+      prev_tsc = r->tsc;
+    }
+}
+
+#else /* !TRACING */
+
+/* Tells a user who asked for a trace dump why there is none. */
+void
+trace_dump (void)
+{
+  printf ("Tracepoints not compiled in; define TRACING.\n");
+}
+
+#endif /* !TRACING */
@@ -0,0 +1,43 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdint.h>
+
+/* Latency tracepoints.
+
+   printf() is far too slow to put inside schedule() or an
+   interrupt handler: the serial output perturbs the very timing
+   being investigated.  A tracepoint instead appends a (TSC,
+   event, argument, tid) record to a static ring buffer in a few
+   instructions; the "trace" kernel action decodes the ring
+   afterwards, when the timing no longer matters.  The ring keeps
+   the newest records, so the buffer always covers the moments
+   leading up to whatever latency spike is under investigation.
+
+   Tracepoints are compiled in only when TRACING is defined (see
+   DEFINES in Make.config); without it the TRACE() macro expands
+   to nothing and the kernel is bit-for-bit unaffected. */
+
+/* Traced events.  The argument recorded with each is noted. */
+enum trace_event
+  {
+    TRACE_SCHED,                /* Context switch; the incoming tid. */
+    TRACE_INTR,                 /* Interrupt entry; the vector. */
+    TRACE_INTR_RET,             /* Interrupt exit; the vector. */
+    TRACE_BLOCK_READ,           /* Block read issued; the sector. */
+    TRACE_BLOCK_WRITE,          /* Block write issued; the sector. */
+    TRACE_SYS_ENTER,            /* System call entry; the number. */
+    TRACE_SYS_EXIT,             /* System call exit; the number. */
+    TRACE_EVENT_CNT
+  };
+
+#ifdef TRACING
+void trace_record (enum trace_event, uint32_t arg);
+#define TRACE(event, arg) trace_record ((event), (uint32_t) (arg))
+#else
+#define TRACE(event, arg) ((void) 0)
+#endif
+
+void trace_dump (void);
+
+#endif /* threads/trace.h */
@@ -0,0 +1,162 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+
+/* Worker threads in the pool.  Two let one long item (a cache
+   walk, say) overlap a stream of short ones without devoting a
+   stack to every background job in the kernel. */
+#define WORKER_CNT 2
+
+/* Pending items.  Workers take the highest-priority one first.
+   A spinlock rather than a sleeping lock, so that items can be
+   submitted from interrupt context -- in particular by the timer
+   wheel callback that fires delayed submissions. */
+static struct list pending;
+static struct spinlock pending_lock;
+
+/* Counts pending items; workers sleep here. */
+static struct semaphore pending_sema;
+
+/* Statistics, guarded by pending_lock. */
+static long long submitted;     /* Items submitted. */
+static long long completed;     /* Items run to completion. */
+static size_t depth;            /* Items pending now. */
+static size_t max_depth;        /* Most items ever pending at once. */
+static int64_t total_wait_ns;   /* Summed submit-to-dispatch latency. */
+static int64_t max_wait_ns;     /* Worst submit-to-dispatch latency. */
+
+static thread_func worker;
+
+/* Initializes the workqueue and starts the worker pool. */
+void
+workqueue_init (void)
+{
+  int i;
+
+  list_init (&pending);
+  spinlock_init (&pending_lock);
+  sema_init (&pending_sema, 0);
+  for (i = 0; i < WORKER_CNT; i++)
+    thread_create ("worker", PRI_MIN, worker, NULL);
+}
+
+/* Queues ITEM and wakes a worker.  Safe in any context. */
+static void
+enqueue (struct work *item)
+{
+  spinlock_acquire (&pending_lock);
+  item->submit_ns = timer_now_ns ();
+  list_push_back (&pending, &item->elem);
+  submitted++;
+  if (++depth > max_depth)
+    max_depth = depth;
+  spinlock_release (&pending_lock);
+  sema_up (&pending_sema);
+}
+
+/* Submits ITEM to run FUNC with argument AUX on a worker at
+   PRIORITY.  ITEM must stay valid until FUNC runs; FUNC itself
+   may free or resubmit it. */
+void
+workqueue_submit (struct work *item, thread_func *func, void *aux,
+                  int priority)
+{
+  ASSERT (item != NULL && func != NULL);
+  ASSERT (priority >= PRI_MIN && priority <= PRI_MAX);
+
+  item->func = func;
+  item->aux = aux;
+  item->priority = priority;
+  enqueue (item);
+}
+
+/* Timer wheel callback: the delay has elapsed, queue the item
+   for real.  Runs in interrupt context under the wheel lock, so
+   it only pushes and wakes; it touches no timeouts. */
+static void
+delay_elapsed (void *item_)
+{
+  enqueue (item_);
+}
+
+/* Like workqueue_submit(), but the item becomes pending only
+   after DELAY_TICKS timer ticks, via the timer wheel.  A
+   periodic job resubmits itself this way from its own
+   function. */
+void
+workqueue_submit_delayed (struct work *item, thread_func *func, void *aux,
+                          int priority, int64_t delay_ticks)
+{
+  ASSERT (item != NULL && func != NULL);
+  ASSERT (priority >= PRI_MIN && priority <= PRI_MAX);
+
+  item->func = func;
+  item->aux = aux;
+  item->priority = priority;
+  timeout_set (&item->timeout, delay_ticks, delay_elapsed, item);
+}
+
+/* Returns true if work A has lower priority than work B. */
+static bool
+work_less (const struct list_elem *a, const struct list_elem *b,
+           void *aux UNUSED)
+{
+  return list_entry (a, struct work, elem)->priority
+    < list_entry (b, struct work, elem)->priority;
+}
+
+/* Worker thread: runs pending items forever, most important
+   first, at the submitter's chosen priority. */
+static void
+worker (void *aux_ UNUSED)
+{
+  for (;;)
+    {
+      struct work *item;
+      thread_func *func;
+      void *aux;
+      int priority;
+      int64_t wait_ns;
+
+      sema_down (&pending_sema);
+
+      spinlock_acquire (&pending_lock);
+      item = list_entry (list_max (&pending, work_less, NULL),
+                         struct work, elem);
+      list_remove (&item->elem);
+      depth--;
+      wait_ns = timer_now_ns () - item->submit_ns;
+      total_wait_ns += wait_ns;
+      if (wait_ns > max_wait_ns)
+        max_wait_ns = wait_ns;
+      /* FUNC may free or resubmit the item, so take what we need
+         before running it. */
+      func = item->func;
+      aux = item->aux;
+      priority = item->priority;
+      spinlock_release (&pending_lock);
+
+      thread_set_priority (priority);
+      func (aux);
+
+      thread_set_priority (PRI_MIN);
+      spinlock_acquire (&pending_lock);
+      completed++;
+      spinlock_release (&pending_lock);
+    }
+}
+
+/* Prints queue depth and latency statistics, for the "wqstat"
+   action. */
+void
+workqueue_print_stats (void)
+{
+  printf ("Workqueue: %lld submitted, %lld completed, "
+          "depth %zu (max %zu)\n",
+          submitted, completed, depth, max_depth);
+  if (completed > 0)
+    printf ("Queue latency: %lld us average, %lld us worst\n",
+            total_wait_ns / completed / 1000, max_wait_ns / 1000);
+}
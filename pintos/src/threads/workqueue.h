@@ -0,0 +1,45 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+/* Shared worker pool for kernel background tasks.
+
+   Every background job given a dedicated daemon thread costs a
+   4 kB stack and a scheduler entry even while idle.  The
+   workqueue runs submitted items on a small fixed pool of
+   workers instead: a caller embeds a struct work in its own
+   structure, fills in a function and auxiliary argument -- the
+   same signature thread_create() takes -- and submits it, either
+   immediately or after a delay on the timer wheel.  Workers run
+   the highest-priority pending item first and adopt its priority
+   while running it.
+
+   An item may be resubmitted from inside its own function, which
+   is how a periodic job reschedules itself, but must not be
+   submitted again while still queued.  Submission is safe in
+   interrupt context; the items themselves run in thread context
+   and may sleep. */
+
+#include <stdint.h>
+#include <list.h>
+#include "devices/timer.h"
+#include "threads/thread.h"
+
+/* A unit of background work. */
+struct work
+  {
+    struct list_elem elem;      /* Element in the pending list. */
+    thread_func *func;          /* Function to run. */
+    void *aux;                  /* Argument to FUNC. */
+    int priority;               /* Priority the worker adopts. */
+    int64_t submit_ns;          /* Submission time, for the stats. */
+    struct timeout timeout;     /* Timer wheel entry for delayed items. */
+  };
+
+void workqueue_init (void);
+void workqueue_submit (struct work *, thread_func *, void *aux,
+                       int priority);
+void workqueue_submit_delayed (struct work *, thread_func *, void *aux,
+                               int priority, int64_t delay_ticks);
+void workqueue_print_stats (void);
+
+#endif /* threads/workqueue.h */
@@ -4,6 +4,13 @@
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "devices/timer.h"
+#include "threads/thread.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -67,6 +74,38 @@ exception_print_stats (void)
   printf ("Exception: %lld page faults\n", page_fault_cnt);
 }
 
+#ifdef VM
+/* Charges the current process for one fault of class CLASS whose
+   handling began at TSC reading START. */
+static void
+record_fault (enum fault_class class, uint64_t start)
+{
+  struct thread *t = thread_current ();
+
+  t->fault_cnt[class]++;
+  t->fault_cycles[class] += timer_cycles () - start;
+}
+
+/* Prints the current process's page fault counters, one line per
+   class that actually occurred, next to its exit message.  A
+   workload dominated by lazy and stack faults is cold-starting;
+   one dominated by swap-ins is thrashing. */
+void
+exception_print_fault_stats (void)
+{
+  static const char *class_names[FAULT_CLASS_CNT] =
+    {"lazy", "swap-in", "stack", "cow", "mmap"};
+  struct thread *t = thread_current ();
+  int class;
+
+  for (class = 0; class < FAULT_CLASS_CNT; class++)
+    if (t->fault_cnt[class] > 0)
+      printf ("%s: %lld %s faults, %lld cycles each on average\n",
+              t->name, t->fault_cnt[class], class_names[class],
+              (long long) (t->fault_cycles[class] / t->fault_cnt[class]));
+}
+#endif
+
 /* Handler for an exception (probably) caused by a user process. */
 static void
 kill (struct intr_frame *f) 
@@ -114,7 +153,7 @@ kill (struct intr_frame *f)
 
    At entry, the address that faulted is in CR2 (Control Register
    2) and information about the fault, formatted as described in
-   the PF_* macros in exception.h, is in F's error_code member.  The
+   the PFE_* macros in exception.h, is in F's error_code member.  The
    example code here shows how to parse that information.  You
    can find more information about both of these in the
    description of "Interrupt 14--Page Fault Exception (#PF)" in
@@ -140,13 +179,81 @@ page_fault (struct intr_frame *f)
      be assured of reading CR2 before it changed). */
   intr_enable ();
 
-  /* Count page faults. */
+  /* Count page faults, globally and against the process. */
   page_fault_cnt++;
+  thread_current ()->page_fault_cnt++;
 
   /* Determine cause. */
-  not_present = (f->error_code & PF_P) == 0;
-  write = (f->error_code & PF_W) != 0;
-  user = (f->error_code & PF_U) != 0;
+  not_present = (f->error_code & PFE_P) == 0;
+  write = (f->error_code & PFE_W) != 0;
+  user = (f->error_code & PFE_U) != 0;
+
+#ifdef VM
+  uint64_t start = timer_cycles ();
+
+  if (not_present && fault_addr != NULL && is_user_vaddr (fault_addr))
+    {
+      /* Stack growth heuristic.  A fault just below the stack
+         pointer is taken as the stack growing: PUSH faults 4
+         bytes below ESP and PUSHA 32 bytes below, so anything at
+         ESP - 32 or above within STACK_MAX of PHYS_BASE gets a
+         fresh zeroed page.  For a fault taken in the kernel, the
+         user ESP comes from the value saved at system call
+         entry, since F holds the kernel stack pointer then. */
+      uint8_t *esp = user ? f->esp : thread_current ()->user_esp;
+
+      if (esp != NULL && (uint8_t *) fault_addr >= esp - 32
+          && (uint8_t *) PHYS_BASE - (uint8_t *) pg_round_down (fault_addr)
+             <= STACK_MAX)
+        page_allocate (pg_round_down (fault_addr), true);
+
+      /* A not-present fault on a user address may just mean the
+         page has not been brought in yet; ask the supplemental
+         page table before treating it as an error.  This covers
+         kernel accesses to not-yet-loaded user pages during
+         system calls too.  The page's backing store, inspected
+         before page_in() consumes it, tells the fault classes
+         apart. */
+      struct page *p = page_lookup (fault_addr);
+      enum fault_class class;
+
+      if (p == NULL || p->swap_slot != SWAP_NONE)
+        class = FAULT_SWAP;
+      else if (p->file == NULL)
+        class = FAULT_STACK;
+      else if (p->private)
+        class = FAULT_LAZY;
+      else
+        class = FAULT_MMAP;
+      if (page_in (fault_addr, write))
+        {
+          record_fault (class, start);
+          return;
+        }
+    }
+
+  /* A write to a present but read-only page may be a
+     copy-on-write share from fork: give the page a private copy
+     and retry the write. */
+  if (!not_present && write && fault_addr != NULL
+      && is_user_vaddr (fault_addr) && page_unshare (fault_addr))
+    {
+      record_fault (FAULT_COW, start);
+      return;
+    }
+#endif
+
+  /* A fault in kernel context means the kernel touched user
+     memory through get_user() or put_user() in syscall.c.  Those
+     helpers put the address of their fault handler in EAX before
+     the access; resume there with EAX set to -1 to signal the
+     failure. */
+  if (!user)
+    {
+      f->eip = (void (*) (void)) f->eax;
+      f->eax = 0xffffffff;
+      return;
+    }
 
   /* To implement virtual memory, delete the rest of the function
      body, and replace it with code that brings in the page to
@@ -1,12 +1,33 @@
 #ifndef USERPROG_EXCEPTION_H
 #define USERPROG_EXCEPTION_H
 
-/* Page fault error code bits that describe the cause of the exception.  */
-#define PF_P 0x1    /* 0: not-present page. 1: access rights violation. */
-#define PF_W 0x2    /* 0: read, 1: write. */
-#define PF_U 0x4    /* 0: kernel, 1: user process. */
+/* Page fault error code bits that describe the cause of the
+   exception.  Named PFE_* rather than PF_* so they cannot be
+   confused with the ELF segment flags in process.c. */
+#define PFE_P 0x1   /* 0: not-present page. 1: access rights violation. */
+#define PFE_W 0x2   /* 0: read, 1: write. */
+#define PFE_U 0x4   /* 0: kernel, 1: user process. */
+
+#ifdef VM
+/* Classes of page fault the handler can resolve, for the
+   per-process counters in struct thread.  Telling the classes
+   apart is what distinguishes a workload that is cold-starting
+   (lazy loads) from one that is thrashing (swap-ins). */
+enum fault_class
+  {
+    FAULT_LAZY,                 /* First touch of an executable page. */
+    FAULT_SWAP,                 /* Page brought back from swap. */
+    FAULT_STACK,                /* Stack growth or fresh zero page. */
+    FAULT_COW,                  /* Copy-on-write private copy. */
+    FAULT_MMAP,                 /* First touch of a memory-mapped page. */
+    FAULT_CLASS_CNT
+  };
+#endif
 
 void exception_init (void);
 void exception_print_stats (void);
+#ifdef VM
+void exception_print_fault_stats (void);
+#endif
 
 #endif /* userprog/exception.h */
@@ -1,5 +1,6 @@
 #include "userprog/gdt.h"
 #include <debug.h>
+#include <stdbool.h>
 #include "userprog/tss.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -30,6 +31,42 @@ static uint64_t make_data_desc (int dpl);
 static uint64_t make_tss_desc (void *laddr);
 static uint64_t make_gdtr_operand (uint16_t limit, void *base);
 
+/* Model-specific registers controlling sysenter/sysexit.  See
+   [IA32-v2b] under SYSENTER. */
+#define MSR_SYSENTER_CS  0x174  /* Ring 0 code segment. */
+#define MSR_SYSENTER_ESP 0x175  /* Ring 0 stack pointer. */
+#define MSR_SYSENTER_EIP 0x176  /* Ring 0 entry point. */
+
+/* Fast system call entry point, in sysenter.S. */
+void sysenter_entry (void);
+
+/* True once gdt_init() has found sysenter support and programmed
+   the MSRs. */
+static bool sysenter_usable;
+
+/* Writes VALUE to model-specific register MSR. */
+static void
+wrmsr (uint32_t msr, uint64_t value)
+{
+  asm volatile ("wrmsr"
+                : : "c" (msr), "a" ((uint32_t) value),
+                    "d" ((uint32_t) (value >> 32)));
+}
+
+/* Returns true if the CPU implements sysenter/sysexit, as
+   advertised by the SEP bit in CPUID leaf 1. */
+static bool
+cpu_has_sysenter (void)
+{
+  uint32_t eax, ebx, ecx, edx;
+
+  asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "0" (0));
+  if (eax < 1)
+    return false;
+  asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "0" (1));
+  return (edx & (1 << 11)) != 0;
+}
+
 /* Sets up a proper GDT.  The bootstrap loader's GDT didn't
    include user-mode selectors or a TSS, but we need both now. */
 void
@@ -37,7 +74,11 @@ gdt_init (void)
 {
   uint64_t gdtr_operand;
 
-  /* Initialize GDT. */
+  /* Initialize GDT.  Note that sysenter and sysexit fix the
+     segment layout: the ring 0 data, ring 3 code, and ring 3
+     data selectors must follow the ring 0 code selector at 8,
+     16, and 24 bytes respectively, which the arrangement below
+     satisfies. */
   gdt[SEL_NULL / sizeof *gdt] = 0;
   gdt[SEL_KCSEG / sizeof *gdt] = make_code_desc (0);
   gdt[SEL_KDSEG / sizeof *gdt] = make_data_desc (0);
@@ -51,6 +92,29 @@ gdt_init (void)
   gdtr_operand = make_gdtr_operand (sizeof gdt - 1, gdt);
   asm volatile ("lgdt %0" : : "m" (gdtr_operand));
   asm volatile ("ltr %w0" : : "q" (SEL_TSS));
+
+  /* Open the sysenter fast path if the CPU has one.  The user
+     syscall stubs check the same CPUID bit, so they use it
+     exactly when it has been set up here.  The stack pointer MSR
+     tracks the running thread's kernel stack, updated alongside
+     the TSS's esp0 in tss_update(). */
+  if (cpu_has_sysenter ())
+    {
+      wrmsr (MSR_SYSENTER_CS, SEL_KCSEG);
+      wrmsr (MSR_SYSENTER_EIP, (uintptr_t) sysenter_entry);
+      sysenter_usable = true;
+      tss_update ();
+    }
+}
+
+/* Points the sysenter stack pointer MSR at ESP0, the running
+   thread's kernel stack top.  No-op before gdt_init() or on a
+   CPU without sysenter. */
+void
+gdt_set_sysenter_esp (void *esp0)
+{
+  if (sysenter_usable)
+    wrmsr (MSR_SYSENTER_ESP, (uintptr_t) esp0);
 }
 
 /* System segment or code/data segment? */
@@ -10,6 +10,9 @@
 #define SEL_TSS         0x28    /* Task-state segment. */
 #define SEL_CNT         6       /* Number of segments. */
 
+#ifndef __ASSEMBLER__
 void gdt_init (void);
+void gdt_set_sysenter_esp (void *esp0);
+#endif
 
 #endif /* userprog/gdt.h */
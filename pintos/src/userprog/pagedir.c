@@ -1,13 +1,54 @@
 #include "userprog/pagedir.h"
+#include <list.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/malloc.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
 
 static uint32_t *active_pd (void);
-static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *upage);
+
+/* Deferred page directory teardown.  Freeing every frame of a
+   large address space takes long enough that doing it inline in
+   process_exit() shows up in exit-to-wait latency, so dead page
+   directories are queued here and a reaper daemon frees their
+   frames in the background, yielding between page tables.  The
+   list is protected by dead_lock; dead_nonempty is signaled when
+   a directory is queued. */
+struct dead_pd
+  {
+    uint32_t *pd;               /* The unhooked page directory. */
+    struct list_elem elem;      /* Element in dead_pds. */
+  };
+static struct list dead_pds = LIST_INITIALIZER (dead_pds);
+static struct lock dead_lock;
+static struct condition dead_nonempty;
+static bool reaper_started;
+
+static thread_func pagedir_reaper;
+
+/* Batched TLB invalidation.  Between pagedir_begin_updates() and
+   pagedir_end_updates(), single pages are still invalidated with
+   invlpg, but once a batch has touched enough pages that one
+   full flush is cheaper than the per-page invalidations, the
+   remaining ones are skipped and a single CR3 reload is done at
+   the end of the outermost batch.  There is no concurrency issue
+   in keeping this state global: only the active page directory's
+   entries are ever in the TLB, and an update batch does not
+   survive a switch to a different page directory, which flushes
+   everything anyway.  (A switch between threads sharing one page
+   directory may skip the flush, but then the deferred
+   invalidations still cover the right TLB and are performed at
+   the outermost pagedir_end_updates().) */
+#define UPDATE_FLUSH_THRESHOLD 32
+static int update_depth;        /* Nesting depth of update batches. */
+static size_t update_cnt;       /* Pages invalidated in this batch. */
+static bool update_flush_all;   /* Threshold crossed; flush at end. */
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -22,17 +63,15 @@ pagedir_create (void)
   return pd;
 }
 
-/* Destroys page directory PD, freeing all the pages it
-   references. */
-void
-pagedir_destroy (uint32_t *pd) 
+/* Frees every page PD references, then PD itself.  With YIELD
+   set, offers the CPU to other threads after each page table, so
+   the reaper does not monopolize a processor while it walks a
+   big address space. */
+static void
+reap_pagedir (uint32_t *pd, bool yield)
 {
   uint32_t *pde;
 
-  if (pd == NULL)
-    return;
-
-  ASSERT (pd != init_page_dir);
   for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
     if (*pde & PTE_P) 
       {
@@ -43,10 +82,72 @@ pagedir_destroy (uint32_t *pd)
           if (*pte & PTE_P) 
             palloc_free_page (pte_get_page (*pte));
         palloc_free_page (pt);
+        if (yield)
+          thread_yield ();
       }
   palloc_free_page (pd);
 }
 
+/* Teardown daemon.  Pulls dead page directories off the queue
+   and frees their pages. */
+static void
+pagedir_reaper (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct dead_pd *dead;
+
+      lock_acquire (&dead_lock);
+      while (list_empty (&dead_pds))
+        cond_wait (&dead_nonempty, &dead_lock);
+      dead = list_entry (list_pop_front (&dead_pds),
+                         struct dead_pd, elem);
+      lock_release (&dead_lock);
+
+      reap_pagedir (dead->pd, true);
+      free (dead);
+    }
+}
+
+/* Destroys page directory PD, freeing all the pages it
+   references.  The caller must already have unhooked and
+   deactivated PD; the actual freeing is handed to the reaper
+   daemon, so an exiting process does not spend time proportional
+   to its address-space size while its parent waits. */
+void
+pagedir_destroy (uint32_t *pd) 
+{
+  struct dead_pd *dead;
+
+  if (pd == NULL)
+    return;
+
+  ASSERT (pd != init_page_dir);
+
+  if (!reaper_started)
+    {
+      lock_init (&dead_lock);
+      lock_set_name (&dead_lock, "dead_pds");
+      cond_init (&dead_nonempty);
+      thread_create ("pagedird", PRI_MIN, pagedir_reaper, NULL);
+      reaper_started = true;
+    }
+
+  dead = malloc (sizeof *dead);
+  if (dead == NULL)
+    {
+      /* No memory to queue with: tear down inline after all. */
+      reap_pagedir (pd, false);
+      return;
+    }
+
+  dead->pd = pd;
+  lock_acquire (&dead_lock);
+  list_push_back (&dead_pds, &dead->elem);
+  cond_signal (&dead_nonempty, &dead_lock);
+  lock_release (&dead_lock);
+}
+
 /* Returns the address of the page table entry for virtual
    address VADDR in page directory PD.
    If PD does not have a page table for VADDR, behavior depends
@@ -152,7 +253,7 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_page (pd, upage);
     }
 }
 
@@ -180,7 +281,7 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -208,10 +309,97 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
         *pte |= PTE_A;
       else 
         {
-          *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          *pte &= ~(uint32_t) PTE_A;
+          invalidate_page (pd, vpage);
+        }
+    }
+}
+
+/* Collects and clears VPAGE's accessed bit in PD, storing the
+   dirty bit into *DIRTY on the way, all in one page-table walk.
+   Returns the accessed bit's previous value.  The one walk
+   replaces the three that separate is_accessed, set_accessed and
+   is_dirty calls would cost an eviction sweep per page. */
+bool
+pagedir_harvest_page (uint32_t *pd, const void *vpage, bool *dirty)
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  bool accessed = false;
+
+  *dirty = false;
+  if (pte != NULL && (*pte & PTE_P) != 0)
+    {
+      accessed = (*pte & PTE_A) != 0;
+      *dirty = (*pte & PTE_D) != 0;
+      if (accessed)
+        {
+          *pte &= ~(uint32_t) PTE_A;
+          invalidate_page (pd, vpage);
         }
     }
+  return accessed;
+}
+
+/* Harvests up to CNT present user pages of PD in address order,
+   starting at the page *STARTP, into OUT: each element records
+   the page's address and its accessed and dirty bits, and the
+   accessed bit is cleared in the same pass.  A page table is
+   walked into once and its entries scanned in place, so the walk
+   cost is amortized over up to 1024 entries rather than paid per
+   query.  Returns the number of pages collected and advances
+   *STARTP just past the last page examined, or to a null pointer
+   when the sweep reached the end of user space; a caller looping
+   until then visits every present page exactly once. */
+size_t
+pagedir_harvest (uint32_t *pd, void **startp,
+                 struct pagedir_harvest *out, size_t cnt)
+{
+  uintptr_t page = pg_no (*startp);
+  uintptr_t end = pg_no (PHYS_BASE);
+  size_t n = 0;
+
+  ASSERT (pd != NULL);
+  ASSERT (is_user_vaddr (*startp));
+
+  while (n < cnt && page < end)
+    {
+      uint32_t pde = pd[page >> PTBITS];
+      uint32_t *pt;
+
+      if (pde == 0)
+        {
+          /* Whole page table absent: skip to the next one. */
+          page = (page | (PTSPAN / PGSIZE - 1)) + 1;
+          continue;
+        }
+
+      pt = pde_get_pt (pde);
+      do
+        {
+          uint32_t *pte = &pt[page & ((1u << PTBITS) - 1)];
+
+          if ((*pte & PTE_P) != 0)
+            {
+              out[n].upage = (void *) (page * PGSIZE);
+              out[n].accessed = (*pte & PTE_A) != 0;
+              out[n].dirty = (*pte & PTE_D) != 0;
+              if (out[n].accessed)
+                *pte &= ~(uint32_t) PTE_A;
+              n++;
+            }
+          page++;
+        }
+      while (n < cnt && page < end
+             && (page & (PTSPAN / PGSIZE - 1)) != 0);
+    }
+
+  /* Any accessed bits cleared above must leave the TLB too.  One
+     full flush covers the whole batch. */
+  if (n > 0 && active_pd () == pd)
+    pagedir_activate (pd);
+
+  *startp = page < end ? (void *) (page * PGSIZE) : NULL;
+  return n;
 }
 
 /* Loads page directory PD into the CPU's page directory base
@@ -243,21 +431,74 @@ active_pd (void)
   return ptov (pd);
 }
 
-/* Seom page table changes can cause the CPU's translation
+/* Activates PD like pagedir_activate(), but skips the CR3 load
+   -- and with it the full TLB flush -- when PD is active
+   already.  For the thread switch path, where consecutive kernel
+   threads all share init_page_dir.  pagedir_activate() itself
+   must stay unconditional: some callers reload CR3 precisely for
+   the flush. */
+void
+pagedir_activate_lazy (uint32_t *pd)
+{
+  if (pd == NULL)
+    pd = init_page_dir;
+  if (pd != active_pd ())
+    pagedir_activate (pd);
+}
+
+/* Some page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
-   table.  When this happens, we have to "invalidate" the TLB by
-   re-activating it.
+   table.  When this happens, we have to "invalidate" the stale
+   entry.
 
-   This function invalidates the TLB if PD is the active page
-   directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+   This function invalidates the TLB entry for UPAGE if PD is the
+   active page directory, with invlpg rather than the full flush
+   a CR3 reload causes.  (If PD is not active then its entries
+   are not in the TLB, so there is no need to invalidate
+   anything.)  Inside an update batch that has crossed the flush
+   threshold, it does nothing; pagedir_end_updates() will flush
+   everything at once.  See [IA32-v2a] "INVLPG--Invalidate TLB
+   Entry". */
 static void
-invalidate_pagedir (uint32_t *pd) 
+invalidate_page (uint32_t *pd, const void *upage)
 {
-  if (active_pd () == pd) 
+  if (active_pd () != pd)
+    return;
+  if (update_depth > 0)
     {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
-         "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
-    } 
+      if (update_flush_all)
+        return;
+      if (++update_cnt >= UPDATE_FLUSH_THRESHOLD)
+        {
+          update_flush_all = true;
+          return;
+        }
+    }
+  asm volatile ("invlpg %0" : : "m" (*(const char *) upage) : "memory");
+}
+
+/* Starts a batch of page table updates.  Batches nest; while one
+   is open, invalidations beyond a threshold are deferred and
+   folded into a single TLB flush at pagedir_end_updates().  Use
+   around loops that clear many mappings at once, such as
+   unmapping a large file mapping. */
+void
+pagedir_begin_updates (void)
+{
+  update_depth++;
+}
+
+/* Ends a batch of page table updates, performing the single
+   deferred TLB flush if the batch crossed the threshold. */
+void
+pagedir_end_updates (void)
+{
+  ASSERT (update_depth > 0);
+  if (--update_depth == 0)
+    {
+      if (update_flush_all)
+        pagedir_activate (active_pd ());
+      update_cnt = 0;
+      update_flush_all = false;
+    }
 }
@@ -2,8 +2,18 @@
 #define USERPROG_PAGEDIR_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/* One page examined by pagedir_harvest(): its user address and
+   the accessed and dirty bits collected for it. */
+struct pagedir_harvest
+  {
+    void *upage;                /* User page. */
+    bool accessed;              /* Accessed bit, now cleared. */
+    bool dirty;                 /* Dirty bit, left alone. */
+  };
+
 uint32_t *pagedir_create (void);
 void pagedir_destroy (uint32_t *pd);
 bool pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool rw);
@@ -13,6 +23,12 @@ bool pagedir_is_dirty (uint32_t *pd, const void *upage);
 void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
+bool pagedir_harvest_page (uint32_t *pd, const void *upage, bool *dirty);
+size_t pagedir_harvest (uint32_t *pd, void **startp,
+                        struct pagedir_harvest *out, size_t cnt);
 void pagedir_activate (uint32_t *pd);
+void pagedir_activate_lazy (uint32_t *pd);
+void pagedir_begin_updates (void);
+void pagedir_end_updates (void);
 
 #endif /* userprog/pagedir.h */
@@ -1,69 +1,288 @@
 #include "userprog/process.h"
+#include <cachestat.h>
 #include <debug.h>
 #include <inttypes.h>
 #include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "userprog/exception.h"
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
+#include "userprog/shm.h"
+#include "userprog/syscall.h"
 #include "userprog/tss.h"
+#include "devices/timer.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+#endif
+
+/* Status record shared between a parent and one child.
+
+   The record outlives whichever of the two dies first: each side
+   holds a reference, dropped by status_release(), and the record
+   is freed as soon as both are gone, so a parent that never
+   waits does not leak its children's records; a parent that dies
+   first drops its references in process_exit(), reaping any
+   zombies on the spot.  The child ups DEAD when it exits;
+   process_wait() downs it.
+
+   The members a wait-after-exit touches -- the status word, the
+   semaphore, and the reference count -- lead the struct so they
+   share a cache line; the bulky rusage block follows. */
+struct child_status
+  {
+    int exit_code;              /* Child's exit status. */
+    struct semaphore dead;      /* Upped when the child exits. */
+    int ref_cnt;                /* References held: parent + child. */
+    tid_t tid;                  /* Child's thread id; parent's use only. */
+    struct list_elem elem;      /* Element in parent's children list. */
+    struct rusage usage;        /* Child's resource usage, for wait2. */
+  };
+
+/* Slab the status records are drawn from.  The cap bounds what a
+   supervisor that spawns freely and waits lazily can pin in
+   kernel memory; at the cap, spawning fails rather than the
+   heap filling with zombies. */
+#define CHILD_STATUS_MAX 4096
+static struct slab_cache *status_cache;
+static bool process_inited;
+
+/* Protects the exec cache; see the comment above struct
+   exec_segment. */
+static struct lock exec_cache_lock;
+
+/* A command line tokenized into a single page: the argument
+   count, each argument's length, and then the strings
+   themselves, null-terminated and back to back.  Built once in
+   process_execute(), so the new thread can build the user stack
+   straight from the record instead of parsing the command line a
+   second time. */
+struct cmd_rec
+  {
+    int argc;                   /* Number of arguments. */
+    size_t blob_len;            /* Bytes of strings, terminators included. */
+    uint16_t len[];             /* Each argument's length, then the
+                                   strings themselves. */
+  };
+
+/* Returns the first argument in REC, the program name. */
+static const char *
+cmd_rec_name (const struct cmd_rec *rec)
+{
+  return (const char *) &rec->len[rec->argc];
+}
+
+/* Tokenizes CMD_LINE into a struct cmd_rec on a fresh page and
+   returns it, or a null pointer if the page cannot be allocated,
+   the record does not fit on one page, or the command line names
+   no program.  The caller frees the page. */
+static struct cmd_rec *
+cmd_rec_parse (const char *cmd_line)
+{
+  struct cmd_rec *rec;
+  const char *p;
+  char *blob, *end;
+  int argc, i;
+
+  /* Count the arguments, to place the string blob just past the
+     length array. */
+  argc = 0;
+  for (p = cmd_line + strspn (cmd_line, " "); *p != '\0';
+       p += strcspn (p, " "), p += strspn (p, " "))
+    argc++;
+  if (argc == 0)
+    return NULL;
+
+  rec = palloc_get_page (0);
+  if (rec == NULL)
+    return NULL;
+  rec->argc = argc;
+  blob = (char *) &rec->len[argc];
+  end = (char *) rec + PGSIZE;
+
+  p = cmd_line + strspn (cmd_line, " ");
+  for (i = 0; i < argc; i++)
+    {
+      size_t len = strcspn (p, " ");
+
+      if (len > UINT16_MAX || blob + len + 1 > end)
+        {
+          palloc_free_page (rec);
+          return NULL;
+        }
+      rec->len[i] = len;
+      memcpy (blob, p, len);
+      blob[len] = '\0';
+      blob += len + 1;
+      p += len;
+      p += strspn (p, " ");
+    }
+  rec->blob_len = blob - (char *) &rec->len[argc];
+
+  return rec;
+}
+
+/* Arguments passed from process_execute() to start_process(). */
+struct exec_info
+  {
+    struct cmd_rec *cmd;        /* Tokenized command line, on its own page. */
+    struct dir *cwd;            /* Working directory to inherit. */
+    struct child_status *status;  /* Record shared with the new child. */
+    struct semaphore load_done; /* Upped once loading succeeds or fails. */
+    bool success;               /* Did loading succeed? */
+  };
 
 static thread_func start_process NO_RETURN;
-static bool load (const char *cmdline, void (**eip) (void), void **esp);
+#ifdef VM
+static thread_func start_fork NO_RETURN;
+#endif
+static bool load (const struct cmd_rec *cmd, void (**eip) (void),
+                  void **esp);
+
+/* Drops one reference to STATUS, freeing it when both the parent
+   and the child are gone.  Only the two holders ever touch
+   REF_CNT, so a brief interrupt-off window suffices to make the
+   decrement atomic; the common wait-after-exit path thus takes
+   no lock at all. */
+static void
+status_release (struct child_status *status)
+{
+  enum intr_level old_level;
+  bool free_it;
+
+  old_level = intr_disable ();
+  free_it = --status->ref_cnt == 0;
+  intr_set_level (old_level);
+
+  if (free_it)
+    slab_free (status_cache, status);
+}
 
 /* Starts a new thread running a user program loaded from
-   FILENAME.  The new thread may be scheduled (and may even exit)
-   before process_execute() returns.  Returns the new process's
-   thread id, or TID_ERROR if the thread cannot be created. */
+   FILENAME.  Waits until the new process has finished loading
+   its executable, so a load failure is reported here.  Returns
+   the new process's thread id, or TID_ERROR if the thread cannot
+   be created or the executable cannot be loaded. */
 tid_t
-process_execute (const char *file_name) 
+process_execute (const char *file_name)
 {
-  char *fn_copy;
+  struct exec_info exec;
+  struct child_status *status;
+  char thread_name[16];
   tid_t tid;
 
-  /* Make a copy of FILE_NAME.
-     Otherwise there's a race between the caller and load(). */
-  fn_copy = palloc_get_page (0);
-  if (fn_copy == NULL)
+  if (!process_inited)
+    {
+      status_cache = slab_create ("child_status",
+                                  sizeof (struct child_status));
+      if (status_cache == NULL)
+        return TID_ERROR;
+      slab_set_limit (status_cache, CHILD_STATUS_MAX);
+      lock_init (&exec_cache_lock);
+      process_inited = true;
+    }
+
+  /* Tokenize FILE_NAME into a record of our own.  Besides
+     severing the race between the caller and load(), this is the
+     only pass over the command line: the child builds the user
+     stack directly from the record. */
+  exec.cmd = cmd_rec_parse (file_name);
+  if (exec.cmd == NULL)
     return TID_ERROR;
-  strlcpy (fn_copy, file_name, PGSIZE);
 
-  /* Create a new thread to execute FILE_NAME. */
-  tid = thread_create (file_name, PRI_DEFAULT, start_process, fn_copy);
+  status = slab_alloc (status_cache);
+  if (status == NULL)
+    {
+      palloc_free_page (exec.cmd);
+      return TID_ERROR;
+    }
+  status->exit_code = -1;
+  status->ref_cnt = 2;
+  sema_init (&status->dead, 0);
+
+  exec.status = status;
+  exec.cwd = thread_current ()->cwd != NULL
+    ? dir_reopen (thread_current ()->cwd) : NULL;
+  sema_init (&exec.load_done, 0);
+  exec.success = false;
+
+  /* Create a new thread to execute FILE_NAME, named after the
+     program alone rather than the whole command line. */
+  strlcpy (thread_name, cmd_rec_name (exec.cmd), sizeof thread_name);
+  tid = thread_create (thread_name, PRI_DEFAULT, start_process, &exec);
   if (tid == TID_ERROR)
-    palloc_free_page (fn_copy); 
+    {
+      palloc_free_page (exec.cmd);
+      dir_close (exec.cwd);
+      slab_free (status_cache, status);
+      return TID_ERROR;
+    }
+
+  /* Wait for the child to finish (or fail) loading.  On failure
+     the child drops its reference to the record before exiting,
+     so we free our side and report the error. */
+  sema_down (&exec.load_done);
+  if (!exec.success)
+    {
+      status_release (status);
+      return TID_ERROR;
+    }
+
+  status->tid = tid;
+  list_push_back (&thread_current ()->children, &status->elem);
   return tid;
 }
 
 /* A thread function that loads a user process and starts it
    running. */
 static void
-start_process (void *file_name_)
+start_process (void *exec_)
 {
-  char *file_name = file_name_;
+  struct exec_info *exec = exec_;
+  struct cmd_rec *cmd = exec->cmd;
   struct intr_frame if_;
   bool success;
 
+  /* Inherit the parent's working directory; process_exit()
+     closes it. */
+  thread_current ()->cwd = exec->cwd;
+
   /* Initialize interrupt frame and load executable. */
   memset (&if_, 0, sizeof if_);
   if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
   if_.cs = SEL_UCSEG;
   if_.eflags = FLAG_IF | FLAG_MBS;
-  success = load (file_name, &if_.eip, &if_.esp);
+  success = load (cmd, &if_.eip, &if_.esp);
+
+  /* Tell the parent how loading went.  EXEC lives on the
+     parent's stack, so it must not be touched after the up. */
+  if (success)
+    thread_current ()->my_status = exec->status;
+  else
+    status_release (exec->status);
+  exec->success = success;
+  sema_up (&exec->load_done);
 
-  /* If load failed, quit. */
-  palloc_free_page (file_name);
-  if (!success) 
+  /* The record has served both load() and the stack setup;
+     success or not, it goes back here. */
+  palloc_free_page (cmd);
+  if (!success)
     thread_exit ();
 
   /* Start the user process by simulating a return from an
@@ -76,18 +295,227 @@ start_process (void *file_name_)
   NOT_REACHED ();
 }
 
-/* Waits for thread TID to die and returns its exit status.  If
+#ifdef VM
+/* Arguments passed from process_fork() to start_fork(). */
+struct fork_info
+  {
+    struct thread *parent;      /* The forking process. */
+    struct intr_frame *frame;   /* Its user register state. */
+    struct child_status *status;  /* Record shared with the new child. */
+    struct semaphore done;      /* Upped when duplication succeeds or fails. */
+    bool success;               /* Did duplication succeed? */
+  };
+
+/* Clones the current process: the child gets a copy-on-write
+   duplicate of the address space, duplicates of the open file
+   descriptors, and the register state in F, except that the
+   system call appears to return 0 in the child.  File mappings
+   from mmap() are not inherited.  Returns the child's thread id
+   to the parent, or TID_ERROR on failure.
+
+   The parent blocks until duplication finishes, so the child
+   copies a consistent image of the address space. */
+tid_t
+process_fork (struct intr_frame *f)
+{
+  struct thread *cur = thread_current ();
+  struct fork_info fork;
+  struct child_status *status;
+  tid_t tid;
+
+  status = slab_alloc (status_cache);
+  if (status == NULL)
+    return TID_ERROR;
+  status->exit_code = -1;
+  status->ref_cnt = 2;
+  sema_init (&status->dead, 0);
+
+  fork.parent = cur;
+  fork.frame = f;
+  fork.status = status;
+  sema_init (&fork.done, 0);
+  fork.success = false;
+
+  tid = thread_create (cur->name, PRI_DEFAULT, start_fork, &fork);
+  if (tid == TID_ERROR)
+    {
+      slab_free (status_cache, status);
+      return TID_ERROR;
+    }
+
+  sema_down (&fork.done);
+  if (!fork.success)
+    {
+      status_release (status);
+      return TID_ERROR;
+    }
+
+  status->tid = tid;
+  list_push_back (&cur->children, &status->elem);
+  return tid;
+}
+
+/* Duplicates PARENT's user pages into the current (child)
+   process.  Resident pages share the parent's frame, mapped
+   read-only on both sides so the first write in either process
+   breaks the share with a copy; swapped pages are copied eagerly
+   since a swap slot has one owner; pages not yet faulted in are
+   registered to fault in from the child's own reopened
+   executable.  Returns true if successful. */
+static bool
+fork_pages (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  struct tree_elem *e;
+
+  for (e = tree_min (parent->pages); e != NULL; e = tree_next (e))
+    {
+      struct page *p = tree_entry (e, struct page, elem);
+      struct page *c;
+      void *kaddr;
+
+      /* File mappings are not inherited; the child can mmap
+         again. */
+      if (!p->private)
+        continue;
+
+      if (p->file != NULL)
+        c = page_allocate_file (p->uaddr, t->exec_file, p->offset,
+                                p->read_bytes, p->writable);
+      else
+        c = page_allocate (p->uaddr, p->writable);
+      if (c == NULL)
+        return false;
+
+      kaddr = pagedir_get_page (parent->pagedir, p->uaddr);
+      if (kaddr != NULL)
+        {
+          bool dirty = pagedir_is_dirty (parent->pagedir, p->uaddr);
+
+          frame_share (kaddr, c);
+          if (!pagedir_set_page (t->pagedir, c->uaddr, kaddr, false))
+            {
+              frame_free (kaddr, c, true);
+              return false;
+            }
+
+          /* Downgrade the parent's mapping to read-only so its
+             next write faults too, preserving the dirty bit the
+             remapping wipes out. */
+          if (p->writable)
+            {
+              pagedir_clear_page (parent->pagedir, p->uaddr);
+              pagedir_set_page (parent->pagedir, p->uaddr, kaddr, false);
+              pagedir_set_dirty (parent->pagedir, p->uaddr, dirty);
+            }
+          frame_set_ready (kaddr);
+        }
+      else if (p->swap_slot != SWAP_NONE)
+        {
+          /* The slot belongs to the parent, so the child gets an
+             eager copy in a fresh frame. */
+          kaddr = frame_alloc (c);
+          if (kaddr == NULL)
+            return false;
+          swap_read (p->swap_slot, kaddr);
+          if (!pagedir_set_page (t->pagedir, c->uaddr, kaddr, c->writable))
+            {
+              frame_free (kaddr, c, true);
+              return false;
+            }
+          frame_set_ready (kaddr);
+        }
+    }
+  return true;
+}
+
+/* A thread function that finishes duplicating the forking
+   parent's state into this new process and starts it running. */
+static void
+start_fork (void *fork_)
+{
+  struct fork_info *fork = fork_;
+  struct thread *t = thread_current ();
+  struct intr_frame if_;
+  bool success;
+
+  /* The child resumes in the same user state as the parent,
+     except that fork() returns 0 to it. */
+  if_ = *fork->frame;
+  if_.eax = 0;
+
+  t->cwd = fork->parent->cwd != NULL
+    ? dir_reopen (fork->parent->cwd) : NULL;
+
+  t->pagedir = pagedir_create ();
+  success = t->pagedir != NULL && page_table_create ()
+    && pagedir_set_page (t->pagedir, TIME_PAGE_UADDR,
+                         timer_time_page (), false);
+  if (success)
+    process_activate ();
+
+  if (success && fork->parent->exec_file != NULL)
+    {
+      t->exec_file = file_reopen (fork->parent->exec_file);
+      success = t->exec_file != NULL;
+      if (success)
+        file_deny_write (t->exec_file);
+    }
+
+  success = success && fork_pages (fork->parent)
+    && syscall_duplicate_fds (fork->parent);
+
+  /* Tell the parent how it went.  FORK lives on the parent's
+     stack, so it must not be touched after the up. */
+  if (success)
+    t->my_status = fork->status;
+  else
+    status_release (fork->status);
+  fork->success = success;
+  sema_up (&fork->done);
+
+  if (!success)
+    thread_exit ();
+
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+#endif /* VM */
+
+/* Waits for thread TID to die and returns its exit status,
+   storing its resource usage in *USAGE if USAGE is nonnull.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
    child of the calling process, or if process_wait() has already
    been successfully called for the given TID, returns -1
-   immediately, without waiting.
-
-   This function will be implemented in problem 2-2.  For now, it
-   does nothing. */
+   immediately, without waiting. */
 int
-process_wait (tid_t child_tid UNUSED) 
+process_wait (tid_t child_tid, struct rusage *usage)
 {
+  struct thread *cur = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&cur->children); e != list_end (&cur->children);
+       e = list_next (e))
+    {
+      struct child_status *status
+        = list_entry (e, struct child_status, elem);
+      if (status->tid == child_tid)
+        {
+          int exit_code;
+
+          /* Remove the record first so a second wait for the
+             same child fails. */
+          list_remove (&status->elem);
+          sema_down (&status->dead);
+          exit_code = status->exit_code;
+          if (usage != NULL)
+            *usage = status->usage;
+          status_release (status);
+          return exit_code;
+        }
+    }
+
   return -1;
 }
 
@@ -98,11 +526,69 @@ process_exit (void)
   struct thread *cur = thread_current ();
   uint32_t *pd;
 
+  if (cur->cwd != NULL)
+    {
+      dir_close (cur->cwd);
+      cur->cwd = NULL;
+    }
+
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = cur->pagedir;
-  if (pd != NULL) 
+  if (pd != NULL)
     {
+      /* This was a user process, so flush its staged console
+         output, close its files, detach its shared memory, and
+         announce its exit status. */
+      syscall_stdout_flush ();
+      syscall_close_all ();
+      shm_exit ();
+      printf ("%s: exit(%d)\n", cur->name, cur->exit_code);
+#ifdef VM
+      exception_print_fault_stats ();
+#endif
+
+      /* Wake a waiting parent and drop our side of the shared
+         status record, leaving our resource bill with it. */
+      if (cur->my_status != NULL)
+        {
+          struct rusage *u = &cur->my_status->usage;
+
+          u->user_ticks = cur->user_ticks;
+          u->kernel_ticks = cur->kernel_ticks;
+          u->page_faults = cur->page_fault_cnt;
+          u->read_bytes = cur->read_bytes;
+          u->write_bytes = cur->write_bytes;
+#ifdef VM
+          u->peak_frames = cur->peak_pages;
+#else
+          u->peak_frames = 0;
+#endif
+          cur->my_status->exit_code = cur->exit_code;
+          sema_up (&cur->my_status->dead);
+          status_release (cur->my_status);
+        }
+
+      /* Drop our references to our children's records; any that
+         are already dead are freed here. */
+      while (!list_empty (&cur->children))
+        status_release (list_entry (list_pop_front (&cur->children),
+                                    struct child_status, elem));
+
+#ifdef VM
+      /* Write back and drop file mappings while the page
+         directory is still live, so dirty pages reach the
+         filesystem. */
+      syscall_munmap_all ();
+      frame_remove_all (cur);
+      page_table_destroy ();
+      if (cur->exec_file != NULL)
+        {
+          file_close (cur->exec_file);
+          cur->exec_file = NULL;
+        }
+#endif
+
       /* Correct ordering here is crucial.  We must set
          cur->pagedir to NULL before switching page directories,
          so that a timer interrupt can't switch back to the
@@ -110,6 +596,11 @@ process_exit (void)
          directory before destroying the process's page
          directory, or our active page directory will be one
          that's been freed (and cleared). */
+      /* Unmap the shared time page first: it is a kernel page,
+         and pagedir_destroy() must not free it as if the process
+         owned it. */
+      pagedir_clear_page (pd, TIME_PAGE_UADDR);
+
       cur->pagedir = NULL;
       pagedir_activate (NULL);
       pagedir_destroy (pd);
@@ -124,12 +615,16 @@ process_activate (void)
 {
   struct thread *t = thread_current ();
 
-  /* Activate thread's page tables. */
-  pagedir_activate (t->pagedir);
+  /* Activate thread's page tables, unless they are active
+     already: consecutive kernel threads all share init_page_dir,
+     and a needless CR3 reload flushes the whole TLB. */
+  pagedir_activate_lazy (t->pagedir);
 
-  /* Set thread's kernel stack for use in processing
-     interrupts. */
-  tss_update ();
+  /* Set thread's kernel stack for use in processing interrupts.
+     A kernel-only thread never runs in ring 3, so no interrupt
+     it takes consults esp0. */
+  if (t->pagedir != NULL)
+    tss_update ();
 }
 
 /* We load ELF binaries.  The following definitions are taken
@@ -195,24 +690,128 @@ struct Elf32_Phdr
 #define PF_W 2          /* Writable. */
 #define PF_R 4          /* Readable. */
 
-static bool setup_stack (void **esp);
+static bool setup_stack (const struct cmd_rec *cmd, void **esp);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
 static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
                           uint32_t read_bytes, uint32_t zero_bytes,
                           bool writable);
 
-/* Loads an ELF executable from FILE_NAME into the current thread.
-   Stores the executable's entry point into *EIP
-   and its initial stack pointer into *ESP.
+/* Exec cache.  Workloads that exec the same few binaries over
+   and over re-read and re-validate the ELF header and every
+   program header on each exec.  The cache remembers, keyed by
+   the executable's inode sector, the outcome of that parse: the
+   entry point and one "segment plan" per loadable segment, ready
+   to hand to load_segment().  A warm exec skips the header and
+   program header reads entirely; the segment contents themselves
+   are read on demand and read-only pages are already shared
+   between instances by the frame table.
+
+   A plan is validated against the file's current length, so a
+   grown or truncated executable parses cold.  An executable
+   rewritten in place between execs without changing size would
+   go stale, but file_deny_write() blocks that for the common
+   case of a binary that is still running. */
+#define EXEC_CACHE_SIZE 8       /* Cached executables. */
+#define EXEC_PLAN_MAX_SEGS 4    /* Loadable segments per plan. */
+
+/* One loadable segment, in load_segment() terms. */
+struct exec_segment
+  {
+    off_t file_page;            /* Segment's start offset in the file. */
+    uint8_t *mem_page;          /* User virtual address of first page. */
+    uint32_t read_bytes;        /* Bytes to read from the file. */
+    uint32_t zero_bytes;        /* Bytes to zero after them. */
+    bool writable;              /* Read/write segment? */
+  };
+
+/* A parsed executable. */
+struct exec_plan
+  {
+    bool in_use;                /* Is this slot valid? */
+    block_sector_t inumber;     /* Executable's inode sector. */
+    off_t length;               /* File length when parsed. */
+    Elf32_Addr entry;           /* Entry point. */
+    int seg_cnt;                /* Number of segments. */
+    struct exec_segment segs[EXEC_PLAN_MAX_SEGS];
+  };
+
+static struct exec_plan exec_cache[EXEC_CACHE_SIZE];
+static size_t exec_cache_hand;  /* Round-robin eviction cursor. */
+
+/* Hit/miss/eviction counts, for the "cachestat" action. */
+static struct cache_stats exec_stats;
+
+/* Looks up the cached plan for the executable at INUMBER, parsed
+   at length LENGTH.  Copies it into *OUT and returns true on a
+   hit, returns false otherwise. */
+static bool
+exec_plan_lookup (block_sector_t inumber, off_t length,
+                  struct exec_plan *out)
+{
+  bool found = false;
+  size_t i;
+
+  lock_acquire (&exec_cache_lock);
+  if (exec_stats.name == NULL)
+    {
+      exec_stats.name = "exec";
+      exec_stats.size = EXEC_CACHE_SIZE;
+      cache_stats_register (&exec_stats);
+    }
+  for (i = 0; i < EXEC_CACHE_SIZE; i++)
+    {
+      struct exec_plan *p = &exec_cache[i];
+
+      if (p->in_use && p->inumber == inumber && p->length == length)
+        {
+          *out = *p;
+          found = true;
+          break;
+        }
+    }
+  counter_inc (found ? &exec_stats.hits : &exec_stats.misses);
+  lock_release (&exec_cache_lock);
+  return found;
+}
+
+/* Inserts PLAN into the exec cache, replacing any stale plan for
+   the same executable, or the oldest slot otherwise. */
+static void
+exec_plan_insert (const struct exec_plan *plan)
+{
+  size_t i;
+
+  lock_acquire (&exec_cache_lock);
+  for (i = 0; i < EXEC_CACHE_SIZE; i++)
+    if (exec_cache[i].in_use && exec_cache[i].inumber == plan->inumber)
+      break;
+  if (i == EXEC_CACHE_SIZE)
+    {
+      i = exec_cache_hand;
+      exec_cache_hand = (exec_cache_hand + 1) % EXEC_CACHE_SIZE;
+      if (exec_cache[i].in_use)
+        counter_inc (&exec_stats.evictions);
+    }
+  exec_cache[i] = *plan;
+  exec_cache[i].in_use = true;
+  lock_release (&exec_cache_lock);
+}
+
+/* Loads the ELF executable named by CMD's first argument into
+   the current thread.  Stores the executable's entry point into
+   *EIP and its initial stack pointer into *ESP.
    Returns true if successful, false otherwise. */
 bool
-load (const char *file_name, void (**eip) (void), void **esp) 
+load (const struct cmd_rec *cmd, void (**eip) (void), void **esp)
 {
   struct thread *t = thread_current ();
   struct Elf32_Ehdr ehdr;
   struct file *file = NULL;
+  struct exec_plan plan;
+  bool have_plan, cacheable = true;
   off_t file_ofs;
   bool success = false;
+  const char *name = cmd_rec_name (cmd);
   int i;
 
   /* Allocate and activate page directory. */
@@ -221,14 +820,42 @@ load (const char *file_name, void (**eip) (void), void **esp)
     goto done;
   process_activate ();
 
-  /* Open executable file. */
-  file = filesys_open (file_name);
+#ifdef VM
+  /* Create the supplemental page table. */
+  if (!page_table_create ())
+    goto done;
+#endif
+
+  /* Open executable file.  The program name is the first word
+     of the command line; the rest are its arguments. */
+  file = filesys_open (name);
   if (file == NULL) 
     {
-      printf ("load: %s: open failed\n", file_name);
+      printf ("load: %s: open failed\n", name);
       goto done; 
     }
 
+  /* Check the exec cache; a warm exec skips the header parse
+     below and drives segment setup from the cached plan. */
+  memset (&plan, 0, sizeof plan);
+  plan.inumber = inode_get_inumber (file_get_inode (file));
+  plan.length = file_length (file);
+  have_plan = exec_plan_lookup (plan.inumber, plan.length, &plan);
+
+  if (have_plan)
+    {
+      for (i = 0; i < plan.seg_cnt; i++)
+        {
+          const struct exec_segment *seg = &plan.segs[i];
+
+          if (!load_segment (file, seg->file_page, seg->mem_page,
+                             seg->read_bytes, seg->zero_bytes,
+                             seg->writable))
+            goto done;
+        }
+      goto stack;
+    }
+
   /* Read and verify executable header. */
   if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
       || memcmp (ehdr.e_ident, "\177ELF\1\1\1", 7)
@@ -236,15 +863,16 @@ load (const char *file_name, void (**eip) (void), void **esp)
       || ehdr.e_machine != 3
       || ehdr.e_version != 1
       || ehdr.e_phentsize != sizeof (struct Elf32_Phdr)
-      || ehdr.e_phnum > 1024) 
+      || ehdr.e_phnum > 1024)
     {
-      printf ("load: %s: error loading executable\n", file_name);
-      goto done; 
+      printf ("load: %s: error loading executable\n", name);
+      goto done;
     }
+  plan.entry = ehdr.e_entry;
 
   /* Read program headers. */
   file_ofs = ehdr.e_phoff;
-  for (i = 0; i < ehdr.e_phnum; i++) 
+  for (i = 0; i < ehdr.e_phnum; i++)
     {
       struct Elf32_Phdr phdr;
 
@@ -255,7 +883,7 @@ load (const char *file_name, void (**eip) (void), void **esp)
       if (file_read (file, &phdr, sizeof phdr) != sizeof phdr)
         goto done;
       file_ofs += sizeof phdr;
-      switch (phdr.p_type) 
+      switch (phdr.p_type)
         {
         case PT_NULL:
         case PT_NOTE:
@@ -269,7 +897,7 @@ load (const char *file_name, void (**eip) (void), void **esp)
         case PT_SHLIB:
           goto done;
         case PT_LOAD:
-          if (validate_segment (&phdr, file)) 
+          if (validate_segment (&phdr, file))
             {
               bool writable = (phdr.p_flags & PF_W) != 0;
               uint32_t file_page = phdr.p_offset & ~PGMASK;
@@ -284,7 +912,7 @@ load (const char *file_name, void (**eip) (void), void **esp)
                   zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz, PGSIZE)
                                 - read_bytes);
                 }
-              else 
+              else
                 {
                   /* Entirely zero.
                      Don't read anything from disk. */
@@ -294,6 +922,20 @@ load (const char *file_name, void (**eip) (void), void **esp)
               if (!load_segment (file, file_page, (void *) mem_page,
                                  read_bytes, zero_bytes, writable))
                 goto done;
+
+              /* Record the segment for the exec cache. */
+              if (plan.seg_cnt < EXEC_PLAN_MAX_SEGS)
+                {
+                  struct exec_segment *seg = &plan.segs[plan.seg_cnt++];
+
+                  seg->file_page = file_page;
+                  seg->mem_page = (uint8_t *) mem_page;
+                  seg->read_bytes = read_bytes;
+                  seg->zero_bytes = zero_bytes;
+                  seg->writable = writable;
+                }
+              else
+                cacheable = false;
             }
           else
             goto done;
@@ -301,18 +943,37 @@ load (const char *file_name, void (**eip) (void), void **esp)
         }
     }
 
+ stack:
   /* Set up stack. */
-  if (!setup_stack (esp))
+  if (!setup_stack (cmd, esp))
+    goto done;
+
+  /* Map the kernel's time page read-only, so user code reads the
+     clock without a trap. */
+  if (!pagedir_set_page (t->pagedir, TIME_PAGE_UADDR,
+                         timer_time_page (), false))
     goto done;
 
   /* Start address. */
-  *eip = (void (*) (void)) ehdr.e_entry;
+  *eip = (void (*) (void)) plan.entry;
 
   success = true;
+  if (!have_plan && cacheable)
+    exec_plan_insert (&plan);
 
  done:
   /* We arrive here whether the load is successful or not. */
+#ifdef VM
+  /* On success, keep the executable open: the supplemental page
+     table reads segment pages from it on demand.  It is closed
+     in process_exit(). */
+  if (success)
+    t->exec_file = file;
+  else
+    file_close (file);
+#else
   file_close (file);
+#endif
   return success;
 }
 
@@ -396,6 +1057,22 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+#ifdef VM
+      /* Record the page in the supplemental page table; the
+         fault handler reads it in on first touch.  A page with
+         no file data at all -- pure BSS -- goes in as anonymous,
+         so its first touch maps the shared zero frame instead of
+         reading zero bytes and zeroing a frame. */
+      if (page_read_bytes > 0)
+        {
+          if (page_allocate_file (upage, file, ofs, page_read_bytes,
+                                  writable) == NULL)
+            return false;
+          ofs += page_read_bytes;
+        }
+      else if (page_allocate (upage, writable) == NULL)
+        return false;
+#else
       /* Get a page of memory. */
       uint8_t *kpage = palloc_get_page (PAL_USER);
       if (kpage == NULL)
@@ -415,6 +1092,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
           palloc_free_page (kpage);
           return false; 
         }
+#endif
 
       /* Advance. */
       read_bytes -= page_read_bytes;
@@ -424,21 +1102,95 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   return true;
 }
 
-/* Create a minimal stack by mapping a zeroed page at the top of
-   user virtual memory. */
+/* Pushes SIZE bytes in BUF onto the stack in KPAGE, whose
+   page-relative stack pointer is *OFS, rounding the stack
+   pointer down to a 32-bit boundary first.  Returns the kernel
+   address of the pushed data, or a null pointer if the stack
+   would overflow the page. */
+static void *
+push (uint8_t *kpage, size_t *ofs, const void *buf, size_t size)
+{
+  size_t rounded = ROUND_UP (size, sizeof (uint32_t));
+
+  if (*ofs < rounded)
+    return NULL;
+  *ofs -= rounded;
+  memcpy (kpage + *ofs, buf, size);
+  return kpage + *ofs;
+}
+
+/* Builds the initial user stack from CMD in KPAGE, which will be
+   mapped at UPAGE, and stores the initial user stack pointer
+   into *ESP.
+
+   The record was tokenized in process_execute(), so there is no
+   parsing left to do: the string blob is pushed in one block,
+   and each argv[] pointer is computed from the recorded lengths,
+   pushed last to first so the array comes out in command line
+   order.  Returns true if successful. */
 static bool
-setup_stack (void **esp) 
+init_cmd_line (uint8_t *kpage, uint8_t *upage, const struct cmd_rec *cmd,
+               void **esp)
+{
+  size_t ofs = PGSIZE;
+  char *const null = NULL;
+  const char *blob = (const char *) &cmd->len[cmd->argc];
+  size_t arg_ofs;
+  char *kblob;
+  void *uargv;
+  int argc = cmd->argc;
+  int i;
+
+  /* Push the argument strings in one block; the record already
+     holds them back to back, null terminators included. */
+  kblob = push (kpage, &ofs, blob, cmd->blob_len);
+  if (kblob == NULL)
+    return false;
+
+  /* Push the argv[argc] null sentinel. */
+  if (push (kpage, &ofs, &null, sizeof null) == NULL)
+    return false;
+
+  /* Push a user pointer to each argument, last to first. */
+  arg_ofs = cmd->blob_len;
+  for (i = argc - 1; i >= 0; i--)
+    {
+      void *uarg;
+
+      arg_ofs -= cmd->len[i] + 1;
+      uarg = upage + (kblob - (char *) kpage) + arg_ofs;
+      if (push (kpage, &ofs, &uarg, sizeof uarg) == NULL)
+        return false;
+    }
+
+  /* Push argv, argc, and a fake return address. */
+  uargv = upage + ofs;
+  if (push (kpage, &ofs, &uargv, sizeof uargv) == NULL
+      || push (kpage, &ofs, &argc, sizeof argc) == NULL
+      || push (kpage, &ofs, &null, sizeof null) == NULL)
+    return false;
+
+  *esp = upage + ofs;
+  return true;
+}
+
+/* Creates the initial stack: a zeroed page mapped at the top of
+   user virtual memory, loaded with the arguments recorded in
+   CMD. */
+static bool
+setup_stack (const struct cmd_rec *cmd, void **esp)
 {
   uint8_t *kpage;
   bool success = false;
 
   kpage = palloc_get_page (PAL_USER | PAL_ZERO);
-  if (kpage != NULL) 
+  if (kpage != NULL)
     {
-      success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
-      if (success)
-        *esp = PHYS_BASE;
-      else
+      uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
+
+      success = install_page (upage, kpage, true)
+        && init_cmd_line (kpage, upage, cmd, esp);
+      if (!success)
         palloc_free_page (kpage);
     }
   return success;
@@ -3,8 +3,30 @@
 
 #include "threads/thread.h"
 
+/* User virtual address where the kernel's read-only time page is
+   mapped in every process, just below the deepest the stack can
+   grow.  Must match TIME_PAGE in lib/user/time.h. */
+#define TIME_PAGE_UADDR ((void *) 0xbfeff000)
+
+/* Resource usage of an exited child, reported by the wait2
+   system call.  Must match struct rusage in
+   lib/user/syscall.h. */
+struct rusage
+  {
+    long long user_ticks;       /* Timer ticks running user code. */
+    long long kernel_ticks;     /* Timer ticks in system calls. */
+    long long page_faults;      /* Page faults taken. */
+    long long read_bytes;       /* Bytes read via syscalls. */
+    long long write_bytes;      /* Bytes written via syscalls. */
+    long long peak_frames;      /* Most page frames resident at once. */
+  };
+
 tid_t process_execute (const char *file_name);
-int process_wait (tid_t);
+#ifdef VM
+struct intr_frame;
+tid_t process_fork (struct intr_frame *);
+#endif
+int process_wait (tid_t, struct rusage *);
 void process_exit (void);
 void process_activate (void);
 
@@ -0,0 +1,366 @@
+#include "userprog/shm.h"
+#include <list.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
+
+/* Shared memory segments.
+
+   A segment is a named run of user-pool pages that any process
+   can map into its own address space with shm_attach(), so bulk
+   data moves between cooperating processes with zero copies
+   instead of two trips through the filesystem.  The kernel holds
+   the pages directly -- they are mapped with pagedir_set_page()
+   and never enter the supplemental page table, so they are
+   effectively pinned and survive eviction.  A segment lives as
+   long as any process is attached; the last detach (explicit or
+   at process exit) frees it.
+
+   Attachments are per-process and not inherited across fork: a
+   child that wants the segment attaches it again by name.
+
+   The companion futex calls let processes sharing a segment
+   block on a word in it instead of spinning: futex_wait() sleeps
+   while the word holds an expected value and futex_wake() wakes
+   sleepers.  Waiters are keyed by the word's kernel address, so
+   the same word matches no matter where each process mapped
+   it. */
+
+/* Limits, chosen to keep a hostile process from tying up the
+   user pool. */
+#define SHM_NAME_MAX 15         /* Longest segment name. */
+#define SHM_MAX_PAGES 64        /* Largest segment, in pages. */
+
+/* A named segment. */
+struct shm_segment
+  {
+    char name[SHM_NAME_MAX + 1];        /* Null-terminated name. */
+    void **kpages;                      /* Its pages, in order. */
+    size_t page_cnt;                    /* Number of pages. */
+    int ref_cnt;                        /* Processes attached. */
+    struct list_elem elem;              /* Element in segment list. */
+  };
+
+/* One process's attachment of one segment.  Element in struct
+   thread's shm_list. */
+struct shm_attachment
+  {
+    struct shm_segment *seg;            /* The segment. */
+    uint8_t *base;                      /* Where it is mapped. */
+    struct list_elem elem;              /* Element in shm_list. */
+  };
+
+/* All segments, under one lock; segment churn is rare. */
+static struct list segments;
+static struct lock shm_lock;
+
+/* A thread blocked in futex_wait(), keyed by the kernel address
+   of the word it is waiting on. */
+struct futex_waiter
+  {
+    const void *kaddr;                  /* Word's kernel address. */
+    struct semaphore sema;              /* Upped by futex_wake(). */
+    struct list_elem elem;              /* Element in waiter list. */
+  };
+
+static struct list futex_waiters;
+static struct lock futex_lock;
+
+static void shm_unref (struct shm_segment *);
+static void detach (struct shm_attachment *);
+
+/* Initializes the shared memory system. */
+void
+shm_init (void)
+{
+  list_init (&segments);
+  lock_init (&shm_lock);
+  list_init (&futex_waiters);
+  lock_init (&futex_lock);
+}
+
+/* Looks up the segment named NAME, or returns a null pointer.
+   The caller must hold shm_lock. */
+static struct shm_segment *
+segment_by_name (const char *name)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&segments); e != list_end (&segments);
+       e = list_next (e))
+    {
+      struct shm_segment *seg = list_entry (e, struct shm_segment, elem);
+
+      if (!strcmp (seg->name, name))
+        return seg;
+    }
+  return NULL;
+}
+
+/* Creates a PAGE_CNT-page segment named NAME.  Returns it with a
+   zero reference count, or a null pointer if memory runs out.
+   The caller must hold shm_lock. */
+static struct shm_segment *
+segment_create (const char *name, size_t page_cnt)
+{
+  struct shm_segment *seg = malloc (sizeof *seg);
+  size_t i;
+
+  if (seg == NULL)
+    return NULL;
+  seg->kpages = malloc (page_cnt * sizeof *seg->kpages);
+  if (seg->kpages == NULL)
+    {
+      free (seg);
+      return NULL;
+    }
+
+  for (i = 0; i < page_cnt; i++)
+    {
+      seg->kpages[i] = palloc_get_page (PAL_USER | PAL_ZERO);
+      if (seg->kpages[i] == NULL)
+        {
+          while (i-- > 0)
+            palloc_free_page (seg->kpages[i]);
+          free (seg->kpages);
+          free (seg);
+          return NULL;
+        }
+    }
+
+  strlcpy (seg->name, name, sizeof seg->name);
+  seg->page_cnt = page_cnt;
+  seg->ref_cnt = 0;
+  list_push_back (&segments, &seg->elem);
+  return seg;
+}
+
+/* Drops one reference to SEG, freeing it when the last process
+   detaches.  The caller must hold shm_lock. */
+static void
+shm_unref (struct shm_segment *seg)
+{
+  if (--seg->ref_cnt == 0)
+    {
+      size_t i;
+
+      list_remove (&seg->elem);
+      for (i = 0; i < seg->page_cnt; i++)
+        palloc_free_page (seg->kpages[i]);
+      free (seg->kpages);
+      free (seg);
+    }
+}
+
+/* Attaches the segment named NAME, creating it PAGE_CNT pages
+   long if it does not yet exist, and maps it read/write at user
+   virtual address ADDR.  ADDR must be page-aligned and the range
+   must be unused.  An existing segment's size must match
+   PAGE_CNT.  Returns 0 on success, -1 on failure. */
+int
+shm_attach (const char *name, void *addr, size_t page_cnt)
+{
+  struct thread *cur = thread_current ();
+  struct shm_segment *seg;
+  struct shm_attachment *at;
+  bool created = false;
+  size_t i;
+
+  if (name[0] == '\0' || strlen (name) > SHM_NAME_MAX
+      || page_cnt == 0 || page_cnt > SHM_MAX_PAGES
+      || addr == NULL || pg_ofs (addr) != 0
+      || !is_user_vaddr ((uint8_t *) addr + page_cnt * PGSIZE - 1))
+    return -1;
+
+  /* The range must not overlap anything already mapped. */
+  for (i = 0; i < page_cnt; i++)
+    {
+      uint8_t *upage = (uint8_t *) addr + i * PGSIZE;
+
+      if (pagedir_get_page (cur->pagedir, upage) != NULL)
+        return -1;
+#ifdef VM
+      if (page_lookup (upage) != NULL)
+        return -1;
+#endif
+    }
+
+  at = malloc (sizeof *at);
+  if (at == NULL)
+    return -1;
+
+  lock_acquire (&shm_lock);
+  seg = segment_by_name (name);
+  if (seg != NULL)
+    {
+      if (seg->page_cnt != page_cnt)
+        goto fail;
+    }
+  else
+    {
+      seg = segment_create (name, page_cnt);
+      if (seg == NULL)
+        goto fail;
+      created = true;
+    }
+
+  for (i = 0; i < page_cnt; i++)
+    if (!pagedir_set_page (cur->pagedir, (uint8_t *) addr + i * PGSIZE,
+                           seg->kpages[i], true))
+      {
+        pagedir_begin_updates ();
+        while (i-- > 0)
+          pagedir_clear_page (cur->pagedir, (uint8_t *) addr + i * PGSIZE);
+        pagedir_end_updates ();
+        if (created)
+          {
+            seg->ref_cnt = 1;   /* Make shm_unref() free it. */
+            shm_unref (seg);
+          }
+        goto fail;
+      }
+
+  seg->ref_cnt++;
+  at->seg = seg;
+  at->base = addr;
+  list_push_back (&cur->shm_list, &at->elem);
+  lock_release (&shm_lock);
+  return 0;
+
+ fail:
+  lock_release (&shm_lock);
+  free (at);
+  return -1;
+}
+
+/* Unmaps attachment AT from the current process and drops its
+   segment reference. */
+static void
+detach (struct shm_attachment *at)
+{
+  struct thread *cur = thread_current ();
+  size_t i;
+
+  pagedir_begin_updates ();
+  for (i = 0; i < at->seg->page_cnt; i++)
+    pagedir_clear_page (cur->pagedir, at->base + i * PGSIZE);
+  pagedir_end_updates ();
+
+  lock_acquire (&shm_lock);
+  shm_unref (at->seg);
+  lock_release (&shm_lock);
+
+  list_remove (&at->elem);
+  free (at);
+}
+
+/* Detaches the segment mapped at ADDR from the current process.
+   Returns 0 on success, -1 if nothing is attached there. */
+int
+shm_detach (const void *addr)
+{
+  struct thread *cur = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&cur->shm_list); e != list_end (&cur->shm_list);
+       e = list_next (e))
+    {
+      struct shm_attachment *at = list_entry (e, struct shm_attachment,
+                                              elem);
+
+      if (at->base == addr)
+        {
+          detach (at);
+          return 0;
+        }
+    }
+  return -1;
+}
+
+/* Detaches all of the current process's segments.  Called from
+   process_exit() while the page directory is still live. */
+void
+shm_exit (void)
+{
+  struct thread *cur = thread_current ();
+
+  while (!list_empty (&cur->shm_list))
+    detach (list_entry (list_front (&cur->shm_list),
+                        struct shm_attachment, elem));
+}
+
+/* Blocks until another process calls futex_wake() on the same
+   word, provided *UADDR still holds EXPECTED.  Returns 0 after
+   being woken, -1 if UADDR is unmapped or misaligned or the word
+   has already changed.  The check and the enqueue are atomic
+   with respect to futex_wake(), so a wake after the caller's
+   final check of the word cannot be lost. */
+int
+futex_wait (int *uaddr, int expected)
+{
+  struct thread *cur = thread_current ();
+  struct futex_waiter waiter;
+  const int *kaddr;
+
+  if ((uintptr_t) uaddr % sizeof *uaddr != 0)
+    return -1;
+  kaddr = pagedir_get_page (cur->pagedir, uaddr);
+  if (kaddr == NULL)
+    return -1;
+
+  lock_acquire (&futex_lock);
+  if (*kaddr != expected)
+    {
+      lock_release (&futex_lock);
+      return -1;
+    }
+  waiter.kaddr = kaddr;
+  sema_init (&waiter.sema, 0);
+  list_push_back (&futex_waiters, &waiter.elem);
+  lock_release (&futex_lock);
+
+  sema_down (&waiter.sema);
+  return 0;
+}
+
+/* Wakes up to MAX processes blocked in futex_wait() on the same
+   word as UADDR.  Returns the number woken, or -1 if UADDR is
+   unmapped or misaligned. */
+int
+futex_wake (int *uaddr, int max)
+{
+  struct thread *cur = thread_current ();
+  const void *kaddr;
+  struct list_elem *e, *next;
+  int cnt = 0;
+
+  if ((uintptr_t) uaddr % sizeof *uaddr != 0)
+    return -1;
+  kaddr = pagedir_get_page (cur->pagedir, uaddr);
+  if (kaddr == NULL)
+    return -1;
+
+  lock_acquire (&futex_lock);
+  for (e = list_begin (&futex_waiters);
+       e != list_end (&futex_waiters) && cnt < max; e = next)
+    {
+      struct futex_waiter *w = list_entry (e, struct futex_waiter, elem);
+
+      next = list_next (e);
+      if (w->kaddr == kaddr)
+        {
+          list_remove (&w->elem);
+          sema_up (&w->sema);
+          cnt++;
+        }
+    }
+  lock_release (&futex_lock);
+  return cnt;
+}
@@ -0,0 +1,14 @@
+#ifndef USERPROG_SHM_H
+#define USERPROG_SHM_H
+
+#include <stddef.h>
+
+void shm_init (void);
+int shm_attach (const char *name, void *addr, size_t page_cnt);
+int shm_detach (const void *addr);
+void shm_exit (void);
+
+int futex_wait (int *uaddr, int expected);
+int futex_wake (int *uaddr, int max);
+
+#endif /* userprog/shm.h */
@@ -1,20 +1,1676 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
+#include "devices/input.h"
+#include "devices/shutdown.h"
+#include "devices/timer.h"
+#include "filesys/directory.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/vaddr.h"
+#include "userprog/process.h"
+#include "userprog/shm.h"
+#ifdef VM
+#include <round.h>
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+#endif
+
+/* System call layer.
+
+   The handler reads the system call number and arguments off the
+   user stack, then dispatches through a table indexed by the
+   SYS_* numbers from lib/syscall-nr.h.  Each entry records how
+   many argument words the call takes, so argument fetching and
+   validation happen once, in the dispatcher, rather than in
+   every call. */
+
+/* Per-process limit on open files. */
+#define FD_MAX 128
+
+/* First file descriptor handed out; 0 and 1 are the console. */
+#define FD_FIRST 2
+
+/* What a descriptor holds. */
+enum fd_kind
+  {
+    FD_FILE,                            /* An ordinary file. */
+    FD_DIR,                             /* A directory. */
+    FD_PIPE                             /* One end of a pipe. */
+  };
+
+/* A process's open file table, allocated lazily on the first
+   open() and pointed to by struct thread.  Descriptor FD lives
+   in handles[FD - FD_FIRST], so lookup is a bounds check and an
+   array index; free slots are tracked in a bitmap so allocation
+   is a few word scans rather than a search of the table.  A
+   handle is a struct file, a struct dir when the matching
+   dir_map bit is set, or a struct pipe_end when the matching
+   pipe_map bit is set. */
+struct fd_table
+  {
+    void *handles[FD_MAX];              /* Indexed by fd - FD_FIRST. */
+    uint32_t free_map[FD_MAX / 32];     /* 1 bits mark free slots. */
+    uint32_t dir_map[FD_MAX / 32];      /* 1 bits mark directories. */
+    uint32_t pipe_map[FD_MAX / 32];     /* 1 bits mark pipe ends. */
+  };
+
+/* An in-kernel pipe: a one-page ring buffer streaming bytes from
+   the write end to the read end, so cooperating processes can
+   talk at memory bandwidth instead of through the filesystem.
+   Readers block while the pipe is empty and some writer still
+   has it open; writers block while it is full and some reader
+   still has it open.  Reading an empty pipe with no writers left
+   returns end-of-file; writing with no readers left fails. */
+#define PIPE_BUFSIZE PGSIZE
+struct pipe
+  {
+    struct lock lock;                   /* Protects everything below. */
+    struct condition not_empty;         /* Signaled when data arrives. */
+    struct condition not_full;          /* Signaled when space appears. */
+    uint8_t *buf;                       /* PIPE_BUFSIZE-byte ring. */
+    size_t tail;                        /* Next byte to read. */
+    size_t cnt;                         /* Bytes in the buffer. */
+    int readers;                        /* Open read ends. */
+    int writers;                        /* Open write ends. */
+  };
+
+/* One process's handle on one end of a pipe.  Each descriptor
+   gets its own, so fork can duplicate an end without the two
+   processes sharing a handle. */
+struct pipe_end
+  {
+    struct pipe *pipe;                  /* The pipe proper. */
+    bool writer;                        /* Write end? */
+  };
+
+/* Slab cache for fd tables, created on first use. */
+static struct slab_cache *fd_table_cache;
+
+#ifdef VM
+/* A memory-mapped file: a run of PAGE_CNT consecutive pages
+   starting at BASE, backed by a private reopen of the mapped
+   file.  Element in struct thread's mappings list. */
+struct mapping
+  {
+    int id;                             /* Mapping id from mmap(). */
+    struct file *file;                  /* Reopened backing file. */
+    uint8_t *base;                      /* First mapped address. */
+    size_t page_cnt;                    /* Number of pages mapped. */
+    struct list_elem elem;              /* Element in mappings list. */
+  };
+#endif
+
+/* Serializes filesystem calls that touch directories or create
+   and remove files.  Plain reads and writes no longer need it:
+   the inode layer locks each inode individually. */
+static struct lock filesys_lock;
 
 static void syscall_handler (struct intr_frame *);
 
+static int sys_halt (uint32_t, uint32_t, uint32_t);
+static int sys_exit (uint32_t, uint32_t, uint32_t);
+static int sys_exec (uint32_t, uint32_t, uint32_t);
+static int sys_wait (uint32_t, uint32_t, uint32_t);
+static int sys_wait2 (uint32_t, uint32_t, uint32_t);
+static int sys_create (uint32_t, uint32_t, uint32_t);
+static int sys_remove (uint32_t, uint32_t, uint32_t);
+static int sys_rename (uint32_t, uint32_t, uint32_t);
+static int sys_open (uint32_t, uint32_t, uint32_t);
+static int sys_filesize (uint32_t, uint32_t, uint32_t);
+static int sys_read (uint32_t, uint32_t, uint32_t);
+static int sys_write (uint32_t, uint32_t, uint32_t);
+static int sys_readv (uint32_t, uint32_t, uint32_t);
+static int sys_writev (uint32_t, uint32_t, uint32_t);
+static int sys_batch (uint32_t, uint32_t, uint32_t);
+static int sys_pipe (uint32_t, uint32_t, uint32_t);
+static int sys_shm_attach (uint32_t, uint32_t, uint32_t);
+static int sys_shm_detach (uint32_t, uint32_t, uint32_t);
+static int sys_futex_wait (uint32_t, uint32_t, uint32_t);
+static int sys_futex_wake (uint32_t, uint32_t, uint32_t);
+static int sys_seek (uint32_t, uint32_t, uint32_t);
+static int sys_tell (uint32_t, uint32_t, uint32_t);
+static int sys_close (uint32_t, uint32_t, uint32_t);
+static int sys_chdir (uint32_t, uint32_t, uint32_t);
+static int sys_mkdir (uint32_t, uint32_t, uint32_t);
+static int sys_readdir (uint32_t, uint32_t, uint32_t);
+static int sys_getdents (uint32_t, uint32_t, uint32_t);
+static int sys_isdir (uint32_t, uint32_t, uint32_t);
+static int sys_inumber (uint32_t, uint32_t, uint32_t);
+static int sys_fdirect (uint32_t, uint32_t, uint32_t);
+#ifdef VM
+static int sys_mmap (uint32_t, uint32_t, uint32_t);
+static int sys_munmap (uint32_t, uint32_t, uint32_t);
+#endif
+
+/* One buffer of a vectored I/O request.  Layout must match
+   struct iovec in lib/user/syscall.h. */
+struct iovec
+  {
+    void *iov_base;             /* Starting address. */
+    unsigned iov_len;           /* Length in bytes. */
+  };
+#define IOV_MAX 1024            /* Maximum buffers per request. */
+
+/* One call of a batch submission.  Layout must match struct
+   syscall_rec in lib/user/syscall.h. */
+struct syscall_rec
+  {
+    unsigned nr;                /* System call number. */
+    unsigned args[3];           /* Argument words. */
+    int result;                 /* Out: the call's return value. */
+  };
+#define BATCH_MAX 256           /* Maximum records per batch. */
+
+/* A system call: its implementation, the number of 32-bit
+   argument words it expects on the user stack, and its name for
+   the "syscallstat" report. */
+struct syscall
+  {
+    int (*func) (uint32_t, uint32_t, uint32_t);
+    int argc;
+    const char *name;
+  };
+
+/* Dispatch table, indexed by system call number. */
+static const struct syscall syscall_table[] =
+  {
+    [SYS_HALT] = {sys_halt, 0, "halt"},
+    [SYS_EXIT] = {sys_exit, 1, "exit"},
+    [SYS_EXEC] = {sys_exec, 1, "exec"},
+    [SYS_WAIT] = {sys_wait, 1, "wait"},
+    [SYS_WAIT2] = {sys_wait2, 2, "wait2"},
+    [SYS_CREATE] = {sys_create, 2, "create"},
+    [SYS_REMOVE] = {sys_remove, 1, "remove"},
+    [SYS_OPEN] = {sys_open, 1, "open"},
+    [SYS_FILESIZE] = {sys_filesize, 1, "filesize"},
+    [SYS_READ] = {sys_read, 3, "read"},
+    [SYS_WRITE] = {sys_write, 3, "write"},
+    [SYS_SEEK] = {sys_seek, 2, "seek"},
+    [SYS_TELL] = {sys_tell, 1, "tell"},
+    [SYS_CLOSE] = {sys_close, 1, "close"},
+#ifdef VM
+    [SYS_MMAP] = {sys_mmap, 2, "mmap"},
+    [SYS_MUNMAP] = {sys_munmap, 1, "munmap"},
+#endif
+    [SYS_CHDIR] = {sys_chdir, 1, "chdir"},
+    [SYS_MKDIR] = {sys_mkdir, 1, "mkdir"},
+    [SYS_READDIR] = {sys_readdir, 2, "readdir"},
+    [SYS_GETDENTS] = {sys_getdents, 3, "getdents"},
+    [SYS_ISDIR] = {sys_isdir, 1, "isdir"},
+    [SYS_INUMBER] = {sys_inumber, 1, "inumber"},
+    [SYS_READV] = {sys_readv, 3, "readv"},
+    [SYS_WRITEV] = {sys_writev, 3, "writev"},
+    [SYS_PIPE] = {sys_pipe, 1, "pipe"},
+    [SYS_SHM_ATTACH] = {sys_shm_attach, 3, "shm_attach"},
+    [SYS_SHM_DETACH] = {sys_shm_detach, 1, "shm_detach"},
+    [SYS_FUTEX_WAIT] = {sys_futex_wait, 2, "futex_wait"},
+    [SYS_FUTEX_WAKE] = {sys_futex_wake, 2, "futex_wake"},
+    [SYS_RENAME] = {sys_rename, 2, "rename"},
+    [SYS_BATCH] = {sys_batch, 2, "batch"},
+    [SYS_FDIRECT] = {sys_fdirect, 2, "fdirect"},
+  };
+
+/* Per-syscall tracing, indexed by system call number.  SYS_FORK,
+   dispatched by hand, has a slot here but none in the dispatch
+   table.  A call that terminates the process never returns to
+   the handler, so it is counted but contributes no latency.
+   Dumped by the "syscallstat" action and reset by
+   "syscallreset". */
+struct syscall_stat
+  {
+    long long calls;            /* Invocations. */
+    int64_t total_ns;           /* Cumulative time spent. */
+    int64_t max_ns;             /* Longest single call. */
+  };
+static struct syscall_stat
+  syscall_stats[sizeof syscall_table / sizeof *syscall_table];
+
 void
-syscall_init (void) 
+syscall_init (void)
 {
+  lock_init (&filesys_lock);
+  lock_set_name (&filesys_lock, "filesys");
+  shm_init ();
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
+/* Terminates the current process with EXIT_CODE. */
 static void
-syscall_handler (struct intr_frame *f UNUSED) 
+process_kill (int exit_code)
 {
-  printf ("system call!\n");
+  thread_current ()->exit_code = exit_code;
   thread_exit ();
 }
+
+/* Reads a byte at user virtual address UADDR, which need not be
+   mapped.  Returns the byte value if successful, -1 if UADDR is
+   unmapped: the MMU raises a page fault on a bad access and the
+   handler in exception.c resumes us at the label stored in EAX
+   with EAX set to -1, so no page table walk is needed up front. */
+static int
+get_user (const uint8_t *uaddr)
+{
+  int result;
+
+  asm ("movl $1f, %0; movzbl %1, %0; 1:"
+       : "=&a" (result) : "m" (*uaddr));
+  return result;
+}
+
+/* Writes BYTE to user address UDST, which need not be mapped.
+   Returns true if successful, false if UDST is unmapped or
+   read-only, detected through the same page fault fixup as
+   get_user(). */
+static bool
+put_user (uint8_t *udst, uint8_t byte)
+{
+  int error_code;
+
+  asm ("movl $1f, %0; movb %b2, %1; 1:"
+       : "=&a" (error_code), "=m" (*udst) : "q" (byte));
+  return error_code != -1;
+}
+
+/* Verifies that the SIZE bytes starting at UADDR may be read as
+   user memory, by probing one byte per page.  Kills the process
+   if not. */
+static void
+validate_read (const void *uaddr, size_t size)
+{
+  const uint8_t *p = uaddr;
+  const uint8_t *end = p + size;
+
+  if (size == 0)
+    return;
+  if (p == NULL || !is_user_vaddr (end - 1))
+    process_kill (-1);
+
+  if (get_user (end - 1) == -1)
+    process_kill (-1);
+  for (p = pg_round_down (p); p < end; p += PGSIZE)
+    if (get_user (p) == -1)
+      process_kill (-1);
+}
+
+/* Verifies that the SIZE bytes starting at UADDR may be written
+   as user memory.  Probes each page by reading a byte and
+   writing it back, so read-only pages fail too.  Kills the
+   process if not. */
+static void
+validate_write (void *uaddr, size_t size)
+{
+  uint8_t *p = uaddr;
+  uint8_t *end = p + size;
+  int c;
+
+  if (size == 0)
+    return;
+  if (p == NULL || !is_user_vaddr (end - 1))
+    process_kill (-1);
+
+  c = get_user (end - 1);
+  if (c == -1 || !put_user (end - 1, c))
+    process_kill (-1);
+  for (p = pg_round_down (p); p < end; p += PGSIZE)
+    {
+      c = get_user (p);
+      if (c == -1 || !put_user (p, c))
+        process_kill (-1);
+    }
+}
+
+#ifdef VM
+/* Releases the pins pin_buffer() took on the pages holding the
+   SIZE bytes at UADDR. */
+static void
+unpin_buffer (const void *uaddr, size_t size)
+{
+  const uint8_t *p;
+  const uint8_t *end = (const uint8_t *) uaddr + size;
+
+  if (size == 0)
+    return;
+  for (p = pg_round_down (uaddr); p < end; p += PGSIZE)
+    page_unpin (p);
+}
+
+/* Pins the pages holding the SIZE bytes at UADDR into their
+   frames, faulting them in as needed, for the duration of a file
+   operation that copies through them: eviction skips pinned
+   frames, so the copy cannot race with a frame being unmapped or
+   written back, and independent I/O stays concurrent because no
+   global lock is involved.  Kills the process if a page cannot
+   be pinned.  The caller must already have validated the
+   buffer. */
+static void
+pin_buffer (const void *uaddr, size_t size)
+{
+  const uint8_t *start = pg_round_down (uaddr);
+  const uint8_t *end = (const uint8_t *) uaddr + size;
+  const uint8_t *p;
+
+  if (size == 0)
+    return;
+  for (p = start; p < end; p += PGSIZE)
+    if (!page_pin (p))
+      {
+        /* Unwind the pins taken so far before dying, so shared
+           frames are not left pinned forever. */
+        while (p > start)
+          {
+            p -= PGSIZE;
+            page_unpin (p);
+          }
+        process_kill (-1);
+      }
+}
+#endif
+
+/* Verifies that UADDR points to a valid null-terminated string
+   in user memory.  Kills the process if not. */
+static void
+validate_ustr (const char *uaddr)
+{
+  const uint8_t *p = (const uint8_t *) uaddr;
+
+  for (;;)
+    {
+      int c;
+
+      if (p == NULL || !is_user_vaddr (p))
+        process_kill (-1);
+      c = get_user (p);
+      if (c == -1)
+        process_kill (-1);
+      if (c == '\0')
+        return;
+      p++;
+    }
+}
+
+/* Returns true if descriptor FD in TABLE holds a directory. */
+static bool
+fd_is_dir (const struct fd_table *table, int fd)
+{
+  int slot = fd - FD_FIRST;
+
+  return (table->dir_map[slot / 32] >> slot % 32) & 1;
+}
+
+/* Returns true if descriptor FD in TABLE holds a pipe end. */
+static bool
+fd_is_pipe (const struct fd_table *table, int fd)
+{
+  int slot = fd - FD_FIRST;
+
+  return (table->pipe_map[slot / 32] >> slot % 32) & 1;
+}
+
+/* Returns what descriptor FD in TABLE holds. */
+static enum fd_kind
+fd_kind (const struct fd_table *table, int fd)
+{
+  return (fd_is_dir (table, fd) ? FD_DIR
+          : fd_is_pipe (table, fd) ? FD_PIPE
+          : FD_FILE);
+}
+
+/* Returns the file open as FD in the current thread, or a null
+   pointer if FD is not open or holds something other than an
+   ordinary file. */
+static struct file *
+lookup_fd (int fd)
+{
+  struct fd_table *table = thread_current ()->fd_table;
+
+  if (table == NULL || fd < FD_FIRST || fd >= FD_FIRST + FD_MAX
+      || fd_kind (table, fd) != FD_FILE)
+    return NULL;
+  return table->handles[fd - FD_FIRST];
+}
+
+/* Returns the directory open as FD in the current thread, or a
+   null pointer if FD is not open or holds something else. */
+static struct dir *
+lookup_fd_dir (int fd)
+{
+  struct fd_table *table = thread_current ()->fd_table;
+
+  if (table == NULL || fd < FD_FIRST || fd >= FD_FIRST + FD_MAX
+      || fd_kind (table, fd) != FD_DIR)
+    return NULL;
+  return table->handles[fd - FD_FIRST];
+}
+
+/* Returns the pipe end open as FD in the current thread, or a
+   null pointer if FD is not open or holds something else. */
+static struct pipe_end *
+lookup_fd_pipe (int fd)
+{
+  struct fd_table *table = thread_current ()->fd_table;
+
+  if (table == NULL || fd < FD_FIRST || fd >= FD_FIRST + FD_MAX
+      || fd_kind (table, fd) != FD_PIPE)
+    return NULL;
+  return table->handles[fd - FD_FIRST];
+}
+
+/* Allocates a descriptor in the current thread's fd table for
+   HANDLE, which is of kind KIND, creating the table if the
+   process has none yet.  Returns the new descriptor or -1 if the
+   table is full or cannot be allocated. */
+static int
+allocate_fd (void *handle, enum fd_kind kind)
+{
+  struct thread *cur = thread_current ();
+  struct fd_table *table = cur->fd_table;
+  size_t i;
+
+  if (table == NULL)
+    {
+      if (fd_table_cache == NULL)
+        fd_table_cache = slab_create ("fdtable", sizeof (struct fd_table));
+      table = fd_table_cache != NULL ? slab_alloc (fd_table_cache) : NULL;
+      if (table == NULL)
+        return -1;
+
+      memset (table->handles, 0, sizeof table->handles);
+      memset (table->free_map, 0xff, sizeof table->free_map);
+      memset (table->dir_map, 0, sizeof table->dir_map);
+      memset (table->pipe_map, 0, sizeof table->pipe_map);
+      cur->fd_table = table;
+    }
+
+  /* Find the lowest free slot via the bitmap. */
+  for (i = 0; i < sizeof table->free_map / sizeof *table->free_map; i++)
+    if (table->free_map[i] != 0)
+      {
+        int bit = __builtin_ctz (table->free_map[i]);
+        int slot = i * 32 + bit;
+
+        table->free_map[i] &= ~((uint32_t) 1 << bit);
+        if (kind == FD_DIR)
+          table->dir_map[i] |= (uint32_t) 1 << bit;
+        else if (kind == FD_PIPE)
+          table->pipe_map[i] |= (uint32_t) 1 << bit;
+        table->handles[slot] = handle;
+        return slot + FD_FIRST;
+      }
+
+  return -1;
+}
+
+/* Releases descriptor FD in the current thread's fd table and
+   returns the handle that was open there, setting *KIND to what
+   it holds.  Returns a null pointer if FD was not open. */
+static void *
+release_fd (int fd, enum fd_kind *kind)
+{
+  struct fd_table *table = thread_current ()->fd_table;
+  void *handle;
+  int slot;
+
+  if (table == NULL || fd < FD_FIRST || fd >= FD_FIRST + FD_MAX)
+    return NULL;
+  slot = fd - FD_FIRST;
+  handle = table->handles[slot];
+  if (handle != NULL)
+    {
+      *kind = fd_kind (table, fd);
+      table->handles[slot] = NULL;
+      table->free_map[slot / 32] |= (uint32_t) 1 << slot % 32;
+      table->dir_map[slot / 32] &= ~((uint32_t) 1 << slot % 32);
+      table->pipe_map[slot / 32] &= ~((uint32_t) 1 << slot % 32);
+    }
+  return handle;
+}
+
+/* Closes pipe end PE, waking any thread blocked on the vanishing
+   end and destroying the pipe when the last end goes. */
+static void
+pipe_end_close (struct pipe_end *pe)
+{
+  struct pipe *p = pe->pipe;
+  bool destroy;
+
+  lock_acquire (&p->lock);
+  if (pe->writer)
+    {
+      if (--p->writers == 0)
+        cond_broadcast (&p->not_empty, &p->lock);
+    }
+  else
+    {
+      if (--p->readers == 0)
+        cond_broadcast (&p->not_full, &p->lock);
+    }
+  destroy = p->readers == 0 && p->writers == 0;
+  lock_release (&p->lock);
+
+  free (pe);
+  if (destroy)
+    {
+      palloc_free_page (p->buf);
+      free (p);
+    }
+}
+
+#ifdef VM
+/* Duplicates pipe end PE for a forked child.  Returns the new
+   end, or a null pointer if memory runs out. */
+static struct pipe_end *
+pipe_end_dup (struct pipe_end *pe)
+{
+  struct pipe *p = pe->pipe;
+  struct pipe_end *copy = malloc (sizeof *copy);
+
+  if (copy == NULL)
+    return NULL;
+  *copy = *pe;
+  lock_acquire (&p->lock);
+  if (pe->writer)
+    p->writers++;
+  else
+    p->readers++;
+  lock_release (&p->lock);
+  return copy;
+}
+#endif
+
+/* Reads up to SIZE bytes from pipe P into BUFFER.  Blocks until
+   at least one byte is available or every write end has been
+   closed.  Returns the number of bytes read, 0 at
+   end-of-file. */
+static int
+pipe_read (struct pipe *p, uint8_t *buffer, size_t size)
+{
+  size_t cnt = 0;
+
+  lock_acquire (&p->lock);
+  while (p->cnt == 0 && p->writers > 0)
+    cond_wait (&p->not_empty, &p->lock);
+  while (cnt < size && p->cnt > 0)
+    {
+      /* Copy a contiguous span, up to the end of the ring. */
+      size_t run = p->cnt < size - cnt ? p->cnt : size - cnt;
+
+      if (run > PIPE_BUFSIZE - p->tail)
+        run = PIPE_BUFSIZE - p->tail;
+      memcpy (buffer + cnt, p->buf + p->tail, run);
+      p->tail = (p->tail + run) % PIPE_BUFSIZE;
+      p->cnt -= run;
+      cnt += run;
+    }
+  if (cnt > 0)
+    cond_broadcast (&p->not_full, &p->lock);
+  lock_release (&p->lock);
+  return cnt;
+}
+
+/* Writes the SIZE bytes in BUFFER to pipe P, blocking whenever
+   the ring fills.  Returns SIZE, or -1 if every read end was
+   closed before anything could be written, or a short count if
+   the last read end vanished partway. */
+static int
+pipe_write (struct pipe *p, const uint8_t *buffer, size_t size)
+{
+  size_t cnt = 0;
+  int result;
+
+  lock_acquire (&p->lock);
+  while (cnt < size)
+    {
+      size_t head, run;
+
+      if (p->readers == 0)
+        break;
+      if (p->cnt == PIPE_BUFSIZE)
+        {
+          cond_wait (&p->not_full, &p->lock);
+          continue;
+        }
+
+      /* Copy a contiguous span, up to the end of the ring. */
+      head = (p->tail + p->cnt) % PIPE_BUFSIZE;
+      run = PIPE_BUFSIZE - p->cnt < size - cnt
+        ? PIPE_BUFSIZE - p->cnt : size - cnt;
+      if (run > PIPE_BUFSIZE - head)
+        run = PIPE_BUFSIZE - head;
+      memcpy (p->buf + head, buffer + cnt, run);
+      p->cnt += run;
+      cnt += run;
+      cond_broadcast (&p->not_empty, &p->lock);
+    }
+  result = cnt == 0 && p->readers == 0 ? -1 : (int) cnt;
+  lock_release (&p->lock);
+  return result;
+}
+
+/* Closes all of the current process's open files and frees its
+   fd table.  Called from process_exit(). */
+void
+syscall_close_all (void)
+{
+  struct thread *cur = thread_current ();
+  struct fd_table *table = cur->fd_table;
+  int i;
+
+  if (table == NULL)
+    return;
+
+  for (i = 0; i < FD_MAX; i++)
+    if (table->handles[i] != NULL)
+      {
+        if (fd_is_pipe (table, i + FD_FIRST))
+          {
+            pipe_end_close (table->handles[i]);
+            continue;
+          }
+        lock_acquire (&filesys_lock);
+        if (fd_is_dir (table, i + FD_FIRST))
+          dir_close (table->handles[i]);
+        else
+          file_close (table->handles[i]);
+        lock_release (&filesys_lock);
+      }
+
+  cur->fd_table = NULL;
+  slab_free (fd_table_cache, table);
+}
+
+/* Flushes and frees the current process's console staging
+   buffer, so a final line without a newline still appears.
+   Called from process_exit(), before the exit message. */
+void
+syscall_stdout_flush (void)
+{
+  struct thread *cur = thread_current ();
+
+  if (cur->stdout_buf == NULL)
+    return;
+  if (cur->stdout_len > 0)
+    putbuf (cur->stdout_buf, cur->stdout_len);
+  free (cur->stdout_buf);
+  cur->stdout_buf = NULL;
+  cur->stdout_len = 0;
+}
+
+/* Adds the time elapsed since START to NR's latency totals. */
+static void
+syscall_record (uint32_t nr, int64_t start)
+{
+  struct syscall_stat *st = &syscall_stats[nr];
+  int64_t elapsed = timer_now_ns () - start;
+
+  st->total_ns += elapsed;
+  if (elapsed > st->max_ns)
+    st->max_ns = elapsed;
+}
+
+/* Prints per-syscall invocation counts and latencies. */
+void
+syscall_print_stats (void)
+{
+  uint32_t nr;
+
+  printf ("%-10s %10s %12s %12s %12s\n",
+          "syscall", "calls", "total us", "avg us", "max us");
+  for (nr = 0; nr < sizeof syscall_stats / sizeof *syscall_stats; nr++)
+    {
+      const struct syscall_stat *st = &syscall_stats[nr];
+      const char *name = (nr == SYS_FORK ? "fork"
+                          : syscall_table[nr].name);
+
+      if (st->calls == 0)
+        continue;
+      printf ("%-10s %10lld %12lld %12lld %12lld\n",
+              name, st->calls, st->total_ns / 1000,
+              st->total_ns / st->calls / 1000, st->max_ns / 1000);
+    }
+}
+
+/* Resets the per-syscall statistics to zero. */
+void
+syscall_reset_stats (void)
+{
+  memset (syscall_stats, 0, sizeof syscall_stats);
+}
+
+/* Dispatches the system call in F. */
+static void
+syscall_handler (struct intr_frame *f)
+{
+  uint32_t args[4];
+  uint32_t nr;
+  const struct syscall *call;
+  int64_t start;
+
+  /* Ticks from here to the return are kernel time on the
+     process's bill; see thread_tick(). */
+  thread_current ()->in_syscall = true;
+
+#ifdef VM
+  /* Save the user stack pointer for the stack growth heuristic:
+     a fault taken while we probe user memory below arrives in
+     kernel context, where F's ESP is useless. */
+  thread_current ()->user_esp = f->esp;
+#endif
+
+  /* Fetch the system call number. */
+  validate_read (f->esp, sizeof (uint32_t));
+  memcpy (&nr, f->esp, sizeof nr);
+
+  TRACE (TRACE_SYS_ENTER, nr);
+
+#ifdef VM
+  /* fork is dispatched by hand: it needs the whole interrupt
+     frame, not just stack arguments, to clone the caller's
+     register state. */
+  if (nr == SYS_FORK)
+    {
+      syscall_stats[SYS_FORK].calls++;
+      start = timer_now_ns ();
+      f->eax = process_fork (f);
+      syscall_record (SYS_FORK, start);
+      TRACE (TRACE_SYS_EXIT, nr);
+      thread_current ()->in_syscall = false;
+      return;
+    }
+#endif
+
+  if (nr >= sizeof syscall_table / sizeof *syscall_table
+      || syscall_table[nr].func == NULL)
+    process_kill (-1);
+  call = &syscall_table[nr];
+
+  /* Fetch the arguments. */
+  validate_read ((uint32_t *) f->esp + 1, call->argc * sizeof (uint32_t));
+  memset (args, 0, sizeof args);
+  memcpy (args, (uint32_t *) f->esp + 1, call->argc * sizeof (uint32_t));
+
+  syscall_stats[nr].calls++;
+  start = timer_now_ns ();
+  f->eax = call->func (args[0], args[1], args[2]);
+  syscall_record (nr, start);
+  TRACE (TRACE_SYS_EXIT, nr);
+  thread_current ()->in_syscall = false;
+}
+
+/* Dispatches a system call that entered through sysenter.
+   sysenter_entry in sysenter.S rebuilds the same frame `int
+   $0x30' would have delivered, so dispatch is shared; only the
+   entry and exit paths differ. */
+void
+syscall_sysenter (struct intr_frame *f)
+{
+  syscall_handler (f);
+}
+
+/* halt: powers off the machine. */
+static int
+sys_halt (uint32_t a UNUSED, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  shutdown_power_off ();
+}
+
+/* exit: terminates the current process with the given status. */
+static int
+sys_exit (uint32_t status, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  process_kill ((int) status);
+  NOT_REACHED ();
+}
+
+/* exec: runs the given command line as a new process and returns
+   its pid, or -1 on failure. */
+static int
+sys_exec (uint32_t cmd_line_, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  const char *cmd_line = (const char *) cmd_line_;
+
+  validate_ustr (cmd_line);
+  return process_execute (cmd_line);
+}
+
+/* wait: waits for the given child process to exit and returns
+   its exit status. */
+static int
+sys_wait (uint32_t pid, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  return process_wait ((tid_t) pid, NULL);
+}
+
+/* wait2: like wait, but also stores the child's resource usage
+   in *USAGE, for supervisors that account for their children's
+   cost. */
+static int
+sys_wait2 (uint32_t pid, uint32_t usage_, uint32_t c UNUSED)
+{
+  struct rusage *usage = (struct rusage *) usage_;
+  struct rusage u;
+  int exit_code;
+
+  /* A child the kernel killed also exits with -1, so usage is
+     reported regardless; an invalid pid reports zeros. */
+  validate_write (usage, sizeof *usage);
+  memset (&u, 0, sizeof u);
+  exit_code = process_wait ((tid_t) pid, &u);
+  memcpy (usage, &u, sizeof u);
+  return exit_code;
+}
+
+/* create: creates a file of the given initial size. */
+static int
+sys_create (uint32_t file_, uint32_t initial_size, uint32_t c UNUSED)
+{
+  const char *file = (const char *) file_;
+  bool ok;
+
+  validate_ustr (file);
+  lock_acquire (&filesys_lock);
+  ok = filesys_create (file, initial_size);
+  lock_release (&filesys_lock);
+  return ok;
+}
+
+/* remove: deletes the given file. */
+static int
+sys_remove (uint32_t file_, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  const char *file = (const char *) file_;
+  bool ok;
+
+  validate_ustr (file);
+  lock_acquire (&filesys_lock);
+  ok = filesys_remove (file);
+  lock_release (&filesys_lock);
+  return ok;
+}
+
+/* rename: atomically renames a file or directory, replacing the
+   destination if it exists. */
+static int
+sys_rename (uint32_t old_, uint32_t new_, uint32_t c UNUSED)
+{
+  const char *old_path = (const char *) old_;
+  const char *new_path = (const char *) new_;
+  bool ok;
+
+  validate_ustr (old_path);
+  validate_ustr (new_path);
+  lock_acquire (&filesys_lock);
+  ok = filesys_rename (old_path, new_path);
+  lock_release (&filesys_lock);
+  return ok;
+}
+
+/* open: opens the given file, returning a file descriptor or -1
+   on failure. */
+static int
+sys_open (uint32_t file_, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  const char *file_name = (const char *) file_;
+  struct file *file;
+  int fd;
+
+  validate_ustr (file_name);
+
+  lock_acquire (&filesys_lock);
+  file = filesys_open (file_name);
+  if (file != NULL && inode_is_dir (file_get_inode (file)))
+    {
+      /* A directory: rewrap the inode in a directory handle. */
+      struct dir *dir = dir_open (inode_reopen (file_get_inode (file)));
+
+      file_close (file);
+      lock_release (&filesys_lock);
+      if (dir == NULL)
+        return -1;
+      fd = allocate_fd (dir, FD_DIR);
+      if (fd == -1)
+        {
+          lock_acquire (&filesys_lock);
+          dir_close (dir);
+          lock_release (&filesys_lock);
+        }
+      return fd;
+    }
+  lock_release (&filesys_lock);
+  if (file == NULL)
+    return -1;
+
+  fd = allocate_fd (file, FD_FILE);
+  if (fd == -1)
+    {
+      lock_acquire (&filesys_lock);
+      file_close (file);
+      lock_release (&filesys_lock);
+    }
+  return fd;
+}
+
+/* filesize: returns the size of the file open as FD. */
+static int
+sys_filesize (uint32_t fd, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  struct file *file = lookup_fd (fd);
+  int size;
+
+  if (file == NULL)
+    return -1;
+  lock_acquire (&filesys_lock);
+  size = file_length (file);
+  lock_release (&filesys_lock);
+  return size;
+}
+
+/* Reads from an open file or the keyboard into a user buffer.
+   Returns the number of bytes read or -1 on error. */
+static int
+do_read (uint32_t fd, uint32_t buffer_, uint32_t size)
+{
+  uint8_t *buffer = (uint8_t *) buffer_;
+  struct pipe_end *pe;
+  struct file *file;
+  int bytes;
+
+  validate_write (buffer, size);
+
+  if (fd == STDIN_FILENO)
+    {
+      size_t ofs = 0;
+
+      /* Drain the input buffer a batch at a time rather than a
+         key at a time. */
+      while (ofs < size)
+        ofs += input_read (buffer + ofs, size - ofs);
+      return size;
+    }
+
+  pe = lookup_fd_pipe (fd);
+  if (pe != NULL)
+    return pe->writer ? -1 : pipe_read (pe->pipe, buffer, size);
+
+  file = lookup_fd (fd);
+  if (file == NULL)
+    return -1;
+  /* No global lock: the inode layer locks each inode on its own,
+     so reads of independent files proceed in parallel.  The
+     buffer's frames are pinned so eviction cannot unmap them
+     mid-copy. */
+#ifdef VM
+  pin_buffer (buffer, size);
+#endif
+  bytes = file_read (file, buffer, size);
+#ifdef VM
+  unpin_buffer (buffer, size);
+#endif
+  return bytes;
+}
+
+/* read: do_read() plus the byte accounting wait2 reports. */
+static int
+sys_read (uint32_t fd, uint32_t buffer_, uint32_t size)
+{
+  int bytes = do_read (fd, buffer_, size);
+
+  if (bytes > 0)
+    thread_current ()->read_bytes += bytes;
+  return bytes;
+}
+
+/* Size of the per-process console staging buffer. */
+#define STDOUT_BUF_SIZE 256
+
+/* Stages SIZE bytes of BUFFER for the console.  Staged bytes are
+   flushed to the console as a unit at each newline or when the
+   buffer fills, so the console lock is held for at most
+   STDOUT_BUF_SIZE bytes at a time no matter how large the user's
+   write is, and output from concurrently writing processes
+   interleaves by line instead of by character. */
+static void
+stdout_write (const char *buffer, size_t size)
+{
+  struct thread *cur = thread_current ();
+  size_t i;
+
+  if (cur->stdout_buf == NULL)
+    {
+      cur->stdout_buf = malloc (STDOUT_BUF_SIZE);
+      if (cur->stdout_buf == NULL)
+        {
+          /* No memory for staging; write straight through. */
+          putbuf (buffer, size);
+          return;
+        }
+    }
+
+  for (i = 0; i < size; i++)
+    {
+      cur->stdout_buf[cur->stdout_len++] = buffer[i];
+      if (buffer[i] == '\n' || cur->stdout_len == STDOUT_BUF_SIZE)
+        {
+          putbuf (cur->stdout_buf, cur->stdout_len);
+          cur->stdout_len = 0;
+        }
+    }
+}
+
+/* Writes a user buffer to an open file or the console.  Returns
+   the number of bytes written or -1 on error. */
+static int
+do_write (uint32_t fd, uint32_t buffer_, uint32_t size)
+{
+  const char *buffer = (const char *) buffer_;
+  struct pipe_end *pe;
+  struct file *file;
+  int bytes;
+
+  validate_read (buffer, size);
+
+  if (fd == STDOUT_FILENO)
+    {
+      stdout_write (buffer, size);
+      return size;
+    }
+
+  pe = lookup_fd_pipe (fd);
+  if (pe != NULL)
+    return !pe->writer ? -1
+      : pipe_write (pe->pipe, (const uint8_t *) buffer, size);
+
+  file = lookup_fd (fd);
+  if (file == NULL)
+    return -1;
+  /* No global lock, as in sys_read(): per-inode locking makes
+     writes to independent files concurrent.  Pinning keeps
+     eviction from writing the buffer back mid-copy. */
+#ifdef VM
+  pin_buffer (buffer, size);
+#endif
+  bytes = file_write (file, buffer, size);
+#ifdef VM
+  unpin_buffer (buffer, size);
+#endif
+  return bytes;
+}
+
+/* write: do_write() plus the byte accounting wait2 reports. */
+static int
+sys_write (uint32_t fd, uint32_t buffer_, uint32_t size)
+{
+  int bytes = do_write (fd, buffer_, size);
+
+  if (bytes > 0)
+    thread_current ()->write_bytes += bytes;
+  return bytes;
+}
+
+/* pipe: creates a pipe, storing the read-end descriptor in
+   FDS[0] and the write-end descriptor in FDS[1].  Returns 0, or
+   -1 if memory or descriptors run out. */
+static int
+sys_pipe (uint32_t fds_, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  int *fds = (int *) fds_;
+  struct pipe *p;
+  struct pipe_end *rd, *wr;
+  int rfd, wfd;
+
+  validate_write (fds, 2 * sizeof *fds);
+
+  p = malloc (sizeof *p);
+  rd = malloc (sizeof *rd);
+  wr = malloc (sizeof *wr);
+  if (p == NULL || rd == NULL || wr == NULL)
+    goto fail;
+  p->buf = palloc_get_page (0);
+  if (p->buf == NULL)
+    goto fail;
+
+  lock_init (&p->lock);
+  cond_init (&p->not_empty);
+  cond_init (&p->not_full);
+  p->tail = 0;
+  p->cnt = 0;
+  p->readers = 1;
+  p->writers = 1;
+  rd->pipe = p;
+  rd->writer = false;
+  wr->pipe = p;
+  wr->writer = true;
+
+  rfd = allocate_fd (rd, FD_PIPE);
+  wfd = allocate_fd (wr, FD_PIPE);
+  if (rfd == -1 || wfd == -1)
+    {
+      enum fd_kind kind;
+
+      if (rfd != -1)
+        release_fd (rfd, &kind);
+      if (wfd != -1)
+        release_fd (wfd, &kind);
+      palloc_free_page (p->buf);
+      goto fail;
+    }
+
+  fds[0] = rfd;
+  fds[1] = wfd;
+  return 0;
+
+ fail:
+  free (p);
+  free (rd);
+  free (wr);
+  return -1;
+}
+
+/* readv: reads from FD into each buffer of an iovec array in
+   turn, in one kernel entry.  Returns the total number of bytes
+   read, which is short if a read comes up short, or -1 if
+   nothing could be read. */
+static int
+sys_readv (uint32_t fd, uint32_t iov_, uint32_t iov_cnt)
+{
+  const struct iovec *iov = (const struct iovec *) iov_;
+  uint32_t i;
+  int total = 0;
+
+  if (iov_cnt > IOV_MAX)
+    return -1;
+  validate_read (iov, iov_cnt * sizeof *iov);
+  for (i = 0; i < iov_cnt; i++)
+    {
+      int bytes = sys_read (fd, (uint32_t) iov[i].iov_base,
+                            iov[i].iov_len);
+
+      if (bytes < 0)
+        return total > 0 ? total : -1;
+      total += bytes;
+      if ((unsigned) bytes < iov[i].iov_len)
+        break;
+    }
+  return total;
+}
+
+/* writev: writes each buffer of an iovec array to FD in turn, in
+   one kernel entry.  Returns the total number of bytes written,
+   which is short if a write comes up short, or -1 if nothing
+   could be written. */
+static int
+sys_writev (uint32_t fd, uint32_t iov_, uint32_t iov_cnt)
+{
+  const struct iovec *iov = (const struct iovec *) iov_;
+  uint32_t i;
+  int total = 0;
+
+  if (iov_cnt > IOV_MAX)
+    return -1;
+  validate_read (iov, iov_cnt * sizeof *iov);
+  for (i = 0; i < iov_cnt; i++)
+    {
+      int bytes = sys_write (fd, (uint32_t) iov[i].iov_base,
+                             iov[i].iov_len);
+
+      if (bytes < 0)
+        return total > 0 ? total : -1;
+      total += bytes;
+      if ((unsigned) bytes < iov[i].iov_len)
+        break;
+    }
+  return total;
+}
+
+/* batch: executes the CNT system calls described by the records
+   at RECS in order, storing each call's return value in its
+   record, so a syscall-dense loop pays for one trap instead of
+   CNT.  Each executed call checks its own pointer arguments as
+   usual.  fork cannot be batched, since it needs the trap frame,
+   and batches do not nest; either kills the process like any
+   unknown call number.  Returns CNT, or -1 if it exceeds
+   BATCH_MAX. */
+static int
+sys_batch (uint32_t recs_, uint32_t cnt, uint32_t c UNUSED)
+{
+  struct syscall_rec *recs = (struct syscall_rec *) recs_;
+  uint32_t i;
+
+  if (cnt > BATCH_MAX)
+    return -1;
+  validate_write (recs, cnt * sizeof *recs);
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct syscall_rec r;
+      int64_t start;
+
+      /* Snapshot the record, so another thread sharing the
+         address space cannot swap the number or arguments after
+         they are checked. */
+      memcpy (&r, &recs[i], sizeof r);
+      if (r.nr >= sizeof syscall_table / sizeof *syscall_table
+          || syscall_table[r.nr].func == NULL || r.nr == SYS_BATCH)
+        process_kill (-1);
+
+      syscall_stats[r.nr].calls++;
+      start = timer_now_ns ();
+      recs[i].result = syscall_table[r.nr].func (r.args[0], r.args[1],
+                                                 r.args[2]);
+      syscall_record (r.nr, start);
+    }
+  return cnt;
+}
+
+/* shm_attach: maps the named shared segment at ADDR, creating
+   it PAGE_CNT pages long if it does not exist yet.  Returns 0,
+   or -1 on a bad name, size, or address. */
+static int
+sys_shm_attach (uint32_t name_, uint32_t addr_, uint32_t page_cnt)
+{
+  const char *name = (const char *) name_;
+
+  validate_ustr (name);
+  return shm_attach (name, (void *) addr_, page_cnt);
+}
+
+/* shm_detach: unmaps the shared segment attached at ADDR.
+   Returns 0, or -1 if nothing is attached there. */
+static int
+sys_shm_detach (uint32_t addr_, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  return shm_detach ((const void *) addr_);
+}
+
+/* futex_wait: blocks until a futex_wake() on ADDR, unless the
+   word at ADDR no longer holds EXPECTED.  Returns 0, or -1 if
+   ADDR is unmapped or misaligned. */
+static int
+sys_futex_wait (uint32_t addr_, uint32_t expected, uint32_t c UNUSED)
+{
+  int *addr = (int *) addr_;
+
+  validate_write (addr, sizeof *addr);
+  return futex_wait (addr, expected);
+}
+
+/* futex_wake: wakes up to MAX threads blocked in futex_wait()
+   on ADDR.  Returns the number woken, or -1 if ADDR is unmapped
+   or misaligned. */
+static int
+sys_futex_wake (uint32_t addr_, uint32_t max, uint32_t c UNUSED)
+{
+  int *addr = (int *) addr_;
+
+  validate_write (addr, sizeof *addr);
+  return futex_wake (addr, max);
+}
+
+/* seek: sets the position in the file open as FD. */
+static int
+sys_seek (uint32_t fd, uint32_t position, uint32_t c UNUSED)
+{
+  struct file *file = lookup_fd (fd);
+
+  if (file != NULL)
+    {
+      lock_acquire (&filesys_lock);
+      file_seek (file, position);
+      lock_release (&filesys_lock);
+    }
+  return 0;
+}
+
+/* tell: returns the position in the file open as FD. */
+static int
+sys_tell (uint32_t fd, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  struct file *file = lookup_fd (fd);
+  int pos;
+
+  if (file == NULL)
+    return -1;
+  lock_acquire (&filesys_lock);
+  pos = file_tell (file);
+  lock_release (&filesys_lock);
+  return pos;
+}
+
+#ifdef VM
+/* Writes back and removes every page of M, closes its file, and
+   frees it.  The caller must have removed M from the mappings
+   list. */
+static void
+unmap (struct mapping *m)
+{
+  size_t i;
+
+  /* Batch the TLB invalidations: unmapping a large file mapping
+     clears one PTE per page, and one flush at the end beats
+     hundreds along the way. */
+  pagedir_begin_updates ();
+  for (i = 0; i < m->page_cnt; i++)
+    {
+      struct page *p = page_lookup (m->base + i * PGSIZE);
+
+      if (p != NULL)
+        page_deallocate (p);
+    }
+  pagedir_end_updates ();
+  lock_acquire (&filesys_lock);
+  file_close (m->file);
+  lock_release (&filesys_lock);
+  free (m);
+}
+
+/* mmap: maps the file open as FD at user address ADDR, demand
+   paged from the file, and returns a mapping id, or -1 if the
+   arguments or the address range are no good. */
+static int
+sys_mmap (uint32_t fd, uint32_t addr_, uint32_t c UNUSED)
+{
+  struct thread *cur = thread_current ();
+  uint8_t *addr = (uint8_t *) addr_;
+  struct file *file = lookup_fd (fd);
+  struct mapping *m;
+  off_t length;
+  size_t page_cnt, i;
+
+  if (file == NULL || addr == NULL || pg_ofs (addr) != 0)
+    return -1;
+
+  lock_acquire (&filesys_lock);
+  length = file_length (file);
+  file = length > 0 ? file_reopen (file) : NULL;
+  lock_release (&filesys_lock);
+  if (file == NULL)
+    return -1;
+
+  page_cnt = DIV_ROUND_UP (length, PGSIZE);
+  m = malloc (sizeof *m);
+  if (m == NULL || !is_user_vaddr (addr + page_cnt * PGSIZE - 1))
+    goto fail;
+
+  /* Register the pages.  page_allocate_file() refuses an address
+     that is already mapped, so overlap with the stack, the
+     executable, or another mapping fails cleanly here; the
+     pagedir check catches pages mapped outside the supplemental
+     page table, like shared memory and the time page. */
+  for (i = 0; i < page_cnt; i++)
+    {
+      off_t offset = i * PGSIZE;
+      size_t read_bytes = offset + PGSIZE < length ? PGSIZE : length - offset;
+      struct page *p
+        = pagedir_get_page (cur->pagedir, addr + offset) == NULL
+        ? page_allocate_file (addr + offset, file, offset, read_bytes, true)
+        : NULL;
+
+      if (p == NULL)
+        {
+          while (i-- > 0)
+            page_deallocate (page_lookup (addr + i * PGSIZE));
+          goto fail;
+        }
+      p->private = false;
+    }
+
+  m->id = cur->next_mapid++;
+  m->file = file;
+  m->base = addr;
+  m->page_cnt = page_cnt;
+  list_push_back (&cur->mappings, &m->elem);
+  return m->id;
+
+ fail:
+  free (m);
+  lock_acquire (&filesys_lock);
+  file_close (file);
+  lock_release (&filesys_lock);
+  return -1;
+}
+
+/* munmap: removes the mapping with the given id, writing any
+   dirty pages back to the file. */
+static int
+sys_munmap (uint32_t mapid, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  struct thread *cur = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&cur->mappings); e != list_end (&cur->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+
+      if (m->id == (int) mapid)
+        {
+          list_remove (&m->elem);
+          unmap (m);
+          break;
+        }
+    }
+  return 0;
+}
+
+/* Duplicates PARENT's open files into the current (child)
+   process, for fork: each descriptor is reopened on the same
+   inode and seeked to the same position.  Returns true if
+   successful. */
+bool
+syscall_duplicate_fds (struct thread *parent)
+{
+  struct fd_table *pt = parent->fd_table;
+  struct fd_table *ct;
+  int i;
+
+  if (pt == NULL)
+    return true;
+
+  ct = slab_alloc (fd_table_cache);
+  if (ct == NULL)
+    return false;
+  memset (ct->handles, 0, sizeof ct->handles);
+  memcpy (ct->free_map, pt->free_map, sizeof ct->free_map);
+  memcpy (ct->dir_map, pt->dir_map, sizeof ct->dir_map);
+  memcpy (ct->pipe_map, pt->pipe_map, sizeof ct->pipe_map);
+
+  for (i = 0; i < FD_MAX; i++)
+    if (pt->handles[i] != NULL)
+      {
+        if (fd_is_pipe (pt, i + FD_FIRST))
+          ct->handles[i] = pipe_end_dup (pt->handles[i]);
+        else
+          {
+            lock_acquire (&filesys_lock);
+            if (fd_is_dir (pt, i + FD_FIRST))
+              ct->handles[i] = dir_reopen (pt->handles[i]);
+            else
+              {
+                ct->handles[i] = file_reopen (pt->handles[i]);
+                if (ct->handles[i] != NULL)
+                  file_seek (ct->handles[i], file_tell (pt->handles[i]));
+              }
+            lock_release (&filesys_lock);
+          }
+
+        if (ct->handles[i] == NULL)
+          {
+            while (i-- > 0)
+              if (ct->handles[i] != NULL)
+                {
+                  if (fd_is_pipe (ct, i + FD_FIRST))
+                    {
+                      pipe_end_close (ct->handles[i]);
+                      continue;
+                    }
+                  lock_acquire (&filesys_lock);
+                  if (fd_is_dir (ct, i + FD_FIRST))
+                    dir_close (ct->handles[i]);
+                  else
+                    file_close (ct->handles[i]);
+                  lock_release (&filesys_lock);
+                }
+            slab_free (fd_table_cache, ct);
+            return false;
+          }
+      }
+
+  thread_current ()->fd_table = ct;
+  return true;
+}
+
+/* Removes all of the current process's file mappings.  Called
+   from process_exit(), while the page directory is still live so
+   dirty pages can be written back. */
+void
+syscall_munmap_all (void)
+{
+  struct thread *cur = thread_current ();
+
+  while (!list_empty (&cur->mappings))
+    {
+      struct mapping *m = list_entry (list_pop_front (&cur->mappings),
+                                      struct mapping, elem);
+      unmap (m);
+    }
+}
+#endif
+
+/* close: closes the file, directory, or pipe end open as FD. */
+static int
+sys_close (uint32_t fd, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  enum fd_kind kind = FD_FILE;
+  void *handle = release_fd (fd, &kind);
+
+  if (handle != NULL)
+    {
+      if (kind == FD_PIPE)
+        {
+          pipe_end_close (handle);
+          return 0;
+        }
+      lock_acquire (&filesys_lock);
+      if (kind == FD_DIR)
+        dir_close (handle);
+      else
+        file_close (handle);
+      lock_release (&filesys_lock);
+    }
+  return 0;
+}
+
+/* chdir: changes the current working directory. */
+static int
+sys_chdir (uint32_t dir_, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  const char *dir = (const char *) dir_;
+  bool ok;
+
+  validate_ustr (dir);
+  lock_acquire (&filesys_lock);
+  ok = filesys_chdir (dir);
+  lock_release (&filesys_lock);
+  return ok;
+}
+
+/* mkdir: creates a new directory. */
+static int
+sys_mkdir (uint32_t dir_, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  const char *dir = (const char *) dir_;
+  bool ok;
+
+  validate_ustr (dir);
+  lock_acquire (&filesys_lock);
+  ok = filesys_mkdir (dir);
+  lock_release (&filesys_lock);
+  return ok;
+}
+
+/* readdir: reads the next entry name from the directory open as
+   FD into a user buffer of READDIR_MAX_LEN + 1 bytes. */
+static int
+sys_readdir (uint32_t fd, uint32_t name_, uint32_t c UNUSED)
+{
+  char *name = (char *) name_;
+  struct dir *dir = lookup_fd_dir (fd);
+  bool ok;
+
+  validate_write (name, NAME_MAX + 1);
+  if (dir == NULL)
+    return false;
+  lock_acquire (&filesys_lock);
+  ok = dir_readdir (dir, name);
+  lock_release (&filesys_lock);
+  return ok;
+}
+
+/* getdents: fills the SIZE-byte user buffer BUF with as many
+   null-terminated entry names from the directory open as FD as
+   fit, so listing a large directory costs one trap per bufferful
+   instead of one per name.  Returns the number of bytes used,
+   0 at end of directory, -1 if FD is not a directory. */
+static int
+sys_getdents (uint32_t fd, uint32_t buf_, uint32_t size)
+{
+  char *buf = (char *) buf_;
+  struct dir *dir = lookup_fd_dir (fd);
+  size_t used;
+
+  validate_write (buf, size);
+  if (dir == NULL)
+    return -1;
+  lock_acquire (&filesys_lock);
+  used = dir_readdir_bulk (dir, buf, size);
+  lock_release (&filesys_lock);
+  return used;
+}
+
+/* isdir: returns whether FD holds a directory. */
+static int
+sys_isdir (uint32_t fd, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  return lookup_fd_dir (fd) != NULL;
+}
+
+/* fdirect: switches FD between direct and cached I/O.  A direct
+   handle streams whole sectors between the user buffer and the
+   disk without populating the buffer cache or triggering
+   read-ahead, so a job that scans a large file once does not
+   evict everyone else's working set.  Returns true on success,
+   false if FD is not an open file. */
+static int
+sys_fdirect (uint32_t fd, uint32_t enable, uint32_t c UNUSED)
+{
+  struct file *file = lookup_fd (fd);
+
+  if (file == NULL)
+    return false;
+  file_set_direct (file, enable);
+  return true;
+}
+
+/* inumber: returns the inode number of the file or directory
+   open as FD. */
+static int
+sys_inumber (uint32_t fd, uint32_t b UNUSED, uint32_t c UNUSED)
+{
+  struct file *file = lookup_fd (fd);
+  struct dir *dir = lookup_fd_dir (fd);
+
+  if (file != NULL)
+    return inode_get_inumber (file_get_inode (file));
+  if (dir != NULL)
+    return inode_get_inumber (dir_get_inode (dir));
+  return -1;
+}
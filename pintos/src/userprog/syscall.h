@@ -1,6 +1,19 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include <stdbool.h>
+
 void syscall_init (void);
+struct intr_frame;
+void syscall_sysenter (struct intr_frame *);
+void syscall_close_all (void);
+void syscall_stdout_flush (void);
+void syscall_print_stats (void);
+void syscall_reset_stats (void);
+#ifdef VM
+struct thread;
+void syscall_munmap_all (void);
+bool syscall_duplicate_fds (struct thread *parent);
+#endif
 
 #endif /* userprog/syscall.h */
@@ -97,10 +97,13 @@ tss_get (void)
 }
 
 /* Sets the ring 0 stack pointer in the TSS to point to the end
-   of the thread stack. */
+   of the thread stack, and keeps the sysenter stack pointer MSR
+   in step with it, since a fast system call switches stacks from
+   the MSR rather than the TSS. */
 void
-tss_update (void) 
+tss_update (void)
 {
   ASSERT (tss != NULL);
   tss->esp0 = (uint8_t *) thread_current () + PGSIZE;
+  gdt_set_sysenter_esp (tss->esp0);
 }
@@ -0,0 +1,955 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "filesys/file.h"
+#include "filesys/off_t.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+
+/* Frame table.
+
+   Tracks every frame allocated to a user page, so that when the
+   user pool runs dry a victim can be chosen and its page evicted
+   instead of failing the allocation.  Victim selection sits
+   behind a small policy table chosen with the -fp kernel option:
+   the default second-chance clock sweeps the table, giving
+   recently accessed frames another pass by clearing their
+   accessed bit and taking the first frame nobody has touched
+   since the last sweep; the random policy picks candidates
+   blindly, as a baseline to compare the clock against.  Counters
+   for evictions, eviction write-backs, and re-faults of evicted
+   pages measure how well the chosen policy does on a workload.
+
+   Read-only file-backed pages are shared: a frame holding such a
+   page is keyed by (inode, offset), and a later fault on the
+   same file data in any process attaches to the existing frame
+   instead of reading a duplicate copy.  So a frame holds a list
+   of pages, usually one but one per process for shared text.
+
+   A frame carries a count of pins, and eviction skips any frame
+   with a pin outstanding.  A frame is pinned from allocation
+   until its contents are loaded and mapped, so the policy cannot
+   hand out a frame whose page is still in transit, and by
+   frame_pin() while a system call copies through the frame, so
+   eviction cannot unmap or write back a buffer mid-copy without
+   any global lock serializing paging against I/O.
+
+   An idle-priority daemon periodically hashes the contents of
+   anonymous frames and folds frames holding identical data into
+   one, remapping every sharer read-only; the first write to a
+   merged page breaks the share through the same copy-on-write
+   path fork uses.  All-zero pages, which dominate in practice,
+   fold into a single permanently resident zero frame; a fresh
+   anonymous page attaches to that frame at fault time without
+   waiting for the scanner, so untouched stack and BSS pages cost
+   one frame system-wide no matter how many processes hold
+   them. */
+
+/* A frame holding one user page, or one shared read-only page
+   mapped by several processes. */
+struct frame
+  {
+    void *kaddr;                /* Kernel virtual address of the frame. */
+    struct list pages;          /* Pages mapping the frame. */
+    struct inode *inode;        /* Sharing key, or null if the page
+                                   is not shareable. */
+    off_t offset;               /* Offset of the data in INODE. */
+    bool ready;                 /* Contents loaded and mapped? */
+    int pin_cnt;                /* Pins outstanding; a pinned frame is
+                                   exempt from eviction.  Held from
+                                   allocation to frame_set_ready(), and
+                                   by syscalls copying through the
+                                   frame. */
+    struct list_elem elem;      /* Element in frame_list. */
+  };
+
+/* All frames holding user pages, in allocation order.  The clock
+   hand cycles through this list. */
+static struct list frame_list = LIST_INITIALIZER (frame_list);
+static struct list_elem *clock_hand;
+
+/* Protects frame_list, the clock hand, and every frame's page
+   list. */
+static struct lock frame_lock;
+static bool frame_lock_inited;
+
+/* Resident-page accounting, reported to a parent by wait2: each
+   page attached to a frame counts against its owner, and the
+   high-water mark is the process's peak memory footprint.  The
+   caller must hold frame_lock. */
+static void
+resident_inc (struct page *p)
+{
+  struct thread *t = p->owner;
+
+  if (++t->resident_pages > t->peak_pages)
+    t->peak_pages = t->resident_pages;
+}
+
+static void
+resident_dec (struct page *p)
+{
+  p->owner->resident_pages--;
+}
+
+/* Returns the frame at kernel address KADDR, or a null pointer
+   if there is none.  The caller must hold frame_lock. */
+static struct frame *
+frame_find (void *kaddr)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&frame_list); e != list_end (&frame_list);
+       e = list_next (e))
+    {
+      struct frame *f = list_entry (e, struct frame, elem);
+      if (f->kaddr == kaddr)
+        return f;
+    }
+  return NULL;
+}
+
+/* Returns the ready frame holding the data at OFFSET in INODE,
+   or a null pointer if no such frame exists.  The caller must
+   hold frame_lock. */
+static struct frame *
+frame_find_shared (struct inode *inode, off_t offset)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&frame_list); e != list_end (&frame_list);
+       e = list_next (e))
+    {
+      struct frame *f = list_entry (e, struct frame, elem);
+      if (f->inode == inode && f->offset == offset && f->ready)
+        return f;
+    }
+  return NULL;
+}
+
+/* Advances the clock hand one frame, wrapping around the end of
+   the table.  The caller must hold frame_lock and the table must
+   be nonempty. */
+static struct frame *
+clock_next (void)
+{
+  if (clock_hand == NULL || clock_hand == list_end (&frame_list))
+    clock_hand = list_begin (&frame_list);
+
+  struct frame *f = list_entry (clock_hand, struct frame, elem);
+  clock_hand = list_next (clock_hand);
+  return f;
+}
+
+/* Returns a frame picked uniformly at random.  The caller must
+   hold frame_lock and the table must be nonempty. */
+static struct frame *
+random_next (void)
+{
+  size_t i = random_ulong () % list_size (&frame_list);
+  struct list_elem *e = list_begin (&frame_list);
+
+  while (i-- > 0)
+    e = list_next (e);
+  return list_entry (e, struct frame, elem);
+}
+
+/* A victim-selection policy.  candidate() proposes the next
+   frame to consider, in whatever order the policy prefers; the
+   common code in evict_frame() skips pinned frames, gives
+   accessed frames a second chance when the policy asks for one,
+   and handles the eviction itself. */
+struct frame_policy
+  {
+    const char *name;                   /* Name for -fp=NAME. */
+    struct frame *(*candidate) (void);  /* Next frame to consider. */
+    bool second_chance;                 /* Honor accessed bits? */
+  };
+
+/* The built-in policies; the first is the default. */
+static const struct frame_policy policies[] =
+  {
+    {"clock", clock_next, true},
+    {"random", random_next, false},
+  };
+static const struct frame_policy *policy = &policies[0];
+
+/* Policy-quality counters.  A write-back is an eviction that had
+   to push the contents out, to the backing file or to swap,
+   rather than just dropping them; a re-fault is a fault on a
+   page that an earlier eviction pushed out, so a high re-fault
+   rate means the policy keeps choosing pages that are still
+   wanted. */
+static long long eviction_cnt;          /* Frames evicted. */
+static long long writeback_cnt;         /* Evictions that wrote. */
+static long long refault_cnt;           /* Faults on evicted pages. */
+
+/* Page deduplication.  The shared zero frame holds a page of
+   zeros and is never evicted or freed; merge_cnt counts frames
+   the scanner has folded into another. */
+static struct frame *zero_frame;
+static long long merge_cnt;
+static bool dedupd_started;
+
+static void dedup_daemon (void *aux);
+
+/* Selects the victim-selection policy called NAME, for the -fp
+   kernel option.  Returns false if no policy is so named. */
+bool
+frame_set_policy (const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof policies / sizeof *policies; i++)
+    if (!strcmp (policies[i].name, name))
+      {
+        policy = &policies[i];
+        return true;
+      }
+  return false;
+}
+
+/* Counts a fault on a page that eviction pushed out earlier.
+   Called by page_in(). */
+void
+frame_note_refault (void)
+{
+  refault_cnt++;
+}
+
+/* Prints eviction statistics and the policy that produced
+   them. */
+void
+frame_print_stats (void)
+{
+  printf ("Frame: %lld evictions (%s policy), %lld write-backs, "
+          "%lld re-faults, %lld frames merged\n",
+          eviction_cnt, policy->name, writeback_cnt, refault_cnt, merge_cnt);
+}
+
+/* Chooses a victim frame with the selected policy, evicts its
+   pages, and returns the frame, now free for reuse.  Returns a
+   null pointer if no page in the table can be evicted.  The
+   caller must hold frame_lock. */
+static struct frame *
+evict_frame (void)
+{
+  size_t passes = 2 * list_size (&frame_list);
+  size_t i;
+
+  for (i = 0; i < passes; i++)
+    {
+      struct frame *f = policy->candidate ();
+      struct list_elem *e;
+      struct page *p;
+      uint32_t *pd;
+      bool accessed = false;
+      bool dirty = false;
+
+      if (f->pin_cnt > 0)
+        continue;
+
+      /* Recently used by anyone: clear the accessed bits and
+         give the frame a second chance.  The harvest call
+         collects and clears the accessed bit and reads the dirty
+         bit in one page-table walk per page. */
+      for (e = list_begin (&f->pages); e != list_end (&f->pages);
+           e = list_next (e))
+        {
+          bool page_dirty;
+
+          p = list_entry (e, struct page, frame_elem);
+          if (pagedir_harvest_page (p->owner->pagedir, p->uaddr,
+                                    &page_dirty))
+            accessed = true;
+          if (page_dirty)
+            dirty = true;
+        }
+      if (accessed && policy->second_chance)
+        continue;
+
+      /* A shared frame: either a read-only file page, which is
+         never dirty and can just be unmapped everywhere and
+         dropped, or a copy-on-write share from fork, where every
+         sharer gets its own swap copy and the share ends. */
+      if (list_size (&f->pages) > 1)
+        {
+          bool ok = true;
+
+          for (e = list_begin (&f->pages); e != list_end (&f->pages);
+               e = list_next (e))
+            {
+              p = list_entry (e, struct page, frame_elem);
+              pagedir_clear_page (p->owner->pagedir, p->uaddr);
+            }
+
+          p = list_entry (list_front (&f->pages), struct page, frame_elem);
+          if (p->writable)
+            for (e = list_begin (&f->pages); e != list_end (&f->pages);
+                 e = list_next (e))
+              {
+                p = list_entry (e, struct page, frame_elem);
+                if (!swap_out (f->kaddr, &p->swap_slot))
+                  {
+                    ok = false;
+                    break;
+                  }
+              }
+
+          if (!ok)
+            {
+              /* Swap filled up partway: release the slots taken
+                 so far, put the read-only mappings back, and
+                 keep sweeping. */
+              for (e = list_begin (&f->pages); e != list_end (&f->pages);
+                   e = list_next (e))
+                {
+                  p = list_entry (e, struct page, frame_elem);
+                  if (p->swap_slot != SWAP_NONE)
+                    {
+                      swap_free (p->swap_slot);
+                      p->swap_slot = SWAP_NONE;
+                    }
+                  pagedir_set_page (p->owner->pagedir, p->uaddr,
+                                    f->kaddr, false);
+                  pagedir_set_dirty (p->owner->pagedir, p->uaddr, dirty);
+                }
+              continue;
+            }
+
+          while (!list_empty (&f->pages))
+            {
+              p = list_entry (list_pop_front (&f->pages),
+                              struct page, frame_elem);
+              p->evicted = true;
+              resident_dec (p);
+            }
+          eviction_cnt++;
+          if (p->writable)
+            writeback_cnt++;
+          f->ready = false;
+          return f;
+        }
+
+      p = list_entry (list_front (&f->pages), struct page, frame_elem);
+      pd = p->owner->pagedir;
+
+      /* A page of a writable file mapping is written back to the
+         file if dirty, then dropped; the next fault re-reads it.
+         The mapping is cleared before the write, so the owner
+         faults and blocks on frame_lock rather than modifying
+         the page mid-write. */
+      if (p->file != NULL && !p->private)
+        {
+          pagedir_clear_page (pd, p->uaddr);
+          if (dirty)
+            {
+              file_write_at (p->file, f->kaddr, p->read_bytes, p->offset);
+              writeback_cnt++;
+            }
+          list_pop_front (&f->pages);
+          p->evicted = true;
+          resident_dec (p);
+          eviction_cnt++;
+          f->ready = false;
+          return f;
+        }
+
+      /* A clean file-backed page that has never been to swap can
+         be dropped and re-read on the next fault. */
+      if (p->file != NULL && p->swap_slot == SWAP_NONE && !dirty)
+        {
+          pagedir_clear_page (pd, p->uaddr);
+          list_pop_front (&f->pages);
+          p->evicted = true;
+          resident_dec (p);
+          eviction_cnt++;
+          f->ready = false;
+          return f;
+        }
+
+      /* Anything else goes to a swap slot. */
+      pagedir_clear_page (pd, p->uaddr);
+      if (swap_out (f->kaddr, &p->swap_slot))
+        {
+          list_pop_front (&f->pages);
+          p->evicted = true;
+          resident_dec (p);
+          eviction_cnt++;
+          writeback_cnt++;
+          f->ready = false;
+          return f;
+        }
+
+      /* No swap space: put the mapping back and keep looking for
+         a droppable page. */
+      pagedir_set_page (pd, p->uaddr, f->kaddr, p->writable);
+      pagedir_set_dirty (pd, p->uaddr, dirty);
+    }
+
+  return NULL;
+}
+
+/* Obtains an empty, pinned frame: a fresh page from the user
+   pool if one is free, otherwise by evicting a victim.  Returns
+   a null pointer if neither works.  The caller must hold
+   frame_lock. */
+static struct frame *
+frame_get (void)
+{
+  struct frame *f;
+  void *kaddr = palloc_get_page (PAL_USER);
+
+  if (kaddr != NULL)
+    {
+      f = malloc (sizeof *f);
+      if (f == NULL)
+        {
+          palloc_free_page (kaddr);
+          return NULL;
+        }
+      f->kaddr = kaddr;
+      list_push_back (&frame_list, &f->elem);
+    }
+  else
+    {
+      f = evict_frame ();
+      if (f == NULL)
+        return NULL;
+    }
+
+  list_init (&f->pages);
+  f->inode = NULL;
+  f->offset = 0;
+  f->ready = false;
+  f->pin_cnt = 1;
+  return f;
+}
+
+/* Lazy one-time setup, from the first call into the frame
+   table: initializes frame_lock and starts the deduplication
+   daemon. */
+static void
+frame_startup (void)
+{
+  if (!frame_lock_inited)
+    {
+      lock_init (&frame_lock);
+      frame_lock_inited = true;
+    }
+  if (!dedupd_started)
+    {
+      dedupd_started = true;
+      thread_create ("dedupd", PRI_MIN, dedup_daemon, NULL);
+    }
+}
+
+/* Returns the shared zero frame, creating it on first use, or a
+   null pointer if no frame can be found for it.  The zero frame
+   keeps its allocation pin forever, so eviction never takes it.
+   The caller must hold frame_lock. */
+static struct frame *
+zero_frame_get (void)
+{
+  if (zero_frame == NULL)
+    {
+      struct frame *f = frame_get ();
+      if (f != NULL)
+        {
+          memset (f->kaddr, 0, PGSIZE);
+          f->ready = true;
+          zero_frame = f;
+        }
+    }
+  return zero_frame;
+}
+
+/* Allocates a frame for PAGE, evicting another page if the user
+   pool is exhausted.  A read-only file-backed page that is
+   already in memory in another process shares that frame instead
+   of getting its own.  Returns the frame's kernel virtual
+   address, or a null pointer if no frame is free and nothing can
+   be evicted.
+
+   The frame comes back pinned; the caller must load and map the
+   page, then call frame_set_ready(). */
+void *
+frame_alloc (struct page *page)
+{
+  struct frame *f;
+
+  frame_startup ();
+  lock_acquire (&frame_lock);
+
+  /* Read-only file-backed pages are shared by (inode, offset). */
+  if (page->file != NULL && !page->writable)
+    {
+      struct inode *inode = file_get_inode (page->file);
+
+      f = frame_find_shared (inode, page->offset);
+      if (f != NULL)
+        {
+          list_push_back (&f->pages, &page->frame_elem);
+          f->pin_cnt++;
+          resident_inc (page);
+          lock_release (&frame_lock);
+          return f->kaddr;
+        }
+
+      f = frame_get ();
+      if (f != NULL)
+        {
+          f->inode = inode;
+          f->offset = page->offset;
+        }
+    }
+  else
+    f = frame_get ();
+
+  if (f == NULL)
+    {
+      lock_release (&frame_lock);
+      return NULL;
+    }
+
+  list_push_back (&f->pages, &page->frame_elem);
+  resident_inc (page);
+  lock_release (&frame_lock);
+  return f->kaddr;
+}
+
+/* Attaches PAGE to the existing frame at KADDR, for fork's
+   copy-on-write and text sharing.  The frame comes back pinned;
+   the caller must map the page and call frame_set_ready(). */
+void
+frame_share (void *kaddr, struct page *page)
+{
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  f = frame_find (kaddr);
+  ASSERT (f != NULL);
+  list_push_back (&f->pages, &page->frame_elem);
+  f->pin_cnt++;
+  resident_inc (page);
+  lock_release (&frame_lock);
+}
+
+/* Attaches PAGE, an anonymous page that has never been written,
+   to the shared zero frame, so faulting it in costs no frame and
+   no memset.  Returns the zero frame's kernel address, pinned,
+   or a null pointer if no zero frame can be made; the caller
+   must map PAGE read-only and call frame_set_ready().  The first
+   write faults and gets a private zeroed copy through
+   frame_cow_break(), the same way a fork share breaks. */
+void *
+frame_share_zero (struct page *page)
+{
+  struct frame *f;
+
+  frame_startup ();
+  lock_acquire (&frame_lock);
+  f = zero_frame_get ();
+  if (f == NULL)
+    {
+      lock_release (&frame_lock);
+      return NULL;
+    }
+  list_push_back (&f->pages, &page->frame_elem);
+  f->pin_cnt++;
+  resident_inc (page);
+  lock_release (&frame_lock);
+  return f->kaddr;
+}
+
+/* Gives PAGE, currently sharing the frame at KADDR copy-on-write,
+   a frame it owns alone.  Returns the kernel address of that
+   frame, pinned: KADDR itself if PAGE turned out to be the last
+   sharer, otherwise a fresh frame holding a copy of the data.
+   Returns a null pointer if no frame can be found for the copy. */
+void *
+frame_cow_break (void *kaddr, struct page *page)
+{
+  struct frame *f, *copy;
+
+  lock_acquire (&frame_lock);
+  f = frame_find (kaddr);
+  ASSERT (f != NULL);
+
+  if (list_size (&f->pages) == 1 && f != zero_frame)
+    {
+      /* Last sharer: the frame just becomes private. */
+      f->inode = NULL;
+      f->pin_cnt++;
+      lock_release (&frame_lock);
+      return kaddr;
+    }
+
+  /* Keep the shared frame away from eviction while we copy out
+     of it. */
+  f->pin_cnt++;
+  copy = frame_get ();
+  f->pin_cnt--;
+  if (copy == NULL)
+    {
+      lock_release (&frame_lock);
+      return NULL;
+    }
+
+  memcpy (copy->kaddr, kaddr, PGSIZE);
+  list_remove (&page->frame_elem);
+  list_push_back (&copy->pages, &page->frame_elem);
+  lock_release (&frame_lock);
+  return copy->kaddr;
+}
+
+/* Returns true if the frame at KADDR still needs its contents
+   loaded, false if it already holds the data, as when the caller
+   attached to a shared frame. */
+bool
+frame_needs_fill (void *kaddr)
+{
+  struct frame *f;
+  bool needs;
+
+  lock_acquire (&frame_lock);
+  f = frame_find (kaddr);
+  ASSERT (f != NULL);
+  needs = !f->ready;
+  lock_release (&frame_lock);
+  return needs;
+}
+
+/* Marks the frame at KADDR loaded and mapped, and drops the pin
+   taken at allocation, so eviction may take the frame and other
+   processes may share it. */
+void
+frame_set_ready (void *kaddr)
+{
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  f = frame_find (kaddr);
+  ASSERT (f != NULL && f->pin_cnt > 0);
+  f->ready = true;
+  f->pin_cnt--;
+  lock_release (&frame_lock);
+}
+
+/* Pins the frame at KADDR on behalf of PAGE, so that eviction
+   leaves it alone while a system call copies through it.
+   Returns true if PAGE was still attached to the frame, which is
+   then pinned; false if eviction got there first and the caller
+   must fault the page back in. */
+bool
+frame_pin (void *kaddr, struct page *page)
+{
+  struct frame *f;
+  bool pinned = false;
+
+  lock_acquire (&frame_lock);
+  f = frame_find (kaddr);
+  if (f != NULL)
+    {
+      struct list_elem *e;
+
+      for (e = list_begin (&f->pages); e != list_end (&f->pages);
+           e = list_next (e))
+        if (list_entry (e, struct page, frame_elem) == page)
+          {
+            f->pin_cnt++;
+            pinned = true;
+            break;
+          }
+    }
+  lock_release (&frame_lock);
+  return pinned;
+}
+
+/* Drops one frame_pin() pin on the frame at KADDR. */
+void
+frame_unpin (void *kaddr)
+{
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  f = frame_find (kaddr);
+  ASSERT (f != NULL && f->pin_cnt > 0);
+  f->pin_cnt--;
+  lock_release (&frame_lock);
+}
+
+/* Returns true if F may be merged with another frame holding
+   identical contents: it is loaded, unpinned, and every page on
+   it is a writable anonymous page.  File-backed pages are left
+   out: read-only ones are already shared by (inode, offset), and
+   writable ones rely on the hardware dirty bit to decide whether
+   eviction writes them back, which remapping would lose.
+   Anonymous pages always go to swap on eviction, so their dirty
+   bits do not matter.  The caller must hold frame_lock. */
+static bool
+dedup_candidate (struct frame *f)
+{
+  struct list_elem *e;
+
+  if (f == zero_frame || !f->ready || f->pin_cnt > 0 || f->inode != NULL
+      || list_empty (&f->pages))
+    return false;
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      if (p->file != NULL || !p->writable)
+        return false;
+    }
+  return true;
+}
+
+/* Folds SRC into DST if the two frames hold identical bytes,
+   moving SRC's pages onto DST, remapping every page of both
+   frames read-only, and freeing SRC.  The first write to any of
+   them faults and breaks the share with frame_cow_break(), just
+   as after fork.  Returns true if the frames were merged, false
+   if their equal hashes were a collision.  The caller must hold
+   frame_lock. */
+static bool
+dedup_merge (struct frame *dst, struct frame *src)
+{
+  struct list_elem *e;
+  struct page *p;
+
+  /* A frame with several sharers, or the zero frame, was mapped
+     read-only before this merge and must be restored that way if
+     the merge falls through. */
+  bool dst_rw = list_size (&dst->pages) == 1 && dst != zero_frame;
+  bool src_rw = list_size (&src->pages) == 1;
+
+  /* Unmap every sharer of both frames before comparing, so a
+     write slipping in between the comparison and the read-only
+     remap cannot make copies diverge after they were declared
+     identical.  A sharer that touches its page meanwhile faults
+     and blocks on frame_lock until the merge is decided. */
+  for (e = list_begin (&dst->pages); e != list_end (&dst->pages);
+       e = list_next (e))
+    {
+      p = list_entry (e, struct page, frame_elem);
+      pagedir_clear_page (p->owner->pagedir, p->uaddr);
+    }
+  for (e = list_begin (&src->pages); e != list_end (&src->pages);
+       e = list_next (e))
+    {
+      p = list_entry (e, struct page, frame_elem);
+      pagedir_clear_page (p->owner->pagedir, p->uaddr);
+    }
+
+  if (memcmp (dst->kaddr, src->kaddr, PGSIZE) != 0)
+    {
+      /* Hash collision: put the original mappings back. */
+      for (e = list_begin (&dst->pages); e != list_end (&dst->pages);
+           e = list_next (e))
+        {
+          p = list_entry (e, struct page, frame_elem);
+          pagedir_set_page (p->owner->pagedir, p->uaddr, dst->kaddr,
+                            p->writable && dst_rw);
+        }
+      for (e = list_begin (&src->pages); e != list_end (&src->pages);
+           e = list_next (e))
+        {
+          p = list_entry (e, struct page, frame_elem);
+          pagedir_set_page (p->owner->pagedir, p->uaddr, src->kaddr,
+                            p->writable && src_rw);
+        }
+      return false;
+    }
+
+  while (!list_empty (&src->pages))
+    {
+      p = list_entry (list_pop_front (&src->pages), struct page, frame_elem);
+      list_push_back (&dst->pages, &p->frame_elem);
+    }
+  for (e = list_begin (&dst->pages); e != list_end (&dst->pages);
+       e = list_next (e))
+    {
+      p = list_entry (e, struct page, frame_elem);
+      pagedir_set_page (p->owner->pagedir, p->uaddr, dst->kaddr, false);
+    }
+
+  if (clock_hand == &src->elem)
+    clock_hand = list_next (clock_hand);
+  list_remove (&src->elem);
+  palloc_free_page (src->kaddr);
+  free (src);
+  merge_cnt++;
+  return true;
+}
+
+/* One deduplication sweep: hashes the contents of every
+   candidate frame with hash_bytes() and merges frames whose
+   hashes and bytes agree.  The zero frame goes first in the
+   candidate array so all-zero pages always fold into it. */
+static void
+dedup_pass (void)
+{
+  struct dedup_cand
+    {
+      struct frame *f;          /* Candidate, or null once merged. */
+      unsigned hash;            /* Hash of its contents. */
+    };
+  struct dedup_cand *cand;
+  struct list_elem *e;
+  size_t n, i, j;
+
+  lock_acquire (&frame_lock);
+
+  /* If no frame can be found for the zero frame, zero pages
+     still merge among themselves. */
+  zero_frame_get ();
+
+  cand = malloc ((list_size (&frame_list) + 1) * sizeof *cand);
+  if (cand == NULL)
+    {
+      lock_release (&frame_lock);
+      return;
+    }
+
+  n = 0;
+  if (zero_frame != NULL)
+    {
+      cand[n].f = zero_frame;
+      cand[n].hash = hash_bytes (zero_frame->kaddr, PGSIZE);
+      n++;
+    }
+  for (e = list_begin (&frame_list); e != list_end (&frame_list);
+       e = list_next (e))
+    {
+      struct frame *f = list_entry (e, struct frame, elem);
+      if (dedup_candidate (f))
+        {
+          cand[n].f = f;
+          cand[n].hash = hash_bytes (f->kaddr, PGSIZE);
+          n++;
+        }
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      if (cand[i].f == NULL)
+        continue;
+      for (j = i + 1; j < n; j++)
+        if (cand[j].f != NULL && cand[j].hash == cand[i].hash
+            && dedup_merge (cand[i].f, cand[j].f))
+          cand[j].f = NULL;
+    }
+
+  lock_release (&frame_lock);
+  free (cand);
+}
+
+/* Page deduplication daemon.  Started at idle priority by the
+   first frame allocation; sweeps the frame table once a second
+   whenever nothing better is runnable. */
+static void
+dedup_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (TIMER_FREQ);
+      dedup_pass ();
+    }
+}
+
+/* Detaches PAGE from the frame at KADDR.  If PAGE was the last
+   user, the frame leaves the table and returns to the page
+   allocator; otherwise the frame lives on for its other sharers.
+   PINNED says whether the caller holds a pin on the frame, as
+   the error paths unwinding a fresh allocation do; it is dropped
+   here. */
+void
+frame_free (void *kaddr, struct page *page, bool pinned)
+{
+  struct frame *f;
+  bool last;
+
+  lock_acquire (&frame_lock);
+  f = frame_find (kaddr);
+  ASSERT (f != NULL);
+  list_remove (&page->frame_elem);
+  resident_dec (page);
+  last = list_empty (&f->pages) && f != zero_frame;
+  if (last)
+    {
+      if (clock_hand == &f->elem)
+        clock_hand = list_next (clock_hand);
+      list_remove (&f->elem);
+      free (f);
+    }
+  else if (pinned)
+    {
+      ASSERT (f->pin_cnt > 0);
+      f->pin_cnt--;
+    }
+  lock_release (&frame_lock);
+
+  if (last)
+    palloc_free_page (kaddr);
+}
+
+/* Removes every page owned by OWNER from the table.  Called on
+   process exit, before the page directory is destroyed, so the
+   clock never examines a dead process's mappings.
+
+   A frame left with no users stays mapped in OWNER's dying page
+   directory and is freed by pagedir_destroy(); a frame that
+   still has sharers is unmapped from OWNER first so that
+   pagedir_destroy() does not free a page others are using. */
+void
+frame_remove_all (struct thread *owner)
+{
+  struct list_elem *e, *next;
+
+  if (!frame_lock_inited)
+    return;
+
+  lock_acquire (&frame_lock);
+  for (e = list_begin (&frame_list); e != list_end (&frame_list); e = next)
+    {
+      struct frame *f = list_entry (e, struct frame, elem);
+      struct list_elem *pe, *pnext;
+
+      next = list_next (e);
+      for (pe = list_begin (&f->pages); pe != list_end (&f->pages);
+           pe = pnext)
+        {
+          struct page *p = list_entry (pe, struct page, frame_elem);
+
+          pnext = list_next (pe);
+          if (p->owner == owner)
+            {
+              list_remove (&p->frame_elem);
+              resident_dec (p);
+              if (!list_empty (&f->pages) || f == zero_frame)
+                pagedir_clear_page (owner->pagedir, p->uaddr);
+            }
+        }
+
+      if (list_empty (&f->pages) && f != zero_frame)
+        {
+          if (clock_hand == &f->elem)
+            clock_hand = next;
+          list_remove (&f->elem);
+          free (f);
+        }
+    }
+  lock_release (&frame_lock);
+}
@@ -0,0 +1,23 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <stdbool.h>
+
+struct page;
+struct thread;
+
+bool frame_set_policy (const char *name);
+void *frame_alloc (struct page *);
+void frame_share (void *kaddr, struct page *);
+void *frame_share_zero (struct page *);
+void *frame_cow_break (void *kaddr, struct page *);
+void frame_set_ready (void *kaddr);
+bool frame_pin (void *kaddr, struct page *);
+void frame_unpin (void *kaddr);
+bool frame_needs_fill (void *kaddr);
+void frame_free (void *kaddr, struct page *, bool pinned);
+void frame_remove_all (struct thread *owner);
+void frame_note_refault (void);
+void frame_print_stats (void);
+
+#endif /* vm/frame.h */
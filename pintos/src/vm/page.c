@@ -0,0 +1,329 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+
+static bool page_less (const struct tree_elem *, const struct tree_elem *,
+                       void *);
+static void page_destructor (struct tree_elem *, void *);
+
+/* Creates the current thread's supplemental page table.
+   Returns true if successful. */
+bool
+page_table_create (void)
+{
+  struct thread *t = thread_current ();
+
+  t->pages = malloc (sizeof *t->pages);
+  if (t->pages == NULL)
+    return false;
+  tree_init (t->pages, page_less, NULL);
+  return true;
+}
+
+/* Destroys the current thread's supplemental page table, freeing
+   every entry and any frame it still holds. */
+void
+page_table_destroy (void)
+{
+  struct thread *t = thread_current ();
+
+  if (t->pages != NULL)
+    {
+      tree_clear (t->pages, page_destructor);
+      free (t->pages);
+      t->pages = NULL;
+    }
+}
+
+/* Adds an entry for an all-zero page at UADDR, writable
+   according to WRITABLE.  Returns the new entry, or a null
+   pointer if UADDR is already mapped or memory is short. */
+struct page *
+page_allocate (void *uaddr, bool writable)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+
+  ASSERT (pg_ofs (uaddr) == 0);
+
+  p = malloc (sizeof *p);
+  if (p == NULL)
+    return NULL;
+
+  p->uaddr = uaddr;
+  p->writable = writable;
+  p->owner = t;
+  p->file = NULL;
+  p->offset = 0;
+  p->read_bytes = 0;
+  p->swap_slot = SWAP_NONE;
+  p->private = true;
+  p->evicted = false;
+
+  if (tree_insert (t->pages, &p->elem) != NULL)
+    {
+      free (p);
+      return NULL;
+    }
+  return p;
+}
+
+/* Adds an entry for a page at UADDR backed by READ_BYTES bytes
+   of FILE starting at OFFSET, the rest zeroed.  Returns the new
+   entry, or a null pointer on failure. */
+struct page *
+page_allocate_file (void *uaddr, struct file *file, off_t offset,
+                    size_t read_bytes, bool writable)
+{
+  struct page *p = page_allocate (uaddr, writable);
+
+  if (p != NULL)
+    {
+      ASSERT (read_bytes <= PGSIZE);
+      p->file = file;
+      p->offset = offset;
+      p->read_bytes = read_bytes;
+    }
+  return p;
+}
+
+/* Returns the current thread's entry for the page containing
+   UADDR, or a null pointer if there is none. */
+struct page *
+page_lookup (const void *uaddr)
+{
+  struct thread *t = thread_current ();
+  struct page p;
+  struct tree_elem *e;
+
+  if (t->pages == NULL)
+    return NULL;
+
+  p.uaddr = pg_round_down ((void *) uaddr);
+  e = tree_find (t->pages, &p.elem);
+  return e != NULL ? tree_entry (e, struct page, elem) : NULL;
+}
+
+/* Removes UADDR's entry P from the current thread's page table,
+   freeing its frame and swap slot.  A dirty page backed by a
+   writable mapping is written back to its file first.  Used by
+   munmap and on process exit. */
+void
+page_deallocate (struct page *p)
+{
+  struct thread *t = thread_current ();
+  void *kaddr = pagedir_get_page (t->pagedir, p->uaddr);
+
+  if (kaddr != NULL)
+    {
+      if (p->file != NULL && !p->private
+          && pagedir_is_dirty (t->pagedir, p->uaddr))
+        file_write_at (p->file, kaddr, p->read_bytes, p->offset);
+      pagedir_clear_page (t->pagedir, p->uaddr);
+      frame_free (kaddr, p, false);
+    }
+  if (p->swap_slot != SWAP_NONE)
+    swap_free (p->swap_slot);
+  tree_delete (t->pages, &p->elem);
+  free (p);
+}
+
+/* Faults in the page containing FAULT_ADDR: obtains a frame,
+   fills it from the page's backing store, and installs the
+   mapping.  WRITE says whether the faulting access was a write.
+   Returns true if successful, false if FAULT_ADDR has no entry
+   or no frame is available. */
+bool
+page_in (void *fault_addr, bool write)
+{
+  struct thread *t = thread_current ();
+  struct page *p = page_lookup (fault_addr);
+  uint8_t *frame;
+
+  if (p == NULL)
+    return false;
+
+  /* A fault on a page that eviction pushed out earlier scores
+     against the eviction policy. */
+  if (p->evicted)
+    {
+      frame_note_refault ();
+      p->evicted = false;
+    }
+
+  /* An anonymous page that has never been written holds nothing
+     but zeros, so a read fault maps the shared zero frame
+     read-only instead of zeroing a frame of its own; the first
+     write
+     breaks the share with a private copy, the same as after
+     fork.  Exec cost and resident memory then track the stack
+     and BSS a process touches, not what it declares.  A write
+     fault skips the detour and gets its private zeroed frame
+     below at once, rather than paying a second fault and a
+     copy-on-write break for a share that would end
+     immediately. */
+  if (!write && p->file == NULL && p->swap_slot == SWAP_NONE)
+    {
+      frame = frame_share_zero (p);
+      if (frame != NULL)
+        {
+          if (!pagedir_set_page (t->pagedir, p->uaddr, frame, false))
+            {
+              frame_free (frame, p, true);
+              return false;
+            }
+          frame_set_ready (frame);
+          return true;
+        }
+      /* No zero frame could be made; fall through and zero a
+         private frame. */
+    }
+
+  frame = frame_alloc (p);
+  if (frame == NULL)
+    return false;
+
+  /* Fill the frame from the backing store, unless it came back
+     already holding the data because another process shares it.
+     A page that was evicted to swap comes back from there; its
+     swap copy is more recent than anything in its file. */
+  if (frame_needs_fill (frame))
+    {
+      if (p->swap_slot != SWAP_NONE)
+        {
+          swap_in (p->swap_slot, frame);
+          p->swap_slot = SWAP_NONE;
+        }
+      else if (p->file != NULL)
+        {
+          if (file_read_at (p->file, frame, p->read_bytes, p->offset)
+              != (int) p->read_bytes)
+            {
+              frame_free (frame, p, true);
+              return false;
+            }
+          memset (frame + p->read_bytes, 0, PGSIZE - p->read_bytes);
+        }
+      else
+        memset (frame, 0, PGSIZE);
+    }
+
+  if (!pagedir_set_page (t->pagedir, p->uaddr, frame, p->writable))
+    {
+      frame_free (frame, p, true);
+      return false;
+    }
+  frame_set_ready (frame);
+  return true;
+}
+
+/* Handles a write fault on a present read-only page at
+   FAULT_ADDR.  If the page is writable but shared copy-on-write,
+   it gets a private copy (or sole ownership of the frame, if the
+   other sharers are gone) and is remapped writable, and the
+   faulting write can be retried.  Returns false if FAULT_ADDR is
+   genuinely read-only. */
+bool
+page_unshare (void *fault_addr)
+{
+  struct thread *t = thread_current ();
+  struct page *p = page_lookup (fault_addr);
+  void *kaddr, *copy;
+
+  if (p == NULL || !p->writable)
+    return false;
+  kaddr = pagedir_get_page (t->pagedir, p->uaddr);
+  if (kaddr == NULL)
+    return false;
+
+  copy = frame_cow_break (kaddr, p);
+  if (copy == NULL)
+    return false;
+
+  pagedir_clear_page (t->pagedir, p->uaddr);
+  if (!pagedir_set_page (t->pagedir, p->uaddr, copy, true))
+    {
+      frame_free (copy, p, true);
+      return false;
+    }
+  pagedir_set_dirty (t->pagedir, p->uaddr, true);
+  frame_set_ready (copy);
+  return true;
+}
+
+/* Pins the page containing UADDR into its frame, faulting it in
+   first if it is not resident, so that a kernel access through
+   the frame cannot race with eviction.  Returns true on success,
+   false if UADDR has no page or no frame can be found for it.
+   The matching page_unpin() releases the pin. */
+bool
+page_pin (const void *uaddr)
+{
+  struct thread *t = thread_current ();
+  struct page *p = page_lookup (uaddr);
+
+  if (p == NULL)
+    return false;
+
+  for (;;)
+    {
+      void *kaddr = pagedir_get_page (t->pagedir, p->uaddr);
+
+      /* frame_pin() fails if eviction took the frame between the
+         lookup and the pin; fault the page back in and retry.
+         The kernel may write through the pinned frame, so fault
+         as a write: a writable page then gets a private frame
+         rather than a zero-frame share the write would only have
+         to break mid-I/O. */
+      if (kaddr != NULL && frame_pin (kaddr, p))
+        return true;
+      if (!page_in (p->uaddr, p->writable))
+        return false;
+    }
+}
+
+/* Drops the pin page_pin() took on the page containing UADDR. */
+void
+page_unpin (const void *uaddr)
+{
+  struct thread *t = thread_current ();
+  struct page *p = page_lookup (uaddr);
+  void *kaddr;
+
+  ASSERT (p != NULL);
+  kaddr = pagedir_get_page (t->pagedir, p->uaddr);
+  ASSERT (kaddr != NULL);
+  frame_unpin (kaddr);
+}
+
+/* Orders pages A and B by user virtual address. */
+static bool
+page_less (const struct tree_elem *a_, const struct tree_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = tree_entry (a_, struct page, elem);
+  const struct page *b = tree_entry (b_, struct page, elem);
+
+  return a->uaddr < b->uaddr;
+}
+
+/* Frees the page E on table destruction, releasing any swap
+   slot it still occupies.  The frame, if any, is freed along
+   with the rest of the address space by pagedir_destroy(). */
+static void
+page_destructor (struct tree_elem *e, void *aux UNUSED)
+{
+  struct page *p = tree_entry (e, struct page, elem);
+
+  if (p->swap_slot != SWAP_NONE)
+    swap_free (p->swap_slot);
+  free (p);
+}
@@ -0,0 +1,69 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <list.h>
+#include <tree.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+
+/* Supplemental page table.
+
+   Records, for each page in a process's virtual address space,
+   where its contents live when the page is not in memory: a
+   range of a file, or nothing at all for an all-zero page.  The
+   page fault handler consults it to bring pages in on first
+   touch.
+
+   The table is an AVL tree ordered by user address, so besides
+   the exact lookup the fault handler needs it supports ordered
+   iteration and lower-bound queries over the address space,
+   which fork and address-range scans use. */
+
+struct file;
+struct thread;
+
+/* Maximum size the user stack may grow to, measured down from
+   PHYS_BASE. */
+#define STACK_MAX (1024 * 1024)
+
+/* A virtual page and its backing store. */
+struct page
+  {
+    void *uaddr;                /* User virtual address (tree key). */
+    bool writable;              /* May the process write to it? */
+    struct thread *owner;       /* Process the page belongs to. */
+
+    /* Backing store.  FILE is null for an all-zero page;
+       otherwise READ_BYTES bytes come from the file at OFFSET
+       and the rest of the page is zeroed. */
+    struct file *file;          /* Backing file, or null. */
+    off_t offset;               /* Offset of page data in FILE. */
+    size_t read_bytes;          /* Bytes to read from FILE. */
+    size_t swap_slot;           /* Swap slot holding the page's
+                                   contents, or SWAP_NONE. */
+    bool private;               /* True: dirty copies go to swap.
+                                   False: written back to FILE. */
+    bool evicted;               /* Evicted since it last faulted in?
+                                   Counts re-faults (vm/frame.c). */
+
+    struct tree_elem elem;      /* Element in the page table. */
+    struct list_elem frame_elem; /* Element in a frame's page list,
+                                    valid while the page is in
+                                    memory (vm/frame.c). */
+  };
+
+bool page_table_create (void);
+void page_table_destroy (void);
+
+struct page *page_allocate (void *uaddr, bool writable);
+struct page *page_allocate_file (void *uaddr, struct file *, off_t offset,
+                                 size_t read_bytes, bool writable);
+struct page *page_lookup (const void *uaddr);
+void page_deallocate (struct page *);
+bool page_in (void *fault_addr, bool write);
+bool page_unshare (void *fault_addr);
+bool page_pin (const void *uaddr);
+void page_unpin (const void *uaddr);
+
+#endif /* vm/page.h */
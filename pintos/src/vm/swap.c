@@ -0,0 +1,437 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <lz.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Swap manager.
+
+   Divides the device serving the BLOCK_SWAP role into page-size
+   slots tracked by a bitmap.  The frame table's eviction path
+   calls swap_out() for pages that cannot simply be dropped, and
+   the fault handler calls swap_in() to restore them.
+
+   In front of the device sits a compressed in-memory tier: an
+   outgoing page that compresses to at most half its size is
+   stored as an lz_compress() blob in the kernel pool instead of
+   going to disk, up to a fixed byte budget, and a fault on such
+   a page is served by decompressing in place of a device read --
+   microseconds instead of the milliseconds an IDE PIO transfer
+   costs.  Pages that compress poorly, or arrive once the budget
+   is spent, take the disk path below.
+
+   Disk slots are handed out next-fit, so the burst of evictions
+   that follows memory pressure gets contiguous slots, and
+   outgoing pages are staged in a cluster buffer that goes to the
+   device as a single multi-sector write once it fills or the run
+   of contiguous slots breaks.  Pages evicted together thus stay
+   neighbors on the device and cost one command, not one
+   per page; a swap-in that arrives while its page is still
+   staged is served straight from the buffer. */
+
+/* Sectors in a page-size swap slot. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Pages staged per clustered write.  Eight pages turn eight
+   separate 4 kB writes into one 32 kB sequential command. */
+#define SWAP_CLUSTER 8
+
+static struct block *swap_device;       /* The BLOCK_SWAP device. */
+static struct bitmap *swap_map;         /* In-use swap slots. */
+static struct lock swap_lock;           /* Protects swap_map and the
+                                           staging cluster. */
+static bool swap_inited;
+
+/* The staging cluster: CLUSTER_CNT outgoing pages bound for the
+   contiguous slots starting at CLUSTER_BASE, not yet written to
+   the device. */
+static uint8_t cluster_buf[SWAP_CLUSTER][PGSIZE];
+static size_t cluster_base;
+static size_t cluster_cnt;
+
+/* Slot just past the last one allocated: the next-fit hint that
+   keeps a burst of evictions in adjacent slots. */
+static size_t slot_hint;
+
+/* The compressed tier.  Its slot numbers start at ZSWAP_BASE,
+   well above any disk slot and below SWAP_NONE, so the slot a
+   page carries says which tier holds it.  A page is accepted
+   only if it compresses to ZSWAP_LIMIT bytes or fewer, which
+   keeps hopeless pages off the pool and each blob within a
+   sub-page malloc block, and only while the blobs' total stays
+   under ZSWAP_BUDGET. */
+#define ZSWAP_MAX 512                     /* Compressed pages at once. */
+#define ZSWAP_BASE (SWAP_NONE - ZSWAP_MAX) /* First compressed slot. */
+#define ZSWAP_LIMIT (PGSIZE / 2)          /* Largest acceptable blob. */
+#define ZSWAP_BUDGET (256 * 1024)         /* Byte budget for all blobs. */
+
+/* A compressed page.  An entry whose blob has been written back
+   to disk under memory pressure keeps its slot number and
+   forwards to the disk slot instead; an entry with neither is
+   free. */
+static struct zswap_entry
+  {
+    uint8_t *data;              /* Compressed contents, or null. */
+    size_t size;                /* Compressed size in bytes. */
+    size_t fwd_slot;            /* Disk slot + 1 after writeback, or 0. */
+  }
+zswap[ZSWAP_MAX];
+static size_t zswap_bytes;      /* Total bytes across live blobs. */
+static uint8_t zswap_buf[ZSWAP_LIMIT]; /* Compression scratch space. */
+
+/* Compressed-tier counters, for swap_print_stats(). */
+static long long zswap_stored;      /* Pages the tier accepted. */
+static long long zswap_stored_bytes; /* Their total compressed size. */
+static long long zswap_rejected;    /* Pages sent to disk instead. */
+static long long zswap_hits;        /* Faults served by decompression. */
+
+/* Returns true if SLOT names a compressed-tier entry rather than
+   a disk slot. */
+static bool
+zswap_slot (size_t slot)
+{
+  return slot >= ZSWAP_BASE && slot < SWAP_NONE;
+}
+
+static void zswap_shrink (void);
+
+/* Sets up the swap map the first time swap is needed.  Returns
+   true if a swap device exists. */
+static bool
+swap_init (void)
+{
+  if (!swap_inited)
+    {
+      swap_device = block_get_role (BLOCK_SWAP);
+      if (swap_device != NULL)
+        swap_map = bitmap_create (block_size (swap_device)
+                                  / SECTORS_PER_PAGE);
+      lock_init (&swap_lock);
+      /* With a device to write back to, the compressed tier can
+         give its memory up under pressure. */
+      if (swap_map != NULL)
+        palloc_register_shrinker (zswap_shrink);
+      swap_inited = true;
+    }
+  return swap_map != NULL;
+}
+
+/* Tries to place the page at KADDR in the compressed tier,
+   storing its slot number in *SLOT.  Returns false if the page
+   compresses poorly, the budget is spent, or memory is short, in
+   which case the page belongs on the device.  swap_lock must be
+   held. */
+static bool
+zswap_store (const void *kaddr, size_t *slot)
+{
+  size_t size, i;
+  uint8_t *data;
+
+  /* Under memory pressure the tier would consume exactly what
+     eviction is trying to free; send the page to disk instead. */
+  if (palloc_under_pressure ())
+    {
+      zswap_rejected++;
+      return false;
+    }
+
+  size = lz_compress (kaddr, PGSIZE, zswap_buf, sizeof zswap_buf);
+  if (size == 0 || zswap_bytes + size > ZSWAP_BUDGET)
+    {
+      zswap_rejected++;
+      return false;
+    }
+
+  for (i = 0; i < ZSWAP_MAX; i++)
+    if (zswap[i].data == NULL && zswap[i].fwd_slot == 0)
+      break;
+  if (i == ZSWAP_MAX || (data = malloc (size)) == NULL)
+    {
+      zswap_rejected++;
+      return false;
+    }
+
+  memcpy (data, zswap_buf, size);
+  zswap[i].data = data;
+  zswap[i].size = size;
+  zswap_bytes += size;
+  zswap_stored++;
+  zswap_stored_bytes += size;
+  *slot = ZSWAP_BASE + i;
+  return true;
+}
+
+/* Decompresses the compressed-tier entry SLOT into KADDR.
+   swap_lock must be held. */
+static void
+zswap_load (size_t slot, void *kaddr)
+{
+  struct zswap_entry *e = &zswap[slot - ZSWAP_BASE];
+  size_t size;
+
+  ASSERT (e->data != NULL);
+  size = lz_decompress (e->data, e->size, kaddr, PGSIZE);
+  ASSERT (size == PGSIZE);
+  zswap_hits++;
+}
+
+/* Frees the compressed-tier entry SLOT: its blob's bytes go back
+   to the budget, or, if the blob was written back, its disk slot
+   is released.  swap_lock must be held. */
+static void
+zswap_release (size_t slot)
+{
+  struct zswap_entry *e = &zswap[slot - ZSWAP_BASE];
+
+  if (e->data != NULL)
+    {
+      zswap_bytes -= e->size;
+      free (e->data);
+      e->data = NULL;
+    }
+  else
+    {
+      ASSERT (e->fwd_slot != 0);
+      bitmap_reset (swap_map, e->fwd_slot - 1);
+      e->fwd_slot = 0;
+    }
+}
+
+/* Writes the staged cluster to the device as one multi-sector
+   request and empties it.  swap_lock must be held. */
+static void
+cluster_flush (void)
+{
+  if (cluster_cnt == 0)
+    return;
+  block_write_multiple (swap_device, cluster_base * SECTORS_PER_PAGE,
+                        cluster_cnt * SECTORS_PER_PAGE, cluster_buf);
+  cluster_cnt = 0;
+}
+
+/* Allocates a free disk slot, stages the page at KADDR for it,
+   and stores the slot number in *SLOT.  Returns false if the
+   device is full.  swap_lock must be held. */
+static bool
+disk_stage (const void *kaddr, size_t *slot)
+{
+  size_t s;
+
+  /* Next-fit: extend the run of recently allocated slots,
+     falling back to a scan from the start when the tail of the
+     device is taken. */
+  s = bitmap_scan_and_flip (swap_map, slot_hint, 1, false);
+  if (s == BITMAP_ERROR && slot_hint > 0)
+    s = bitmap_scan_and_flip (swap_map, 0, 1, false);
+  if (s == BITMAP_ERROR)
+    return false;
+  slot_hint = s + 1 < bitmap_size (swap_map) ? s + 1 : 0;
+
+  /* Stage the page.  A slot that does not extend the pending
+     cluster flushes it first. */
+  if (cluster_cnt > 0 && s != cluster_base + cluster_cnt)
+    cluster_flush ();
+  if (cluster_cnt == 0)
+    cluster_base = s;
+  memcpy (cluster_buf[cluster_cnt++], kaddr, PGSIZE);
+  if (cluster_cnt == SWAP_CLUSTER)
+    cluster_flush ();
+
+  *slot = s;
+  return true;
+}
+
+/* Writes the page at KADDR to a free swap slot and stores the
+   slot number in *SLOT.  The write is staged and may reach the
+   device only with a later swap_out(); the contents are readable
+   from swap either way.  Returns true if successful, false if
+   there is no swap device or it is full. */
+bool
+swap_out (const void *kaddr, size_t *slot)
+{
+  bool have_device = swap_init ();
+  bool ok;
+
+  lock_acquire (&swap_lock);
+
+  /* The compressed tier first; the device is the fallback, and
+     without one the tier is all the swap space there is. */
+  if (zswap_store (kaddr, slot))
+    {
+      lock_release (&swap_lock);
+      return true;
+    }
+  ok = have_device && disk_stage (kaddr, slot);
+  lock_release (&swap_lock);
+  return ok;
+}
+
+/* Pressure callback, registered with palloc: writes compressed
+   pages out to the swap device until half the byte budget is
+   free again, returning their blobs to the kernel pool.  The
+   slot number the owning page carries does not change; the entry
+   stays allocated and forwards to the disk slot the contents
+   moved to. */
+static void
+zswap_shrink (void)
+{
+  uint8_t *buf;
+  size_t i;
+
+  /* The decompression scratch page is a reclaim-path
+     allocation: it exists to free more memory than it costs. */
+  buf = palloc_get_page (PAL_RESERVE);
+  if (buf == NULL)
+    return;
+
+  lock_acquire (&swap_lock);
+  for (i = 0; i < ZSWAP_MAX && zswap_bytes > ZSWAP_BUDGET / 2; i++)
+    {
+      struct zswap_entry *e = &zswap[i];
+      size_t size, s;
+
+      if (e->data == NULL)
+        continue;
+      size = lz_decompress (e->data, e->size, buf, PGSIZE);
+      ASSERT (size == PGSIZE);
+      if (!disk_stage (buf, &s))
+        break;                  /* Device full; keep the rest. */
+      zswap_bytes -= e->size;
+      free (e->data);
+      e->data = NULL;
+      e->fwd_slot = s + 1;
+    }
+  lock_release (&swap_lock);
+
+  palloc_free_page (buf);
+}
+
+/* Copies the contents of swap slot SLOT into KADDR, from the
+   staging cluster if the slot is still pending there, otherwise
+   from the device.  A slot owned by a faulting page cannot be
+   restaged concurrently, so the check and the device read need
+   not be atomic. */
+static void
+slot_read (size_t slot, void *kaddr)
+{
+  bool staged = false;
+
+  lock_acquire (&swap_lock);
+  if (cluster_cnt > 0 && slot >= cluster_base
+      && slot < cluster_base + cluster_cnt)
+    {
+      memcpy (kaddr, cluster_buf[slot - cluster_base], PGSIZE);
+      staged = true;
+    }
+  lock_release (&swap_lock);
+
+  if (!staged)
+    block_read_multiple (swap_device, slot * SECTORS_PER_PAGE,
+                         SECTORS_PER_PAGE, kaddr);
+}
+
+/* Reads the page in swap slot SLOT into KADDR and releases the
+   slot. */
+void
+swap_in (size_t slot, void *kaddr)
+{
+  if (zswap_slot (slot))
+    {
+      struct zswap_entry *e = &zswap[slot - ZSWAP_BASE];
+      size_t disk;
+
+      lock_acquire (&swap_lock);
+      if (e->data != NULL)
+        {
+          zswap_load (slot, kaddr);
+          zswap_release (slot);
+          lock_release (&swap_lock);
+          return;
+        }
+
+      /* The shrinker wrote the entry back to disk; follow the
+         forwarding slot.  slot_read() takes swap_lock itself. */
+      ASSERT (e->fwd_slot != 0);
+      disk = e->fwd_slot - 1;
+      e->fwd_slot = 0;
+      lock_release (&swap_lock);
+
+      slot_read (disk, kaddr);
+      swap_free (disk);
+      return;
+    }
+
+  ASSERT (swap_map != NULL);
+  ASSERT (bitmap_test (swap_map, slot));
+
+  slot_read (slot, kaddr);
+  swap_free (slot);
+}
+
+/* Reads the page in swap slot SLOT into KADDR, leaving the slot
+   allocated.  Used by fork to copy a swapped parent page for the
+   child while the parent keeps the original. */
+void
+swap_read (size_t slot, void *kaddr)
+{
+  if (zswap_slot (slot))
+    {
+      struct zswap_entry *e = &zswap[slot - ZSWAP_BASE];
+
+      lock_acquire (&swap_lock);
+      if (e->data != NULL)
+        {
+          zswap_load (slot, kaddr);
+          lock_release (&swap_lock);
+          return;
+        }
+
+      /* Written back by the shrinker; read the forwarded disk
+         slot, leaving the entry in place for the owner. */
+      ASSERT (e->fwd_slot != 0);
+      slot = e->fwd_slot - 1;
+      lock_release (&swap_lock);
+    }
+
+  ASSERT (swap_map != NULL);
+  ASSERT (bitmap_test (swap_map, slot));
+
+  slot_read (slot, kaddr);
+}
+
+/* Releases swap slot SLOT without reading it, e.g. because its
+   page's process exited. */
+void
+swap_free (size_t slot)
+{
+  lock_acquire (&swap_lock);
+  if (zswap_slot (slot))
+    zswap_release (slot);
+  else
+    {
+      ASSERT (swap_map != NULL);
+      bitmap_reset (swap_map, slot);
+    }
+  lock_release (&swap_lock);
+}
+
+/* Prints compressed-tier statistics: how many evicted pages the
+   tier took and at what average compression, how many fell
+   through to the device, and how many faults it served. */
+void
+swap_print_stats (void)
+{
+  int pct = zswap_stored > 0
+            ? (int) (zswap_stored_bytes * 100 / (zswap_stored * PGSIZE))
+            : 0;
+
+  printf ("Swap: %lld pages compressed to %d%% of size, "
+          "%lld to disk, %lld compressed hits\n",
+          zswap_stored, pct, zswap_rejected, zswap_hits);
+}
@@ -0,0 +1,16 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Marks a page with no swap slot. */
+#define SWAP_NONE ((size_t) -1)
+
+bool swap_out (const void *kaddr, size_t *slot);
+void swap_in (size_t slot, void *kaddr);
+void swap_read (size_t slot, void *kaddr);
+void swap_free (size_t slot);
+void swap_print_stats (void);
+
+#endif /* vm/swap.h */